@@ -0,0 +1,81 @@
+#include "DnsCache.h"
+
+#include <QDateTime>
+#include <QHostInfo>
+
+// 后台刷新的最长等待时间（毫秒），发起刷新的对象提前销毁时超时后允许重新刷新
+static const qint64 kRefreshTimeoutMs = 30000;
+
+DnsCache *DnsCache::instance() {
+  static DnsCache cache;
+  return &cache;
+}
+
+void DnsCache::setTtl(int secs) {
+  QMutexLocker locker(&mutex_);
+  ttl_secs_ = qMax(0, secs);
+}
+
+void DnsCache::resolve(const QString &host, QObject *context, const Callback &callback) {
+  QHostAddress literal;
+  if (literal.setAddress(host)) {
+    callback(QList<QHostAddress>() << literal);
+    return;
+  }
+
+  QMutexLocker locker(&mutex_);
+  QHash<QString, Entry>::iterator it = entries_.find(host);
+  if (it == entries_.end()) {
+    locker.unlock();
+    lookup(host, context, callback);
+    return;
+  }
+
+  // 过期的条目先返回旧地址，同时在后台刷新
+  const QList<QHostAddress> addresses = it->addresses;
+  const qint64 now = QDateTime::currentMSecsSinceEpoch();
+  bool refresh = it->expires_ms <= now && (it->refresh_ms == 0 || now - it->refresh_ms > kRefreshTimeoutMs);
+  if (refresh) {
+    it->refresh_ms = now;
+  }
+  locker.unlock();
+
+  callback(addresses);
+  if (refresh) {
+    lookup(host, context, Callback());
+  }
+}
+
+QList<QHostAddress> DnsCache::cached(const QString &host) const {
+  QMutexLocker locker(&mutex_);
+  return entries_.value(host).addresses;
+}
+
+void DnsCache::invalidate(const QString &host) {
+  QMutexLocker locker(&mutex_);
+  entries_.remove(host);
+}
+
+void DnsCache::lookup(const QString &host, QObject *context, const Callback &callback) {
+  QHostInfo::lookupHost(host, context, [this, host, callback](const QHostInfo &info) {
+    const QList<QHostAddress> addresses = info.error() == QHostInfo::NoError ? info.addresses() : QList<QHostAddress>();
+    {
+      QMutexLocker locker(&mutex_);
+      if (addresses.isEmpty()) {
+        // 刷新失败时保留旧地址，下次访问再试
+        QHash<QString, Entry>::iterator it = entries_.find(host);
+        if (it != entries_.end()) {
+          it->refresh_ms = 0;
+        }
+      } else {
+        Entry &entry = entries_[host];
+        entry.addresses = addresses;
+        entry.expires_ms = QDateTime::currentMSecsSinceEpoch() + qint64(ttl_secs_) * 1000;
+        entry.refresh_ms = 0;
+      }
+    }
+    if (callback) {
+      callback(addresses);
+    }
+  });
+}
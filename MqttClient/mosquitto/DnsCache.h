@@ -0,0 +1,69 @@
+#ifndef DNSCACHE_H
+#define DNSCACHE_H
+
+#include <QHash>
+#include <QHostAddress>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <functional>
+
+/*!
+ * \brief 进程内共享的主机名解析缓存
+ * 解析通过QHostInfo异步进行，不阻塞调用线程。结果缓存一段时间，过期后仍先返回旧地址，
+ * 同时在后台刷新，因此只有首次解析需要等待DNS。解析失败不缓存。线程安全。
+ */
+class DnsCache {
+ public:
+  /*!
+   * \brief 解析结果回调，失败时地址列表为空
+   */
+  typedef std::function<void(const QList<QHostAddress> &)> Callback;
+
+  /*!
+   * \brief 获取全局实例
+   */
+  static DnsCache *instance();
+
+  /*!
+   * \brief 设置缓存有效期（秒）
+   */
+  void setTtl(int secs);
+
+  /*!
+   * \brief 解析主机名
+   * IP字面量或已有缓存时在调用线程中立即回调；否则异步解析，完成后在context所在线程回调，
+   * context在解析完成前被销毁时不回调。
+   * \param host 主机名或IP字面量
+   * \param context 回调所在的对象
+   * \param callback 结果回调
+   */
+  void resolve(const QString &host, QObject *context, const Callback &callback);
+
+  /*!
+   * \brief 只查询缓存，不发起解析
+   */
+  QList<QHostAddress> cached(const QString &host) const;
+
+  /*!
+   * \brief 删除主机名的缓存
+   */
+  void invalidate(const QString &host);
+
+ private:
+  DnsCache() = default;
+
+  struct Entry {
+    QList<QHostAddress> addresses;  // 解析到的地址
+    qint64 expires_ms = 0;          // 过期时刻（自纪元起的毫秒数）
+    qint64 refresh_ms = 0;          // 后台刷新开始的时刻，0表示未在刷新
+  };
+
+  void lookup(const QString &host, QObject *context, const Callback &callback);
+
+  mutable QMutex mutex_;           // 保护以下成员
+  QHash<QString, Entry> entries_;  // 主机名到解析结果
+  int ttl_secs_ = 300;             // 缓存有效期
+};
+
+#endif  // DNSCACHE_H
@@ -0,0 +1,369 @@
+#include "MqttCapture.h"
+
+#include <QDateTime>
+#include <algorithm>
+#include <cstring>
+
+#include "MqttFileSpace.h"
+#include "MqttLog.h"
+#include "MqttMetrics.h"
+
+namespace {
+
+const quint32 kFileMagic = 0x5043514d;     // "MQCP"
+const quint32 kTrailerMagic = 0x4943514d;  // "MQCI"
+const quint32 kFileVersion = 1;
+
+// 记录类型
+const quint8 kMessageRecord = 0;  // 消息，内容为消息负载
+const quint8 kTopicRecord = 1;    // 主题定义，内容为UTF-8主题
+
+// 文件头
+struct FileHeader {
+  quint32 magic;
+  quint32 version;
+  qint64 start_ms;  // 录制开始时刻
+};
+
+// 记录头，其后为记录内容
+struct RecordHeader {
+  quint32 size;  // 记录总字节数（含头部并按8字节对齐），0表示记录区结束
+  quint32 len;   // 内容长度
+  qint64 offset_ns;
+  quint32 topic_id;
+  quint8 kind;
+  quint8 qos;
+  quint8 retain;
+  quint8 reserved;
+};
+
+// 文件末尾的索引描述，位于主题表和索引项之后
+struct Trailer {
+  quint32 magic;
+  quint32 topic_count;
+  qint64 index_count;
+  qint64 records_end;  // 记录区的结束位置，其后是8字节的结束标记、主题表和索引项
+  qint64 record_count;
+  qint64 duration_ns;
+};
+
+const qint64 kFileHeaderSize = sizeof(FileHeader);
+const qint64 kRecordHeaderSize = sizeof(RecordHeader);
+const qint64 kTrailerSize = sizeof(Trailer);
+
+inline qint64 alignRecord(qint64 size) { return (size + 7) & ~qint64(7); }
+
+// 读取pos处的记录头，记录不完整时返回false
+bool readRecordHeader(const uchar *map, qint64 pos, qint64 end, RecordHeader *header) {
+  if (pos + kRecordHeaderSize > end) {
+    return false;
+  }
+  memcpy(header, map + pos, sizeof(*header));
+  return header->size >= kRecordHeaderSize && pos + header->size <= end &&
+         kRecordHeaderSize + header->len <= header->size;
+}
+
+}  // namespace
+
+const int MqttCaptureWriter::kIndexInterval;
+const qint64 MqttCaptureWriter::kDefaultMaxBytes;
+
+MqttCaptureWriter::MqttCaptureWriter() = default;
+
+MqttCaptureWriter::~MqttCaptureWriter() { close(); }
+
+bool MqttCaptureWriter::open(const QString &path, qint64 max_bytes) {
+  close();
+
+  capacity_ = qMax(max_bytes, kFileHeaderSize + kRecordHeaderSize);
+  file_.setFileName(path);
+  if (!file_.open(QIODevice::ReadWrite | QIODevice::Truncate)) {
+    mqttWarning() << "无法创建录制文件:" << path << file_.errorString();
+    return false;
+  }
+  if (!mqttReserveFileSpace(&file_, capacity_)) {
+    file_.close();
+    file_.remove();
+    return false;
+  }
+  map_ = file_.map(0, capacity_);
+  if (!map_) {
+    mqttWarning() << "无法映射录制文件:" << file_.errorString();
+    file_.close();
+    file_.remove();
+    return false;
+  }
+
+  FileHeader header;
+  header.magic = kFileMagic;
+  header.version = kFileVersion;
+  header.start_ms = QDateTime::currentMSecsSinceEpoch();
+  memcpy(map_, &header, sizeof(header));
+  offset_ = kFileHeaderSize;
+  start_ns_ = mqttMonotonicNs();
+  last_offset_ns_ = 0;
+  topic_ids_.clear();
+  topics_.clear();
+  index_.clear();
+  records_.store(0, std::memory_order_relaxed);
+  dropped_.store(0, std::memory_order_relaxed);
+  bytes_.store(offset_, std::memory_order_relaxed);
+  return true;
+}
+
+void MqttCaptureWriter::close() {
+  if (!map_) {
+    return;
+  }
+  file_.unmap(map_);
+  map_ = nullptr;
+
+  // 主题表：4字节长度加主题内容，整体按8字节对齐；之后是索引项和文件尾
+  QByteArray footer(8, '\0');
+  for (const QByteArray &topic : topics_) {
+    quint32 len = static_cast<quint32>(topic.size());
+    footer.append(reinterpret_cast<const char *>(&len), sizeof(len));
+    footer.append(topic);
+  }
+  footer.append(static_cast<int>(alignRecord(footer.size()) - footer.size()), '\0');
+  for (const QPair<qint64, qint64> &entry : index_) {
+    footer.append(reinterpret_cast<const char *>(&entry.first), sizeof(entry.first));
+    footer.append(reinterpret_cast<const char *>(&entry.second), sizeof(entry.second));
+  }
+  Trailer trailer;
+  trailer.magic = kTrailerMagic;
+  trailer.topic_count = static_cast<quint32>(topics_.size());
+  trailer.index_count = index_.size();
+  trailer.records_end = offset_;
+  trailer.record_count = records_.load(std::memory_order_relaxed);
+  trailer.duration_ns = last_offset_ns_;
+  footer.append(reinterpret_cast<const char *>(&trailer), sizeof(trailer));
+
+  if (!file_.resize(offset_) || !file_.seek(offset_) || file_.write(footer) != footer.size()) {
+    mqttWarning() << "无法写入录制文件索引:" << file_.errorString();
+  }
+  file_.close();
+}
+
+bool MqttCaptureWriter::append(const char *topic, const void *payload, int payload_len, int qos, bool retain) {
+  if (!map_) {
+    return false;
+  }
+  const qint64 offset_ns = mqttMonotonicNs() - start_ns_;
+
+  // 查找时不拷贝主题，只有首次出现的主题才分配内存
+  const QByteArray key = QByteArray::fromRawData(topic, static_cast<int>(strlen(topic)));
+  QHash<QByteArray, quint32>::const_iterator it = topic_ids_.constFind(key);
+  quint32 topic_id;
+  if (it != topic_ids_.constEnd()) {
+    topic_id = it.value();
+  } else {
+    topic_id = static_cast<quint32>(topics_.size());
+    if (!writeRecord(kTopicRecord, topic_id, offset_ns, key.constData(), key.size(), 0, false)) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    const QByteArray owned(key.constData(), key.size());
+    topics_.append(owned);
+    topic_ids_.insert(owned, topic_id);
+  }
+
+  const qint64 record_offset = offset_;
+  if (!writeRecord(kMessageRecord, topic_id, offset_ns, payload, payload_len, qos, retain)) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  const qint64 records = records_.load(std::memory_order_relaxed);
+  if (records % kIndexInterval == 0) {
+    index_.append(qMakePair(offset_ns, record_offset));
+  }
+  records_.store(records + 1, std::memory_order_relaxed);
+  last_offset_ns_ = offset_ns;
+  return true;
+}
+
+bool MqttCaptureWriter::writeRecord(quint8 kind, quint32 topic_id, qint64 offset_ns, const void *data, int len,
+                                    int qos, bool retain) {
+  const qint64 size = alignRecord(kRecordHeaderSize + len);
+  if (offset_ + size > capacity_) {
+    return false;
+  }
+
+  RecordHeader header;
+  header.size = 0;
+  header.len = static_cast<quint32>(len);
+  header.offset_ns = offset_ns;
+  header.topic_id = topic_id;
+  header.kind = kind;
+  header.qos = static_cast<quint8>(qos);
+  header.retain = retain ? 1 : 0;
+  header.reserved = 0;
+
+  // 最后写入记录长度，中途崩溃时读取方只会看到长度为0的结尾
+  uchar *dst = map_ + offset_;
+  memcpy(dst + sizeof(header.size), reinterpret_cast<const char *>(&header) + sizeof(header.size),
+         kRecordHeaderSize - sizeof(header.size));
+  memcpy(dst + kRecordHeaderSize, data, len);
+  header.size = static_cast<quint32>(size);
+  memcpy(dst, &header.size, sizeof(header.size));
+
+  offset_ += size;
+  bytes_.store(offset_, std::memory_order_relaxed);
+  return true;
+}
+
+MqttCaptureReader::MqttCaptureReader() = default;
+
+MqttCaptureReader::~MqttCaptureReader() { close(); }
+
+bool MqttCaptureReader::open(const QString &path) {
+  close();
+
+  file_.setFileName(path);
+  if (!file_.open(QIODevice::ReadOnly) || file_.size() < kFileHeaderSize) {
+    mqttWarning() << "无法打开录制文件:" << path << file_.errorString();
+    file_.close();
+    return false;
+  }
+  map_ = file_.map(0, file_.size());
+  FileHeader header;
+  if (map_) {
+    memcpy(&header, map_, sizeof(header));
+  }
+  if (!map_ || header.magic != kFileMagic || header.version != kFileVersion) {
+    mqttWarning() << "不是有效的录制文件:" << path;
+    close();
+    return false;
+  }
+  start_ms_ = header.start_ms;
+
+  if (!loadFooter()) {
+    scan();
+  }
+  rewind();
+  return true;
+}
+
+void MqttCaptureReader::close() {
+  if (map_) {
+    file_.unmap(map_);
+    map_ = nullptr;
+  }
+  file_.close();
+  end_ = 0;
+  cursor_ = 0;
+  start_ms_ = 0;
+  record_count_ = 0;
+  duration_ns_ = 0;
+  has_index_ = false;
+  topics_.clear();
+  index_.clear();
+}
+
+bool MqttCaptureReader::loadFooter() {
+  const qint64 file_size = file_.size();
+  if (file_size < kFileHeaderSize + 8 + kTrailerSize) {
+    return false;
+  }
+  Trailer trailer;
+  memcpy(&trailer, map_ + file_size - kTrailerSize, sizeof(trailer));
+  const qint64 footer_end = file_size - kTrailerSize;
+  if (trailer.magic != kTrailerMagic || trailer.records_end < kFileHeaderSize ||
+      trailer.records_end + 8 > footer_end || trailer.index_count < 0) {
+    return false;
+  }
+
+  QVector<QByteArray> topics;
+  topics.reserve(static_cast<int>(trailer.topic_count));
+  qint64 pos = trailer.records_end + 8;
+  for (quint32 i = 0; i < trailer.topic_count; ++i) {
+    quint32 len;
+    if (pos + qint64(sizeof(len)) > footer_end) {
+      return false;
+    }
+    memcpy(&len, map_ + pos, sizeof(len));
+    pos += sizeof(len);
+    if (pos + len > footer_end) {
+      return false;
+    }
+    topics.append(QByteArray(reinterpret_cast<const char *>(map_ + pos), static_cast<int>(len)));
+    pos += len;
+  }
+  pos = alignRecord(pos);
+  if (pos + trailer.index_count * 2 * qint64(sizeof(qint64)) != footer_end) {
+    return false;
+  }
+
+  index_.resize(static_cast<int>(trailer.index_count));
+  for (int i = 0; i < index_.size(); ++i) {
+    memcpy(&index_[i].first, map_ + pos, sizeof(qint64));
+    memcpy(&index_[i].second, map_ + pos + sizeof(qint64), sizeof(qint64));
+    pos += 2 * sizeof(qint64);
+  }
+  topics_ = topics;
+  end_ = trailer.records_end;
+  record_count_ = trailer.record_count;
+  duration_ns_ = trailer.duration_ns;
+  has_index_ = true;
+  return true;
+}
+
+void MqttCaptureReader::scan() {
+  const qint64 file_size = file_.size();
+  qint64 pos = kFileHeaderSize;
+  RecordHeader header;
+  while (readRecordHeader(map_, pos, file_size, &header)) {
+    if (header.kind == kTopicRecord) {
+      if (header.topic_id != static_cast<quint32>(topics_.size())) {
+        break;
+      }
+      topics_.append(QByteArray(reinterpret_cast<const char *>(map_ + pos + kRecordHeaderSize),
+                                static_cast<int>(header.len)));
+    } else {
+      if (record_count_ % MqttCaptureWriter::kIndexInterval == 0) {
+        index_.append(qMakePair(header.offset_ns, pos));
+      }
+      ++record_count_;
+      duration_ns_ = header.offset_ns;
+    }
+    pos += header.size;
+  }
+  end_ = pos;
+}
+
+bool MqttCaptureReader::next(Record *record) {
+  RecordHeader header;
+  while (map_ && readRecordHeader(map_, cursor_, end_, &header)) {
+    const qint64 pos = cursor_;
+    cursor_ += header.size;
+    if (header.kind != kMessageRecord || header.topic_id >= static_cast<quint32>(topics_.size())) {
+      continue;
+    }
+    record->offset_ns = header.offset_ns;
+    record->topic = topics_.at(static_cast<int>(header.topic_id));
+    record->payload =
+        QByteArray(reinterpret_cast<const char *>(map_ + pos + kRecordHeaderSize), static_cast<int>(header.len));
+    record->qos = header.qos;
+    record->retain = header.retain != 0;
+    return true;
+  }
+  return false;
+}
+
+void MqttCaptureReader::seek(qint64 offset_ns) {
+  // 从不晚于目标时刻的最后一个索引项开始顺序查找
+  QVector<QPair<qint64, qint64>>::const_iterator it =
+      std::upper_bound(index_.constBegin(), index_.constEnd(), offset_ns,
+                       [](qint64 value, const QPair<qint64, qint64> &entry) { return value < entry.first; });
+  cursor_ = it == index_.constBegin() ? kFileHeaderSize : (it - 1)->second;
+
+  RecordHeader header;
+  while (map_ && readRecordHeader(map_, cursor_, end_, &header)) {
+    if (header.kind == kMessageRecord && header.offset_ns >= offset_ns) {
+      return;
+    }
+    cursor_ += header.size;
+  }
+}
+
+void MqttCaptureReader::rewind() { cursor_ = kFileHeaderSize; }
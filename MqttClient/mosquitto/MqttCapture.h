@@ -0,0 +1,196 @@
+#ifndef MQTTCAPTURE_H
+#define MQTTCAPTURE_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QPair>
+#include <QString>
+#include <QVector>
+#include <atomic>
+
+/*!
+ * \brief 流量录制文件写入器
+ * 把收到的消息依次追加到内存映射的录制文件中，每条记录包含相对录制开始的时刻、主题编号、
+ * QoS、保留标志和消息内容；主题在首次出现时写入一条定义记录，之后只引用编号。
+ * 打开时按上限在磁盘上实际分配整个文件（默认1GB）并一次性映射，追加一条消息只在映射区内
+ * 拷贝一次，不加锁也不产生系统调用，文件写满后的消息计为丢弃。
+ * 每kIndexInterval条消息记录一个索引项，close()时把主题表和索引写到文件末尾并截去未用部分；
+ * 进程崩溃时文件没有索引，读取时顺序扫描恢复。文件格式使用本机字节序。
+ * append()及open()/close()只能由同一线程调用，统计方法可在任意线程调用。
+ */
+class MqttCaptureWriter {
+ public:
+  static const int kIndexInterval = 1024;                       // 相邻索引项之间的消息数
+  static const qint64 kDefaultMaxBytes = 1024LL * 1024 * 1024;  // 默认文件大小上限
+
+  MqttCaptureWriter();
+
+  /*!
+   * \brief 析构函数，关闭文件
+   */
+  ~MqttCaptureWriter();
+
+  MqttCaptureWriter(const MqttCaptureWriter &) = delete;
+  MqttCaptureWriter &operator=(const MqttCaptureWriter &) = delete;
+
+  /*!
+   * \brief 创建录制文件，已有的同名文件被覆盖
+   * 打开时即为整个文件分配磁盘空间，空间不足时失败，录制过程中不会因磁盘写满而崩溃。
+   * 文件系统不支持posix_fallocate时改为逐块写零，按上限大小可能阻塞数秒。
+   * \param path 文件路径
+   * \param max_bytes 文件大小上限
+   * \return 是否成功打开
+   */
+  bool open(const QString &path, qint64 max_bytes = kDefaultMaxBytes);
+
+  /*!
+   * \brief 写入主题表和索引，截去未用部分并关闭文件
+   */
+  void close();
+
+  /*!
+   * \brief 是否已打开
+   */
+  bool isOpen() const { return map_ != nullptr; }
+
+  /*!
+   * \brief 追加一条消息
+   * \param topic 以0结尾的UTF-8主题
+   * \param payload 消息内容
+   * \param payload_len 消息长度
+   * \param qos 消息质量等级
+   * \param retain 是否为保留消息
+   * \return 是否写入，未打开或文件已满时返回false
+   */
+  bool append(const char *topic, const void *payload, int payload_len, int qos, bool retain);
+
+  /*!
+   * \brief 已写入的消息数
+   */
+  qint64 recordCount() const { return records_.load(std::memory_order_relaxed); }
+
+  /*!
+   * \brief 因文件已满而丢弃的消息数
+   */
+  qint64 droppedCount() const { return dropped_.load(std::memory_order_relaxed); }
+
+  /*!
+   * \brief 已使用的文件字节数
+   */
+  qint64 bytesWritten() const { return bytes_.load(std::memory_order_relaxed); }
+
+ private:
+  bool writeRecord(quint8 kind, quint32 topic_id, qint64 offset_ns, const void *data, int len, int qos, bool retain);
+
+  QFile file_;                            // 录制文件
+  uchar *map_ = nullptr;                  // 整个文件的映射
+  qint64 capacity_ = 0;                   // 文件大小上限
+  qint64 offset_ = 0;                     // 下一条记录的写入位置
+  qint64 start_ns_ = 0;                   // 录制开始的单调时钟时刻
+  QHash<QByteArray, quint32> topic_ids_;  // 主题到编号
+  QVector<QByteArray> topics_;            // 按编号排列的主题
+  QVector<QPair<qint64, qint64>> index_;  // 索引项（相对时刻，文件偏移）
+  qint64 last_offset_ns_ = 0;             // 最后一条消息的相对时刻
+  std::atomic<qint64> records_{0};        // 已写入的消息数
+  std::atomic<qint64> dropped_{0};        // 丢弃的消息数
+  std::atomic<qint64> bytes_{0};          // 已使用的字节数
+};
+
+/*!
+ * \brief 流量录制文件读取器
+ * 有索引时直接加载主题表和索引，否则（录制进程崩溃）顺序扫描到第一条不完整的记录为止。
+ * 读取出的消息内容是独立的拷贝，关闭读取器后仍然有效。
+ */
+class MqttCaptureReader {
+ public:
+  /*!
+   * \brief 录制文件中的一条消息
+   */
+  struct Record {
+    qint64 offset_ns = 0;  // 相对录制开始的时刻（纳秒）
+    QByteArray topic;      // UTF-8编码的主题
+    QByteArray payload;    // 消息内容
+    int qos = 0;           // 消息质量等级
+    bool retain = false;   // 是否为保留消息
+  };
+
+  MqttCaptureReader();
+
+  /*!
+   * \brief 析构函数，关闭文件
+   */
+  ~MqttCaptureReader();
+
+  MqttCaptureReader(const MqttCaptureReader &) = delete;
+  MqttCaptureReader &operator=(const MqttCaptureReader &) = delete;
+
+  /*!
+   * \brief 打开录制文件
+   * \return 是否为有效的录制文件
+   */
+  bool open(const QString &path);
+
+  /*!
+   * \brief 关闭文件
+   */
+  void close();
+
+  /*!
+   * \brief 录制开始时刻（毫秒级Unix时间戳）
+   */
+  qint64 startTimeMs() const { return start_ms_; }
+
+  /*!
+   * \brief 消息总数
+   */
+  qint64 recordCount() const { return record_count_; }
+
+  /*!
+   * \brief 最后一条消息的相对时刻（纳秒）
+   */
+  qint64 durationNs() const { return duration_ns_; }
+
+  /*!
+   * \brief 按编号排列的全部主题
+   */
+  const QVector<QByteArray> &topics() const { return topics_; }
+
+  /*!
+   * \brief 文件是否带有索引（正常关闭）
+   */
+  bool hasIndex() const { return has_index_; }
+
+  /*!
+   * \brief 读取下一条消息
+   * \return 是否读到，已到结尾时返回false
+   */
+  bool next(Record *record);
+
+  /*!
+   * \brief 定位到相对时刻不早于offset_ns的第一条消息
+   */
+  void seek(qint64 offset_ns);
+
+  /*!
+   * \brief 回到第一条消息
+   */
+  void rewind();
+
+ private:
+  bool loadFooter();
+  void scan();
+
+  QFile file_;                            // 录制文件
+  uchar *map_ = nullptr;                  // 整个文件的映射
+  qint64 end_ = 0;                        // 记录区的结束位置
+  qint64 cursor_ = 0;                     // 下一条记录的位置
+  qint64 start_ms_ = 0;                   // 录制开始时刻
+  qint64 record_count_ = 0;               // 消息总数
+  qint64 duration_ns_ = 0;                // 最后一条消息的相对时刻
+  bool has_index_ = false;                // 是否带有索引
+  QVector<QByteArray> topics_;            // 按编号排列的主题
+  QVector<QPair<qint64, qint64>> index_;  // 索引项（相对时刻，文件偏移）
+};
+
+#endif  // MQTTCAPTURE_H
@@ -1,10 +1,21 @@
 #include "MqttClient.h"
 
 #include <mosquitto.h>
+#include <mqtt_protocol.h>
 
-#include <QDebug>
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+
+#include <QDateTime>
+#include <QMap>
 #include <QRandomGenerator>
+#include <QSaveFile>
 #include <QThread>
+#include <QVarLengthArray>
+#include <cerrno>
+#include <cstring>
+
+#include "MqttLog.h"
 
 // static struct MosquittoLibInitializer {
 //   MosquittoLibInitializer() { mosquitto_lib_init(); }
@@ -14,16 +25,85 @@
 int MqttClient::init_count_ = 0;
 QMutex MqttClient::init_mutex_;
 
+// 主题驻留表的最大条目数，超出后整体清空，防止主题无限增长时内存泄漏
+static const int kMaxInternedTopics = 4096;
+// 每次处理发布队列最多发送的消息数，超出部分在下一轮事件循环中继续发送
+static const int kMaxPublishDrainBatch = 1024;
+// 每次套接字可读时最多读取的报文数，避免持续涌入的消息长期占用事件循环
+static const int kMaxPacketsPerRead = 256;
+// mosquitto_loop_misc的调用间隔（毫秒），负责发送心跳及检测超时
+static const int kLoopMiscIntervalMs = 1000;
+// 订阅确认后等待代理推送保留消息的时间（毫秒），之后清除未被确认的快照条目
+static const int kRetainedReconcileDelayMs = 3000;
+// 发件箱重发定时器间隔（毫秒）
+static const int kOutboxReplayIntervalMs = 10;
+// 一轮竞速（DNS解析及TCP连接）的总超时（毫秒）
+static const int kConnectRaceTimeoutMs = 10000;
+// TCP连通后等待CONNACK的超时（毫秒）
+static const int kConnackTimeoutMs = 10000;
+// 主题句柄的QoS0发布达到该次数后才分配主题别名，偶尔发布的主题不占用别名
+static const quint32 kTopicAliasMinPublishes = 16;
+// 本机分发区检查读者进程是否退出的间隔（纳秒）
+static const qint64 kFanoutReapIntervalNs = 1000000000LL;
+// Qt 5.14起分割选项移到Qt命名空间，旧枚举在Qt 6中被移除
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+static const Qt::SplitBehavior kSkipEmptyParts = Qt::SkipEmptyParts;
+#else
+static const QString::SplitBehavior kSkipEmptyParts = QString::SkipEmptyParts;
+#endif
+
+// 检查连接参数并解析代理地址，不访问客户端状态，可在任意线程调用；返回错误原因，有效时返回空
+static QString parseConnectParams(const QStringList &texts, int default_port, int keepalive,
+                                  QList<MqttEndpoint> *endpoints) {
+  for (const QString &text : texts) {
+    MqttEndpoint endpoint;
+    if (!MqttEndpoint::parse(text, default_port, &endpoint)) {
+      return "Invalid broker address: " + text;
+    }
+    endpoints->append(endpoint);
+  }
+  if (endpoints->isEmpty() || keepalive <= 0) {
+    return "Invalid connection parameters";
+  }
+  return QString();
+}
+
+// 在独立线程中调用阻塞的mosquitto_connect_bind_v5，返回后由finished信号回到客户端线程处理结果
+class MqttClient::BlockingConnect : public QThread {
+ public:
+  BlockingConnect(mosquitto *mosq, const QByteArray &host, int port, int keepalive, const mosquitto_property *props)
+      : mosq_(mosq), host_(host), port_(port), keepalive_(keepalive), props_(props) {}
+
+  int result() const { return rc_; }
+
+ protected:
+  void run() override { rc_ = mosquitto_connect_bind_v5(mosq_, host_.constData(), port_, keepalive_, nullptr, props_); }
+
+ private:
+  mosquitto *mosq_;                  // 连接的实例
+  QByteArray host_;                  // 代理地址
+  int port_;                         // 代理端口
+  int keepalive_;                    // 保持连接时间间隔
+  const mosquitto_property *props_;  // CONNECT属性，为空时清除之前保存的属性
+  int rc_ = MOSQ_ERR_UNKNOWN;        // 连接结果
+};
+
 MqttClient::MqttClient(QObject *parent) : QObject(parent) {
   QMutexLocker locker(&init_mutex_);
   if (init_count_++ == 0) {
     mosquitto_lib_init();
-    qInfo() << "mosquitto libraay initialized!";
+    mqttInfo() << "mosquitto libraay initialized!";
   }
   locker.unlock();
 
+  qRegisterMetaType<MqttMessage>("MqttMessage");
+  qRegisterMetaType<MqttMessageBatch>("MqttMessageBatch");
+  qRegisterMetaType<MqttPublishToken>("MqttPublishToken");
+  qRegisterMetaType<MqttStats>("MqttStats");
+
   // 生成唯一ID (示例：使用Qt的随机数)
   client_id_ = QString("CLIENTID_%1_END").arg(QRandomGenerator::global()->generate());
+  payload_prefix_ = "[ClientID:" + client_id_.toUtf8() + "]";
   // 创建Mosquitto实例（设置clean session为true）
   mosq_ = mosquitto_new(client_id_.toUtf8().constData(), true, this);
   if (!mosq_) {
@@ -33,115 +113,980 @@ MqttClient::MqttClient(QObject *parent) : QObject(parent) {
   // 设置回调函数
   setupCallbacks();
 
-  // 配置自动重连定时器
+  // 配置自动重连定时器，间隔由scheduleReconnect()按退避时间设置
   reconnect_timer_ = new QTimer(this);
-  reconnect_timer_->setInterval(5000);    // 5秒重连间隔
   reconnect_timer_->setSingleShot(true);  // 设为单次触发
   connect(reconnect_timer_, &QTimer::timeout, this, &MqttClient::handleReconnect);
+
+  connect_timer_ = new QTimer(this);
+  connect_timer_->setInterval(kConnackTimeoutMs);
+  connect_timer_->setSingleShot(true);
+  connect(connect_timer_, &QTimer::timeout, this, &MqttClient::onConnectTimeout);
+
+  // 心跳维护定时器，与套接字通知器一起驱动网络循环
+  misc_timer_ = new QTimer(this);
+  misc_timer_->setInterval(kLoopMiscIntervalMs);
+  connect(misc_timer_, &QTimer::timeout, this, &MqttClient::onLoopMisc);
+
+  // 发件箱按固定节拍分批重发，避免重连后瞬间占满发送缓冲
+  replay_timer_ = new QTimer(this);
+  replay_timer_->setInterval(kOutboxReplayIntervalMs);
+  connect(replay_timer_, &QTimer::timeout, this, &MqttClient::replayOutbox);
+
+  stats_timer_ = new QTimer(this);
+  connect(stats_timer_, &QTimer::timeout, this, &MqttClient::publishStats);
 }
 
 MqttClient::~MqttClient() {
   disconnect();
+  // 订阅句柄可能属于其他线程，交由其所在线程释放
+  for (MqttSubscription *subscription : subscriptions_) {
+    subscription->deleteLater();
+  }
+  // 唤醒仍在等待确认的生产者
+  while (PublishRequest *request = publish_queue_.pop()) {
+    request->token.finish(MqttPublishToken::Failed, MOSQ_ERR_NO_CONN);
+    delete request;
+  }
+  failPendingPublishes(MOSQ_ERR_NO_CONN, false);
   cleanup();
+  // 等待工作线程退出，之后不再有线程引用本对象
+  delete worker_pool_;
+  delete outbox_;
+  if (retained_cache_) {
+    if (!retained_snapshot_path_.isEmpty()) {
+      retained_cache_->saveSnapshot(retained_snapshot_path_);
+    }
+    delete retained_cache_;
+  }
+  mosquitto_property_free_all(&publish_props_);
+  mosquitto_property_free_all(&connect_props_);
+  for (mosquitto_property *props : alias_props_) {
+    mosquitto_property_free_all(&props);
+  }
   QMutexLocker locker(&init_mutex_);
   init_count_--;
   if (init_count_ == 0) {
     mosquitto_lib_cleanup();
-    qInfo() << "mosquitto library cleaned up!";
+    mqttInfo() << "mosquitto library cleaned up!";
   }
 }
 
 bool MqttClient::connectToBroker(const QString &host, int port, int keepalive, int max_retry, const QString &username,
                                  const QString &password) {
+  // 先在调用方线程检查参数，转发时返回值同样反映参数是否有效；未指定端口的地址使用port参数
+  QList<MqttEndpoint> parsed;
+  const QString error = parseConnectParams(host.split(',', kSkipEmptyParts), port, keepalive, &parsed);
+  if (!error.isEmpty()) {
+    mqttWarning() << error;
+    emit connectionFailed(error);
+    return false;
+  }
+
+  // 套接字通知器必须创建在客户端所在线程
+  if (QThread::currentThread() != this->thread()) {
+    QMetaObject::invokeMethod(this, "connectToBroker", Qt::QueuedConnection, Q_ARG(QString, host), Q_ARG(int, port),
+                              Q_ARG(int, keepalive), Q_ARG(int, max_retry), Q_ARG(QString, username),
+                              Q_ARG(QString, password));
+    return true;
+  }
+
   // 优先使用参数中的凭据
   if (!username.isEmpty() || !password.isEmpty()) {
     setCredentials(username, password);
   }
 
-  // 参数有效性检查
-  if (host.isEmpty() || port <= 0 || keepalive <= 0) {
-    qWarning() << "Invalid connection parameters";
+  QStringList endpoints;
+  for (const MqttEndpoint &endpoint : parsed) {
+    endpoints.append(endpoint.toString());
+  }
+  return connectToBrokers(endpoints, keepalive, max_retry);
+}
+
+bool MqttClient::connectToBrokers(const QStringList &endpoints, int keepalive, int max_retry) {
+  // 参数有效性检查，在调用方线程进行
+  QList<MqttEndpoint> parsed;
+  const QString error = parseConnectParams(endpoints, 1883, keepalive, &parsed);
+  if (!error.isEmpty()) {
+    mqttWarning() << error;
+    emit connectionFailed(error);
     return false;
   }
 
+  if (QThread::currentThread() != this->thread()) {
+    QMetaObject::invokeMethod(this, "connectToBrokers", Qt::QueuedConnection, Q_ARG(QStringList, endpoints),
+                              Q_ARG(int, keepalive), Q_ARG(int, max_retry));
+    return true;
+  }
+
   // 保存连接参数用于重连
-  host_ = host;
-  port_ = port;
+  endpoints_ = parsed;
+  endpoint_index_ = -1;
   keepalive_ = keepalive;
-  max_retry_ = qMax(1, max_retry);
+  max_retry_ = qMax(0, max_retry);
   retry_count_ = 0;
+  reconnect_timer_->stop();
+  connect_timer_->stop();
+  connect_started_ns_ = mqttMonotonicNs();
 
-  // 发起连接
-  int rc = mosquitto_connect(mosq_, host.toUtf8().constData(), port, keepalive);
-  if (rc != MOSQ_ERR_SUCCESS) {
-    qCritical() << "Initial connection failed:" << mosquitto_strerror(rc);
-    return false;
+  // DNS解析和TCP探测都是异步的，结果由onRaceSucceeded/onRaceFailed处理
+  startRace(0);
+  return true;
+}
+
+void MqttClient::setReconnectBackoff(int min_ms, int max_ms) {
+  backoff_min_ms_ = qMax(1, min_ms);
+  backoff_max_ms_ = qMax(backoff_min_ms_, max_ms);
+}
+
+QString MqttClient::currentBroker() const {
+  return endpoint_index_ >= 0 ? endpoints_.at(endpoint_index_).toString() : QString();
+}
+
+void MqttClient::startRace(int first_endpoint) {
+  cancelRace();
+  race_first_ = first_endpoint % endpoints_.size();
+  QList<MqttEndpoint> ordered;
+  for (int i = 0; i < endpoints_.size(); ++i) {
+    ordered.append(endpoints_.at((race_first_ + i) % endpoints_.size()));
+  }
+
+  race_ = new MqttConnectRace(ordered, this);
+  connect(race_, &MqttConnectRace::succeeded, this, &MqttClient::onRaceSucceeded);
+  connect(race_, &MqttConnectRace::failed, this, &MqttClient::onRaceFailed);
+  race_->start(kConnectRaceTimeoutMs);
+}
+
+void MqttClient::cancelRace() {
+  if (race_) {
+    // 可能在竞速对象自身的信号中被调用，不能直接delete
+    race_->disconnect(this);
+    race_->deleteLater();
+    race_ = nullptr;
   }
+}
 
-  // 启动网络循环线程（非阻塞）
-  rc = mosquitto_loop_start(mosq_);
+void MqttClient::startConnect(const QHostAddress &address) {
+  if (blocking_connect_) {
+    // 上一次持久会话连接尚未返回，实例仍被占用
+    scheduleReconnect();
+    return;
+  }
+  const MqttEndpoint &endpoint = endpoints_.at(endpoint_index_);
+  // 连接IP字面量，libmosquitto不再在客户端线程同步调用getaddrinfo；
+  // TLS的SNI和证书主机名校验改由onTlsInfo()按原主机名设置。SSL_CTX创建失败时只能退回传主机名
+  const bool tls_by_name = tls_enabled_ && !tls_ctx_;
+  const QByteArray target = tls_by_name ? endpoint.host.toUtf8() : address.toString().toUtf8();
+  tls_server_name_ = endpoint.host.toUtf8();
+  tls_server_is_ip_ = !QHostAddress(endpoint.host).isNull();
+
+  detachSocket();
+  updateLogCallback();
+  if (persistent_session_) {
+    // 会话过期时间只能作为CONNECT属性设置，而libmosquitto只有阻塞的connect接受属性，保存后重连时复用。
+    // 阻塞调用放到独立线程，期间客户端线程不访问mosq_：通知器和心跳定时器已停止，未连接时发布和订阅都不发送。
+    // v3.1.1模式下传空以清除旧属性
+    const bool v5 = protocol_version_.load(std::memory_order_relaxed) == MQTTv5;
+    blocking_connect_aborted_ = false;
+    blocking_connect_ = new BlockingConnect(mosq_, target, endpoint.port, keepalive_, v5 ? connect_props_ : nullptr);
+    connect(blocking_connect_, &QThread::finished, this, &MqttClient::onBlockingConnectFinished);
+    blocking_connect_->start();
+    return;
+  }
+  finishConnect(mosquitto_connect_async(mosq_, target.constData(), endpoint.port, keepalive_));
+}
+
+void MqttClient::finishConnect(int rc) {
   if (rc != MOSQ_ERR_SUCCESS) {
-    qCritical() << "Failed to start network loop:" << mosquitto_strerror(rc);
-    return false;
+    mqttWarning() << "Connection to" << currentBroker() << "failed:" << mosquitto_strerror(rc);
+    emit connectionFailed(mosquitto_strerror(rc));
+    scheduleReconnect();
+    return;
   }
 
-  return true;
+  // 由当前线程的事件循环驱动网络读写（非阻塞），写通知器在TCP连通后发出CONNECT
+  if (!attachSocket()) {
+    mqttError() << "Failed to start network loop: invalid socket";
+    scheduleReconnect();
+    return;
+  }
+  connect_timer_->start();
+}
+
+void MqttClient::scheduleReconnect() {
+  if (reconnect_timer_->isActive() || endpoints_.isEmpty()) {
+    return;
+  }
+
+  const int delay = static_cast<int>(qMin<qint64>(backoff_max_ms_, qint64(backoff_min_ms_) << qMin(retry_count_, 20)));
+  // 在[delay/2, delay]内随机抖动，避免大量客户端在代理恢复时同时重连
+  reconnect_timer_->start(delay / 2 + QRandomGenerator::global()->bounded(delay / 2 + 1));
 }
 
 void MqttClient::disconnectFromBroker() {
+  reconnect_timer_->stop();
+  connect_timer_->stop();
+  cancelRace();
+  if (blocking_connect_) {
+    // 阻塞连接返回后由onBlockingConnectFinished()断开
+    blocking_connect_aborted_ = true;
+  }
   if (connected_) {
-    mosquitto_disconnect(mosq_);
-    reconnect_timer_->stop();
     connected_ = false;
+    // 非线程模式下mosquitto_disconnect()可能当场回调onDisconnect()，由标志告知这是主动断开
+    disconnect_requested_ = true;
+    mosquitto_disconnect(mosq_);
+    if (disconnect_requested_) {
+      // 没有回调（例如写出失败），在这里通知
+      disconnect_requested_ = false;
+      mqttInfo() << "Gracefully disconnected";
+      emit disconnected();
+    }
   }
+  detachSocket();
 }
 
 void MqttClient::subscribe(const QString &topic, int qos) {
-  if (!connected_) {
-    qWarning() << "Cannot subscribe when disconnected";
+  if (QThread::currentThread() != this->thread()) {
+    QMetaObject::invokeMethod(this, "subscribe", Qt::QueuedConnection, Q_ARG(QString, topic), Q_ARG(int, qos));
     return;
   }
 
+  // 先记录，未连接时由restoreSubscriptions()在连接成功后订阅
+  subscribed_filters_.insert(topic, qos);
+  unsynced_filters_.insert(topic);
+  pending_unsubscribes_.remove(topic);
+  if (connected_) {
+    sendSubscribe(QStringList(topic), qos);
+  }
+}
+
+void MqttClient::sendSubscribe(const QStringList &filters, int qos) {
   // 使用UTF8编码处理中文主题
-  int rc = mosquitto_subscribe(mosq_, nullptr, topic.toUtf8().constData(), qos);
+  QVector<QByteArray> encoded;
+  QVarLengthArray<char *, 16> pointers;
+  encoded.reserve(filters.size());
+  for (const QString &filter : filters) {
+    encoded.append(filter.toUtf8());
+    pointers.append(encoded.last().data());
+  }
+
+  int mid = 0;
+  int options = 0;
+  if (protocol_version_.load(std::memory_order_relaxed) == MQTTv5 && !TopicTrie::isSharedFilter(encoded.first())) {
+    // 设置no_local，代理不会把本客户端发布的消息回传给自己；共享订阅不允许设置no_local
+    options = MQTT_SUB_OPT_NO_LOCAL;
+  }
+  int rc = mosquitto_subscribe_multiple(mosq_, &mid, pointers.size(), pointers.data(), qos, options, nullptr);
   if (rc != MOSQ_ERR_SUCCESS) {
-    qWarning() << "Subscribe failed:" << mosquitto_strerror(rc);
+    mqttWarning() << "Subscribe failed:" << mosquitto_strerror(rc);
     emit connectionFailed(mosquitto_strerror(rc));
+  } else {
+    pending_subacks_.insert(mid, filters);
+  }
+  updateWriteNotifier();
+}
+
+MqttSubscription *MqttClient::subscribe(const QString &filter, int qos, const MqttSubscription::Handler &handler) {
+  if (!TopicTrie::isValidFilter(filter.toUtf8())) {
+    mqttWarning() << "Invalid topic filter:" << filter;
+    return nullptr;
+  }
+
+  MqttSubscription *subscription =
+      new MqttSubscription(next_subscription_id_.fetch_add(1, std::memory_order_relaxed), filter, qos, handler);
+  if (QThread::currentThread() != this->thread()) {
+    // 前缀树只在客户端线程中访问，注册操作转发过去
+    QMetaObject::invokeMethod(this, [this, subscription]() { addSubscription(subscription); }, Qt::QueuedConnection);
+  } else {
+    addSubscription(subscription);
   }
+  return subscription;
 }
 
-void MqttClient::publish(const QString &topic, const QByteArray &payload, int qos, bool retain) {
+void MqttClient::unsubscribe(const QString &topic) {
   if (QThread::currentThread() != this->thread()) {
-    QMetaObject::invokeMethod(this, "publish", Qt::QueuedConnection, Q_ARG(QString, topic), Q_ARG(QByteArray, payload),
-                              Q_ARG(int, qos), Q_ARG(bool, retain));
+    QMetaObject::invokeMethod(this, "unsubscribe", Qt::QueuedConnection, Q_ARG(QString, topic));
     return;
   }
+  subscribed_filters_.remove(topic);
+  unsynced_filters_.remove(topic);
   if (!connected_) {
-    qWarning() << "Cannot publish when disconnected";
+    // 持久会话中代理仍保留该订阅，重连后再取消
+    if (persistent_session_) {
+      pending_unsubscribes_.insert(topic);
+    }
     return;
   }
 
-  /*
-  // 创建MQTTv5属性（需要Mosquitto 2.0+版本）
-  mosquitto_property *props = nullptr;
-  // 设置NO_LOCAL属性（需代理支持MQTTv5）让代理不要将消息回传给发布者自己
-  mosquitto_property_add_boolean(&props, MQTT_PROP_NO_LOCAL, 1);
-  int rc = mosquitto_publish_v5(mosq_,
-                                nullptr,  // 自动生成message id
-                                topic.toUtf8().constData(), payload.size(), payload.constData(), qos, retain, props);
-  // 清理属性资源
-  mosquitto_property_free_all(&props);
+  int rc = mosquitto_unsubscribe(mosq_, nullptr, topic.toUtf8().constData());
   if (rc != MOSQ_ERR_SUCCESS) {
-    qWarning() << "Publish failed:" << mosquitto_strerror(rc);
+    mqttWarning() << "Unsubscribe failed:" << mosquitto_strerror(rc);
   }
-*/
+  updateWriteNotifier();
+}
 
-  QByteArray fullPayload = "[ClientID:" + client_id_.toUtf8() + "]" + payload;
-  int rc = mosquitto_publish(mosq_,
-                             nullptr,  // 自动生成 message id
-                             topic.toUtf8().constData(), fullPayload.size(), fullPayload.constData(), qos, retain);
+void MqttClient::unsubscribe(MqttSubscription *subscription) {
+  if (!subscription) {
+    return;
+  }
+  if (QThread::currentThread() != this->thread()) {
+    QMetaObject::invokeMethod(this, [this, subscription]() { removeSubscription(subscription); },
+                              Qt::QueuedConnection);
+  } else {
+    removeSubscription(subscription);
+  }
+}
+
+void MqttClient::addSubscription(MqttSubscription *subscription) {
+  topic_trie_.insert(TopicTrie::topicFilter(subscription->filter().toUtf8()), subscription->id());
+  subscriptions_.insert(subscription->id(), subscription);
+  // 同一过滤器只向代理订阅一次；未连接时在连接成功后由restoreSubscriptions()订阅
+  if (filter_refs_[subscription->filter()]++ == 0) {
+    subscribe(subscription->filter(), subscription->qos());
+  }
+}
+
+void MqttClient::restoreSubscriptions(bool session_present) {
+  // 上一个连接中未确认的订阅已无法确认
+  pending_subacks_.clear();
+  QStringList filters;
+  if (session_present) {
+    // 代理保留了订阅，只同步断线期间的变更
+    if (!pending_unsubscribes_.isEmpty()) {
+      QVector<QByteArray> encoded;
+      QVarLengthArray<char *, 16> pointers;
+      encoded.reserve(pending_unsubscribes_.size());
+      for (const QString &filter : pending_unsubscribes_) {
+        encoded.append(filter.toUtf8());
+        pointers.append(encoded.last().data());
+      }
+      int rc = mosquitto_unsubscribe_multiple(mosq_, nullptr, pointers.size(), pointers.data(), nullptr);
+      if (rc != MOSQ_ERR_SUCCESS) {
+        mqttWarning() << "Unsubscribe failed:" << mosquitto_strerror(rc);
+      }
+    }
+    filters = unsynced_filters_.values();
+  } else {
+    filters = subscribed_filters_.keys();
+  }
+  pending_unsubscribes_.clear();
+
+  // 一个SUBSCRIBE报文中的过滤器共用QoS和订阅选项，按两者分组，各组连续发出，只需一次往返
+  QMap<int, QStringList> groups;
+  for (const QString &filter : filters) {
+    const bool shared = TopicTrie::isSharedFilter(filter.toUtf8());
+    groups[subscribed_filters_.value(filter) * 2 + (shared ? 1 : 0)].append(filter);
+  }
+  for (QMap<int, QStringList>::const_iterator it = groups.constBegin(); it != groups.constEnd(); ++it) {
+    sendSubscribe(it.value(), it.key() / 2);
+  }
+}
+
+void MqttClient::removeSubscription(MqttSubscription *subscription) {
+  if (!subscriptions_.remove(subscription->id())) {
+    return;
+  }
+  topic_trie_.remove(TopicTrie::topicFilter(subscription->filter().toUtf8()), subscription->id());
+  if (--filter_refs_[subscription->filter()] == 0) {
+    filter_refs_.remove(subscription->filter());
+    unsubscribe(subscription->filter());
+  }
+  // 可能正处于该句柄的处理函数中，延迟释放
+  subscription->deleteLater();
+}
+
+void MqttClient::dispatch(const char *topic, const MqttMessage &message) {
+  // 先收集匹配结果再投递，处理函数中释放句柄不会影响遍历
+  QVarLengthArray<int, 16> ids;
+  topic_trie_.match(topic, [&ids](int id) { ids.append(id); });
+  for (int id : ids) {
+    MqttSubscription *subscription = subscriptions_.value(id, nullptr);
+    if (subscription) {
+      subscription->deliver(message);
+    }
+  }
+}
+
+MqttPublishToken MqttClient::publish(const QString &topic, const QByteArray &payload, int qos,
+                                     bool retain) {
+  return publishEncoded(topic.toUtf8(), payload, qos, retain);
+}
+
+MqttPublishToken MqttClient::publishEncoded(const QByteArray &topic, const QByteArray &payload, int qos,
+                                            bool retain) {
+  return publishWithEntry(topic, nullptr, payload, qos, retain);
+}
+
+MqttTopic MqttClient::topic(const QString &name) { return topic_table_.intern(name); }
+
+MqttPublishToken MqttClient::publishTopic(const MqttTopic &topic, const QByteArray &payload, int qos, bool retain) {
+  // 其他客户端的句柄的别名字段属于另一个客户端线程和另一个连接的别名空间
+  if (!topic.isValid() || topic.entry_->table != &topic_table_) {
+    MqttPublishToken token = MqttPublishToken::create(qos);
+    metrics_.add(MqttMetrics::PublishFailed);
+    token.finish(MqttPublishToken::Failed, MOSQ_ERR_INVAL);
+    return token;
+  }
+  return publishWithEntry(topic.entry_->utf8, topic.entry_, payload, qos, retain);
+}
+
+MqttPublishToken MqttClient::publishWithEntry(const QByteArray &topic, MqttTopicEntry *entry,
+                                              const QByteArray &payload, int qos, bool retain) {
+  MqttPublishToken token = MqttPublishToken::create(qos);
+  // 编码在生产者线程完成，客户端线程只负责发送
+  bool encoded = false;
+  const QByteArray body = encodePayload(topic, payload, &encoded);
+  // 断线或发件箱仍有积压时直接写入发件箱，保证消息顺序
+  bool spool = outbox_ && (!connected_ || !outbox_->isEmpty());
+  if (!spool && !acquirePublishSlot()) {
+    // 窗口已满时转入发件箱；未启用发件箱则拒绝，由生产者决定重试或等待publishWindowAvailable信号
+    if (!outbox_) {
+      metrics_.add(MqttMetrics::PublishRejected);
+      token.finish(MqttPublishToken::Rejected, MOSQ_ERR_SUCCESS);
+      return token;
+    }
+    spool = true;
+  }
+  if (spool) {
+    spoolPublish(topic, framePayload(body), qos, retain, token, false);
+    return token;
+  }
+
+  if (QThread::currentThread() != this->thread()) {
+    // 前缀在客户端线程发送时添加：入队后可能因代理不支持v5回退到v3.1.1，此时需要前缀过滤自身消息
+    PublishRequest *request = new PublishRequest;
+    request->topic = topic;
+    request->topic_entry = entry;
+    request->payload = body;
+    request->encoded = encoded;
+    request->qos = qos;
+    request->retain = retain;
+    request->token = token;
+    publish_queue_.push(request);
+
+    // 队列由空闲转为待处理时才投递一次事件，其余生产者只入队
+    if (!drain_scheduled_.exchange(true, std::memory_order_acq_rel)) {
+      QMetaObject::invokeMethod(this, "drainPublishQueue", Qt::QueuedConnection);
+    }
+    return token;
+  }
+
+  sendPublish(topic, framePayload(body), qos, retain, token, entry);
+  return token;
+}
+
+void MqttClient::setMaxInflightMessages(int max_inflight) {
+  max_inflight = qMax(0, max_inflight);
+  int rc = mosquitto_max_inflight_messages_set(mosq_, static_cast<unsigned int>(max_inflight));
   if (rc != MOSQ_ERR_SUCCESS) {
-    qWarning() << "Publish failed:" << mosquitto_strerror(rc);
+    mqttWarning() << "设置在途消息上限失败:" << mosquitto_strerror(rc);
+    return;
+  }
+  max_inflight_.store(max_inflight, std::memory_order_relaxed);
+}
+
+int MqttClient::maxInflightMessages() const { return max_inflight_.load(std::memory_order_relaxed); }
+
+int MqttClient::inflightCount() const { return inflight_count_.load(std::memory_order_relaxed); }
+
+bool MqttClient::canPublish() const {
+  int limit = max_inflight_.load(std::memory_order_relaxed);
+  return limit == 0 || inflight_count_.load(std::memory_order_relaxed) < limit;
+}
+
+bool MqttClient::acquirePublishSlot() {
+  int limit = max_inflight_.load(std::memory_order_relaxed);
+  int count = inflight_count_.fetch_add(1, std::memory_order_acq_rel) + 1;
+  if (limit > 0 && count > limit) {
+    inflight_count_.fetch_sub(1, std::memory_order_acq_rel);
+    window_full_.store(true, std::memory_order_release);
+    return false;
+  }
+  return true;
+}
+
+void MqttClient::finishPublish(const MqttPublishToken &token, MqttPublishToken::Status status, int rc) {
+  token.finish(status, rc);
+  int count = inflight_count_.fetch_sub(1, std::memory_order_acq_rel) - 1;
+
+  switch (status) {
+    case MqttPublishToken::Completed:
+      metrics_.add(MqttMetrics::PublishAcked);
+      metrics_.publish_ack_latency.record(token.latencyUs() * 1000);
+      emit messageAcknowledged(token.messageId(), token.latencyUs());
+      break;
+    case MqttPublishToken::Failed:
+      metrics_.add(MqttMetrics::PublishFailed);
+      break;
+    default:
+      break;
+  }
+
+  // 窗口回落到一半以下时通知被拒绝过的生产者，避免在窗口边缘反复触发
+  if (window_full_.load(std::memory_order_acquire) && count <= max_inflight_.load(std::memory_order_relaxed) / 2) {
+    window_full_.store(false, std::memory_order_release);
+    emit publishWindowAvailable();
+  }
+}
+
+void MqttClient::failPendingPublishes(int rc, bool qos0_only) {
+  QHash<int, MqttPublishToken>::iterator it = inflight_.begin();
+  while (it != inflight_.end()) {
+    if (qos0_only && it.value().qos() > 0) {
+      ++it;
+      continue;
+    }
+    MqttPublishToken token = it.value();
+    it = inflight_.erase(it);
+    finishPublish(token, MqttPublishToken::Failed, rc);
+  }
+}
+
+QByteArray MqttClient::encodePayload(const QByteArray &topic, const QByteArray &payload, bool *encoded) const {
+  if (encoded) {
+    *encoded = false;
+  }
+  if (protocol_version_.load(std::memory_order_acquire) != MQTTv5) {
+    return payload;
+  }
+  for (const CodecRule &rule : codec_rules_) {
+    if (TopicTrie::matches(rule.filter, topic)) {
+      if (encoded) {
+        *encoded = true;
+      }
+      // 小负载不值得编码，但仍需转义恰好以编码头部开始的负载
+      return MqttCodec::encode(payload.size() >= rule.min_bytes ? rule.type : MqttCodec::Identity, payload);
+    }
+  }
+  return payload;
+}
+
+QByteArray MqttClient::framePayload(const QByteArray &payload) const {
+  // v5模式由代理过滤自身消息，负载原样发送
+  if (protocol_version_.load(std::memory_order_acquire) == MQTTv5) {
+    return payload;
+  }
+
+  QByteArray fullPayload;
+  fullPayload.reserve(payload_prefix_.size() + payload.size());
+  fullPayload.append(payload_prefix_);
+  fullPayload.append(payload);
+  return fullPayload;
+}
+
+void MqttClient::sendPublish(const QByteArray &topic, const QByteArray &payload, int qos, bool retain,
+                             const MqttPublishToken &token, MqttTopicEntry *entry) {
+  if (!connected_) {
+    mqttWarning() << "Cannot publish when disconnected";
+    finishPublish(token, MqttPublishToken::Failed, MOSQ_ERR_NO_CONN);
+    return;
+  }
+
+  int mid = 0;
+  int rc;
+  // 只有本次QoS0发布的确认可能早于mosquitto_publish返回，其余未知消息ID的确认直接忽略
+  publishing_qos0_ = qos == 0;
+  early_qos0_ack_ = 0;
+  if (protocol_version_.load(std::memory_order_relaxed) == MQTTv5) {
+    const mosquitto_property *props = publish_props_;
+    const char *topic_data = topic.constData();
+    const mosquitto_property *alias_props = entry && qos == 0 ? topicAliasProperties(entry) : nullptr;
+    if (alias_props) {
+      props = alias_props;
+      // 代理已知道映射时主题留空，只发送别名
+      if (entry->alias_sent) {
+        topic_data = nullptr;
+      }
+    }
+    rc = mosquitto_publish_v5(mosq_, &mid, topic_data, payload.size(), payload.constData(), qos, retain, props);
+    if (rc == MOSQ_ERR_SUCCESS && alias_props) {
+      if (topic_data) {
+        entry->alias_sent = true;
+      } else {
+        metrics_.add(MqttMetrics::TopicAliasPublishes);
+        metrics_.add(MqttMetrics::TopicBytesSaved, topic.size());
+      }
+    }
+  } else {
+    rc = mosquitto_publish(mosq_, &mid, topic.constData(), payload.size(), payload.constData(), qos, retain);
+  }
+  publishing_qos0_ = false;
+  const bool acked = early_qos0_ack_ != 0 && early_qos0_ack_ == mid;
+  early_qos0_ack_ = 0;
+  if (rc != MOSQ_ERR_SUCCESS) {
+    mqttWarning() << "Publish failed:" << mosquitto_strerror(rc);
+    finishPublish(token, MqttPublishToken::Failed, rc);
+    updateWriteNotifier();
+    return;
+  }
+
+  metrics_.add(MqttMetrics::MessagesOut);
+  metrics_.add(MqttMetrics::BytesOut, payload.size());
+  token.state_->mid.store(mid, std::memory_order_relaxed);
+  // QoS0报文可能在mosquitto_publish内部就已写出并回调
+  if (acked) {
+    finishPublish(token, MqttPublishToken::Completed, MOSQ_ERR_SUCCESS);
+  } else {
+    inflight_.insert(mid, token);
+  }
+  updateWriteNotifier();
+}
+
+const mosquitto_property *MqttClient::topicAliasProperties(MqttTopicEntry *entry) {
+  if (topic_alias_max_ == 0) {
+    return nullptr;
+  }
+  // 别名只在分配它的连接内有效
+  if (entry->alias_epoch != connection_epoch_) {
+    entry->alias = 0;
+    entry->alias_sent = false;
+    entry->alias_epoch = connection_epoch_;
+  }
+  if (entry->alias == 0) {
+    // 按先达到发布次数的顺序分配，别名用完后其余主题继续发送完整主题
+    if (++entry->publishes < kTopicAliasMinPublishes || topic_aliases_used_ >= topic_alias_max_) {
+      return nullptr;
+    }
+    entry->alias = ++topic_aliases_used_;
+  }
+
+  // 同一别名的属性在各连接间相同，只构造一次
+  if (alias_props_.size() <= entry->alias) {
+    alias_props_.resize(entry->alias + 1);
+  }
+  mosquitto_property *&props = alias_props_[entry->alias];
+  if (!props) {
+    int rc = mosquitto_property_copy_all(&props, publish_props_);
+    if (rc == MOSQ_ERR_SUCCESS) {
+      rc = mosquitto_property_add_int16(&props, MQTT_PROP_TOPIC_ALIAS, static_cast<uint16_t>(entry->alias));
+    }
+    if (rc != MOSQ_ERR_SUCCESS) {
+      mqttWarning() << "设置主题别名失败:" << mosquitto_strerror(rc);
+      mosquitto_property_free_all(&props);
+      return nullptr;
+    }
+  }
+  return props;
+}
+
+void MqttClient::drainPublishQueue() {
+  // 先清除标志再取队列，保证清除之后入队的生产者会重新投递事件
+  drain_scheduled_.exchange(false, std::memory_order_acq_rel);
+
+  int sent = 0;
+  while (PublishRequest *request = publish_queue_.pop()) {
+    // 入队后回退到v3.1.1时，v3.1.1的接收方无法识别编码头部，还原为原始负载
+    if (request->encoded && protocol_version_.load(std::memory_order_acquire) != MQTTv5) {
+      request->payload = MqttCodec::decode(request->payload);
+    }
+    const QByteArray payload = framePayload(request->payload);
+    // 入队后连接可能已断开
+    if (outbox_ && (!connected_ || !outbox_->isEmpty())) {
+      spoolPublish(request->topic, payload, request->qos, request->retain, request->token, true);
+    } else {
+      sendPublish(request->topic, payload, request->qos, request->retain, request->token, request->topic_entry);
+    }
+    delete request;
+    if (++sent >= kMaxPublishDrainBatch) {
+      // 让出事件循环，剩余消息在下一轮继续发送
+      if (!drain_scheduled_.exchange(true, std::memory_order_acq_rel)) {
+        QMetaObject::invokeMethod(this, "drainPublishQueue", Qt::QueuedConnection);
+      }
+      break;
+    }
+  }
+}
+
+bool MqttClient::enableOutbox(const QString &dir, qint64 max_bytes, int max_age_secs) {
+  MqttOutbox *outbox = new MqttOutbox;
+  if (!outbox->open(dir, max_bytes, static_cast<qint64>(max_age_secs) * 1000)) {
+    mqttWarning() << "无法打开离线发件箱:" << dir;
+    delete outbox;
+    return false;
+  }
+  delete outbox_;
+  outbox_ = outbox;
+  if (!outbox_->isEmpty()) {
+    mqttInfo() << "离线发件箱中有" << outbox_->pendingCount() << "条消息等待重发";
+  }
+  return true;
+}
+
+void MqttClient::setOutboxReplayRate(int messages_per_second) {
+  replay_batch_ = qMax(1, messages_per_second * kOutboxReplayIntervalMs / 1000);
+}
+
+qint64 MqttClient::outboxPendingCount() const { return outbox_ ? outbox_->pendingCount() : 0; }
+
+void MqttClient::spoolPublish(const QByteArray &topic, const QByteArray &payload, int qos, bool retain,
+                              const MqttPublishToken &token, bool holds_slot) {
+  bool ok = outbox_->append(topic, payload, qos, retain);
+  MqttPublishToken::Status status = ok ? MqttPublishToken::Spooled : MqttPublishToken::Failed;
+  int rc = ok ? MOSQ_ERR_SUCCESS : MOSQ_ERR_ERRNO;
+  if (ok) {
+    metrics_.add(MqttMetrics::PublishSpooled);
+  }
+  if (holds_slot) {
+    finishPublish(token, status, rc);
+  } else {
+    if (!ok) {
+      metrics_.add(MqttMetrics::PublishFailed);
+    }
+    token.finish(status, rc);
+  }
+
+  // 已连接时写入的消息（发件箱尚有积压）需要重发定时器继续运行
+  if (ok && connected_ && !replay_scheduled_.exchange(true, std::memory_order_acq_rel)) {
+    QMetaObject::invokeMethod(this, "startOutboxReplay", Qt::QueuedConnection);
+  }
+}
+
+void MqttClient::startOutboxReplay() {
+  if (connected_ && !replay_timer_->isActive()) {
+    replay_timer_->start();
+  }
+}
+
+void MqttClient::replayOutbox() {
+  MqttOutbox::Record record;
+  for (int i = 0; i < replay_batch_; ++i) {
+    // 窗口已满时等待下一次定时
+    if (!connected_ || !canPublish()) {
+      return;
+    }
+    if (!outbox_->peek(&record)) {
+      replay_timer_->stop();
+      replay_scheduled_.store(false, std::memory_order_release);
+      // 停止前可能有生产者写入了新消息
+      if (!outbox_->isEmpty() && !replay_scheduled_.exchange(true, std::memory_order_acq_rel)) {
+        replay_timer_->start();
+      }
+      return;
+    }
+    if (!acquirePublishSlot()) {
+      return;
+    }
+
+    MqttPublishToken token = MqttPublishToken::create(record.qos);
+    sendPublish(record.topic, record.payload, record.qos, record.retain, token);
+    // 连接问题导致的失败保留在发件箱中，下次连接后重试；其他错误（如消息过大）重试也不会成功
+    if (token.status() == MqttPublishToken::Failed &&
+        (token.errorCode() == MOSQ_ERR_NO_CONN || token.errorCode() == MOSQ_ERR_CONN_LOST)) {
+      return;
+    }
+    outbox_->pop();
+  }
+}
+
+void MqttClient::enableRetainedCache(const QString &snapshot_path, qint64 max_bytes) {
+  delete retained_cache_;
+  retained_cache_ = new RetainedCache(max_bytes);
+  retained_snapshot_path_ = snapshot_path;
+  if (!snapshot_path.isEmpty() && retained_cache_->loadSnapshot(snapshot_path)) {
+    mqttInfo() << "Loaded" << retained_cache_->size() << "cached topics from" << snapshot_path;
+  }
+}
+
+RetainedCache *MqttClient::retainedCache() const { return retained_cache_; }
+
+MqttConflator *MqttClient::enableConflation(int max_queue) {
+  if (!conflator_) {
+    conflator_ = new MqttConflator(max_queue, this);
+  } else {
+    conflator_->setMaxQueue(max_queue);
+  }
+  return conflator_;
+}
+
+MqttConflator *MqttClient::conflator() const { return conflator_; }
+
+MqttWorkerPool *MqttClient::enableWorkerPool(int threads, const MqttWorkerPool::Handler &handler) {
+  delete worker_pool_;
+  MqttLatencyHistogram *latency = &metrics_.delivery_latency;
+  worker_pool_ = new MqttWorkerPool(threads, [handler, latency](const MqttMessage &message) {
+    handler(message);
+    latency->record(mqttMonotonicNs() - message.received_ns);
+  });
+  return worker_pool_;
+}
+
+MqttWorkerPool *MqttClient::workerPool() const { return worker_pool_; }
+
+bool MqttClient::enableCapture(const QString &path, qint64 max_bytes) {
+  if (QThread::currentThread() != this->thread()) {
+    bool ok = false;
+    QMetaObject::invokeMethod(this, [this, path, max_bytes, &ok]() { ok = enableCapture(path, max_bytes); },
+                              Qt::BlockingQueuedConnection);
+    return ok;
+  }
+  return capture_.open(path, max_bytes);
+}
+
+void MqttClient::stopCapture() {
+  if (QThread::currentThread() != this->thread()) {
+    QMetaObject::invokeMethod(this, [this]() { stopCapture(); }, Qt::BlockingQueuedConnection);
+    return;
+  }
+  capture_.close();
+}
+
+bool MqttClient::enableFanout(const QString &path, qint64 capacity, int max_readers) {
+  if (QThread::currentThread() != this->thread()) {
+    bool ok = false;
+    QMetaObject::invokeMethod(
+        this, [this, path, capacity, max_readers, &ok]() { ok = enableFanout(path, capacity, max_readers); },
+        Qt::BlockingQueuedConnection);
+    return ok;
+  }
+  return fanout_.create(path, capacity, max_readers);
+}
+
+void MqttClient::stopFanout() {
+  if (QThread::currentThread() != this->thread()) {
+    QMetaObject::invokeMethod(this, [this]() { stopFanout(); }, Qt::BlockingQueuedConnection);
+    return;
+  }
+  fanout_.close();
+}
+
+int MqttClient::relayFanoutPublishes(int timeout_ms) {
+  if (!fanout_.isOpen()) {
+    return 0;
+  }
+  const qint64 now_ns = mqttMonotonicNs();
+  if (now_ns - fanout_reaped_ns_ >= kFanoutReapIntervalNs) {
+    fanout_reaped_ns_ = now_ns;
+    fanout_.reapReaders();
+  }
+  if (!fanout_.waitForPublishes(timeout_ms)) {
+    return 0;
+  }
+  // 取出的主题和内容是独立拷贝，直接交给发布队列。代理不会把这些发布回传给本客户端（no_local或前缀过滤），
+  // 其他本机读者要像直连代理一样收到它们，由客户端线程按订阅写回分发区，并标明提交者，提交者自己不会读到
+  QVector<FanoutEcho> echoes;
+  const int count = fanout_.drainPublishes(
+      [this, &echoes](const QByteArray &topic, const QByteArray &payload, int qos, bool retain, int origin) {
+        publishEncoded(topic, payload, qos, retain);
+        FanoutEcho echo;
+        echo.topic = topic;
+        echo.payload = payload;
+        echo.qos = qos;
+        echo.origin = origin;
+        echoes.append(echo);
+      });
+  if (!echoes.isEmpty()) {
+    QMetaObject::invokeMethod(this, [this, echoes]() { echoFanoutPublishes(echoes); }, Qt::QueuedConnection);
+  }
+  return count;
+}
+
+void MqttClient::echoFanoutPublishes(const QVector<FanoutEcho> &echoes) {
+  for (const FanoutEcho &echo : echoes) {
+    // 与代理转发给订阅者时一样取订阅和发布中较低的QoS，保留标志清除；
+    // 共享订阅不设置no_local，代理可能把自身的发布投递回来，不再重复写入
+    int granted = -1;
+    for (QHash<QString, int>::const_iterator it = subscribed_filters_.constBegin();
+         it != subscribed_filters_.constEnd(); ++it) {
+      const QByteArray filter = it.key().toUtf8();
+      if (!TopicTrie::isSharedFilter(filter) && TopicTrie::matches(filter, echo.topic)) {
+        granted = qMax(granted, it.value());
+      }
+    }
+    if (granted >= 0) {
+      // 分发区中是线路上的负载，与代理转发的消息一样按编码规则编码
+      const QByteArray body = encodePayload(echo.topic, echo.payload);
+      fanout_.append(echo.topic.constData(), body.constData(), body.size(), qMin(echo.qos, granted), false,
+                     echo.origin);
+    }
+  }
+}
+
+MqttStats MqttClient::stats() const {
+  MqttStats stats;
+  stats.timestamp = QDateTime::currentMSecsSinceEpoch();
+  stats.client_id = client_id_;
+  stats.messages_in = metrics_.value(MqttMetrics::MessagesIn);
+  stats.bytes_in = metrics_.value(MqttMetrics::BytesIn);
+  stats.messages_out = metrics_.value(MqttMetrics::MessagesOut);
+  stats.bytes_out = metrics_.value(MqttMetrics::BytesOut);
+  stats.publish_acked = metrics_.value(MqttMetrics::PublishAcked);
+  stats.publish_failed = metrics_.value(MqttMetrics::PublishFailed);
+  stats.publish_rejected = metrics_.value(MqttMetrics::PublishRejected);
+  stats.publish_spooled = metrics_.value(MqttMetrics::PublishSpooled);
+  stats.echo_filtered = metrics_.value(MqttMetrics::EchoFiltered);
+  stats.connects = metrics_.value(MqttMetrics::Connects);
+  stats.disconnects = metrics_.value(MqttMetrics::Disconnects);
+  stats.reconnect_attempts = metrics_.value(MqttMetrics::ReconnectAttempts);
+  stats.tls_handshakes = metrics_.value(MqttMetrics::TlsHandshakes);
+  stats.tls_resumed = metrics_.value(MqttMetrics::TlsResumed);
+  stats.sessions_resumed = metrics_.value(MqttMetrics::SessionsResumed);
+  stats.publish_inflight = inflight_count_.load(std::memory_order_relaxed);
+  stats.outbox_pending = outboxPendingCount();
+  if (delivery_mode_ == Conflated && conflator_) {
+    MqttConflator::Stats conflation = conflator_->stats();
+    stats.conflated = conflation.conflated;
+    stats.rate_limited = conflation.rate_limited;
+    stats.delivery_dropped = conflation.dropped;
+    stats.delivery_pending = conflation.queued;
+  } else {
+    stats.delivery_pending = delivery_pending_.load(std::memory_order_relaxed);
+  }
+  if (worker_pool_) {
+    MqttWorkerPool::Stats pool = worker_pool_->stats();
+    stats.pool_processed = pool.processed;
+    stats.pool_steals = pool.steals;
+    stats.pool_queued = pool.queued;
+  }
+  stats.captured = capture_.recordCount();
+  stats.capture_dropped = capture_.droppedCount();
+  stats.fanout_messages = fanout_.messageCount();
+  stats.fanout_dropped = fanout_.droppedCount();
+  stats.fanout_relayed = fanout_.relayedCount();
+  stats.fanout_readers = fanout_.readerCount();
+  stats.publish_ack_latency = metrics_.publish_ack_latency.snapshot();
+  stats.delivery_latency = metrics_.delivery_latency.snapshot();
+  stats.connect_latency = metrics_.connect_latency.snapshot();
+  stats.tls_handshake_latency = metrics_.tls_handshake_latency.snapshot();
+  return stats;
+}
+
+void MqttClient::setStatsInterval(int msecs) {
+  if (QThread::currentThread() != this->thread()) {
+    QMetaObject::invokeMethod(this, [this, msecs]() { setStatsInterval(msecs); }, Qt::QueuedConnection);
+    return;
+  }
+
+  if (msecs > 0) {
+    stats_timer_->start(msecs);
+  } else {
+    stats_timer_->stop();
+  }
+}
+
+void MqttClient::setMetricsFile(const QString &path) { metrics_file_ = path; }
+
+void MqttClient::acknowledgeDelivery(const MqttMessageBatch &batch) {
+  const qint64 now = mqttMonotonicNs();
+  for (const MqttMessage &message : batch) {
+    metrics_.delivery_latency.record(now - message.received_ns);
+  }
+  // 合并队列的积压由队列本身统计
+  if (delivery_mode_ != Conflated || !conflator_) {
+    delivery_pending_.fetch_sub(batch.size(), std::memory_order_relaxed);
+  }
+}
+
+void MqttClient::publishStats() {
+  MqttStats snapshot = stats();
+  emit statsUpdated(snapshot);
+
+  if (!metrics_file_.isEmpty()) {
+    // 先写临时文件再替换，读取方不会看到写了一半的内容
+    QSaveFile file(metrics_file_);
+    if (!file.open(QIODevice::WriteOnly) || file.write(snapshot.toPrometheus()) < 0 || !file.commit()) {
+      mqttWarning() << "无法写入指标文件:" << metrics_file_ << file.errorString();
+    }
   }
 }
 
@@ -157,7 +1102,7 @@ void MqttClient::setCredentials(const QString &username, const QString &password
     int rc = mosquitto_username_pw_set(mosq_, username.isEmpty() ? nullptr : username.toUtf8().constData(),
                                        password.isEmpty() ? nullptr : password.toUtf8().constData());
     if (rc != MOSQ_ERR_SUCCESS) {
-      qWarning() << "设置凭据失败:" << mosquitto_strerror(rc);
+      mqttWarning() << "设置凭据失败:" << mosquitto_strerror(rc);
     }
   }
 }
@@ -169,125 +1114,678 @@ void MqttClient::enableSSL(const QString &caFile, const QString &certFile, const
                          certFile.toUtf8().constData(), keyFile.toUtf8().constData(),
                          nullptr);  // 密码回调
   if (rc != MOSQ_ERR_SUCCESS) {
-    qWarning() << "SSL配置失败:" << mosquitto_strerror(rc);
+    mqttWarning() << "SSL配置失败:" << mosquitto_strerror(rc);
   }
-  // 强制必须证书验证
-  // mosquitto_tls_opts_set(mosq_, SSL_VERIFY_PEER, "tlsv1.2", nullptr);
+  tls_enabled_ = rc == MOSQ_ERR_SUCCESS;
+  if (tls_enabled_) {
+    setupTlsContext();
+  }
+}
+
+bool MqttClient::enableTlsPsk(const QString &identity, const QString &key_hex, const QString &ciphers) {
+  int rc = mosquitto_tls_psk_set(mosq_, key_hex.toUtf8().constData(), identity.toUtf8().constData(),
+                                 ciphers.isEmpty() ? nullptr : ciphers.toUtf8().constData());
+  if (rc != MOSQ_ERR_SUCCESS) {
+    mqttWarning() << "PSK配置失败:" << mosquitto_strerror(rc);
+    return false;
+  }
+  tls_enabled_ = true;
+  setupTlsContext();
+  return true;
 }
 
-void MqttClient::startHearbeat(int interval) { mosquitto_loop(mosq_, interval, 1); }
+bool MqttClient::setTlsOptions(bool verify_peer, const QString &version, const QString &ciphers) {
+  int rc = mosquitto_tls_opts_set(mosq_, verify_peer ? SSL_VERIFY_PEER : SSL_VERIFY_NONE,
+                                  version.isEmpty() ? nullptr : version.toUtf8().constData(),
+                                  ciphers.isEmpty() ? nullptr : ciphers.toUtf8().constData());
+  if (rc != MOSQ_ERR_SUCCESS) {
+    mqttWarning() << "TLS参数设置失败:" << mosquitto_strerror(rc);
+    return false;
+  }
+  return true;
+}
+
+void MqttClient::setTlsSessionResumption(bool enabled) {
+  tls_resumption_ = enabled;
+  if (!enabled && tls_session_) {
+    SSL_SESSION_free(tls_session_);
+    tls_session_ = nullptr;
+  }
+}
+
+void MqttClient::setupTlsContext() {
+  if (tls_ctx_) {
+    return;
+  }
+  SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+  if (!ctx) {
+    mqttWarning() << "创建SSL_CTX失败，TLS会话将不会复用";
+    return;
+  }
+  // 不使用OpenSSL的内部缓存，新会话交给回调由本对象保存
+  SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+  SSL_CTX_sess_set_new_cb(ctx, &MqttClient::onTlsNewSession);
+  SSL_CTX_set_info_callback(ctx, &MqttClient::onTlsInfo);
+  SSL_CTX_set_app_data(ctx, this);
+
+  // libmosquitto增加自己的引用，并在每次连接时把CA、证书、PSK和TLS参数应用到该SSL_CTX上
+  int rc = mosquitto_void_option(mosq_, MOSQ_OPT_SSL_CTX, ctx);
+  if (rc == MOSQ_ERR_SUCCESS) {
+    rc = mosquitto_int_option(mosq_, MOSQ_OPT_SSL_CTX_WITH_DEFAULTS, 1);
+  }
+  if (rc != MOSQ_ERR_SUCCESS) {
+    mqttWarning() << "设置SSL_CTX失败:" << mosquitto_strerror(rc);
+    SSL_CTX_free(ctx);
+    return;
+  }
+  // 连接时传入的是解析后的IP，libmosquitto按该IP做的主机名校验必然失败，关闭后由onTlsInfo()设置的
+  // 主机名校验代替；证书链仍按setTlsOptions()的设置校验
+  mosquitto_tls_insecure_set(mosq_, true);
+  tls_ctx_ = ctx;
+}
+
+int MqttClient::onTlsNewSession(SSL *ssl, SSL_SESSION *session) {
+  MqttClient *client = static_cast<MqttClient *>(SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl)));
+  if (!client || !client->tls_resumption_ || client->endpoint_index_ < 0) {
+    return 0;
+  }
+  // TLS 1.3的票据在握手完成后才到达，同一连接可能收到多张，保留最新的一张
+  if (client->tls_session_) {
+    SSL_SESSION_free(client->tls_session_);
+  }
+  client->tls_session_ = session;
+  client->tls_session_broker_ = client->currentBroker();
+  return 1;
+}
+
+void MqttClient::onTlsInfo(const SSL *ssl, int where, int ret) {
+  Q_UNUSED(ret)
+  MqttClient *client = static_cast<MqttClient *>(SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl)));
+  if (!client) {
+    return;
+  }
+  if (where & SSL_CB_HANDSHAKE_START) {
+    client->tls_handshake_started_ns_ = mqttMonotonicNs();
+    // libmosquitto按连接地址（IP）设置了SNI，握手开始时改回原主机名，并让OpenSSL校验证书中的主机名或IP
+    SSL *mutable_ssl = const_cast<SSL *>(ssl);
+    const char *name = client->tls_server_name_.constData();
+    if (client->tls_server_is_ip_) {
+      X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(mutable_ssl), name);
+    } else if (!client->tls_server_name_.isEmpty()) {
+      SSL_set_tlsext_host_name(mutable_ssl, name);
+      SSL_set1_host(mutable_ssl, name);
+    }
+    // libmosquitto在mosquitto_connect_async内部创建SSL对象并立即开始握手，外部没有机会调用SSL_set_session；
+    // 握手开始回调在构造ClientHello之前触发，此时设置的会话会被携带
+    if (client->tls_resumption_ && client->tls_session_ && !SSL_get_session(ssl) &&
+        client->tls_session_broker_ == client->currentBroker()) {
+      SSL_set_session(mutable_ssl, client->tls_session_);
+    }
+  } else if ((where & SSL_CB_HANDSHAKE_DONE) && client->tls_handshake_started_ns_ != 0) {
+    client->metrics_.tls_handshake_latency.record(mqttMonotonicNs() - client->tls_handshake_started_ns_);
+    client->metrics_.add(SSL_session_reused(const_cast<SSL *>(ssl)) ? MqttMetrics::TlsResumed
+                                                                    : MqttMetrics::TlsHandshakes);
+    client->tls_handshake_started_ns_ = 0;
+  }
+}
+
+void MqttClient::setDeliveryMode(DeliveryMode mode) { delivery_mode_ = mode; }
+
+MqttClient::DeliveryMode MqttClient::deliveryMode() const { return delivery_mode_; }
+
+void MqttClient::setProtocolVersion(ProtocolVersion version) {
+  int rc = mosquitto_int_option(mosq_, MOSQ_OPT_PROTOCOL_VERSION,
+                                version == MQTTv5 ? MQTT_PROTOCOL_V5 : MQTT_PROTOCOL_V311);
+  if (rc != MOSQ_ERR_SUCCESS) {
+    mqttWarning() << "设置协议版本失败:" << mosquitto_strerror(rc);
+    return;
+  }
+  protocol_version_.store(version, std::memory_order_release);
+}
+
+MqttClient::ProtocolVersion MqttClient::protocolVersion() const {
+  return protocol_version_.load(std::memory_order_acquire);
+}
+
+void MqttClient::setPublishIdentity(bool enabled) {
+  // 属性列表只构造一次，每次发布直接复用；主题别名的属性包含发布属性，需要重新构造
+  mosquitto_property_free_all(&publish_props_);
+  for (mosquitto_property *&props : alias_props_) {
+    mosquitto_property_free_all(&props);
+  }
+  if (enabled) {
+    int rc = mosquitto_property_add_string_pair(&publish_props_, MQTT_PROP_USER_PROPERTY, "client-id",
+                                                client_id_.toUtf8().constData());
+    if (rc != MOSQ_ERR_SUCCESS) {
+      mqttWarning() << "设置客户端ID属性失败:" << mosquitto_strerror(rc);
+    }
+  }
+}
+
+bool MqttClient::setPersistentSession(const QString &client_id, int session_expiry_secs) {
+  if (client_id.isEmpty() || session_expiry_secs <= 0) {
+    mqttWarning() << "Invalid persistent session parameters";
+    return false;
+  }
+  if (connected_ || race_ || blocking_connect_ || tls_enabled_) {
+    mqttWarning() << "持久会话必须在连接前、启用TLS之前设置";
+    return false;
+  }
+
+  mosquitto_property *props = nullptr;
+  int rc = mosquitto_property_add_int32(&props, MQTT_PROP_SESSION_EXPIRY_INTERVAL,
+                                        static_cast<uint32_t>(session_expiry_secs));
+  // 客户端ID和clean session只能在创建实例时指定，重建实例会清空回调和全部选项
+  if (rc == MOSQ_ERR_SUCCESS) {
+    rc = mosquitto_reinitialise(mosq_, client_id.toUtf8().constData(), false, this);
+  }
+  if (rc != MOSQ_ERR_SUCCESS) {
+    mqttWarning() << "设置持久会话失败:" << mosquitto_strerror(rc);
+    mosquitto_property_free_all(&props);
+    return false;
+  }
+  mosquitto_property_free_all(&connect_props_);
+  connect_props_ = props;
+  persistent_session_ = true;
+  client_id_ = client_id;
+  payload_prefix_ = "[ClientID:" + client_id_.toUtf8() + "]";
+
+  // 恢复重建前已设置的选项
+  setupCallbacks();
+  setProtocolVersion(protocol_version_.load(std::memory_order_relaxed));
+  if (!username_.isEmpty() || !password_.isEmpty()) {
+    setCredentials(username_, password_);
+  }
+  if (max_inflight_.load(std::memory_order_relaxed) > 0) {
+    setMaxInflightMessages(max_inflight_.load(std::memory_order_relaxed));
+  }
+  if (publish_props_) {
+    // 用户属性中的客户端ID随之更新
+    setPublishIdentity(true);
+  }
+  return true;
+}
+
+bool MqttClient::setPayloadCodec(const QString &filter, MqttCodec::Type type, int min_bytes) {
+  const QByteArray encoded = filter.toUtf8();
+  if (!TopicTrie::isValidFilter(encoded)) {
+    mqttWarning() << "Invalid codec filter:" << filter;
+    return false;
+  }
+  CodecRule rule;
+  rule.filter = encoded;
+  rule.type = type;
+  rule.min_bytes = qMax(0, min_bytes);
+  for (CodecRule &existing : codec_rules_) {
+    if (existing.filter == encoded) {
+      existing = rule;
+      return true;
+    }
+  }
+  codec_rules_.append(rule);
+  return true;
+}
 
 void MqttClient::setupCallbacks() {
-  // 绑定C库回调到静态成员函数
-  mosquitto_connect_callback_set(mosq_, &MqttClient::onConnect);
+  // 绑定C库回调到静态成员函数，连接回调需要CONNACK中的会话存在标志和v5属性
+  mosquitto_connect_v5_callback_set(mosq_, &MqttClient::onConnect);
   mosquitto_disconnect_callback_set(mosq_, &MqttClient::onDisconnect);
   mosquitto_message_callback_set(mosq_, &MqttClient::onMessage);
-  mosquitto_log_callback_set(mosq_, &MqttClient::onLog);
+  mosquitto_publish_callback_set(mosq_, &MqttClient::onPublish);
+  mosquitto_subscribe_callback_set(mosq_, &MqttClient::onSubscribe);
+  updateLogCallback();
+}
+
+void MqttClient::updateLogCallback() {
+  // 安装日志回调后libmosquitto为每个收发的包格式化一条调试日志，其余级别的日志极少，
+  // 因此只在调试级别启用时安装，否则网络线程上不做任何日志格式化
+  mosquitto_log_callback_set(mosq_, MqttLog::isEnabled(MqttLog::Debug) ? &MqttClient::onLog : nullptr);
 }
 
 void MqttClient::cleanup() {
+  if (blocking_connect_) {
+    // 阻塞连接仍在使用实例，等其返回后才能销毁
+    blocking_connect_->wait();
+    delete blocking_connect_;
+    blocking_connect_ = nullptr;
+  }
   if (mosq_) {
-    // 停止网络循环并销毁实例
-    mosquitto_loop_stop(mosq_, true);  // 强制停止
+    // 移除套接字通知器并销毁实例
+    detachSocket();
     mosquitto_destroy(mosq_);
     mosq_ = nullptr;
-    qInfo() << "mosquitto instance destroyed!";
+    mqttInfo() << "mosquitto instance destroyed!";
+  }
+  // libmosquitto已释放它持有的引用
+  if (tls_ctx_) {
+    SSL_CTX_free(tls_ctx_);
+    tls_ctx_ = nullptr;
+  }
+  if (tls_session_) {
+    SSL_SESSION_free(tls_session_);
+    tls_session_ = nullptr;
+  }
+}
+
+bool MqttClient::attachSocket() {
+  detachSocket();
+
+  int fd = mosquitto_socket(mosq_);
+  if (fd < 0) {
+    return false;
+  }
+
+  read_notifier_ = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+  connect(read_notifier_, &QSocketNotifier::activated, this, &MqttClient::onSocketReadable);
+  write_notifier_ = new QSocketNotifier(fd, QSocketNotifier::Write, this);
+  connect(write_notifier_, &QSocketNotifier::activated, this, &MqttClient::onSocketWritable);
+  misc_timer_->start();
+
+  // CONNECT报文可能尚未完全写出
+  updateWriteNotifier();
+  return true;
+}
+
+void MqttClient::detachSocket() {
+  misc_timer_->stop();
+  // 可能在通知器自身的activated信号中被调用，不能直接delete
+  if (read_notifier_) {
+    read_notifier_->setEnabled(false);
+    read_notifier_->deleteLater();
+    read_notifier_ = nullptr;
+  }
+  if (write_notifier_) {
+    write_notifier_->setEnabled(false);
+    write_notifier_->deleteLater();
+    write_notifier_ = nullptr;
+  }
+}
+
+void MqttClient::updateWriteNotifier() {
+  if (write_notifier_) {
+    write_notifier_->setEnabled(mosquitto_want_write(mosq_));
+  }
+}
+
+void MqttClient::onSocketReadable() {
+  // mosquitto_loop_read每次只保证读取一个报文，套接字无数据时errno为EAGAIN
+  for (int i = 0; i < kMaxPacketsPerRead && read_notifier_; ++i) {
+    errno = 0;
+    int rc = mosquitto_loop_read(mosq_, 1);
+    if (rc != MOSQ_ERR_SUCCESS || errno == EAGAIN || errno == EWOULDBLOCK) {
+      break;
+    }
   }
+
+  // 本次读取到的消息作为一个批次投递
+  flushInbound();
+  updateWriteNotifier();
+}
+
+void MqttClient::onSocketWritable() {
+  mosquitto_loop_write(mosq_, 1);
+  updateWriteNotifier();
+}
+
+void MqttClient::onLoopMisc() {
+  mosquitto_loop_misc(mosq_);
+  updateWriteNotifier();
 }
 
-void MqttClient::onConnect(mosquitto *mosq, void *obj, int rc) {
+void MqttClient::onConnect(mosquitto *mosq, void *obj, int rc, int flags, const mosquitto_property *props) {
   MqttClient *client = static_cast<MqttClient *>(obj);
-  client->retry_count_ = 0;  // 重置重试计数器
+  client->connect_timer_->stop();
 
+  // 代理不支持MQTT v5时回退到v3.1.1，改用负载前缀过滤自身消息
+  if (client->protocol_version_.load(std::memory_order_relaxed) == MQTTv5 &&
+      (rc == MQTT_RC_UNSUPPORTED_PROTOCOL_VERSION || rc == CONNACK_REFUSED_PROTOCOL_VERSION)) {
+    // 代理随后会关闭连接，由onDisconnect按正常流程重连
+    mqttWarning() << "Broker does not support MQTT v5, falling back to v3.1.1";
+    client->setProtocolVersion(MQTTv311);
+    return;
+  }
+
+  if (rc == MOSQ_ERR_SUCCESS) {
+    client->connected_ = true;
+    client->retry_count_ = 0;  // 重置重试计数器
+    client->metrics_.add(MqttMetrics::Connects);
+    if (client->connect_started_ns_ != 0) {
+      client->metrics_.connect_latency.record(mqttMonotonicNs() - client->connect_started_ns_);
+      client->connect_started_ns_ = 0;
+    }
+    client->reconnect_timer_->stop();
+    // 主题别名按连接分配，代理没有给出Topic Alias Maximum时不使用别名
+    uint16_t alias_max = 0;
+    mosquitto_property_read_int16(props, MQTT_PROP_TOPIC_ALIAS_MAXIMUM, &alias_max, false);
+    client->topic_alias_max_ = alias_max;
+    client->topic_aliases_used_ = 0;
+    ++client->connection_epoch_;
+    // CONNACK标志最低位表示代理保留了会话；clean session下总是0，全部重新订阅
+    const bool session_present = client->persistent_session_ && (flags & 0x01) != 0;
+    if (session_present) {
+      client->metrics_.add(MqttMetrics::SessionsResumed);
+    }
+    client->restoreSubscriptions(session_present);
+    // 先重发断线期间积压的消息
+    if (client->outbox_ && !client->outbox_->isEmpty()) {
+      client->replay_scheduled_.store(true, std::memory_order_release);
+      client->replay_timer_->start();
+    }
+    emit client->connected();
+    mqttInfo() << "Connected to broker at" << client->currentBroker();
+    return;
+  }
+
+  client->connected_ = false;
+  QString errMsg;
   switch (rc) {
-    case MOSQ_ERR_SUCCESS:
-      client->connected_ = true;
-      client->reconnect_timer_->stop();
-      emit client->connected();
-      qInfo() << "Connected to broker at" << client->host_ << ":" << client->port_;
-      break;
     case MOSQ_ERR_AUTH:  // 认证失败（5）
-      emit client->connectionFailed("认证失败：用户名或密码错误");
+      errMsg = "认证失败：用户名或密码错误";
       break;
     case MOSQ_ERR_CONN_REFUSED:  // 代理拒绝（4）
-      emit client->connectionFailed("连接被拒绝：协议版本或参数错误");
+      errMsg = "连接被拒绝：协议版本或参数错误";
       break;
     default:
-      client->connected_ = false;
-      QString errMsg = mosquitto_strerror(rc);
-      qCritical() << "Connection failed:" << errMsg;
-      emit client->connectionFailed(errMsg);
-      client->reconnect_timer_->start();
-  }
-
-  if (rc == MOSQ_ERR_SUCCESS) {
-  } else {
-    client->connected_ = false;
-    QString errMsg = mosquitto_strerror(rc);
-    qCritical() << "Connection failed:" << errMsg;
-    emit client->connectionFailed(errMsg);
-    client->reconnect_timer_->start();
+      errMsg = mosquitto_strerror(rc);
   }
+  mqttError() << "Connection failed:" << errMsg;
+  emit client->connectionFailed(errMsg);
+  // 代理随后关闭连接时onDisconnect不再重复报告
+  client->scheduleReconnect();
 }
 
 void MqttClient::onDisconnect(mosquitto *mosq, void *obj, int rc) {
   MqttClient *client = static_cast<MqttClient *>(obj);
+  const bool was_connected = client->connected_;
+  const bool requested = client->disconnect_requested_;
   client->connected_ = false;
+  client->disconnect_requested_ = false;
+  client->connect_timer_->stop();
+  client->metrics_.add(MqttMetrics::Disconnects);
+  // 套接字已被关闭，移除通知器
+  client->detachSocket();
+  client->replay_timer_->stop();
+  client->replay_scheduled_.store(false, std::memory_order_release);
+  // 未写出的QoS0消息不会再发送；QoS1/2消息重连后由libmosquitto重发
+  client->failPendingPublishes(MOSQ_ERR_CONN_LOST, true);
+  client->early_qos0_ack_ = 0;
+  // 故障转移耗时从断线时刻算起
+  if (was_connected && client->connect_started_ns_ == 0) {
+    client->connect_started_ns_ = mqttMonotonicNs();
+  }
 
-  if (rc == MOSQ_ERR_SUCCESS) {
-    qInfo() << "Gracefully disconnected";
-    emit client->disconnected();
+  if (rc == MOSQ_ERR_SUCCESS || requested) {
+    // 主动断开时connected_已被disconnectFromBroker()清除；其余未连接的情况只可能是onConnectTimeout()中止握手，
+    // 由其负责通知和重连
+    if (was_connected || requested) {
+      mqttInfo() << "Gracefully disconnected";
+      emit client->disconnected();
+    }
   } else if (rc == MOSQ_ERR_KEEPALIVE) {
-    qWarning() << "心跳超时,连接已断开";
-  } else {
-    qWarning() << "Unexpected disconnection:" << mosquitto_strerror(rc);
+    mqttWarning() << "心跳超时,连接已断开";
+    client->scheduleReconnect();
+  } else if (!client->reconnect_timer_->isActive()) {
+    mqttWarning() << "Unexpected disconnection:" << mosquitto_strerror(rc);
     emit client->connectionFailed(mosquitto_strerror(rc));
-    client->reconnect_timer_->start();
+    client->scheduleReconnect();
   }
 }
 
 void MqttClient::onMessage(mosquitto *mosq, void *obj, const mosquitto_message *msg) {
   MqttClient *client = static_cast<MqttClient *>(obj);
 
-  // 构造消息参数（注意线程安全）
-  QString topic = QString::fromUtf8(msg->topic);
-  QByteArray payload(static_cast<char *>(msg->payload), msg->payloadlen);
+  // v3.1.1模式下代理会回传自身消息，按客户端ID前缀丢弃
+  if (client->protocol_version_.load(std::memory_order_relaxed) == MQTTv311 &&
+      msg->payloadlen >= client->payload_prefix_.size() &&
+      memcmp(msg->payload, client->payload_prefix_.constData(), client->payload_prefix_.size()) == 0) {
+    client->metrics_.add(MqttMetrics::EchoFiltered);
+    return;
+  }
+  client->metrics_.add(MqttMetrics::MessagesIn);
+  client->metrics_.add(MqttMetrics::BytesIn, msg->payloadlen);
+  if (client->capture_.isOpen()) {
+    client->capture_.append(msg->topic, msg->payload, msg->payloadlen, msg->qos, msg->retain);
+  }
+  if (client->fanout_.isOpen()) {
+    client->fanout_.append(msg->topic, msg->payload, msg->payloadlen, msg->qos, msg->retain);
+  }
 
-  // 通过信号传递到主线程
-  emit client->messageReceived(topic, payload, msg->qos, msg->retain);
+  bool has_subscriptions = !client->subscriptions_.isEmpty();
+  if (client->delivery_mode_ == PerMessage && !has_subscriptions && !client->worker_pool_) {
+    // 构造消息参数（注意线程安全）
+    int topic_id;
+    QString topic = client->internTopic(msg->topic, &topic_id);
+    QByteArray payload(static_cast<char *>(msg->payload), msg->payloadlen);
+    if (client->retained_cache_ && msg->retain) {
+      client->retained_cache_->update(topic, payload, msg->qos, msg->retain, QDateTime::currentMSecsSinceEpoch());
+    }
+
+    // 通过信号传递到主线程
+    emit client->messageReceived(topic, payload, msg->qos, msg->retain);
+    return;
+  }
+
+  // 负载写入内存池，主题复用驻留字符串
+  MqttMessage message;
+  message.topic = client->internTopic(msg->topic, &message.topic_id);
+  message.payload =
+      client->payload_arena_.allocate(static_cast<const char *>(msg->payload), msg->payloadlen, &message.slab);
+  message.qos = msg->qos;
+  message.retain = msg->retain;
+  message.timestamp = QDateTime::currentMSecsSinceEpoch();
+  message.received_ns = mqttMonotonicNs();
+
+  // 只缓存保留消息；先与缓存的值比较，值未变化时不拷贝负载
+  if (client->retained_cache_ && message.retain) {
+    message.unchanged = !client->retained_cache_->update(message.topic, message.payload.constData(),
+                                                         message.payload.size(), message.qos, message.retain,
+                                                         message.timestamp);
+  }
+
+  // 按订阅过滤器分发给对应的句柄
+  if (has_subscriptions) {
+    client->dispatch(msg->topic, message);
+  }
+
+  if (client->worker_pool_) {
+    client->worker_pool_->submit(message);
+  }
+
+  if (client->delivery_mode_ == Conflated && client->conflator_) {
+    client->conflator_->push(message);
+    return;
+  }
+
+  if (client->delivery_mode_ == PerMessage) {
+    emit client->messageReceived(message.topic, message.payloadCopy(), message.qos, message.retain);
+    return;
+  }
+
+  // 在本次套接字读取结束后统一投递
+  client->inbound_batch_.append(message);
+}
+
+void MqttClient::onPublish(mosquitto *mosq, void *obj, int mid) {
+  MqttClient *client = static_cast<MqttClient *>(obj);
+
+  QHash<int, MqttPublishToken>::iterator it = client->inflight_.find(mid);
+  if (it == client->inflight_.end()) {
+    // 重连后libmosquitto重发的旧消息等不在窗口中的确认不记录，避免消息ID回绕后误完成新的发布
+    if (client->publishing_qos0_) {
+      client->early_qos0_ack_ = mid;
+    }
+    return;
+  }
+  MqttPublishToken token = it.value();
+  client->inflight_.erase(it);
+  client->finishPublish(token, MqttPublishToken::Completed, MOSQ_ERR_SUCCESS);
+}
+
+void MqttClient::onSubscribe(mosquitto *mosq, void *obj, int mid, int qos_count, const int *granted_qos) {
+  MqttClient *client = static_cast<MqttClient *>(obj);
+  const QStringList filters = client->pending_subacks_.take(mid);
+  RetainedCache *cache = client->retained_cache_;
+  for (int i = 0; i < filters.size() && i < qos_count; ++i) {
+    const QString &filter = filters.at(i);
+    // 被拒绝的订阅保留在未确认集合中，下次连接时重试
+    if (granted_qos[i] >= 0x80) {
+      mqttWarning() << "Broker rejected subscription to" << filter;
+      continue;
+    }
+    client->unsynced_filters_.remove(filter);
+
+    // 代理在确认订阅后推送保留消息，留出时间后清除仍未被确认的快照条目；共享订阅不会收到保留消息
+    if (!cache || TopicTrie::isSharedFilter(filter.toUtf8())) {
+      continue;
+    }
+    QTimer::singleShot(kRetainedReconcileDelayMs, client, [cache, filter]() {
+      int removed = cache->removeStale(filter);
+      if (removed > 0) {
+        mqttInfo() << "Removed" << removed << "stale cached topics under" << filter;
+      }
+    });
+  }
 }
 
 void MqttClient::onLog(mosquitto *mosq, void *obj, int level, const char *str) {
   Q_UNUSED(obj)
-  // 根据日志级别输出不同信息
+  // 文本已由libmosquitto格式化，直接复制进日志缓冲区
+  MqttLog::Level log_level = MqttLog::Debug;
   switch (level) {
-    case MOSQ_LOG_DEBUG:
-      qDebug() << "[MQTT Debug]" << str;
-      break;
     case MOSQ_LOG_INFO:
-      qInfo() << "[MQTT Info]" << str;
-      break;
     case MOSQ_LOG_NOTICE:
-      qInfo() << "[MQTT Notice]" << str;
+      log_level = MqttLog::Info;
       break;
     case MOSQ_LOG_WARNING:
-      qWarning() << "[MQTT Warning]" << str;
+      log_level = MqttLog::Warning;
       break;
     case MOSQ_LOG_ERR:
-      qCritical() << "[MQTT Error]" << str;
+      log_level = MqttLog::Error;
       break;
     default:
-      qDebug() << "[MQTT Unknown]" << str;
+      break;
+  }
+  if (MqttLog::isEnabled(log_level)) {
+    MqttLog::write(log_level, str, static_cast<int>(strlen(str)));
+  }
+}
+
+QString MqttClient::internTopic(const char *topic, int *topic_id) {
+  const int table_size = topic_table_.size();
+  // 使用fromRawData查找，命中时不产生任何内存分配
+  const QByteArray key = QByteArray::fromRawData(topic, static_cast<int>(qstrlen(topic)));
+  QHash<QByteArray, InternedTopic>::iterator it = topic_cache_.find(key);
+  if (it != topic_cache_.end()) {
+    // 驻留时未注册的主题在主题表增长后只重新查找这一个主题，不影响其他已驻留的主题
+    if (it.value().id < 0 && it.value().table_size != table_size) {
+      const MqttTopic registered = topic_table_.find(key);
+      if (registered.isValid()) {
+        it.value().name = registered.name();
+        it.value().id = registered.id();
+      }
+      it.value().table_size = table_size;
+    }
+    *topic_id = it.value().id;
+    return it.value().name;
+  }
+
+  if (topic_cache_.size() >= kMaxInternedTopics) {
+    topic_cache_.clear();
+  }
+  InternedTopic interned;
+  const MqttTopic registered = table_size > 0 ? topic_table_.find(key) : MqttTopic();
+  interned.name = registered.isValid() ? registered.name() : QString::fromUtf8(key);
+  interned.id = registered.id();
+  interned.table_size = table_size;
+  topic_cache_.insert(QByteArray(key.constData(), key.size()), interned);
+  *topic_id = interned.id;
+  return interned.name;
+}
+
+void MqttClient::flushInbound() {
+  if (inbound_batch_.isEmpty()) {
+    return;
   }
+
+  MqttMessageBatch batch;
+  batch.swap(inbound_batch_);
+  delivery_pending_.fetch_add(batch.size(), std::memory_order_relaxed);
+  emit messagesReceived(batch);
 }
 
 void MqttClient::handleReconnect() {
-  if (++retry_count_ > max_retry_) {
-    qCritical() << "Max reconnect attempts reached";
+  if (blocking_connect_) {
+    // 上一次持久会话连接尚未返回，实例仍被占用
+    scheduleReconnect();
+    return;
+  }
+  if (++retry_count_ > max_retry_ && max_retry_ > 0) {
+    mqttError() << "Max reconnect attempts reached";
     emit connectionFailed(tr("Max retry attempts (%1) exceeded").arg(max_retry_));
     return;
   }
 
-  qInfo() << "Attempting reconnect (" << retry_count_ << "/" << max_retry_ << ")";
-  connectToBroker(host_, port_, keepalive_, max_retry_);
+  metrics_.add(MqttMetrics::ReconnectAttempts);
+  if (max_retry_ > 0) {
+    mqttInfo() << "Attempting reconnect (" << retry_count_ << "/" << max_retry_ << ")";
+  } else {
+    mqttInfo() << "Attempting reconnect (" << retry_count_ << ")";
+  }
+  if (connect_started_ns_ == 0) {
+    connect_started_ns_ = mqttMonotonicNs();
+  }
+
+  if (retry_count_ > 1 || endpoint_index_ < 0) {
+    // 原地址重连失败，从下一个代理开始重新竞速（单个代理时重新解析并竞速其全部地址）
+    startRace(endpoint_index_ + 1);
+    return;
+  }
+
+  // 第一次重连直接使用上次连通的地址，不做DNS解析和竞速
+  detachSocket();
+  int rc = mosquitto_reconnect_async(mosq_);
+  if (rc != MOSQ_ERR_SUCCESS || !attachSocket()) {
+    mqttWarning() << "Reconnect to" << currentBroker() << "failed:" << mosquitto_strerror(rc);
+    scheduleReconnect();
+    return;
+  }
+  connect_timer_->start();
+}
+
+void MqttClient::onRaceSucceeded(int endpoint, const QHostAddress &address) {
+  cancelRace();
+  endpoint_index_ = (race_first_ + endpoint) % endpoints_.size();
+  mqttInfo() << "Broker" << currentBroker() << "reachable at" << address.toString();
+  startConnect(address);
+}
+
+void MqttClient::onRaceFailed(const QString &reason) {
+  cancelRace();
+  mqttWarning() << "No reachable broker:" << reason;
+  emit connectionFailed(reason);
+  scheduleReconnect();
+}
+
+void MqttClient::onConnectTimeout() {
+  mqttWarning() << "Timed out waiting for CONNACK from" << currentBroker();
+  // 关闭未完成握手的连接，不再等下次连接时才释放套接字；写出DISCONNECT后onDisconnect()会同步回调
+  mosquitto_disconnect(mosq_);
+  detachSocket();
+  emit connectionFailed(tr("Connection to %1 timed out").arg(currentBroker()));
+  scheduleReconnect();
+}
+
+void MqttClient::onBlockingConnectFinished() {
+  const int rc = blocking_connect_->result();
+  blocking_connect_->wait();
+  delete blocking_connect_;
+  blocking_connect_ = nullptr;
+  if (blocking_connect_aborted_) {
+    // 等待期间已调用disconnectFromBroker()
+    if (rc == MOSQ_ERR_SUCCESS) {
+      mosquitto_disconnect(mosq_);
+    }
+    return;
+  }
+  finishConnect(rc);
 }
@@ -3,18 +3,65 @@
 
 #include <mosquitto.h>
 
+#include <QHash>
 #include <QMutex>
 #include <QObject>
+#include <QSet>
+#include <QSocketNotifier>
+#include <QStringList>
 #include <QTimer>
+#include <atomic>
+
+#include "MqttCapture.h"
+#include "MqttCodec.h"
+#include "MqttConflator.h"
+#include "MqttConnectRace.h"
+#include "MqttFanout.h"
+#include "MqttMessage.h"
+#include "MqttMetrics.h"
+#include "MqttOutbox.h"
+#include "MqttPublishToken.h"
+#include "MqttWorkerPool.h"
+#include "MqttSubscription.h"
+#include "MqttTopic.h"
+#include "PayloadArena.h"
+#include "PublishQueue.h"
+#include "RetainedCache.h"
+#include "TopicTrie.h"
+
+struct ssl_ctx_st;
+struct ssl_session_st;
+struct ssl_st;
 
 /*!
  * \brief MQTT客户端类，封装Mosquitto C API，用于管理和操作MQTT连接。
  * 实现了与MQTT代理的连接、断开连接、消息发布和订阅等功能，并提供了相应的信号以便与其他组件交互。
+ * 网络读写由客户端所在线程的事件循环通过QSocketNotifier驱动，所有Mosquitto回调都在该线程中执行，
+ * 不会额外创建网络线程。
  */
 
 class MqttClient : public QObject {
   Q_OBJECT
  public:
+  /*!
+   * \brief 入站消息投递模式
+   */
+  enum DeliveryMode {
+    PerMessage,  // 逐条投递：每条消息发出一次messageReceived信号（兼容模式）
+    Batched,     // 批量投递：负载写入内存池、主题驻留，按批次发出messagesReceived信号
+    Conflated    // 合并投递：与批量模式相同，但消息写入enableConflation()创建的合并队列，不发出任何消息信号
+  };
+  Q_ENUM(DeliveryMode)
+
+  /*!
+   * \brief MQTT协议版本
+   */
+  enum ProtocolVersion {
+    MQTTv311,  // MQTT v3.1.1：发布时加客户端ID前缀，接收时按前缀过滤自身消息
+    MQTTv5     // MQTT v5：订阅时设置no_local，由代理丢弃自身消息，负载原样传输
+  };
+  Q_ENUM(ProtocolVersion)
+
   /*!
    * \brief 构造函数
    * \param parent 父对象，用于Qt的对象树管理
@@ -29,38 +76,296 @@ class MqttClient : public QObject {
 
   /*!
    * \brief 连接到MQTT代理
-   * \param host MQTT代理的主机地址
-   * \param port MQTT代理的端口号，默认为1883（非加密端口）
+   * 在其他线程调用时会转发到客户端所在线程执行。连接是异步的，结果通过connected或connectionFailed信号通知。
+   * \param host MQTT代理的主机地址，可以是逗号分隔的多个"host[:port]"，按顺序故障转移
+   * \param port MQTT代理的端口号，默认为1883（非加密端口），用于未指定端口的地址
    * \param keepalive 保持连接的时间间隔，默认为60秒
-   * \param max_retry 最大重试次数，默认为3次
+   * \param max_retry 最大重试次数，默认为3次；小于等于0时无限重试（退避间隔不超过setReconnectBackoff()的上限）
    * \param username 可选的用户名，用于认证
    * \param password 可选的密码，用于认证
-   * \return 连接是否成功
+   * \return 参数是否有效，在调用方线程检查；无效时同时发出connectionFailed信号
    */
-  bool connectToBroker(const QString &host, int port = 1883, int keepalive = 60, int max_retry = 3,
-                       const QString &username = "", const QString &password = "");
+  Q_INVOKABLE bool connectToBroker(const QString &host, int port = 1883, int keepalive = 60, int max_retry = 3,
+                                   const QString &username = "", const QString &password = "");
+
+  /*!
+   * \brief 连接到一组MQTT代理中的任意一个
+   * 主机名经DnsCache异步解析，各代理按Happy Eyeballs方式竞速，列表靠前的代理优先；
+   * 连接断开后先重连原地址，失败后从下一个代理开始重新竞速。
+   * 在其他线程调用时会转发到客户端所在线程执行。
+   * \param endpoints 按优先级排列的"host[:port]"，未指定端口时使用1883
+   * \param keepalive 保持连接的时间间隔（秒）
+   * \param max_retry 最大重试次数，连接成功后清零；小于等于0时无限重试
+   * \return 参数是否有效，在调用方线程检查；无效时同时发出connectionFailed信号
+   */
+  Q_INVOKABLE bool connectToBrokers(const QStringList &endpoints, int keepalive = 60, int max_retry = 3);
+
+  /*!
+   * \brief 设置重连退避时间
+   * 第n次重连前等待min_ms * 2^n（不超过max_ms），并在其一半到全部之间随机抖动。
+   * \param min_ms 初始等待时间（毫秒）
+   * \param max_ms 最长等待时间（毫秒）
+   */
+  void setReconnectBackoff(int min_ms, int max_ms);
+
+  /*!
+   * \brief 当前连接（或正在连接）的代理，未连接过时为空。只能在客户端线程调用。
+   */
+  QString currentBroker() const;
 
   /*!
    * \brief 从MQTT代理断开连接
-   * 清理资源并停止网络循环。
+   * 清理资源并停止网络循环。已连接时发出disconnected信号。
    */
   void disconnectFromBroker();
 
   /*!
    * \brief 订阅指定主题
+   * 在其他线程调用时会转发到客户端所在线程执行。订阅记录在客户端中，未连接时在连接成功后订阅，
+   * 重连后代理没有保留会话时自动恢复，调用方不需要在connected信号中重新订阅。
    * \param topic 要订阅的主题
    * \param qos 订阅的消息质量等级，默认为0
    */
-  void subscribe(const QString &topic, int qos = 0);
+  Q_INVOKABLE void subscribe(const QString &topic, int qos = 0);
+
+  /*!
+   * \brief 订阅主题过滤器并返回订阅句柄
+   * 支持'+'和'#'通配符。消息按主题前缀树分发，只投递给过滤器匹配的句柄，
+   * 分发代价与主题层级数成正比，与订阅数量无关。可在任意线程调用。
+   * 未连接时先注册句柄，连接成功（包括重连）后自动向代理订阅。
+   * 支持共享订阅过滤器$share/<group>/<filter>，按<filter>匹配主题。
+   * \param filter 主题过滤器
+   * \param qos 订阅的消息质量等级
+   * \param handler 可选的消息处理函数，在客户端线程中调用
+   * \return 订阅句柄，过滤器不合法时返回nullptr
+   */
+  MqttSubscription *subscribe(const QString &filter, int qos, const MqttSubscription::Handler &handler);
+
+  /*!
+   * \brief 取消订阅指定主题
+   * 在其他线程调用时会转发到客户端所在线程执行。持久会话下断线期间的取消在重连后通知代理。
+   * \param topic 要取消订阅的主题
+   */
+  Q_INVOKABLE void unsubscribe(const QString &topic);
+
+  /*!
+   * \brief 释放订阅句柄
+   * 同一过滤器的最后一个句柄释放后才向代理取消订阅。可在任意线程调用。
+   * \param subscription subscribe()返回的订阅句柄
+   */
+  void unsubscribe(MqttSubscription *subscription);
 
   /*!
    * \brief 发布消息到指定主题
+   * 可在任意线程调用：其他线程的调用进入无锁发布队列，由客户端线程批量发送。
+   * 发布窗口已满时消息被拒绝，返回状态为Rejected的凭据。
    * \param topic 消息要发布到的主题
    * \param payload 消息内容
    * \param qos 发布的消息质量等级，默认为0
    * \param retain 是否将消息设置为保留消息，默认为false
+   * \return 发布凭据，可查询确认结果及确认耗时
+   */
+  MqttPublishToken publish(const QString &topic, const QByteArray &payload, int qos = 0, bool retain = false);
+
+  /*!
+   * \brief 使用已编码的主题发布消息
+   * 与publish()相同，但主题已是UTF-8字节，调用方可缓存编码结果，避免每次发布都转换主题。
+   * \param topic UTF-8编码的主题
+   * \param payload 消息内容
+   * \param qos 发布的消息质量等级，默认为0
+   * \param retain 是否将消息设置为保留消息，默认为false
+   * \return 发布凭据
+   */
+  MqttPublishToken publishEncoded(const QByteArray &topic, const QByteArray &payload, int qos = 0,
+                                  bool retain = false);
+
+  /*!
+   * \brief 注册主题并返回主题句柄
+   * 句柄保存预先编码的UTF-8主题，发布时不再转换；收到该主题的消息时MqttMessage::topic_id等于句柄的id()，
+   * 接收方可直接比较整数。句柄只能用于创建它的客户端。可在任意线程调用。
+   * \param name 主题
+   * \return 主题句柄，主题为空时返回无效句柄
+   */
+  MqttTopic topic(const QString &name);
+
+  /*!
+   * \brief 使用主题句柄发布消息
+   * 与publish()相同，但不转换主题。v5模式下QoS0发布达到一定次数的主题在代理允许的数量内
+   * 自动分配主题别名：第一条报文同时携带主题和别名，之后的报文只携带2字节的别名。
+   * QoS1/2消息断线后由libmosquitto按原报文在新连接上重发，而别名只在一个连接内有效，因此不使用别名。
+   * \param topic 本客户端topic()返回的句柄，无效句柄或其他客户端的句柄直接以Failed结束
+   * \param payload 消息内容
+   * \param qos 发布的消息质量等级，默认为0
+   * \param retain 是否将消息设置为保留消息，默认为false
+   * \return 发布凭据
+   */
+  MqttPublishToken publishTopic(const MqttTopic &topic, const QByteArray &payload, int qos = 0, bool retain = false);
+
+  /*!
+   * \brief 设置发布窗口大小
+   * 同时通过mosquitto_max_inflight_messages_set设置libmosquitto的在途消息上限。
+   * 已发布但尚未确认的消息（含发布队列中的消息）达到上限后，新的发布会被拒绝，
+   * 直到窗口回落到一半以下并发出publishWindowAvailable信号。应在连接前设置。
+   * \param max_inflight 窗口大小，0表示不限制（默认）
+   */
+  void setMaxInflightMessages(int max_inflight);
+
+  /*!
+   * \brief 获取发布窗口大小
+   */
+  int maxInflightMessages() const;
+
+  /*!
+   * \brief 已发布但尚未确认的消息数量
+   */
+  int inflightCount() const;
+
+  /*!
+   * \brief 发布窗口是否还有空间
+   */
+  bool canPublish() const;
+
+  /*!
+   * \brief 启用离线发件箱
+   * 断线期间、发件箱尚有积压或发布窗口已满时，消息写入内存映射的分段日志，凭据状态为Spooled；
+   * 连接成功后按写入顺序、以setOutboxReplayRate()设定的速率重发，保留原有的QoS及保留标志。
+   * 应在连接前、moveToThread之前调用。
+   * \param dir 发件箱目录
+   * \param max_bytes 发件箱总大小上限，超出时丢弃最早的消息
+   * \param max_age_secs 消息最长保留时间（秒），超时的消息不再重发，0表示不限制
+   * \return 是否成功打开
+   */
+  bool enableOutbox(const QString &dir, qint64 max_bytes = 256 * 1024 * 1024, int max_age_secs = 24 * 3600);
+
+  /*!
+   * \brief 设置发件箱重发速率
+   * \param messages_per_second 每秒最多重发的消息数，默认为1000
+   */
+  void setOutboxReplayRate(int messages_per_second);
+
+  /*!
+   * \brief 发件箱中等待重发的消息数量
    */
-  void publish(const QString &topic, const QByteArray &payload, int qos = 0, bool retain = false);
+  qint64 outboxPendingCount() const;
+
+  /*!
+   * \brief 启用主题最新值缓存
+   * 收到的每条保留消息都会更新缓存；启动时加载快照，析构时写回。订阅确认后经过一段时间
+   * 仍未收到实时消息的快照条目会被清除。应在moveToThread之前调用。
+   * \param snapshot_path 快照文件路径，为空表示不读写快照
+   * \param max_bytes 缓存的内存预算
+   */
+  void enableRetainedCache(const QString &snapshot_path, qint64 max_bytes = 64 * 1024 * 1024);
+
+  /*!
+   * \brief 获取主题最新值缓存，未启用时返回nullptr。缓存本身线程安全。
+   */
+  RetainedCache *retainedCache() const;
+
+  /*!
+   * \brief 启用消息合并队列
+   * 只有投递模式为Conflated时入站消息才写入合并队列，此时不再发出messageReceived/messagesReceived信号，
+   * 接收方连接返回对象的messagesAvailable信号并调用take()取走消息；其他投递模式下队列不接收消息，
+   * 已连接消息信号的接收方不受影响。Conflated模式下未启用合并队列时按批量模式投递。
+   * 合并及限速规则通过返回对象的addRule()设置。应在moveToThread之前调用。
+   * \param max_queue 队列上限，超出时丢弃最早的消息
+   * \return 合并队列，由客户端持有
+   */
+  MqttConflator *enableConflation(int max_queue);
+
+  /*!
+   * \brief 获取消息合并队列，未启用时返回nullptr
+   */
+  MqttConflator *conflator() const;
+
+  /*!
+   * \brief 启用按主题分片的并行处理线程池
+   * 启用后每条入站消息都会额外提交给线程池，由handler在工作线程中处理：同一主题的消息
+   * 按到达顺序串行处理，不同主题的消息并行处理。原有的信号投递不受影响。
+   * handler必须是线程安全的，且不应访问属于其他线程的QObject。应在moveToThread之前调用。
+   * \param threads 工作线程数，不大于0时使用CPU核数
+   * \param handler 消息处理函数
+   * \return 线程池，由客户端持有
+   */
+  MqttWorkerPool *enableWorkerPool(int threads, const MqttWorkerPool::Handler &handler);
+
+  /*!
+   * \brief 获取并行处理线程池，未启用时返回nullptr
+   */
+  MqttWorkerPool *workerPool() const;
+
+  /*!
+   * \brief 开始录制入站流量
+   * 此后收到的每条消息（自身回传的消息除外）都追加到内存映射的录制文件中，可用MqttCaptureReader
+   * 读取或用mqtt_capture工具重放。已在录制时先结束之前的录制。
+   * 在其他线程调用时会阻塞转发到客户端所在线程执行，该线程必须已在运行。
+   * \param path 录制文件路径，已有的同名文件被覆盖
+   * \param max_bytes 文件大小上限，写满后的消息不再录制
+   * \return 是否成功创建文件
+   */
+  bool enableCapture(const QString &path, qint64 max_bytes = MqttCaptureWriter::kDefaultMaxBytes);
+
+  /*!
+   * \brief 结束录制，写入索引并关闭文件
+   * 在其他线程调用时会阻塞转发到客户端所在线程执行，该线程必须已在运行。
+   */
+  void stopCapture();
+
+  /*!
+   * \brief 启用本机消息分发
+   * 创建共享内存分发区，此后收到的每条消息（自身回传的消息除外）都写入其中，本机其他进程用
+   * MqttFanoutReader读取，从而共用本客户端的连接；这些进程提交的发布由relayFanoutPublishes()转发，
+   * 并按本客户端的订阅写回分发区，其他读者能收到，提交者自己不会收到，与各自直连代理时一致。
+   * 已启用时先关闭之前的分发区。在其他线程调用时会阻塞转发到客户端所在线程执行，该线程必须已在运行。
+   * \param path 共享内存文件路径，如/dev/shm/mqtt_fanout
+   * \param capacity 广播环字节数，读者落后超过该值时丢弃其未读的消息
+   * \param max_readers 读者进程数上限
+   * \return 是否成功创建
+   */
+  bool enableFanout(const QString &path, qint64 capacity = MqttFanoutWriter::kDefaultCapacity,
+                    int max_readers = MqttFanoutWriter::kDefaultMaxReaders);
+
+  /*!
+   * \brief 关闭并删除本机分发区
+   * 必须在不再调用relayFanoutPublishes()之后调用。在其他线程调用时会阻塞转发到客户端所在线程执行。
+   */
+  void stopFanout();
+
+  /*!
+   * \brief 把本机进程提交的发布转发到代理
+   * 没有待转发的消息时最多等待timeout_ms，同时定期释放已退出的读者进程占用的位置。
+   * 可在任意一个线程中循环调用（通常是守护进程的主线程），同一时刻只能有一个线程调用。
+   * \param timeout_ms 等待超时（毫秒）
+   * \return 转发的消息数，未启用分发时返回0
+   */
+  int relayFanoutPublishes(int timeout_ms);
+
+  /*!
+   * \brief 获取运行指标快照（线程安全）
+   */
+  MqttStats stats() const;
+
+  /*!
+   * \brief 设置statsUpdated信号的发送周期
+   * 在其他线程调用时会转发到客户端所在线程执行。
+   * \param msecs 周期（毫秒），0表示停止（默认）
+   */
+  void setStatsInterval(int msecs);
+
+  /*!
+   * \brief 设置Prometheus文本格式的指标文件
+   * 每个统计周期结束时整体替换文件内容，可供node_exporter的textfile收集器读取。
+   * 应在moveToThread之前调用。
+   * \param path 文件路径，为空表示不输出（默认）
+   */
+  void setMetricsFile(const QString &path);
+
+  /*!
+   * \brief 确认已处理一批消息
+   * 批量投递模式下由messagesReceived信号的接收方在槽函数中调用，用于统计投递延迟及线程间积压。线程安全。
+   * \param batch 收到的消息批次
+   */
+  void acknowledgeDelivery(const MqttMessageBatch &batch);
 
   /*!
    * \brief 获取客户端ID
@@ -81,14 +386,98 @@ class MqttClient : public QObject {
    */
   void setCredentials(const QString &username, const QString &password);
 
+  /*!
+   * \brief 启用持久会话
+   * 使用固定的客户端ID并关闭clean session（v5模式下设置会话过期时间），代理在断线期间保留本客户端的
+   * 订阅和发给它的QoS1/2消息，重连后直接继续投递。代理报告会话仍在时不重新订阅，只同步断线期间的
+   * 订阅变更；会话已不在时把全部订阅合并为一次批量SUBSCRIBE恢复。
+   * 会重建libmosquitto实例，必须在连接前、启用TLS之前调用，已设置的协议版本、凭据和发布窗口会保留。
+   * libmosquitto只能通过阻塞的connect发送CONNECT属性，该调用在独立线程中执行，不阻塞客户端线程。
+   * \param client_id 客户端ID，同一时刻只能有一个连接使用
+   * \param session_expiry_secs 断线后代理保留会话的时间（秒），仅v5模式有效，v3.1.1由代理配置决定
+   * \return 是否设置成功
+   */
+  bool setPersistentSession(const QString &client_id, int session_expiry_secs = 3600);
+
   /*!
    * \brief 启用SSL/TLS加密
+   * 默认复用TLS会话，见setTlsSessionResumption()。
    * \param caFile CA证书文件路径
    * \param certFile 客户端证书文件路径（可选）
    * \param keyFile 客户端密钥文件路径（可选）
    */
   void enableSSL(const QString &caFile, const QString &certFile = "", const QString &keyFile = "");
-  void startHearbeat(int interval);
+
+  /*!
+   * \brief 以预共享密钥（PSK）方式启用TLS
+   * 不需要证书，握手中没有证书传输和签名验证，适合资源受限的设备。与enableSSL()互斥，应在连接前调用。
+   * \param identity PSK身份
+   * \param key_hex 十六进制编码的密钥
+   * \param ciphers 可选的密码套件列表（OpenSSL格式），为空时使用默认的PSK套件
+   * \return 是否设置成功
+   */
+  bool enableTlsPsk(const QString &identity, const QString &key_hex, const QString &ciphers = "");
+
+  /*!
+   * \brief 固定TLS参数，应在连接前调用
+   * \param verify_peer 是否验证代理证书，PSK模式下无效
+   * \param version TLS版本（tlsv1.2或tlsv1.3），为空表示使用libmosquitto的默认值
+   * \param ciphers TLS 1.2密码套件列表（OpenSSL格式），为空表示默认
+   * \return 是否设置成功
+   */
+  bool setTlsOptions(bool verify_peer, const QString &version = "", const QString &ciphers = "");
+
+  /*!
+   * \brief 设置是否复用TLS会话
+   * 启用时保存握手得到的会话（TLS 1.2的会话ID或票据、TLS 1.3的会话票据），重连同一代理时在ClientHello中
+   * 携带，代理接受后省去证书交换、验证和大部分密钥交换计算；代理拒绝时自动进行完整握手。
+   * 会话只保存在本对象中，切换到其他代理时不使用。默认启用。
+   */
+  void setTlsSessionResumption(bool enabled);
+
+  /*!
+   * \brief 设置入站消息投递模式
+   * 应在连接前设置；批量模式下只发出messagesReceived信号，合并模式下不发出消息信号（见enableConflation()）。
+   * \param mode 投递模式，默认为PerMessage
+   */
+  void setDeliveryMode(DeliveryMode mode);
+
+  /*!
+   * \brief 获取入站消息投递模式
+   */
+  DeliveryMode deliveryMode() const;
+
+  /*!
+   * \brief 设置MQTT协议版本
+   * 必须在连接前设置；代理不支持v5时自动回退到v3.1.1。
+   * \param version 协议版本，默认为MQTTv311
+   */
+  void setProtocolVersion(ProtocolVersion version);
+
+  /*!
+   * \brief 获取当前使用的MQTT协议版本
+   */
+  ProtocolVersion protocolVersion() const;
+
+  /*!
+   * \brief 设置v5模式下是否在发布的消息中携带客户端ID
+   * 开启后每条消息附带用户属性client-id，接收方可据此识别来源；v3.1.1模式下无效。
+   * \param enabled 是否携带，默认为false
+   */
+  void setPublishIdentity(bool enabled);
+
+  /*!
+   * \brief 为主题匹配过滤器的发布设置负载编码（仅v5模式）
+   * 负载不小于min_bytes时在调用publish()的线程中编码，编码后不比原负载小时原样发送。
+   * 编码类型记录在负载开头的头部中，离线发件箱和重放都会保留，接收方调用MqttMessage::body()
+   * 或MqttCodec::decode()时才解码。v3.1.1模式下负载带客户端ID前缀，接收方无法识别头部，不做编码。
+   * 按设置顺序使用第一条匹配的规则，同一过滤器再次设置时替换原规则。应在发布前设置。
+   * \param filter 主题过滤器，支持'+'和'#'
+   * \param type 编码类型，Identity表示该过滤器下的主题不编码
+   * \param min_bytes 需要编码的最小负载字节数
+   * \return 过滤器是否合法
+   */
+  bool setPayloadCodec(const QString &filter, MqttCodec::Type type, int min_bytes = 1024);
 
  signals:
   /*!
@@ -115,24 +504,122 @@ class MqttClient : public QObject {
    */
   void messageReceived(const QString &topic, const QByteArray &payload, int qos, bool retain);
 
+  /*!
+   * \brief 批量消息接收信号
+   * 批量投递模式下发出，一个信号携带自上次投递以来到达的全部消息，
+   * 跨线程时每个批次只产生一次队列事件。
+   * \param batch 消息批次
+   */
+  void messagesReceived(const MqttMessageBatch &batch);
+
+  /*!
+   * \brief 周期性的运行指标信号，周期由setStatsInterval()设置
+   * \param stats 指标快照
+   */
+  void statsUpdated(const MqttStats &stats);
+
+  /*!
+   * \brief 消息确认信号
+   * QoS0消息写出、QoS1收到PUBACK、QoS2收到PUBCOMP时发出。
+   * \param mid 消息ID
+   * \param latency_us 从调用publish()到确认的耗时（微秒）
+   */
+  void messageAcknowledged(int mid, qint64 latency_us);
+
+  /*!
+   * \brief 发布窗口恢复信号
+   * 有发布因窗口已满被拒绝后，窗口回落到一半以下时发出，生产者可据此恢复发布。
+   */
+  void publishWindowAvailable();
+
  private:
+  /*!
+   * \brief 负载编码规则
+   */
+  struct CodecRule {
+    QByteArray filter;     // 主题过滤器
+    MqttCodec::Type type;  // 编码类型
+    int min_bytes;         // 需要编码的最小负载字节数
+  };
+
+  /*!
+   * \brief 驻留的入站主题
+   */
+  struct InternedTopic {
+    QString name;    // 主题字符串
+    int id;          // 主题表中的序号，未注册为-1
+    int table_size;  // 查找主题表时主题表的大小，未注册的主题在主题表增长后重新查找
+  };
+
+  /*!
+   * \brief 转发后待写回本机分发区的发布
+   */
+  struct FanoutEcho {
+    QByteArray topic;    // UTF-8编码的主题
+    QByteArray payload;  // 消息内容
+    int qos;             // 发布的QoS
+    int origin;          // 提交发布的读者位置
+  };
+
+  class BlockingConnect;
+
   /*!
    * \brief 设置Mosquitto的回调函数
    */
   void setupCallbacks();
 
+  /*!
+   * \brief 按当前日志级别安装或移除libmosquitto日志回调，每次连接前调用
+   */
+  void updateLogCallback();
+
   /*!
    * \brief 清理资源
    */
   void cleanup();
 
+  /*!
+   * \brief 创建本客户端专用的SSL_CTX交给libmosquitto，用于保存和复用TLS会话
+   * libmosquitto在每次连接时仍把CA、证书、PSK和TLS参数应用到该SSL_CTX上。
+   */
+  void setupTlsContext();
+
+  /*!
+   * \brief OpenSSL新会话回调，保存可复用的会话
+   * \return 1表示接管会话的引用
+   */
+  static int onTlsNewSession(struct ssl_st *ssl, struct ssl_session_st *session);
+
+  /*!
+   * \brief OpenSSL握手状态回调，握手开始时设置要复用的会话，完成时记录耗时
+   */
+  static void onTlsInfo(const struct ssl_st *ssl, int where, int ret);
+
+  /*!
+   * \brief 为当前连接的套接字创建读写通知器并启动维护定时器
+   * \return 套接字是否有效
+   */
+  bool attachSocket();
+
+  /*!
+   * \brief 移除套接字通知器并停止维护定时器
+   */
+  void detachSocket();
+
+  /*!
+   * \brief 根据是否有待发送数据启用或禁用写通知器
+   */
+  void updateWriteNotifier();
+
   /*!
    * \brief 连接回调函数
    * \param mosq Mosquitto实例指针
    * \param obj 用户数据指针
    * \param rc 连接结果代码
+   * \param flags CONNACK标志，最低位为会话是否存在
+   * \param props CONNACK属性（仅v5）
    */
-  static void onConnect(struct mosquitto *mosq, void *obj, int rc);
+  static void onConnect(struct mosquitto *mosq, void *obj, int rc, int flags, const mosquitto_property *props);
 
   /*!
    * \brief 断开连接回调函数
@@ -150,6 +637,24 @@ class MqttClient : public QObject {
    */
   static void onMessage(struct mosquitto *mosq, void *obj, const struct mosquitto_message *msg);
 
+  /*!
+   * \brief 发布完成回调函数
+   * \param mosq Mosquitto实例指针
+   * \param obj 用户数据指针
+   * \param mid 消息ID
+   */
+  static void onPublish(struct mosquitto *mosq, void *obj, int mid);
+
+  /*!
+   * \brief 订阅确认回调函数
+   * \param mosq Mosquitto实例指针
+   * \param obj 用户数据指针
+   * \param mid 订阅请求的消息ID
+   * \param qos_count 授予的QoS数量
+   * \param granted_qos 授予的QoS列表
+   */
+  static void onSubscribe(struct mosquitto *mosq, void *obj, int mid, int qos_count, const int *granted_qos);
+
   /*!
    * \brief 日志回调函数
    * \param mosq Mosquitto实例指针
@@ -159,26 +664,294 @@ class MqttClient : public QObject {
    */
   static void onLog(struct mosquitto *mosq, void *obj, int level, const char *str);
 
+  /*!
+   * \brief 获取驻留后的主题字符串
+   * 相同主题共享同一份QString数据，只在首次出现时进行UTF-8解码；经topic()注册的主题直接使用主题表中的字符串。
+   * \param topic 以'\0'结尾的UTF-8主题
+   * \param topic_id 输出参数，主题表中的序号，未注册时为-1
+   */
+  QString internTopic(const char *topic, int *topic_id);
+
+  /*!
+   * \brief 注册订阅句柄（客户端线程）
+   */
+  void addSubscription(MqttSubscription *subscription);
+
+  /*!
+   * \brief 移除订阅句柄（客户端线程）
+   */
+  void removeSubscription(MqttSubscription *subscription);
+
+  /*!
+   * \brief 连接成功后向代理恢复订阅（客户端线程）
+   * \param session_present 代理是否保留了会话，保留时只发送断线期间的订阅变更
+   */
+  void restoreSubscriptions(bool session_present);
+
+  /*!
+   * \brief 用一个SUBSCRIBE报文订阅一组QoS和订阅选项相同的过滤器
+   */
+  void sendSubscribe(const QStringList &filters, int qos);
+
+  /*!
+   * \brief 把转发的本机发布写回分发区，只写入匹配本客户端订阅的发布（客户端线程）
+   */
+  void echoFanoutPublishes(const QVector<FanoutEcho> &echoes);
+
+  /*!
+   * \brief 将消息分发给过滤器匹配的订阅句柄
+   * \param topic 以'\0'结尾的UTF-8主题
+   * \param message 消息
+   */
+  void dispatch(const char *topic, const MqttMessage &message);
+
+  /*!
+   * \brief 按setPayloadCodec()设置的规则编码负载
+   * \param topic UTF-8编码的主题
+   * \param encoded 输出参数，是否匹配了编码规则（负载带有编码头部），可为空
+   */
+  QByteArray encodePayload(const QByteArray &topic, const QByteArray &payload, bool *encoded = nullptr) const;
+
+  /*!
+   * \brief 为消息内容加上客户端ID前缀，用于过滤自身消息（仅v3.1.1模式）
+   */
+  QByteArray framePayload(const QByteArray &payload) const;
+
+  /*!
+   * \brief publishEncoded()和publishTopic()的共同实现
+   * \param entry 主题表条目，不使用主题句柄时为空
+   */
+  MqttPublishToken publishWithEntry(const QByteArray &topic, MqttTopicEntry *entry, const QByteArray &payload, int qos,
+                                    bool retain);
+
+  /*!
+   * \brief 在客户端线程中直接发送一条消息
+   * \param topic 以'\0'结尾的UTF-8主题
+   * \param payload 已加前缀的消息内容
+   * \param token 发布凭据
+   * \param entry 主题表条目，非空时可使用主题别名
+   */
+  void sendPublish(const QByteArray &topic, const QByteArray &payload, int qos, bool retain,
+                   const MqttPublishToken &token, MqttTopicEntry *entry = nullptr);
+
+  /*!
+   * \brief 返回携带该主题别名的发布属性，需要时为主题分配别名（客户端线程）
+   * \return 发布属性，主题不使用别名时为空
+   */
+  const mosquitto_property *topicAliasProperties(MqttTopicEntry *entry);
+
+  /*!
+   * \brief 将消息写入离线发件箱（线程安全）
+   * \param token 发布凭据，写入后状态为Spooled
+   * \param holds_slot 消息是否已占用发布窗口名额
+   */
+  void spoolPublish(const QByteArray &topic, const QByteArray &payload, int qos, bool retain,
+                    const MqttPublishToken &token, bool holds_slot);
+
+  /*!
+   * \brief 占用一个发布窗口名额（线程安全）
+   * \return 窗口已满时返回false
+   */
+  bool acquirePublishSlot();
+
+  /*!
+   * \brief 设置发布结果并归还窗口名额（客户端线程）
+   */
+  void finishPublish(const MqttPublishToken &token, MqttPublishToken::Status status, int rc);
+
+  /*!
+   * \brief 使所有未完成的发布以指定错误码失败
+   * \param qos0_only 是否只处理QoS0消息（断线后QoS1/2消息会由libmosquitto重发）
+   */
+  void failPendingPublishes(int rc, bool qos0_only);
+
+  /*!
+   * \brief 从指定代理开始竞速，其前面的代理排在列表末尾
+   */
+  void startRace(int first_endpoint);
+
+  /*!
+   * \brief 取消进行中的竞速
+   */
+  void cancelRace();
+
+  /*!
+   * \brief 以非阻塞方式连接当前代理
+   * \param address 连通的IP地址
+   */
+  void startConnect(const QHostAddress &address);
+
+  /*!
+   * \brief 处理libmosquitto发起连接的结果，成功后挂接套接字并等待CONNACK
+   */
+  void finishConnect(int rc);
+
+  /*!
+   * \brief 按退避时间安排下一次重连，已安排时不重复
+   */
+  void scheduleReconnect();
+
  private slots:
   /*!
    * \brief 重连处理槽函数
    */
   void handleReconnect();
 
+  /*!
+   * \brief 竞速找到可达的地址，发起MQTT连接
+   * \param endpoint 代理在竞速列表中的下标
+   * \param address 连通的IP地址
+   */
+  void onRaceSucceeded(int endpoint, const QHostAddress &address);
+
+  /*!
+   * \brief 竞速失败，按退避时间重试
+   */
+  void onRaceFailed(const QString &reason);
+
+  /*!
+   * \brief 在超时时间内未收到CONNACK
+   */
+  void onConnectTimeout();
+
+  /*!
+   * \brief 持久会话的阻塞连接在独立线程中返回
+   */
+  void onBlockingConnectFinished();
+
+  /*!
+   * \brief 投递当前累积的消息批次
+   */
+  void flushInbound();
+
+  /*!
+   * \brief 批量取出发布队列中的消息并发送
+   */
+  void drainPublishQueue();
+
+  /*!
+   * \brief 发出statsUpdated信号并写出指标文件
+   */
+  void publishStats();
+
+  /*!
+   * \brief 启动发件箱重发定时器
+   */
+  void startOutboxReplay();
+
+  /*!
+   * \brief 从发件箱取出一批消息重发
+   */
+  void replayOutbox();
+
+  /*!
+   * \brief 套接字可读，调用mosquitto_loop_read处理入站数据
+   */
+  void onSocketReadable();
+
+  /*!
+   * \brief 套接字可写，调用mosquitto_loop_write发送待发数据
+   */
+  void onSocketWritable();
+
+  /*!
+   * \brief 定时调用mosquitto_loop_misc处理心跳及超时
+   */
+  void onLoopMisc();
+
  private:
-  struct mosquitto *mosq_ = nullptr;   // Mosquitto实例指针
-  QTimer *reconnect_timer_ = nullptr;  // 重连定时器
-  QString host_;                       // MQTT代理主机地址
-  int port_ = 1883;                    // MQTT代理端口号
-  int keepalive_ = 60;                 // 保持连接时间间隔
-  int max_retry_ = 3;                  // 最大重试次数
-  int retry_count_ = 0;                // 当前重试次数
-  bool connected_ = false;             // 是否已连接
-  QString client_id_;                  // 客户端ID
-  QString username_;                   // 用户名
-  QString password_;                   // 密码
-  static QMutex init_mutex_;           // 计数器互斥锁
-  static int init_count_;              // 计数器
+  struct mosquitto *mosq_ = nullptr;    // Mosquitto实例指针
+  QTimer *reconnect_timer_ = nullptr;   // 重连定时器
+  QTimer *connect_timer_ = nullptr;     // 等待CONNACK的超时定时器
+  QList<MqttEndpoint> endpoints_;       // 按优先级排列的代理地址
+  int endpoint_index_ = -1;             // 当前代理的下标，-1表示尚未选出
+  MqttConnectRace *race_ = nullptr;     // 进行中的竞速
+  int race_first_ = 0;                  // 竞速列表第一个代理的下标
+  int backoff_min_ms_ = 250;            // 重连初始等待时间
+  int backoff_max_ms_ = 30000;          // 重连最长等待时间
+  qint64 connect_started_ns_ = 0;       // 开始连接或断线的时刻，连接成功后清零
+  bool tls_enabled_ = false;            // 是否启用了TLS
+  int keepalive_ = 60;                  // 保持连接时间间隔
+  int max_retry_ = 3;                   // 最大重试次数，0表示无限重试
+  int retry_count_ = 0;                 // 当前重试次数
+  std::atomic<bool> connected_{false};  // 是否已连接
+  bool disconnect_requested_ = false;   // disconnectFromBroker()是否正在主动断开
+  QString client_id_;                   // 客户端ID
+  QString username_;                    // 用户名
+  QString password_;                    // 密码
+  static QMutex init_mutex_;            // 计数器互斥锁
+  static int init_count_;               // 计数器
+
+  DeliveryMode delivery_mode_ = PerMessage;       // 入站消息投递模式
+  PayloadArena payload_arena_;                    // 负载内存池（仅网络线程访问）
+  QHash<QByteArray, InternedTopic> topic_cache_;  // 主题驻留表（仅网络线程访问）
+  MqttMessageBatch inbound_batch_;                // 待投递的消息批次
+
+  QByteArray payload_prefix_;                 // 预编码的客户端ID前缀
+  PublishQueue publish_queue_;                // 跨线程发布队列
+  std::atomic<bool> drain_scheduled_{false};  // 是否已投递发布队列处理事件
+
+  std::atomic<ProtocolVersion> protocol_version_{MQTTv311};  // MQTT协议版本，生产者线程编码负载时读取
+  mosquitto_property *publish_props_ = nullptr;              // v5发布属性（客户端ID用户属性）
+  mosquitto_property *connect_props_ = nullptr;              // v5连接属性（会话过期时间）
+  bool persistent_session_ = false;                          // 是否使用持久会话
+  BlockingConnect *blocking_connect_ = nullptr;              // 执行阻塞连接的线程，运行期间客户端线程不访问mosq_
+  bool blocking_connect_aborted_ = false;                    // 阻塞连接返回前是否已调用disconnectFromBroker()
+
+  MqttTopicTable topic_table_;                 // 主题表，topic()注册的主题
+  QVector<mosquitto_property *> alias_props_;  // 以别名为下标的发布属性（别名及发布用户属性）
+  int topic_alias_max_ = 0;                    // 代理允许的主题别名数量（CONNACK的Topic Alias Maximum）
+  int topic_aliases_used_ = 0;                 // 当前连接已分配的别名数量
+  quint64 connection_epoch_ = 0;               // 连接序号，每次连接成功加1，用于使旧连接的别名失效
+
+  QVector<CodecRule> codec_rules_;  // 负载编码规则，按设置顺序匹配（仅在发布前修改）
+
+  QHash<int, MqttPublishToken> inflight_;  // 等待确认的消息（仅客户端线程访问）
+  bool publishing_qos0_ = false;           // 是否正在sendPublish()中发布QoS0消息
+  int early_qos0_ack_ = 0;                 // 在mosquitto_publish返回之前就已确认的QoS0消息ID，0表示没有
+  std::atomic<int> inflight_count_{0};     // 窗口内的消息数量（含发布队列）
+  std::atomic<int> max_inflight_{0};       // 发布窗口大小，0表示不限制
+  std::atomic<bool> window_full_{false};   // 是否有发布因窗口已满被拒绝
+
+  MqttOutbox *outbox_ = nullptr;               // 离线发件箱，未启用时为空
+  QTimer *replay_timer_ = nullptr;             // 发件箱重发定时器
+  int replay_batch_ = 10;                      // 每次定时重发的消息数
+  std::atomic<bool> replay_scheduled_{false};  // 是否已启动或投递了重发
+
+  TopicTrie topic_trie_;                          // 订阅过滤器前缀树（仅客户端线程访问）
+  QHash<int, MqttSubscription *> subscriptions_;  // 订阅句柄（仅客户端线程访问）
+  QHash<QString, int> filter_refs_;               // 各过滤器的句柄数量（仅客户端线程访问）
+  QHash<QString, int> subscribed_filters_;        // 向代理订阅的过滤器及QoS（仅客户端线程访问）
+  QSet<QString> unsynced_filters_;                // 代理尚未确认的订阅
+  QSet<QString> pending_unsubscribes_;            // 持久会话下断线期间取消、待通知代理的订阅
+  std::atomic<int> next_subscription_id_{1};      // 下一个订阅标识
+
+  MqttConflator *conflator_ = nullptr;     // 消息合并队列，未启用时为空
+  MqttWorkerPool *worker_pool_ = nullptr;  // 并行处理线程池，未启用时为空
+  MqttCaptureWriter capture_;              // 流量录制（仅客户端线程访问，统计除外）
+  MqttFanoutWriter fanout_;                // 本机消息分发（写入仅在客户端线程，上行消息由转发线程取出）
+  qint64 fanout_reaped_ns_ = 0;            // 上次检查读者进程的时刻（仅转发线程访问）
+
+  RetainedCache *retained_cache_ = nullptr;  // 主题最新值缓存，未启用时为空
+  QString retained_snapshot_path_;           // 缓存快照文件路径
+  QHash<int, QStringList> pending_subacks_;  // 等待确认的订阅（消息ID到过滤器）
+
+  MqttMetrics metrics_;                      // 运行指标
+  std::atomic<qint64> delivery_pending_{0};  // 已投递但接收方尚未确认的消息数
+  QTimer *stats_timer_ = nullptr;            // 指标发送定时器
+  QString metrics_file_;                     // Prometheus指标文件路径
+
+  struct ssl_ctx_st *tls_ctx_ = nullptr;          // 本客户端的SSL_CTX，未启用TLS时为空
+  struct ssl_session_st *tls_session_ = nullptr;  // 最近一次握手得到的可复用会话
+  QString tls_session_broker_;                    // tls_session_所属的代理
+  QByteArray tls_server_name_;                    // 当前连接的代理主机名，用于SNI和证书校验
+  bool tls_server_is_ip_ = false;                 // tls_server_name_是否为IP字面量
+  bool tls_resumption_ = true;                    // 是否复用TLS会话
+  qint64 tls_handshake_started_ns_ = 0;           // 本次TLS握手开始的时刻
+
+  QSocketNotifier *read_notifier_ = nullptr;   // 套接字读通知器
+  QSocketNotifier *write_notifier_ = nullptr;  // 套接字写通知器
+  QTimer *misc_timer_ = nullptr;               // 心跳维护定时器
 };
 
 #endif  // MQTTCLIENT_H
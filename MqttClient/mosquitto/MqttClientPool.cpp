@@ -0,0 +1,130 @@
+#include "MqttClientPool.h"
+
+// 默认的共享订阅分组名
+static const char *const kDefaultSharedGroup = "mqttclientpool";
+
+MqttClientPool::MqttClientPool(int connections, const Setup &setup, QObject *parent)
+    : QObject(parent), shared_group_(kDefaultSharedGroup) {
+  if (connections <= 0) {
+    connections = qMax(1, QThread::idealThreadCount());
+  }
+
+  clients_.reserve(connections);
+  threads_.reserve(connections);
+  for (int i = 0; i < connections; ++i) {
+    MqttClient *client = new MqttClient();
+    if (setup) {
+      setup(client, i);
+    }
+    QThread *thread = new QThread(this);
+    client->moveToThread(thread);
+    connect(thread, &QThread::finished, client, &QObject::deleteLater);
+
+    connect(client, &MqttClient::connected, this, [this]() {
+      if (connectedCount() == clients_.size()) {
+        emit connected();
+      }
+    });
+    connect(client, &MqttClient::connectionFailed, this,
+            [this, i](const QString &reason) { emit connectionFailed(i, reason); });
+    // 直接连接，信号在连接线程中转发
+    connect(client, &MqttClient::messagesReceived, this, &MqttClientPool::messagesReceived, Qt::DirectConnection);
+
+    clients_.append(client);
+    threads_.append(thread);
+    thread->start();
+  }
+}
+
+MqttClientPool::~MqttClientPool() {
+  for (int i = 0; i < clients_.size(); ++i) {
+    MqttClient *client = clients_.at(i);
+    QMetaObject::invokeMethod(client, [client]() { client->disconnectFromBroker(); }, Qt::BlockingQueuedConnection);
+    threads_.at(i)->quit();
+  }
+  for (QThread *thread : threads_) {
+    thread->wait();
+  }
+}
+
+MqttClient *MqttClientPool::clientForTopic(const QByteArray &topic) const {
+  return clients_.at(static_cast<int>(qHash(topic) % static_cast<uint>(clients_.size())));
+}
+
+void MqttClientPool::connectToBroker(const QString &host, int port, int keepalive, int max_retry,
+                                     const QString &username, const QString &password) {
+  for (MqttClient *client : clients_) {
+    // 转发到各连接的线程执行
+    client->connectToBroker(host, port, keepalive, max_retry, username, password);
+  }
+}
+
+void MqttClientPool::disconnectFromBroker() {
+  for (MqttClient *client : clients_) {
+    QMetaObject::invokeMethod(client, [client]() { client->disconnectFromBroker(); }, Qt::QueuedConnection);
+  }
+}
+
+int MqttClientPool::connectedCount() const {
+  int count = 0;
+  for (MqttClient *client : clients_) {
+    count += client->mqttIsConnected() ? 1 : 0;
+  }
+  return count;
+}
+
+void MqttClientPool::setSharedGroup(const QString &group) {
+  QMutexLocker locker(&mutex_);
+  shared_group_ = group;
+}
+
+MqttPublishToken MqttClientPool::publish(const QString &topic, const QByteArray &payload, int qos, bool retain) {
+  return publishEncoded(topic.toUtf8(), payload, qos, retain);
+}
+
+MqttPublishToken MqttClientPool::publishEncoded(const QByteArray &topic, const QByteArray &payload, int qos,
+                                                bool retain) {
+  return clientForTopic(topic)->publishEncoded(topic, payload, qos, retain);
+}
+
+QList<MqttSubscription *> MqttClientPool::subscribe(const QString &filter, int qos,
+                                                    const MqttSubscription::Handler &handler) {
+  QMutexLocker locker(&mutex_);
+  const QString group = shared_group_;
+  locker.unlock();
+
+  QList<MqttSubscription *> subscriptions;
+  if (group.isEmpty()) {
+    MqttClient *client = clientForTopic(filter.toUtf8());
+    MqttSubscription *subscription = client->subscribe(filter, qos, handler);
+    if (subscription) {
+      subscriptions.append(subscription);
+      locker.relock();
+      owners_.insert(subscription, client);
+    }
+    return subscriptions;
+  }
+
+  const QString shared = QString("$share/%1/%2").arg(group, filter);
+  locker.relock();
+  for (MqttClient *client : clients_) {
+    MqttSubscription *subscription = client->subscribe(shared, qos, handler);
+    if (!subscription) {
+      break;
+    }
+    subscriptions.append(subscription);
+    owners_.insert(subscription, client);
+  }
+  return subscriptions;
+}
+
+void MqttClientPool::unsubscribe(const QList<MqttSubscription *> &subscriptions) {
+  QMutexLocker locker(&mutex_);
+  for (MqttSubscription *subscription : subscriptions) {
+    // 句柄只能交给创建它的连接注销
+    MqttClient *client = owners_.take(subscription);
+    if (client) {
+      client->unsubscribe(subscription);
+    }
+  }
+}
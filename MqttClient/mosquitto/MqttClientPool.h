@@ -0,0 +1,139 @@
+#ifndef MQTTCLIENTPOOL_H
+#define MQTTCLIENTPOOL_H
+
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QThread>
+#include <QVector>
+#include <functional>
+
+#include "MqttClient.h"
+
+/*!
+ * \brief 同一代理的多连接客户端池
+ * 池中每个连接是一个独立的MqttClient（各自的客户端ID、套接字和线程），发布与接收分摊到多个核上：
+ *   - 发布按主题哈希选择连接，同一主题总是经同一连接发出，保持主题内的顺序；
+ *   - 订阅默认使用共享订阅（$share/<group>/<filter>），由代理在各连接间分配消息；
+ *     关闭共享订阅时，每个过滤器按哈希只在一个连接上订阅。
+ * 共享订阅下同一主题的消息可能经不同连接到达，接收端不再保证主题内的顺序，且收不到保留消息。
+ * 一个连接发布的消息会被池中其他连接的订阅收到（no_local只对同一连接生效）。
+ * 除构造和析构外的方法可在任意线程调用。
+ */
+class MqttClientPool : public QObject {
+  Q_OBJECT
+
+ public:
+  /*!
+   * \brief 连接的初始化函数，在连接移入其线程之前调用，用于启用发件箱、设置窗口等
+   * 第二个参数为连接序号，可用于区分各连接的文件路径。
+   */
+  typedef std::function<void(MqttClient *, int)> Setup;
+
+  /*!
+   * \brief 构造函数，创建连接并启动各自的线程
+   * \param connections 连接数，不大于0时使用CPU核数
+   * \param setup 可选的连接初始化函数
+   * \param parent 父对象
+   */
+  explicit MqttClientPool(int connections, const Setup &setup = Setup(), QObject *parent = nullptr);
+
+  /*!
+   * \brief 析构函数，断开全部连接并等待线程退出
+   */
+  ~MqttClientPool();
+
+  /*!
+   * \brief 连接数
+   */
+  int size() const { return clients_.size(); }
+
+  /*!
+   * \brief 获取指定序号的连接
+   */
+  MqttClient *client(int index) const { return clients_.at(index); }
+
+  /*!
+   * \brief 获取发布该主题所用的连接
+   * \param topic UTF-8编码的主题
+   */
+  MqttClient *clientForTopic(const QByteArray &topic) const;
+
+  /*!
+   * \brief 全部连接连接到代理，参数与MqttClient::connectToBroker()相同
+   */
+  void connectToBroker(const QString &host, int port = 1883, int keepalive = 60, int max_retry = 3,
+                       const QString &username = "", const QString &password = "");
+
+  /*!
+   * \brief 断开全部连接
+   */
+  void disconnectFromBroker();
+
+  /*!
+   * \brief 已连接的连接数
+   */
+  int connectedCount() const;
+
+  /*!
+   * \brief 设置共享订阅的分组名，为空表示不使用共享订阅。只影响之后的subscribe()调用。
+   */
+  void setSharedGroup(const QString &group);
+
+  /*!
+   * \brief 按主题哈希选择连接发布消息
+   * \return 发布凭据
+   */
+  MqttPublishToken publish(const QString &topic, const QByteArray &payload, int qos = 0, bool retain = false);
+
+  /*!
+   * \brief 使用已编码的主题发布消息
+   */
+  MqttPublishToken publishEncoded(const QByteArray &topic, const QByteArray &payload, int qos = 0,
+                                  bool retain = false);
+
+  /*!
+   * \brief 订阅主题过滤器
+   * 使用共享订阅时每个连接各订阅一次，handler会在多个连接线程中并发调用，必须是线程安全的；
+   * 否则只在按过滤器哈希选出的连接上订阅。
+   * \param filter 主题过滤器（不含$share前缀）
+   * \param qos 订阅的消息质量等级
+   * \param handler 可选的消息处理函数，在连接线程中调用
+   * \return 各连接上的订阅句柄，过滤器不合法时为空
+   */
+  QList<MqttSubscription *> subscribe(const QString &filter, int qos,
+                                      const MqttSubscription::Handler &handler = MqttSubscription::Handler());
+
+  /*!
+   * \brief 取消subscribe()返回的全部订阅
+   */
+  void unsubscribe(const QList<MqttSubscription *> &subscriptions);
+
+ signals:
+  /*!
+   * \brief 某个连接连上后全部连接都处于已连接状态时发出（在本对象所在线程）
+   */
+  void connected();
+
+  /*!
+   * \brief 任一连接连接失败时发出
+   * \param index 连接序号
+   * \param reason 失败原因
+   */
+  void connectionFailed(int index, const QString &reason);
+
+  /*!
+   * \brief 任一连接收到一批消息时发出（连接使用批量投递模式时），在该连接的线程中发出
+   */
+  void messagesReceived(const MqttMessageBatch &batch);
+
+ private:
+  QVector<MqttClient *> clients_;                   // 各连接
+  QVector<QThread *> threads_;                      // 各连接的线程
+  mutable QMutex mutex_;                            // 保护以下成员
+  QString shared_group_;                            // 共享订阅分组名
+  QHash<MqttSubscription *, MqttClient *> owners_;  // 订阅句柄所属的连接
+};
+
+#endif  // MQTTCLIENTPOOL_H
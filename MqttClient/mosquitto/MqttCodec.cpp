@@ -0,0 +1,339 @@
+#include "MqttCodec.h"
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonParseError>
+#include <QJsonValue>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+const char kMagic[3] = {'\xFF', 'M', 'C'};           // 编码头部标识
+const int kDeflateLevel = 6;                         // zlib压缩级别
+const int kLzMinMatch = 4;                           // 最短匹配长度
+const int kLzLastLiterals = 5;                       // 末尾必须作为字面量的字节数
+const int kLzHashBits = 12;                          // 匹配查找哈希表的位数
+const int kLzMaxOffset = 65535;                      // 最远匹配距离
+const quint32 kMaxDecodedBytes = 256 * 1024 * 1024;  // 解码结果上限（MQTT负载上限约为256MB）
+const quint64 kLzMaxRatio = 255;                     // LZ格式的最大压缩比（每个扩展长度字节最多代表255字节）
+const quint64 kDeflateMaxRatio = 1032;               // deflate的最大压缩比
+
+QByteArray withHeader(MqttCodec::Type type, const QByteArray &body) {
+  QByteArray encoded;
+  encoded.reserve(MqttCodec::kHeaderSize + body.size());
+  encoded.append(kMagic, sizeof(kMagic));
+  encoded.append(static_cast<char>(type));
+  encoded.append(body);
+  return encoded;
+}
+
+quint32 readU32(const uchar *p) {
+  quint32 value;
+  std::memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+quint32 lzHash(quint32 sequence) { return (sequence * 2654435761u) >> (32 - kLzHashBits); }
+
+void lzWriteLength(QByteArray *out, int length) {
+  while (length >= 255) {
+    out->append(static_cast<char>(255));
+    length -= 255;
+  }
+  out->append(static_cast<char>(length));
+}
+
+/*!
+ * \brief LZ压缩
+ * 与LZ4块格式相同的序列结构：标记字节高4位为字面量长度、低4位为匹配长度减4，取15时后接扩展长度；
+ * 随后是字面量和2字节小端的匹配距离。最后一个序列只有字面量。body开头是4字节小端的原始长度。
+ */
+QByteArray lzCompress(const QByteArray &input) {
+  const uchar *src = reinterpret_cast<const uchar *>(input.constData());
+  const int size = input.size();
+  QByteArray out;
+  out.reserve(4 + size + size / 255 + 16);
+  const quint32 original = static_cast<quint32>(size);
+  out.append(reinterpret_cast<const char *>(&original), sizeof(original));
+
+  int table[1 << kLzHashBits];
+  std::fill(table, table + (1 << kLzHashBits), -1);
+  int anchor = 0;
+  int pos = 0;
+  const int match_limit = size - kLzLastLiterals;
+  while (pos + kLzMinMatch <= match_limit) {
+    const quint32 sequence = readU32(src + pos);
+    const quint32 hash = lzHash(sequence);
+    const int candidate = table[hash];
+    table[hash] = pos;
+    if (candidate < 0 || pos - candidate > kLzMaxOffset || readU32(src + candidate) != sequence) {
+      ++pos;
+      continue;
+    }
+
+    int match = kLzMinMatch;
+    while (pos + match < match_limit && src[candidate + match] == src[pos + match]) {
+      ++match;
+    }
+    const int literals = pos - anchor;
+    const int extra = match - kLzMinMatch;
+    out.append(static_cast<char>((qMin(literals, 15) << 4) | qMin(extra, 15)));
+    if (literals >= 15) {
+      lzWriteLength(&out, literals - 15);
+    }
+    out.append(reinterpret_cast<const char *>(src + anchor), literals);
+    const int offset = pos - candidate;
+    out.append(static_cast<char>(offset & 0xff));
+    out.append(static_cast<char>(offset >> 8));
+    if (extra >= 15) {
+      lzWriteLength(&out, extra - 15);
+    }
+    pos += match;
+    anchor = pos;
+  }
+
+  const int literals = size - anchor;
+  out.append(static_cast<char>(qMin(literals, 15) << 4));
+  if (literals >= 15) {
+    lzWriteLength(&out, literals - 15);
+  }
+  out.append(reinterpret_cast<const char *>(src + anchor), literals);
+  return out;
+}
+
+bool lzReadLength(const uchar **p, const uchar *end, quint32 *length) {
+  uchar byte;
+  do {
+    if (*p >= end) {
+      return false;
+    }
+    byte = *(*p)++;
+    *length += byte;
+  } while (byte == 255 && *length < kMaxDecodedBytes);
+  return *length < kMaxDecodedBytes;
+}
+
+/*!
+ * \brief LZ解压，输入来自网络，所有长度和距离都做越界检查
+ */
+bool lzDecompress(const char *data, int size, QByteArray *output) {
+  if (size < 4) {
+    return false;
+  }
+  const quint32 original = readU32(reinterpret_cast<const uchar *>(data));
+  // 先按压缩比检查声明的长度，伪造的小负载不能让接收方分配大块内存
+  if (original > kMaxDecodedBytes || original > static_cast<quint64>(size) * kLzMaxRatio) {
+    return false;
+  }
+  QByteArray out(static_cast<int>(original), Qt::Uninitialized);
+  uchar *dst = reinterpret_cast<uchar *>(out.data());
+  quint32 written = 0;
+  const uchar *p = reinterpret_cast<const uchar *>(data) + 4;
+  const uchar *end = reinterpret_cast<const uchar *>(data) + size;
+  while (p < end) {
+    const uchar token = *p++;
+    quint32 literals = token >> 4;
+    if (literals == 15 && !lzReadLength(&p, end, &literals)) {
+      return false;
+    }
+    if (literals > static_cast<quint32>(end - p) || literals > original - written) {
+      return false;
+    }
+    std::memcpy(dst + written, p, literals);
+    p += literals;
+    written += literals;
+    if (p == end) {
+      break;
+    }
+
+    if (end - p < 2) {
+      return false;
+    }
+    const quint32 offset = p[0] | (p[1] << 8);
+    p += 2;
+    quint32 match = token & 15;
+    if (match == 15 && !lzReadLength(&p, end, &match)) {
+      return false;
+    }
+    match += kLzMinMatch;
+    if (offset == 0 || offset > written || match > original - written) {
+      return false;
+    }
+    // 距离可能小于匹配长度（重复模式），逐字节复制
+    const uchar *from = dst + written - offset;
+    for (quint32 i = 0; i < match; ++i) {
+      dst[written + i] = from[i];
+    }
+    written += match;
+  }
+  if (written != original) {
+    return false;
+  }
+  *output = out;
+  return true;
+}
+
+// qCompress格式以4字节大端的原始长度开头，检查其不超过解码上限和最大压缩比
+bool deflateSizeValid(const char *data, int size) {
+  if (size < 4) {
+    return false;
+  }
+  const uchar *p = reinterpret_cast<const uchar *>(data);
+  const quint32 original = (quint32(p[0]) << 24) | (quint32(p[1]) << 16) | (quint32(p[2]) << 8) | p[3];
+  return original <= kMaxDecodedBytes && original <= static_cast<quint64>(size - 4) * kDeflateMaxRatio;
+}
+
+QByteArray jsonFromCbor(const QByteArray &cbor, bool *ok) {
+  QCborParserError error;
+  const QCborValue value = QCborValue::fromCbor(cbor, &error);
+  if (error.error != QCborError::NoError) {
+    *ok = false;
+    return QByteArray();
+  }
+  *ok = true;
+  const QJsonValue json = value.toJsonValue();
+  if (json.isArray()) {
+    return QJsonDocument(json.toArray()).toJson(QJsonDocument::Compact);
+  }
+  return QJsonDocument(json.toObject()).toJson(QJsonDocument::Compact);
+}
+
+QByteArray cborFromJson(const QByteArray &json, bool *ok) {
+  QJsonParseError error;
+  const QJsonDocument document = QJsonDocument::fromJson(json, &error);
+  if (error.error != QJsonParseError::NoError) {
+    *ok = false;
+    return QByteArray();
+  }
+  const QJsonValue value = document.isArray() ? QJsonValue(document.array()) : QJsonValue(document.object());
+  const QByteArray cbor = QCborValue::fromJsonValue(value).toCbor();
+  // 解码得到的是键有序的紧凑JSON，数字格式也可能变化；只有能逐字节还原的文本才编码，否则不编码
+  bool decoded_ok = false;
+  const QByteArray decoded = jsonFromCbor(cbor, &decoded_ok);
+  *ok = decoded_ok && decoded == json;
+  return *ok ? cbor : QByteArray();
+}
+
+}  // namespace
+
+const int MqttCodec::kHeaderSize;
+
+QByteArray MqttCodec::encode(Type type, const QByteArray &payload) {
+  QByteArray body;
+  bool ok = true;
+  switch (type) {
+    case Deflate:
+      body = qCompress(payload, kDeflateLevel);
+      break;
+    case Lz:
+      body = lzCompress(payload);
+      break;
+    case Cbor:
+      body = cborFromJson(payload, &ok);
+      break;
+    default:
+      ok = false;
+      break;
+  }
+
+  if (!ok || body.size() + kHeaderSize >= payload.size()) {
+    // 不编码；原负载恰好以编码头部开始时加Identity头部，避免接收方误解码
+    return isEncoded(payload) ? withHeader(Identity, payload) : payload;
+  }
+  return withHeader(type, body);
+}
+
+QByteArray MqttCodec::encodeValue(const QCborValue &value) { return withHeader(Cbor, value.toCbor()); }
+
+QByteArray MqttCodec::decode(const QByteArray &payload, bool *ok) {
+  if (ok) {
+    *ok = true;
+  }
+  if (!isEncoded(payload)) {
+    return payload;
+  }
+
+  const char *body = payload.constData() + kHeaderSize;
+  const int body_size = payload.size() - kHeaderSize;
+  QByteArray decoded;
+  bool decoded_ok = false;
+  switch (typeOf(payload)) {
+    case Identity:
+      decoded = payload.mid(kHeaderSize);
+      decoded_ok = true;
+      break;
+    case Deflate:
+      // qUncompress按前4字节（大端）声明的长度预先分配内存，先按压缩比检查；
+      // 它对空输入和损坏的数据返回空数组，原负载为空时不会被编码
+      if (deflateSizeValid(body, body_size)) {
+        decoded = qUncompress(reinterpret_cast<const uchar *>(body), body_size);
+      }
+      decoded_ok = !decoded.isEmpty();
+      break;
+    case Lz:
+      decoded_ok = lzDecompress(body, body_size, &decoded);
+      break;
+    case Cbor:
+      decoded = jsonFromCbor(QByteArray::fromRawData(body, body_size), &decoded_ok);
+      break;
+  }
+  if (ok) {
+    *ok = decoded_ok;
+  }
+  return decoded_ok ? decoded : QByteArray();
+}
+
+QCborValue MqttCodec::decodeValue(const QByteArray &payload) {
+  if (typeOf(payload) == Cbor) {
+    return QCborValue::fromCbor(payload.mid(kHeaderSize));
+  }
+  bool ok = false;
+  const QByteArray json = decode(payload, &ok);
+  QJsonParseError error;
+  const QJsonDocument document = QJsonDocument::fromJson(json, &error);
+  if (!ok || error.error != QJsonParseError::NoError) {
+    return QCborValue();
+  }
+  return document.isArray() ? QCborValue::fromJsonValue(document.array())
+                            : QCborValue::fromJsonValue(document.object());
+}
+
+MqttCodec::Type MqttCodec::typeOf(const QByteArray &payload) {
+  return isEncoded(payload) ? static_cast<Type>(payload.at(3)) : Identity;
+}
+
+bool MqttCodec::isEncoded(const QByteArray &payload) {
+  return payload.size() >= kHeaderSize && std::memcmp(payload.constData(), kMagic, sizeof(kMagic)) == 0 &&
+         static_cast<uchar>(payload.at(3)) <= Cbor;
+}
+
+const char *MqttCodec::typeName(Type type) {
+  switch (type) {
+    case Deflate:
+      return "deflate";
+    case Lz:
+      return "lz";
+    case Cbor:
+      return "cbor";
+    default:
+      return "identity";
+  }
+}
+
+MqttCodec::Type MqttCodec::typeFromName(const QString &name, bool *ok) {
+  static const Type types[] = {Identity, Deflate, Lz, Cbor};
+  for (Type type : types) {
+    if (name.compare(QLatin1String(typeName(type)), Qt::CaseInsensitive) == 0) {
+      if (ok) {
+        *ok = true;
+      }
+      return type;
+    }
+  }
+  if (ok) {
+    *ok = false;
+  }
+  return Identity;
+}
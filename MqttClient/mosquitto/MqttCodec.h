@@ -0,0 +1,80 @@
+#ifndef MQTTCODEC_H
+#define MQTTCODEC_H
+
+#include <QByteArray>
+#include <QCborValue>
+#include <QString>
+
+/*!
+ * \brief 负载编解码
+ * 编码后的负载以4字节头部开始：0xFF 'M' 'C' 编码类型。0xFF不会出现在UTF-8文本中，
+ * 文本负载不会被误认为已编码；原负载恰好以该头部开始时编码为Identity类型以示区分。
+ * 编码方式随负载一起保存，经离线发件箱、录制重放和最新值缓存后仍可解码。
+ * 所有函数线程安全。
+ */
+class MqttCodec {
+ public:
+  /*!
+   * \brief 编码类型
+   */
+  enum Type {
+    Identity = 0,  // 不编码
+    Deflate = 1,   // zlib压缩（qCompress），压缩率高
+    Lz = 2,        // LZ77字节对齐格式，压缩率较低但编解码很快
+    Cbor = 3       // JSON文本转为CBOR二进制，解码结果（紧凑、键有序的JSON）与原文不完全相同时不编码
+  };
+
+  static const int kHeaderSize = 4;  // 编码头部字节数
+
+  /*!
+   * \brief 编码负载
+   * 编码失败或编码后不比原负载小时返回原负载（必要时加Identity头部）。
+   * \param type 编码类型
+   * \param payload 原负载
+   * \return 编码后的负载
+   */
+  static QByteArray encode(Type type, const QByteArray &payload);
+
+  /*!
+   * \brief 将结构化数据编码为CBOR负载
+   */
+  static QByteArray encodeValue(const QCborValue &value);
+
+  /*!
+   * \brief 解码负载
+   * 没有编码头部的负载原样返回（不复制）；CBOR负载解码为紧凑的JSON文本。
+   * \param payload 收到的负载
+   * \param ok 输出参数，编码头部有效且解码成功时为true，没有头部时也为true
+   * \return 解码后的负载，失败时为空
+   */
+  static QByteArray decode(const QByteArray &payload, bool *ok = nullptr);
+
+  /*!
+   * \brief 将负载解码为结构化数据
+   * CBOR负载直接解析，其他负载先解码再按JSON解析，不是JSON时返回Undefined。
+   */
+  static QCborValue decodeValue(const QByteArray &payload);
+
+  /*!
+   * \brief 负载的编码类型，没有编码头部时为Identity
+   */
+  static Type typeOf(const QByteArray &payload);
+
+  /*!
+   * \brief 负载是否带编码头部
+   */
+  static bool isEncoded(const QByteArray &payload);
+
+  /*!
+   * \brief 编码类型名称（identity、deflate、lz、cbor）
+   */
+  static const char *typeName(Type type);
+
+  /*!
+   * \brief 解析编码类型名称
+   * \param ok 输出参数，名称是否有效
+   */
+  static Type typeFromName(const QString &name, bool *ok = nullptr);
+};
+
+#endif  // MQTTCODEC_H
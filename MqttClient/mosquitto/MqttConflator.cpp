@@ -0,0 +1,199 @@
+#include "MqttConflator.h"
+
+#include <QMutexLocker>
+
+#include "MqttMetrics.h"
+
+// 规则缓存的最大主题数，超出后清空重建
+static const int kMaxCachedTopics = 4096;
+// 限速主题的最大记录数，超出后清空（之后每个主题的第一条消息不受限速）
+static const int kMaxRateLimitedTopics = 65536;
+
+MqttConflator::MqttConflator(int max_queue, QObject *parent) : QObject(parent), max_queue_(qMax(1, max_queue)) {
+  release_timer_ = new QTimer(this);
+  release_timer_->setSingleShot(true);
+  release_timer_->setTimerType(Qt::PreciseTimer);
+  connect(release_timer_, &QTimer::timeout, this, &MqttConflator::releaseHeld);
+}
+
+bool MqttConflator::addRule(const QString &filter, bool conflate, double max_rate_hz) {
+  Rule rule;
+  rule.filter = filter.toUtf8();
+  rule.conflate = conflate || max_rate_hz > 0;
+  rule.min_interval_ns = max_rate_hz > 0 ? static_cast<qint64>(1e9 / max_rate_hz) : 0;
+
+  QMutexLocker locker(&mutex_);
+  if (!rule_trie_.insert(rule.filter, rules_.size())) {
+    return false;
+  }
+  rules_.append(rule);
+  rule_cache_.clear();
+  return true;
+}
+
+void MqttConflator::clearRules() {
+  QMutexLocker locker(&mutex_);
+  for (int i = 0; i < rules_.size(); ++i) {
+    rule_trie_.remove(rules_.at(i).filter, i);
+  }
+  rules_.clear();
+  rule_cache_.clear();
+}
+
+void MqttConflator::setMaxQueue(int max_queue) {
+  QMutexLocker locker(&mutex_);
+  max_queue_ = qMax(1, max_queue);
+}
+
+void MqttConflator::push(const MqttMessage &message) {
+  QMutexLocker locker(&mutex_);
+  ++stats_.received;
+
+  const Rule *rule = ruleFor(message.topic);
+  bool conflate = rule && rule->conflate;
+  if (rule && rule->min_interval_ns > 0) {
+    const qint64 now = mqttMonotonicNs();
+    QHash<QString, Held>::iterator held = held_.find(message.topic);
+    if (held != held_.end()) {
+      // 已有等待中的消息，只保留最新值
+      held->message = message;
+      ++stats_.conflated;
+      return;
+    }
+
+    QHash<QString, qint64>::const_iterator last = last_delivery_ns_.constFind(message.topic);
+    if (last != last_delivery_ns_.constEnd() && now < last.value() + rule->min_interval_ns) {
+      Held pending;
+      pending.message = message;
+      pending.due_ns = last.value() + rule->min_interval_ns;
+      held_.insert(message.topic, pending);
+      ++stats_.rate_limited;
+      scheduleRelease(pending.due_ns, now);
+      return;
+    }
+
+    if (last_delivery_ns_.size() >= kMaxRateLimitedTopics) {
+      last_delivery_ns_.clear();
+    }
+    last_delivery_ns_.insert(message.topic, now);
+  }
+
+  bool notify = enqueueLocked(message, conflate);
+  locker.unlock();
+  if (notify) {
+    emit messagesAvailable();
+  }
+}
+
+MqttMessageBatch MqttConflator::take() {
+  MqttMessageBatch batch;
+  QMutexLocker locker(&mutex_);
+  batch.reserve(queue_.size());
+  for (const Item &item : queue_) {
+    batch.append(item.conflated ? latest_.take(item.topic) : item.message);
+  }
+  queue_.clear();
+  notified_ = false;
+  stats_.delivered += batch.size();
+  return batch;
+}
+
+MqttConflator::Stats MqttConflator::stats() const {
+  QMutexLocker locker(&mutex_);
+  Stats stats = stats_;
+  stats.queued = queue_.size() + held_.size();
+  return stats;
+}
+
+void MqttConflator::releaseHeld() {
+  QMutexLocker locker(&mutex_);
+  const qint64 now = mqttMonotonicNs();
+  qint64 next_due = 0;
+  bool notify = false;
+  QHash<QString, Held>::iterator it = held_.begin();
+  while (it != held_.end()) {
+    if (it->due_ns <= now) {
+      last_delivery_ns_.insert(it.key(), now);
+      notify |= enqueueLocked(it->message, true);
+      it = held_.erase(it);
+    } else {
+      next_due = next_due == 0 ? it->due_ns : qMin(next_due, it->due_ns);
+      ++it;
+    }
+  }
+
+  release_due_ns_ = 0;
+  if (next_due != 0) {
+    scheduleRelease(next_due, now);
+  }
+  locker.unlock();
+  if (notify) {
+    emit messagesAvailable();
+  }
+}
+
+const MqttConflator::Rule *MqttConflator::ruleFor(const QString &topic) {
+  if (rules_.isEmpty()) {
+    return nullptr;
+  }
+
+  QHash<QString, int>::const_iterator cached = rule_cache_.constFind(topic);
+  int index;
+  if (cached != rule_cache_.constEnd()) {
+    index = cached.value();
+  } else {
+    index = -1;
+    rule_trie_.match(topic.toUtf8().constData(), [&index](int id) {
+      if (index < 0 || id < index) {
+        index = id;
+      }
+    });
+    if (rule_cache_.size() >= kMaxCachedTopics) {
+      rule_cache_.clear();
+    }
+    rule_cache_.insert(topic, index);
+  }
+  return index >= 0 ? &rules_.at(index) : nullptr;
+}
+
+bool MqttConflator::enqueueLocked(const MqttMessage &message, bool conflate) {
+  Item item;
+  item.topic = message.topic;
+  item.conflated = conflate;
+  if (conflate) {
+    // 队列中已有该主题时原位替换
+    QHash<QString, MqttMessage>::iterator latest = latest_.find(message.topic);
+    if (latest != latest_.end()) {
+      *latest = message;
+      ++stats_.conflated;
+      return false;
+    }
+    latest_.insert(message.topic, message);
+  } else {
+    item.message = message;
+  }
+
+  if (queue_.size() >= max_queue_) {
+    Item oldest = queue_.takeFirst();
+    if (oldest.conflated) {
+      latest_.remove(oldest.topic);
+    }
+    ++stats_.dropped;
+  }
+  queue_.append(item);
+
+  if (notified_) {
+    return false;
+  }
+  notified_ = true;
+  return true;
+}
+
+void MqttConflator::scheduleRelease(qint64 due_ns, qint64 now_ns) {
+  if (release_due_ns_ != 0 && release_due_ns_ <= due_ns) {
+    return;
+  }
+  release_due_ns_ = due_ns;
+  // 向上取整到毫秒，避免提前唤醒
+  release_timer_->start(static_cast<int>(qMax<qint64>(0, (due_ns - now_ns + 999999) / 1000000)));
+}
@@ -0,0 +1,130 @@
+#ifndef MQTTCONFLATOR_H
+#define MQTTCONFLATOR_H
+
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QTimer>
+#include <QVector>
+
+#include "MqttMessage.h"
+#include "TopicTrie.h"
+
+/*!
+ * \brief 网络线程与接收线程之间的消息合并队列
+ * 网络线程调用push()写入消息，接收方收到messagesAvailable信号后调用take()一次取走全部消息。
+ * 在接收方取走之前不会再次发出信号，因此事件队列中最多只有一个待处理事件，
+ * 接收方处理不过来时积压的是本队列而不是Qt事件队列。
+ *   - 合并：匹配合并规则的主题在队列中只保留最新一条（后到的值覆盖先到的值，位置不变）；
+ *   - 限速：匹配限速规则的主题按最小间隔投递，间隔内到达的消息只保留最新一条，到期后入队；
+ *   - 有界：队列达到上限时丢弃最早的消息。
+ * push()只能在本对象所在线程（客户端线程）调用，其余方法线程安全。
+ */
+class MqttConflator : public QObject {
+  Q_OBJECT
+
+ public:
+  /*!
+   * \brief 合并统计
+   */
+  struct Stats {
+    quint64 received = 0;      // 写入的消息数
+    quint64 delivered = 0;     // 被取走的消息数
+    quint64 conflated = 0;     // 被更新值覆盖的消息数
+    quint64 rate_limited = 0;  // 因限速而延后的消息数
+    quint64 dropped = 0;       // 因队列已满而丢弃的消息数
+    int queued = 0;            // 当前排队的消息数
+  };
+
+  /*!
+   * \brief 构造函数
+   * \param max_queue 队列上限
+   * \param parent 父对象
+   */
+  explicit MqttConflator(int max_queue, QObject *parent = nullptr);
+
+  /*!
+   * \brief 添加规则，一个主题匹配多条规则时使用最先添加的规则
+   * \param filter 主题过滤器，支持'+'和'#'通配符
+   * \param conflate 是否只保留最新值
+   * \param max_rate_hz 每个主题的最大投递频率（次/秒），0表示不限速；限速的主题总是合并
+   * \return 过滤器是否合法
+   */
+  bool addRule(const QString &filter, bool conflate, double max_rate_hz = 0);
+
+  /*!
+   * \brief 清除全部规则
+   */
+  void clearRules();
+
+  /*!
+   * \brief 设置队列上限
+   */
+  void setMaxQueue(int max_queue);
+
+  /*!
+   * \brief 写入一条消息（客户端线程）
+   */
+  void push(const MqttMessage &message);
+
+  /*!
+   * \brief 取走全部排队的消息
+   */
+  MqttMessageBatch take();
+
+  /*!
+   * \brief 获取合并统计
+   */
+  Stats stats() const;
+
+ signals:
+  /*!
+   * \brief 队列由空变为非空时发出，接收方调用take()之前不会再次发出
+   */
+  void messagesAvailable();
+
+ private slots:
+  /*!
+   * \brief 将到期的限速消息移入队列
+   */
+  void releaseHeld();
+
+ private:
+  struct Rule {
+    QByteArray filter;           // UTF-8编码的主题过滤器
+    bool conflate = false;       // 是否只保留最新值
+    qint64 min_interval_ns = 0;  // 最小投递间隔
+  };
+
+  struct Item {
+    QString topic;           // 消息主题
+    MqttMessage message;     // 消息（合并的主题存放在latest_中）
+    bool conflated = false;  // 是否为合并的主题
+  };
+
+  struct Held {
+    MqttMessage message;  // 等待投递的最新消息
+    qint64 due_ns = 0;    // 可投递的时刻
+  };
+
+  const Rule *ruleFor(const QString &topic);
+  bool enqueueLocked(const MqttMessage &message, bool conflate);
+  void scheduleRelease(qint64 due_ns, qint64 now_ns);
+
+  mutable QMutex mutex_;                     // 保护以下全部成员
+  QVector<Rule> rules_;                      // 规则列表
+  TopicTrie rule_trie_;                      // 规则过滤器前缀树
+  QHash<QString, int> rule_cache_;           // 主题到规则下标，-1表示无规则
+  QList<Item> queue_;                        // 排队的消息
+  QHash<QString, MqttMessage> latest_;       // 已在队列中的合并主题的最新值
+  QHash<QString, Held> held_;                // 因限速而等待的消息
+  QHash<QString, qint64> last_delivery_ns_;  // 限速主题最近一次入队的时刻
+  int max_queue_;                            // 队列上限
+  bool notified_ = false;                    // 是否已发出信号且尚未被取走
+  Stats stats_;                              // 合并统计（queued字段在读取时计算）
+  QTimer *release_timer_ = nullptr;          // 限速消息释放定时器
+  qint64 release_due_ns_ = 0;                // 定时器到期的时刻
+};
+
+#endif  // MQTTCONFLATOR_H
@@ -0,0 +1,184 @@
+#include "MqttConnectRace.h"
+
+#include "DnsCache.h"
+
+const int MqttConnectRace::kAttemptDelayMs;
+
+bool MqttEndpoint::parse(const QString &text, int default_port, MqttEndpoint *endpoint) {
+  const QString trimmed = text.trimmed();
+  QString host = trimmed;
+  int port = default_port;
+  if (trimmed.startsWith('[')) {
+    // [ipv6]或[ipv6]:port
+    int close = trimmed.indexOf(']');
+    if (close < 0) {
+      return false;
+    }
+    host = trimmed.mid(1, close - 1);
+    if (close + 1 < trimmed.size()) {
+      if (trimmed.at(close + 1) != ':') {
+        return false;
+      }
+      bool ok;
+      port = trimmed.mid(close + 2).toInt(&ok);
+      if (!ok) {
+        return false;
+      }
+    }
+  } else if (trimmed.count(':') == 1) {
+    // 不带方括号的IPv6地址含有多个冒号，不视为带端口
+    int colon = trimmed.indexOf(':');
+    bool ok;
+    host = trimmed.left(colon);
+    port = trimmed.mid(colon + 1).toInt(&ok);
+    if (!ok) {
+      return false;
+    }
+  }
+
+  if (host.isEmpty() || port <= 0 || port > 65535) {
+    return false;
+  }
+  endpoint->host = host;
+  endpoint->port = port;
+  return true;
+}
+
+QString MqttEndpoint::toString() const {
+  return host.contains(':') ? QString("[%1]:%2").arg(host).arg(port) : QString("%1:%2").arg(host).arg(port);
+}
+
+MqttConnectRace::MqttConnectRace(const QList<MqttEndpoint> &endpoints, QObject *parent)
+    : QObject(parent), endpoints_(endpoints), addresses_(endpoints.size()), resolved_(endpoints.size(), false) {
+  attempt_timer_ = new QTimer(this);
+  attempt_timer_->setSingleShot(true);
+  connect(attempt_timer_, &QTimer::timeout, this, &MqttConnectRace::startNextAttempt);
+  timeout_timer_ = new QTimer(this);
+  timeout_timer_->setSingleShot(true);
+  connect(timeout_timer_, &QTimer::timeout, this, [this]() {
+    fail(last_error_.isEmpty() ? tr("Connection attempts timed out") : last_error_);
+  });
+}
+
+void MqttConnectRace::start(int timeout_ms) {
+  if (endpoints_.isEmpty()) {
+    fail(tr("No broker endpoints"));
+    return;
+  }
+
+  timeout_timer_->start(timeout_ms);
+  // 并行解析全部代理，缓存命中时同步回调
+  for (int i = 0; i < endpoints_.size() && !finished_; ++i) {
+    DnsCache::instance()->resolve(endpoints_.at(i).host, this,
+                                  [this, i](const QList<QHostAddress> &addresses) { onResolved(i, addresses); });
+  }
+}
+
+void MqttConnectRace::onResolved(int endpoint, const QList<QHostAddress> &addresses) {
+  if (finished_ || resolved_.at(endpoint)) {
+    return;
+  }
+
+  // IPv6与IPv4交替排列，一个协议族整体不可达时不必等完所有该族地址
+  QList<QHostAddress> v6, v4, ordered;
+  for (const QHostAddress &address : addresses) {
+    (address.protocol() == QAbstractSocket::IPv6Protocol ? v6 : v4).append(address);
+  }
+  for (int i = 0; i < qMax(v6.size(), v4.size()); ++i) {
+    if (i < v6.size()) {
+      ordered.append(v6.at(i));
+    }
+    if (i < v4.size()) {
+      ordered.append(v4.at(i));
+    }
+  }
+  addresses_[endpoint] = ordered;
+  resolved_[endpoint] = true;
+  if (ordered.isEmpty()) {
+    last_error_ = tr("Cannot resolve host %1").arg(endpoints_.at(endpoint).host);
+  }
+
+  if (endpoints_.size() == 1 && ordered.size() == 1) {
+    finish(0, ordered.first());
+    return;
+  }
+  // 正在等待该代理的解析结果
+  if (endpoint == next_endpoint_ && !attempt_timer_->isActive()) {
+    startNextAttempt();
+  }
+}
+
+void MqttConnectRace::startNextAttempt() {
+  attempt_timer_->stop();
+  while (!finished_ && next_endpoint_ < endpoints_.size()) {
+    if (!resolved_.at(next_endpoint_)) {
+      // 等待解析完成后由onResolved继续
+      return;
+    }
+
+    const QList<QHostAddress> &addresses = addresses_.at(next_endpoint_);
+    if (next_address_ >= addresses.size()) {
+      ++next_endpoint_;
+      next_address_ = 0;
+      continue;
+    }
+
+    const QHostAddress address = addresses.at(next_address_++);
+    QTcpSocket *socket = new QTcpSocket(this);
+    attempts_.insert(socket, next_endpoint_);
+    connect(socket, &QAbstractSocket::stateChanged, this,
+            [this, socket](QAbstractSocket::SocketState state) { onAttemptStateChanged(socket, state); });
+    socket->connectToHost(address, static_cast<quint16>(endpoints_.at(next_endpoint_).port));
+    attempt_timer_->start(kAttemptDelayMs);
+    return;
+  }
+
+  if (!finished_ && attempts_.isEmpty() && next_endpoint_ >= endpoints_.size()) {
+    fail(last_error_.isEmpty() ? tr("No reachable broker") : last_error_);
+  }
+}
+
+void MqttConnectRace::onAttemptStateChanged(QTcpSocket *socket, QAbstractSocket::SocketState state) {
+  if (finished_ || !attempts_.contains(socket)) {
+    return;
+  }
+
+  if (state == QAbstractSocket::ConnectedState) {
+    finish(attempts_.value(socket), socket->peerAddress());
+  } else if (state == QAbstractSocket::UnconnectedState) {
+    last_error_ = QString("%1: %2").arg(endpoints_.at(attempts_.value(socket)).toString(), socket->errorString());
+    attempts_.remove(socket);
+    socket->deleteLater();
+    // 失败后不必等满间隔，立即尝试下一个地址
+    if (attempts_.isEmpty()) {
+      startNextAttempt();
+    }
+  }
+}
+
+void MqttConnectRace::finish(int endpoint, const QHostAddress &address) {
+  finished_ = true;
+  attempt_timer_->stop();
+  timeout_timer_->stop();
+  abortAttempts();
+  emit succeeded(endpoint, address);
+}
+
+void MqttConnectRace::fail(const QString &reason) {
+  if (finished_) {
+    return;
+  }
+  finished_ = true;
+  attempt_timer_->stop();
+  timeout_timer_->stop();
+  abortAttempts();
+  emit failed(reason);
+}
+
+void MqttConnectRace::abortAttempts() {
+  for (QHash<QTcpSocket *, int>::const_iterator it = attempts_.constBegin(); it != attempts_.constEnd(); ++it) {
+    it.key()->abort();
+    it.key()->deleteLater();
+  }
+  attempts_.clear();
+}
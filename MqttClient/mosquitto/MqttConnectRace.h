@@ -0,0 +1,101 @@
+#ifndef MQTTCONNECTRACE_H
+#define MQTTCONNECTRACE_H
+
+#include <QHash>
+#include <QHostAddress>
+#include <QList>
+#include <QObject>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QVector>
+
+/*!
+ * \brief MQTT代理地址
+ */
+struct MqttEndpoint {
+  QString host;     // 主机名或IP
+  int port = 1883;  // 端口
+
+  /*!
+   * \brief 解析"host"、"host:port"或"[ipv6]:port"格式的地址
+   * \param text 地址文本
+   * \param default_port 未指定端口时使用的端口
+   * \param endpoint 解析结果
+   * \return 格式是否合法
+   */
+  static bool parse(const QString &text, int default_port, MqttEndpoint *endpoint);
+
+  /*!
+   * \brief 格式化为"host:port"
+   */
+  QString toString() const;
+};
+
+/*!
+ * \brief 按Happy Eyeballs（RFC 8305）方式在多个代理地址间竞速建立TCP连接
+ * 按顺序解析各代理的主机名（经DnsCache缓存），每个代理的地址按IPv6、IPv4交替排列，
+ * 依次发起TCP连接：前一个尝试在kAttemptDelayMs内未成功就并行发起下一个，
+ * 前一个失败则立即发起下一个；第一个连通的地址胜出，其余尝试被中止。
+ * 只有一个代理且只解析到一个地址时不做探测，直接报告该地址。
+ * 探测连接只用于选出可达的地址，胜出后即关闭，由libmosquitto重新连接该地址。
+ * 每个对象只能启动一次。
+ */
+class MqttConnectRace : public QObject {
+  Q_OBJECT
+
+ public:
+  static const int kAttemptDelayMs = 250;  // 相邻两次连接尝试的间隔
+
+  /*!
+   * \brief 构造函数
+   * \param endpoints 按优先级排列的代理地址
+   * \param parent 父对象
+   */
+  explicit MqttConnectRace(const QList<MqttEndpoint> &endpoints, QObject *parent = nullptr);
+
+  /*!
+   * \brief 开始竞速
+   * \param timeout_ms 总超时（毫秒）
+   */
+  void start(int timeout_ms);
+
+ signals:
+  /*!
+   * \brief 找到可达的地址
+   * \param endpoint 代理在列表中的下标
+   * \param address 连通的IP地址
+   */
+  void succeeded(int endpoint, const QHostAddress &address);
+
+  /*!
+   * \brief 全部地址都不可达或超时
+   * \param reason 最后一个错误
+   */
+  void failed(const QString &reason);
+
+ private slots:
+  /*!
+   * \brief 发起下一个连接尝试
+   */
+  void startNextAttempt();
+
+ private:
+  void onResolved(int endpoint, const QList<QHostAddress> &addresses);
+  void onAttemptStateChanged(QTcpSocket *socket, QAbstractSocket::SocketState state);
+  void finish(int endpoint, const QHostAddress &address);
+  void fail(const QString &reason);
+  void abortAttempts();
+
+  QList<MqttEndpoint> endpoints_;           // 代理地址
+  QVector<QList<QHostAddress>> addresses_;  // 各代理的解析结果（已交替排列）
+  QVector<bool> resolved_;                  // 各代理是否已完成解析
+  int next_endpoint_ = 0;                   // 下一个尝试的代理
+  int next_address_ = 0;                    // 下一个尝试的地址
+  QHash<QTcpSocket *, int> attempts_;       // 进行中的连接尝试及其代理下标
+  QTimer *attempt_timer_ = nullptr;         // 连接尝试间隔定时器
+  QTimer *timeout_timer_ = nullptr;         // 总超时定时器
+  QString last_error_;                      // 最后一个错误
+  bool finished_ = false;                   // 是否已报告结果
+};
+
+#endif  // MQTTCONNECTRACE_H
@@ -0,0 +1,552 @@
+#include "MqttFanout.h"
+
+#include <QDateTime>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <linux/futex.h>
+#include <new>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "MqttFileSpace.h"
+#include "MqttLog.h"
+#include "MqttMetrics.h"
+
+// 共享区头部，其后依次为读者位置数组、各读者的上行环和广播环
+struct alignas(64) MqttFanoutHeader {
+  quint32 magic;
+  quint32 version;
+  quint64 capacity;                              // 广播环字节数
+  quint32 max_readers;                           // 读者位置数
+  quint32 publish_capacity;                      // 每个读者的上行环字节数
+  std::atomic<qint64> writer_pid;                // 写入端进程号，关闭后为0
+  alignas(64) std::atomic<quint64> claim;        // 写入端正在改写的范围的结束位置
+  std::atomic<quint64> commit;                   // 已完整写入的位置
+  alignas(64) std::atomic<quint32> inbound_seq;  // 广播环的futex字，有新消息且有读者在等待时递增
+  std::atomic<quint32> inbound_waiters;          // 正在等待广播环的读者数
+  alignas(64) std::atomic<quint32> publish_seq;  // 上行环的futex字，有新消息且写入端在等待时递增
+  std::atomic<quint32> publish_waiters;          // 写入端是否正在等待上行环
+};
+
+// 读者位置，读者写入的字段与写入端写入的字段分处不同的缓存行
+struct alignas(64) MqttFanoutSlot {
+  std::atomic<qint64> pid;                        // 读者进程号，0表示空闲
+  std::atomic<quint64> cursor;                    // 读者的读取位置
+  std::atomic<quint64> dropped;                   // 读者被覆盖的消息数
+  alignas(64) std::atomic<quint64> publish_head;  // 上行环写入位置（读者写）
+  alignas(64) std::atomic<quint64> publish_tail;  // 上行环读取位置（写入端写）
+};
+
+namespace {
+
+const quint32 kFanoutMagic = 0x4f46514d;  // "MQFO"
+const quint32 kFanoutVersion = 2;
+
+// 记录标志
+const quint8 kRetainFlag = 0x01;   // 保留消息
+const quint8 kPaddingFlag = 0x02;  // 环尾的填充，读者直接跳过
+
+// 记录头，其后为UTF-8主题和消息内容
+struct RecordHeader {
+  quint32 size;         // 记录总字节数（含头部并按kRecordAlign对齐）
+  quint32 payload_len;  // 消息长度
+  quint32 sequence;     // 消息序号，读者据此统计被覆盖的消息数
+  quint16 topic_len;    // 主题长度
+  quint8 qos;           // 消息质量等级
+  quint8 flags;         // kRetainFlag、kPaddingFlag
+  qint64 timestamp;     // 收到消息的时刻（毫秒级Unix时间戳）
+  qint64 received_ns;   // 收到消息的单调时钟时刻
+  quint32 origin;       // 写回的本机发布为提交者的读者位置加1，来自代理的消息为0
+  quint32 reserved;
+};
+
+const quint64 kRecordHeaderSize = sizeof(RecordHeader);
+const quint64 kRecordAlign = sizeof(RecordHeader);  // 环尾剩余空间总能放下一个填充记录头
+const qint64 kMinCapacity = 64 * 1024;
+const int kMinPublishCapacity = 4096;
+const int kMaxReaders = 1024;
+
+static_assert(sizeof(RecordHeader) == 40, "RecordHeader must stay 40 bytes");
+static_assert(sizeof(std::atomic<quint32>) == sizeof(quint32), "futex words must be plain 32-bit integers");
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "shared counters must be lock-free");
+
+inline quint64 alignUp(quint64 size, quint64 align) { return (size + align - 1) / align * align; }
+
+// 整个共享区的字节数
+qint64 layoutSize(quint64 capacity, quint32 max_readers, quint32 publish_capacity) {
+  return sizeof(MqttFanoutHeader) + quint64(max_readers) * (sizeof(MqttFanoutSlot) + publish_capacity) + capacity;
+}
+
+// 读取ring中offset处的记录头，长度与所在环不符时返回false
+bool readRecordHeader(const uchar *ring, quint64 offset, quint64 capacity, RecordHeader *record) {
+  memcpy(record, ring + offset, sizeof(*record));
+  if (record->size < kRecordHeaderSize || record->size % kRecordAlign != 0 || record->size > capacity - offset) {
+    return false;
+  }
+  return (record->flags & kPaddingFlag) || kRecordHeaderSize + record->topic_len + record->payload_len <= record->size;
+}
+
+void writePadding(uchar *dst, quint64 size) {
+  RecordHeader record;
+  memset(&record, 0, sizeof(record));
+  record.size = static_cast<quint32>(size);
+  record.flags = kPaddingFlag;
+  memcpy(dst, &record, sizeof(record));
+}
+
+void writeRecord(uchar *dst, const RecordHeader &record, const char *topic, const void *payload) {
+  memcpy(dst, &record, sizeof(record));
+  memcpy(dst + kRecordHeaderSize, topic, record.topic_len);
+  if (record.payload_len > 0) {
+    memcpy(dst + kRecordHeaderSize + record.topic_len, payload, record.payload_len);
+  }
+}
+
+// futex字须是映射区内的32位整数，等待和唤醒不带FUTEX_PRIVATE_FLAG，以便跨进程生效
+void futexWait(std::atomic<quint32> *word, quint32 expected, int timeout_ms) {
+  struct timespec timeout;
+  timeout.tv_sec = timeout_ms / 1000;
+  timeout.tv_nsec = (timeout_ms % 1000) * 1000000L;
+  syscall(SYS_futex, reinterpret_cast<quint32 *>(word), FUTEX_WAIT, expected, &timeout, nullptr, 0);
+}
+
+void futexWakeAll(std::atomic<quint32> *word) {
+  syscall(SYS_futex, reinterpret_cast<quint32 *>(word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+bool processAlive(qint64 pid) { return pid > 0 && (kill(static_cast<pid_t>(pid), 0) == 0 || errno == EPERM); }
+
+}  // namespace
+
+const qint64 MqttFanoutWriter::kDefaultCapacity;
+const int MqttFanoutWriter::kDefaultMaxReaders;
+const int MqttFanoutWriter::kDefaultPublishCapacity;
+
+MqttFanoutWriter::MqttFanoutWriter() = default;
+
+MqttFanoutWriter::~MqttFanoutWriter() { close(); }
+
+bool MqttFanoutWriter::create(const QString &path, qint64 capacity, int max_readers, int publish_capacity) {
+  close();
+
+  const quint64 ring_capacity = alignUp(qMax(capacity, kMinCapacity), kRecordAlign);
+  const quint32 readers = static_cast<quint32>(qBound(1, max_readers, kMaxReaders));
+  const quint32 publish_ring =
+      static_cast<quint32>(alignUp(qMax(publish_capacity, kMinPublishCapacity), kRecordAlign));
+  const qint64 size = layoutSize(ring_capacity, readers, publish_ring);
+
+  // 先删除旧文件再创建，仍映射着旧文件的读者不会看到新数据，而是发现旧的写入端已退出
+  QFile::remove(path);
+  file_.setFileName(path);
+  if (!file_.open(QIODevice::ReadWrite | QIODevice::Truncate)) {
+    mqttWarning() << "无法创建本机分发区:" << path << file_.errorString();
+    return false;
+  }
+  // tmpfs写满时写入稀疏文件的映射区会触发SIGBUS（写入端和读者进程都会），创建时即实际分配全部空间
+  if (!mqttReserveFileSpace(&file_, size)) {
+    file_.close();
+    file_.remove();
+    return false;
+  }
+  map_ = file_.map(0, size);
+  if (!map_) {
+    mqttWarning() << "无法映射本机分发区:" << file_.errorString();
+    file_.close();
+    file_.remove();
+    return false;
+  }
+
+  // 新文件内容全为0，即所有计数和位置的初始值
+  header_ = new (map_) MqttFanoutHeader;
+  uchar *slots = map_ + sizeof(MqttFanoutHeader);
+  for (quint32 i = 0; i < readers; ++i) {
+    new (slots + i * sizeof(MqttFanoutSlot)) MqttFanoutSlot;
+  }
+  slots_ = reinterpret_cast<MqttFanoutSlot *>(slots);
+  publish_rings_ = slots + readers * sizeof(MqttFanoutSlot);
+  ring_ = publish_rings_ + quint64(readers) * publish_ring;
+  header_->version = kFanoutVersion;
+  header_->capacity = ring_capacity;
+  header_->max_readers = readers;
+  header_->publish_capacity = publish_ring;
+  header_->writer_pid.store(getpid(), std::memory_order_relaxed);
+  // 最后写入标识，读者看到标识时其余字段均已就绪
+  std::atomic_thread_fence(std::memory_order_release);
+  header_->magic = kFanoutMagic;
+
+  position_ = 0;
+  sequence_ = 0;
+  drain_start_ = 0;
+  messages_.store(0, std::memory_order_relaxed);
+  dropped_.store(0, std::memory_order_relaxed);
+  relayed_.store(0, std::memory_order_relaxed);
+  reader_count_.store(0, std::memory_order_relaxed);
+  return true;
+}
+
+void MqttFanoutWriter::close() {
+  if (!map_) {
+    return;
+  }
+  header_->writer_pid.store(0, std::memory_order_release);
+  // 唤醒等待中的读者，使其尽快发现写入端已关闭
+  header_->inbound_seq.fetch_add(1, std::memory_order_seq_cst);
+  futexWakeAll(&header_->inbound_seq);
+  file_.unmap(map_);
+  file_.close();
+  file_.remove();
+  map_ = nullptr;
+  header_ = nullptr;
+  slots_ = nullptr;
+  publish_rings_ = nullptr;
+  ring_ = nullptr;
+  reader_count_.store(0, std::memory_order_relaxed);
+}
+
+bool MqttFanoutWriter::append(const char *topic, const void *payload, int payload_len, int qos, bool retain,
+                              int origin) {
+  if (!header_) {
+    return false;
+  }
+  const quint64 capacity = header_->capacity;
+  const size_t topic_len = strlen(topic);
+  const quint64 size = alignUp(kRecordHeaderSize + topic_len + payload_len, kRecordAlign);
+  if (topic_len > 0xffff || size > capacity / 4) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  // 环尾放不下整条记录时用填充补齐，记录总是连续存放
+  const quint64 offset = position_ % capacity;
+  const quint64 padding = capacity - offset < size ? capacity - offset : 0;
+  const quint64 end = position_ + padding + size;
+
+  // 先公布将要改写的范围再写数据，读者拷贝记录后据此判断拷贝期间数据是否可能被改写
+  header_->claim.store(end, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  if (padding > 0) {
+    writePadding(ring_ + offset, padding);
+  }
+  RecordHeader record;
+  record.size = static_cast<quint32>(size);
+  record.payload_len = static_cast<quint32>(payload_len);
+  record.sequence = sequence_++;
+  record.topic_len = static_cast<quint16>(topic_len);
+  record.qos = static_cast<quint8>(qos);
+  record.flags = retain ? kRetainFlag : 0;
+  record.timestamp = QDateTime::currentMSecsSinceEpoch();
+  record.received_ns = mqttMonotonicNs();
+  record.origin = static_cast<quint32>(origin + 1);
+  record.reserved = 0;
+  writeRecord(ring_ + (position_ + padding) % capacity, record, topic, payload);
+  position_ = end;
+
+  // 与读者wait()中对inbound_waiters和commit的访问构成Dekker式配对，两者必须都是seq_cst，
+  // 否则读者可能在写入端检查之后开始等待，却没有看到新的commit
+  header_->commit.store(end, std::memory_order_seq_cst);
+  if (header_->inbound_waiters.load(std::memory_order_seq_cst) != 0) {
+    header_->inbound_seq.fetch_add(1, std::memory_order_seq_cst);
+    futexWakeAll(&header_->inbound_seq);
+  }
+  messages_.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+int MqttFanoutWriter::drainPublishes(const PublishHandler &handler, int max_messages) {
+  if (!header_) {
+    return 0;
+  }
+  const quint32 readers = header_->max_readers;
+  const quint64 capacity = header_->publish_capacity;
+  int count = 0;
+  // 每次从不同的读者开始，避免发布频繁的读者独占转发
+  for (quint32 n = 0; n < readers && count < max_messages; ++n) {
+    const quint32 i = (drain_start_ + n) % readers;
+    MqttFanoutSlot &slot = slots_[i];
+    const quint64 head = slot.publish_head.load(std::memory_order_acquire);
+    quint64 tail = slot.publish_tail.load(std::memory_order_relaxed);
+    const uchar *ring = publish_rings_ + quint64(i) * capacity;
+    while (tail != head && count < max_messages) {
+      RecordHeader record;
+      if (head - tail > capacity || !readRecordHeader(ring, tail % capacity, capacity, &record)) {
+        mqttWarning() << "本机分发区上行环数据无效，已丢弃，读者进程:" << slot.pid.load(std::memory_order_relaxed);
+        tail = head;
+        break;
+      }
+      if (!(record.flags & kPaddingFlag)) {
+        const char *data = reinterpret_cast<const char *>(ring + tail % capacity + kRecordHeaderSize);
+        handler(QByteArray(data, record.topic_len), QByteArray(data + record.topic_len, record.payload_len),
+                record.qos, (record.flags & kRetainFlag) != 0, static_cast<int>(i));
+        ++count;
+      }
+      tail += record.size;
+    }
+    slot.publish_tail.store(tail, std::memory_order_release);
+  }
+  drain_start_ = (drain_start_ + 1) % readers;
+  relayed_.fetch_add(count, std::memory_order_relaxed);
+  return count;
+}
+
+bool MqttFanoutWriter::waitForPublishes(int timeout_ms) {
+  if (!header_) {
+    return false;
+  }
+  auto pending = [this]() {
+    for (quint32 i = 0; i < header_->max_readers; ++i) {
+      if (slots_[i].publish_head.load(std::memory_order_seq_cst) !=
+          slots_[i].publish_tail.load(std::memory_order_relaxed)) {
+        return true;
+      }
+    }
+    return false;
+  };
+  if (pending()) {
+    return true;
+  }
+  header_->publish_waiters.fetch_add(1, std::memory_order_seq_cst);
+  const quint32 seq = header_->publish_seq.load(std::memory_order_seq_cst);
+  if (!pending()) {
+    futexWait(&header_->publish_seq, seq, timeout_ms);
+  }
+  header_->publish_waiters.fetch_sub(1, std::memory_order_seq_cst);
+  return pending();
+}
+
+int MqttFanoutWriter::reapReaders() {
+  if (!header_) {
+    return 0;
+  }
+  int reaped = 0;
+  int active = 0;
+  for (quint32 i = 0; i < header_->max_readers; ++i) {
+    qint64 pid = slots_[i].pid.load(std::memory_order_acquire);
+    if (pid != 0 && kill(static_cast<pid_t>(pid), 0) != 0 && errno == ESRCH &&
+        slots_[i].pid.compare_exchange_strong(pid, 0)) {
+      mqttInfo() << "本机分发区读者已退出，释放位置:" << pid;
+      ++reaped;
+    } else if (pid != 0) {
+      ++active;
+    }
+  }
+  reader_count_.store(active, std::memory_order_relaxed);
+  return reaped;
+}
+
+QVector<MqttFanoutWriter::ReaderInfo> MqttFanoutWriter::readers() const {
+  QVector<ReaderInfo> infos;
+  if (!header_) {
+    return infos;
+  }
+  const quint64 commit = header_->commit.load(std::memory_order_acquire);
+  for (quint32 i = 0; i < header_->max_readers; ++i) {
+    const qint64 pid = slots_[i].pid.load(std::memory_order_acquire);
+    if (pid == 0) {
+      continue;
+    }
+    ReaderInfo info;
+    info.pid = pid;
+    info.lag = qMin(commit - slots_[i].cursor.load(std::memory_order_acquire), header_->capacity);
+    info.dropped = slots_[i].dropped.load(std::memory_order_relaxed);
+    infos.append(info);
+  }
+  return infos;
+}
+
+MqttFanoutReader::MqttFanoutReader() = default;
+
+MqttFanoutReader::~MqttFanoutReader() { detach(); }
+
+bool MqttFanoutReader::attach(const QString &path) {
+  detach();
+
+  file_.setFileName(path);
+  if (!file_.open(QIODevice::ReadWrite)) {
+    mqttWarning() << "无法打开本机分发区:" << path << file_.errorString();
+    return false;
+  }
+  const qint64 size = file_.size();
+  map_ = size >= qint64(sizeof(MqttFanoutHeader)) ? file_.map(0, size) : nullptr;
+  if (!map_) {
+    mqttWarning() << "无法映射本机分发区:" << path << file_.errorString();
+    file_.close();
+    return false;
+  }
+  header_ = reinterpret_cast<MqttFanoutHeader *>(map_);
+  const bool valid = header_->magic == kFanoutMagic;
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (!valid || header_->version != kFanoutVersion || header_->max_readers == 0 ||
+      layoutSize(header_->capacity, header_->max_readers, header_->publish_capacity) != size) {
+    mqttWarning() << "不是有效的本机分发区:" << path;
+    detach();
+    return false;
+  }
+
+  uchar *slots = map_ + sizeof(MqttFanoutHeader);
+  const qint64 pid = getpid();
+  for (quint32 i = 0; i < header_->max_readers && !slot_; ++i) {
+    MqttFanoutSlot *slot = reinterpret_cast<MqttFanoutSlot *>(slots) + i;
+    qint64 expected = 0;
+    if (slot->pid.compare_exchange_strong(expected, pid)) {
+      slot_ = slot;
+      slot_index_ = i;
+      publish_ring_ = slots + header_->max_readers * sizeof(MqttFanoutSlot) + quint64(i) * header_->publish_capacity;
+    }
+  }
+  if (!slot_) {
+    mqttWarning() << "本机分发区的读者位置已满:" << path;
+    detach();
+    return false;
+  }
+  ring_ = slots + quint64(header_->max_readers) * (sizeof(MqttFanoutSlot) + header_->publish_capacity);
+
+  cursor_ = header_->commit.load(std::memory_order_acquire);
+  sequence_valid_ = false;
+  dropped_ = 0;
+  slot_->dropped.store(0, std::memory_order_relaxed);
+  slot_->cursor.store(cursor_, std::memory_order_release);
+  return true;
+}
+
+void MqttFanoutReader::detach() {
+  if (slot_) {
+    slot_->pid.store(0, std::memory_order_release);
+  }
+  if (map_) {
+    file_.unmap(map_);
+  }
+  file_.close();
+  map_ = nullptr;
+  header_ = nullptr;
+  slot_ = nullptr;
+  publish_ring_ = nullptr;
+  ring_ = nullptr;
+}
+
+int MqttFanoutReader::read(const Handler &handler, int max_messages) {
+  if (!slot_) {
+    return 0;
+  }
+  const quint64 capacity = header_->capacity;
+  const quint64 commit = header_->commit.load(std::memory_order_acquire);
+  int count = 0;
+  while (cursor_ != commit && count < max_messages) {
+    if (commit - cursor_ > capacity) {
+      resync();
+      break;
+    }
+    const quint64 offset = cursor_ % capacity;
+    RecordHeader record;
+    const bool valid = readRecordHeader(ring_, offset, capacity, &record);
+    if (valid && !(record.flags & kPaddingFlag)) {
+      if (scratch_.size() < static_cast<int>(record.size)) {
+        scratch_.resize(record.size);
+      }
+      memcpy(scratch_.data(), ring_ + offset, record.size);
+    }
+    // 拷贝完成后再检查写入端是否已开始改写这一位置，是则拷贝的内容不可信
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (!valid || header_->claim.load(std::memory_order_relaxed) - cursor_ > capacity) {
+      resync();
+      break;
+    }
+    cursor_ += record.size;
+    if (record.flags & kPaddingFlag) {
+      continue;
+    }
+
+    // 序号不连续说明中间的消息已被覆盖
+    if (sequence_valid_ && record.sequence != sequence_) {
+      dropped_ += record.sequence - sequence_;
+    }
+    sequence_ = record.sequence + 1;
+    sequence_valid_ = true;
+    // 自己提交、由写入端写回的发布，与直连代理时的no_local一样不交给自己
+    if (record.origin == slot_index_ + 1) {
+      continue;
+    }
+
+    Message message;
+    const char *data = scratch_.constData() + kRecordHeaderSize;
+    message.topic = QByteArray::fromRawData(data, record.topic_len);
+    message.payload = QByteArray::fromRawData(data + record.topic_len, record.payload_len);
+    message.qos = record.qos;
+    message.retain = (record.flags & kRetainFlag) != 0;
+    message.timestamp = record.timestamp;
+    message.received_ns = record.received_ns;
+    handler(message);
+    ++count;
+  }
+  slot_->cursor.store(cursor_, std::memory_order_release);
+  slot_->dropped.store(dropped_, std::memory_order_relaxed);
+  return count;
+}
+
+void MqttFanoutReader::resync() {
+  // 落后超过整个环，跳到最新位置；被跳过的消息数由下一条消息的序号得出
+  cursor_ = header_->commit.load(std::memory_order_acquire);
+}
+
+bool MqttFanoutReader::wait(int timeout_ms) {
+  if (!slot_) {
+    return false;
+  }
+  if (header_->commit.load(std::memory_order_acquire) != cursor_) {
+    return true;
+  }
+  header_->inbound_waiters.fetch_add(1, std::memory_order_seq_cst);
+  const quint32 seq = header_->inbound_seq.load(std::memory_order_seq_cst);
+  if (header_->commit.load(std::memory_order_seq_cst) == cursor_ && writerAlive()) {
+    futexWait(&header_->inbound_seq, seq, timeout_ms);
+  }
+  header_->inbound_waiters.fetch_sub(1, std::memory_order_seq_cst);
+  return header_->commit.load(std::memory_order_acquire) != cursor_;
+}
+
+bool MqttFanoutReader::publish(const QByteArray &topic, const QByteArray &payload, int qos, bool retain) {
+  if (!slot_ || topic.isEmpty() || topic.size() > 0xffff) {
+    return false;
+  }
+  const quint64 capacity = header_->publish_capacity;
+  const quint64 size = alignUp(kRecordHeaderSize + topic.size() + payload.size(), kRecordAlign);
+  if (size > capacity / 2) {
+    return false;
+  }
+  const quint64 head = slot_->publish_head.load(std::memory_order_relaxed);
+  const quint64 tail = slot_->publish_tail.load(std::memory_order_acquire);
+  const quint64 offset = head % capacity;
+  const quint64 padding = capacity - offset < size ? capacity - offset : 0;
+  if (head + padding + size - tail > capacity) {
+    return false;
+  }
+  if (padding > 0) {
+    writePadding(publish_ring_ + offset, padding);
+  }
+  RecordHeader record;
+  record.size = static_cast<quint32>(size);
+  record.payload_len = static_cast<quint32>(payload.size());
+  record.sequence = 0;
+  record.topic_len = static_cast<quint16>(topic.size());
+  record.qos = static_cast<quint8>(qos);
+  record.flags = retain ? kRetainFlag : 0;
+  record.timestamp = QDateTime::currentMSecsSinceEpoch();
+  record.received_ns = mqttMonotonicNs();
+  record.origin = 0;
+  record.reserved = 0;
+  writeRecord(publish_ring_ + (head + padding) % capacity, record, topic.constData(), payload.constData());
+
+  // 与写入端waitForPublishes()配对，见MqttFanoutWriter::append()
+  slot_->publish_head.store(head + padding + size, std::memory_order_seq_cst);
+  if (header_->publish_waiters.load(std::memory_order_seq_cst) != 0) {
+    header_->publish_seq.fetch_add(1, std::memory_order_seq_cst);
+    futexWakeAll(&header_->publish_seq);
+  }
+  return true;
+}
+
+bool MqttFanoutReader::writerAlive() const {
+  return header_ && processAlive(header_->writer_pid.load(std::memory_order_acquire));
+}
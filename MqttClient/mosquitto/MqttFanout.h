@@ -0,0 +1,249 @@
+#ifndef MQTTFANOUT_H
+#define MQTTFANOUT_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <QVector>
+#include <atomic>
+#include <functional>
+
+struct MqttFanoutHeader;
+struct MqttFanoutSlot;
+
+/*!
+ * \brief 本机消息分发区的写入端（守护进程一侧）
+ * 持有上游连接的进程创建一个共享内存文件（通常位于/dev/shm），把收到的消息写入其中的广播环，
+ * 同一台机器上的多个进程用MqttFanoutReader各自独立读取，不必各自连接代理。
+ * 广播环只有一个写入者，写入不等待读者：读者落后超过整个环时，被覆盖的消息计入该读者的丢弃数，
+ * 读者随后从最新位置继续。每个读者另有一个单生产者单消费者的上行环，写入端用drainPublishes()
+ * 取出其中的消息并转发给代理，再以提交者的读者位置为来源写回广播环，提交者读取时跳过自己的发布。
+ * 等待和唤醒使用Linux futex，只在对方确实在等待时才产生系统调用。
+ * append()只能由同一线程调用；drainPublishes()、waitForPublishes()只能由另一个（或同一个）线程调用；
+ * 统计方法可在任意线程调用。
+ */
+class MqttFanoutWriter {
+ public:
+  static const qint64 kDefaultCapacity = 64LL * 1024 * 1024;  // 默认广播环字节数
+  static const int kDefaultMaxReaders = 32;                   // 默认读者数上限
+  static const int kDefaultPublishCapacity = 1024 * 1024;     // 默认每个读者的上行环字节数
+
+  /*!
+   * \brief 读者状态
+   */
+  struct ReaderInfo {
+    qint64 pid = 0;       // 读者进程号
+    quint64 lag = 0;      // 尚未读取的字节数
+    quint64 dropped = 0;  // 因落后被覆盖的消息数
+  };
+
+  /*!
+   * \brief 上行消息处理函数，参数为主题、消息内容、QoS、保留标志和提交消息的读者位置，数据均为独立拷贝
+   */
+  typedef std::function<void(const QByteArray &, const QByteArray &, int, bool, int)> PublishHandler;
+
+  MqttFanoutWriter();
+
+  /*!
+   * \brief 析构函数，关闭并删除共享内存文件
+   */
+  ~MqttFanoutWriter();
+
+  MqttFanoutWriter(const MqttFanoutWriter &) = delete;
+  MqttFanoutWriter &operator=(const MqttFanoutWriter &) = delete;
+
+  /*!
+   * \brief 创建共享内存文件，已有的同名文件先被删除（仍映射着旧文件的读者会发现写入端已退出）
+   * 创建时即实际分配整个文件（默认约100MB），空间不足时失败
+   * \param path 文件路径，如/dev/shm/mqtt_fanout
+   * \param capacity 广播环字节数，单条消息不能超过其四分之一
+   * \param max_readers 读者数上限
+   * \param publish_capacity 每个读者的上行环字节数
+   * \return 是否成功创建
+   */
+  bool create(const QString &path, qint64 capacity = kDefaultCapacity, int max_readers = kDefaultMaxReaders,
+              int publish_capacity = kDefaultPublishCapacity);
+
+  /*!
+   * \brief 关闭并删除共享内存文件
+   */
+  void close();
+
+  /*!
+   * \brief 是否已创建
+   */
+  bool isOpen() const { return header_ != nullptr; }
+
+  /*!
+   * \brief 追加一条消息并唤醒等待中的读者
+   * \param topic 以0结尾的UTF-8主题
+   * \param payload 消息内容
+   * \param payload_len 消息长度
+   * \param qos 消息质量等级
+   * \param retain 是否为保留消息
+   * \param origin 写回本机读者的发布时为提交者的读者位置（PublishHandler的最后一个参数），该读者不会读到；
+   *               来自代理的消息为-1
+   * \return 是否写入，未创建或消息过大时返回false
+   */
+  bool append(const char *topic, const void *payload, int payload_len, int qos, bool retain, int origin = -1);
+
+  /*!
+   * \brief 取出读者提交的上行消息
+   * \param handler 处理函数，逐条调用
+   * \param max_messages 本次最多处理的消息数
+   * \return 处理的消息数
+   */
+  int drainPublishes(const PublishHandler &handler, int max_messages = 1024);
+
+  /*!
+   * \brief 等待读者提交上行消息
+   * \param timeout_ms 超时（毫秒）
+   * \return 是否有待取出的上行消息
+   */
+  bool waitForPublishes(int timeout_ms);
+
+  /*!
+   * \brief 释放进程已退出的读者占用的位置，同时更新readerCount()
+   * \return 释放的位置数
+   */
+  int reapReaders();
+
+  /*!
+   * \brief 当前读者的状态，不能与close()并发调用
+   */
+  QVector<ReaderInfo> readers() const;
+
+  /*!
+   * \brief 最近一次reapReaders()时的读者数，可与close()并发调用
+   */
+  int readerCount() const { return reader_count_.load(std::memory_order_relaxed); }
+
+  /*!
+   * \brief 已写入的消息数
+   */
+  qint64 messageCount() const { return messages_.load(std::memory_order_relaxed); }
+
+  /*!
+   * \brief 因过大而未写入的消息数
+   */
+  qint64 droppedCount() const { return dropped_.load(std::memory_order_relaxed); }
+
+  /*!
+   * \brief 已取出的上行消息数
+   */
+  qint64 relayedCount() const { return relayed_.load(std::memory_order_relaxed); }
+
+ private:
+  QFile file_;                          // 共享内存文件
+  uchar *map_ = nullptr;                // 整个文件的映射
+  MqttFanoutHeader *header_ = nullptr;  // 共享区头部
+  MqttFanoutSlot *slots_ = nullptr;     // 读者位置数组
+  uchar *publish_rings_ = nullptr;      // 各读者的上行环
+  uchar *ring_ = nullptr;               // 广播环
+  quint64 position_ = 0;                // 下一条消息的写入位置（仅写入线程访问）
+  quint32 sequence_ = 0;                // 下一条消息的序号（仅写入线程访问）
+  quint32 drain_start_ = 0;             // 下次取出上行消息时最先处理的读者位置（仅取出线程访问）
+  std::atomic<qint64> messages_{0};     // 已写入的消息数
+  std::atomic<qint64> dropped_{0};      // 未写入的消息数
+  std::atomic<qint64> relayed_{0};      // 已取出的上行消息数
+  std::atomic<int> reader_count_{0};    // 最近一次检查时的读者数
+};
+
+/*!
+ * \brief 本机消息分发区的读取端（订阅进程一侧）
+ * 连接后从当时的最新位置开始读取，之前的消息不会补发。读取时先把记录拷贝到本地缓冲区，
+ * 再检查写入端是否已覆盖该位置，因此不会向调用方交付被改写了一半的消息。
+ * 所有函数只能由同一线程调用，不同进程（或同一进程内的不同读取端）互不影响。
+ */
+class MqttFanoutReader {
+ public:
+  /*!
+   * \brief 一条消息，主题和内容引用读取端的缓冲区，只在处理函数内有效
+   */
+  struct Message {
+    QByteArray topic;        // UTF-8编码的主题
+    QByteArray payload;      // 消息内容
+    int qos = 0;             // 消息质量等级
+    bool retain = false;     // 是否为保留消息
+    qint64 timestamp = 0;    // 守护进程收到消息的时刻（毫秒级Unix时间戳）
+    qint64 received_ns = 0;  // 守护进程收到消息的单调时钟时刻（纳秒），可与本机其他进程比较
+  };
+
+  typedef std::function<void(const Message &)> Handler;
+
+  MqttFanoutReader();
+
+  /*!
+   * \brief 析构函数，释放读者位置
+   */
+  ~MqttFanoutReader();
+
+  MqttFanoutReader(const MqttFanoutReader &) = delete;
+  MqttFanoutReader &operator=(const MqttFanoutReader &) = delete;
+
+  /*!
+   * \brief 连接到共享内存文件并占用一个读者位置
+   * \return 是否成功，文件无效或读者已满时返回false
+   */
+  bool attach(const QString &path);
+
+  /*!
+   * \brief 释放读者位置并解除映射
+   */
+  void detach();
+
+  /*!
+   * \brief 是否已连接
+   */
+  bool isAttached() const { return slot_ != nullptr; }
+
+  /*!
+   * \brief 读取已到达的消息
+   * \param handler 处理函数，逐条调用
+   * \param max_messages 本次最多读取的消息数
+   * \return 读取的消息数
+   */
+  int read(const Handler &handler, int max_messages = 1024);
+
+  /*!
+   * \brief 等待新消息
+   * \param timeout_ms 超时（毫秒）
+   * \return 是否有未读取的消息
+   */
+  bool wait(int timeout_ms);
+
+  /*!
+   * \brief 请求守护进程把消息发布到代理
+   * 与直连代理并设置no_local时一样，订阅了该主题的其他本机读者能收到这条消息，本读者自己不会收到。
+   * \return 是否提交，上行环已满或消息过大时返回false
+   */
+  bool publish(const QByteArray &topic, const QByteArray &payload, int qos = 0, bool retain = false);
+
+  /*!
+   * \brief 因落后被覆盖的消息数
+   */
+  quint64 droppedCount() const { return dropped_; }
+
+  /*!
+   * \brief 写入端进程是否仍在运行
+   */
+  bool writerAlive() const;
+
+ private:
+  void resync();
+
+  QFile file_;                          // 共享内存文件
+  uchar *map_ = nullptr;                // 整个文件的映射
+  MqttFanoutHeader *header_ = nullptr;  // 共享区头部
+  MqttFanoutSlot *slot_ = nullptr;      // 占用的读者位置
+  quint32 slot_index_ = 0;              // 占用的读者位置的序号
+  uchar *publish_ring_ = nullptr;       // 本读者的上行环
+  uchar *ring_ = nullptr;               // 广播环
+  quint64 cursor_ = 0;                  // 下一条消息的读取位置
+  quint32 sequence_ = 0;                // 预期的下一条消息序号
+  bool sequence_valid_ = false;         // sequence_是否有效（连接后读到首条消息之前无效）
+  quint64 dropped_ = 0;                 // 被覆盖的消息数
+  QByteArray scratch_;                  // 读取时拷贝记录的缓冲区
+};
+
+#endif  // MQTTFANOUT_H
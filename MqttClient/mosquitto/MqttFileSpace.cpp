@@ -0,0 +1,33 @@
+#include "MqttFileSpace.h"
+
+#include <cerrno>
+#include <fcntl.h>
+
+#include "MqttLog.h"
+
+bool mqttReserveFileSpace(QFile *file, qint64 size) {
+  const int rc = posix_fallocate(file->handle(), 0, size);
+  if (rc == 0) {
+    return true;
+  }
+  if (rc == ENOSPC || rc == EFBIG) {
+    mqttWarning() << "文件空间不足:" << file->fileName() << qt_error_string(rc);
+    return false;
+  }
+
+  // 已有部分保留原内容，只在末尾写零
+  static const char kZeros[64 * 1024] = {};
+  qint64 pos = file->size();
+  if (!file->seek(pos)) {
+    return false;
+  }
+  while (pos < size) {
+    const qint64 chunk = qMin<qint64>(sizeof(kZeros), size - pos);
+    if (file->write(kZeros, chunk) != chunk) {
+      mqttWarning() << "无法为文件分配空间:" << file->fileName() << file->errorString();
+      return false;
+    }
+    pos += chunk;
+  }
+  return file->flush();
+}
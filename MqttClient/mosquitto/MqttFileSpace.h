@@ -0,0 +1,16 @@
+#ifndef MQTTFILESPACE_H
+#define MQTTFILESPACE_H
+
+#include <QFile>
+#include <QtGlobal>
+
+/*!
+ * \brief 为已打开的文件实际分配前size字节的磁盘空间，文件不足size时随之变长
+ * 只用resize()得到的是稀疏文件，映射后磁盘（或tmpfs）写满时写入映射区会触发SIGBUS，
+ * 因此内存映射写入的文件在映射前都应调用本函数。优先使用posix_fallocate；
+ * 文件系统不支持时退回从文件末尾逐块写零（已有内容不变），较大的文件可能阻塞数秒。
+ * \return 是否分配成功，空间不足时返回false
+ */
+bool mqttReserveFileSpace(QFile *file, qint64 size);
+
+#endif  // MQTTFILESPACE_H
@@ -0,0 +1,437 @@
+#include "MqttLog.h"
+
+#include <QDateTime>
+#include <QFile>
+#include <QList>
+#include <QMutex>
+#include <QThread>
+#include <QVector>
+#include <QWaitCondition>
+#include <algorithm>
+#include <cstring>
+
+#include "MqttMetrics.h"
+
+namespace {
+
+const quint32 kRingBytes = 256 * 1024;              // 每个线程的环形缓冲区大小，须为2的幂
+const int kFlushIntervalMs = 5;                     // 写出线程的轮询间隔
+const quint8 kPaddingLevel = 0xff;                  // 回绕处填充记录的级别标记
+const char kBinaryMagic[4] = {'M', 'Q', 'L', 'G'};  // 二进制日志文件标识
+const quint32 kBinaryVersion = 1;                   // 二进制日志格式版本
+
+/*!
+ * \brief 环形缓冲区中的记录头，后接文本，整条记录按8字节对齐
+ * 回绕处的填充记录只写前8字节（size和level）。
+ */
+struct RingRecord {
+  quint32 size;         // 记录总字节数（含头部和对齐）
+  quint8 level;         // 日志级别，kPaddingLevel表示填充
+  quint8 reserved;      // 保留
+  quint16 length;       // 文本字节数
+  qint64 timestamp_ns;  // 单调时钟时间
+};
+
+/*!
+ * \brief 二进制日志文件头
+ */
+struct BinaryHeader {
+  char magic[4];         // "MQLG"
+  quint32 version;       // 格式版本
+  qint64 start_wall_us;  // 开始时的系统时间（自纪元起的微秒数）
+  qint64 start_mono_ns;  // 开始时的单调时钟时间，与记录时间相减得到偏移
+};
+
+/*!
+ * \brief 二进制日志记录头，后接length字节文本
+ */
+struct BinaryRecord {
+  qint64 timestamp_ns;  // 单调时钟时间
+  quint16 length;       // 文本字节数
+  quint8 level;         // 日志级别
+  quint8 reserved;      // 保留
+  quint32 thread;       // 线程序号
+};
+
+/*!
+ * \brief 单生产者单消费者环形缓冲区
+ * head只由所属线程推进，tail只由持有drain_mutex的消费者推进；两者被数据区隔开，不在同一缓存行。
+ */
+struct LogRing {
+  std::atomic<quint64> head{0};     // 写入位置
+  char data[kRingBytes];            // 记录数据
+  std::atomic<quint64> tail{0};     // 读取位置
+  std::atomic<bool> closed{false};  // 所属线程已退出，读空后释放
+  int thread = 0;                   // 线程序号
+};
+
+/*!
+ * \brief 从环形缓冲区取出、等待输出的日志
+ */
+struct PendingEntry {
+  qint64 timestamp_ns;  // 单调时钟时间
+  int level;            // 日志级别
+  int thread;           // 线程序号
+  QByteArray text;      // 日志内容
+};
+
+bool pushRecord(LogRing *ring, int level, const char *text, int len) {
+  const quint32 size = (sizeof(RingRecord) + len + 7) & ~7u;
+  const quint64 head = ring->head.load(std::memory_order_relaxed);
+  const quint64 tail = ring->tail.load(std::memory_order_acquire);
+  const quint32 offset = head & (kRingBytes - 1);
+  const quint32 contiguous = kRingBytes - offset;
+  const quint32 needed = contiguous < size ? contiguous + size : size;
+  if (kRingBytes - (head - tail) < needed) {
+    return false;
+  }
+
+  quint64 position = head;
+  if (contiguous < size) {
+    // 尾部空间放不下整条记录，用填充记录跳到缓冲区开头
+    RingRecord padding;
+    padding.size = contiguous;
+    padding.level = kPaddingLevel;
+    padding.reserved = 0;
+    padding.length = 0;
+    std::memcpy(ring->data + offset, &padding, 8);
+    position += contiguous;
+  }
+
+  RingRecord record;
+  record.size = size;
+  record.level = static_cast<quint8>(level);
+  record.reserved = 0;
+  record.length = static_cast<quint16>(len);
+  record.timestamp_ns = mqttMonotonicNs();
+  char *dst = ring->data + (position & (kRingBytes - 1));
+  std::memcpy(dst, &record, sizeof(record));
+  std::memcpy(dst + sizeof(record), text, len);
+  ring->head.store(position + size, std::memory_order_release);
+  return true;
+}
+
+void popRecords(LogRing *ring, QVector<PendingEntry> *out) {
+  quint64 tail = ring->tail.load(std::memory_order_relaxed);
+  const quint64 head = ring->head.load(std::memory_order_acquire);
+  while (tail < head) {
+    const char *src = ring->data + (tail & (kRingBytes - 1));
+    RingRecord record;
+    std::memcpy(&record, src, 8);
+    if (record.level != kPaddingLevel) {
+      std::memcpy(&record, src, sizeof(record));
+      PendingEntry entry;
+      entry.timestamp_ns = record.timestamp_ns;
+      entry.level = record.level;
+      entry.thread = ring->thread;
+      entry.text = QByteArray(src + sizeof(record), record.length);
+      out->append(entry);
+    }
+    tail += record.size;
+  }
+  ring->tail.store(tail, std::memory_order_release);
+}
+
+class LogWriter : public QThread {
+ protected:
+  void run() override;
+};
+
+/*!
+ * \brief 日志的全局状态
+ */
+struct LogState {
+  QMutex mutex;                     // 保护rings、next_thread、writer和stopping
+  QMutex drain_mutex;               // 保证同一时刻只有一个消费者，并保护输出目标
+  QWaitCondition wake;              // 唤醒写出线程
+  QList<LogRing *> rings;           // 各线程的环形缓冲区
+  int next_thread = 0;              // 下一个线程序号
+  LogWriter *writer = nullptr;      // 写出线程，首次写日志时启动
+  bool stopping = false;            // 写出线程是否应退出
+  QFile binary;                     // 二进制输出文件，未打开时输出文本
+  std::atomic<quint64> dropped{0};  // 因缓冲区已满而丢弃的日志数
+  QVector<PendingEntry> batch;      // 一次写出的日志，受drain_mutex保护
+
+  ~LogState() {
+    {
+      QMutexLocker locker(&mutex);
+      stopping = true;
+      wake.wakeAll();
+    }
+    if (writer) {
+      writer->wait();
+      delete writer;
+    }
+    QMutexLocker locker(&drain_mutex);
+    drain();
+    qDeleteAll(rings);
+    binary.close();
+  }
+
+  LogRing *ringForThread();
+  void drain();
+  void output();
+};
+
+LogState &logState() {
+  static LogState state;
+  return state;
+}
+
+/*!
+ * \brief 线程退出时标记其环形缓冲区，由消费者读空后释放
+ */
+struct RingHolder {
+  LogRing *ring = nullptr;  // 当前线程的环形缓冲区
+  ~RingHolder() {
+    if (ring) {
+      ring->closed.store(true, std::memory_order_release);
+    }
+  }
+};
+
+thread_local RingHolder t_ring;
+
+LogRing *LogState::ringForThread() {
+  if (t_ring.ring) {
+    return t_ring.ring;
+  }
+  LogRing *ring = new LogRing;
+  QMutexLocker locker(&mutex);
+  ring->thread = next_thread++;
+  rings.append(ring);
+  if (!writer && !stopping) {
+    writer = new LogWriter;
+    writer->start(QThread::LowPriority);
+  }
+  t_ring.ring = ring;
+  return ring;
+}
+
+void LogState::drain() {
+  QList<LogRing *> snapshot;
+  {
+    QMutexLocker locker(&mutex);
+    snapshot = rings;
+  }
+  batch.clear();
+  for (LogRing *ring : snapshot) {
+    // 先读closed再取记录，保证线程退出前写入的记录都被取出
+    const bool closed = ring->closed.load(std::memory_order_acquire);
+    popRecords(ring, &batch);
+    if (closed) {
+      QMutexLocker locker(&mutex);
+      rings.removeOne(ring);
+      delete ring;
+    }
+  }
+  if (!batch.isEmpty()) {
+    // 各线程的记录分别有序，合并后按时间排列
+    std::stable_sort(batch.begin(), batch.end(), [](const PendingEntry &a, const PendingEntry &b) {
+      return a.timestamp_ns < b.timestamp_ns;
+    });
+    output();
+  }
+}
+
+void LogState::output() {
+  if (binary.isOpen()) {
+    QByteArray buffer;
+    for (const PendingEntry &entry : batch) {
+      BinaryRecord record;
+      record.timestamp_ns = entry.timestamp_ns;
+      record.length = static_cast<quint16>(entry.text.size());
+      record.level = static_cast<quint8>(entry.level);
+      record.reserved = 0;
+      record.thread = static_cast<quint32>(entry.thread);
+      buffer.append(reinterpret_cast<const char *>(&record), sizeof(record));
+      buffer.append(entry.text);
+    }
+    binary.write(buffer);
+    binary.flush();
+    return;
+  }
+
+  // 文本经Qt消息处理器输出，保留应用安装的处理器和QT_MESSAGE_PATTERN
+  QMessageLogger logger;
+  for (const PendingEntry &entry : batch) {
+    const char *text = entry.text.constData();
+    switch (entry.level) {
+      case MqttLog::Debug:
+        logger.debug("%s", text);
+        break;
+      case MqttLog::Info:
+        logger.info("%s", text);
+        break;
+      case MqttLog::Warning:
+        logger.warning("%s", text);
+        break;
+      default:
+        logger.critical("%s", text);
+        break;
+    }
+  }
+}
+
+void LogWriter::run() {
+  LogState &state = logState();
+  forever {
+    {
+      QMutexLocker locker(&state.drain_mutex);
+      state.drain();
+    }
+    QMutexLocker locker(&state.mutex);
+    if (state.stopping) {
+      break;
+    }
+    state.wake.wait(&state.mutex, kFlushIntervalMs);
+  }
+}
+
+MqttLog::Level initialLevel() {
+  const QByteArray name = qgetenv("MQTTCLIENT_LOG_LEVEL");
+  if (name.isEmpty()) {
+    return MqttLog::Info;
+  }
+  bool ok = false;
+  const MqttLog::Level level = MqttLog::levelFromName(QString::fromLatin1(name), &ok);
+  return ok ? level : MqttLog::Info;
+}
+
+}  // namespace
+
+std::atomic<int> MqttLog::level_(initialLevel());
+const int MqttLog::kMaxTextBytes;
+
+void MqttLog::setLevel(Level level) { level_.store(level, std::memory_order_relaxed); }
+
+MqttLog::Level MqttLog::levelFromName(const QString &name, bool *ok) {
+  static const Level levels[] = {Debug, Info, Warning, Error, Off};
+  for (Level level : levels) {
+    if (name.compare(QLatin1String(levelName(level)), Qt::CaseInsensitive) == 0) {
+      if (ok) {
+        *ok = true;
+      }
+      return level;
+    }
+  }
+  if (ok) {
+    *ok = false;
+  }
+  return Info;
+}
+
+const char *MqttLog::levelName(Level level) {
+  switch (level) {
+    case Debug:
+      return "debug";
+    case Info:
+      return "info";
+    case Warning:
+      return "warning";
+    case Error:
+      return "error";
+    default:
+      return "off";
+  }
+}
+
+bool MqttLog::setBinaryOutput(const QString &path) {
+  LogState &state = logState();
+  QMutexLocker locker(&state.drain_mutex);
+  // 切换前按原目标写出已记录的日志
+  state.drain();
+  state.binary.close();
+  if (path.isEmpty()) {
+    return true;
+  }
+
+  state.binary.setFileName(path);
+  if (!state.binary.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    return false;
+  }
+  BinaryHeader header;
+  std::memcpy(header.magic, kBinaryMagic, sizeof(header.magic));
+  header.version = kBinaryVersion;
+  header.start_mono_ns = mqttMonotonicNs();
+  header.start_wall_us = QDateTime::currentMSecsSinceEpoch() * 1000;
+  if (state.binary.write(reinterpret_cast<const char *>(&header), sizeof(header)) != sizeof(header)) {
+    state.binary.close();
+    return false;
+  }
+  return true;
+}
+
+void MqttLog::write(Level level, const char *text, int len) {
+  if (len > kMaxTextBytes) {
+    len = kMaxTextBytes;
+  }
+  LogState &state = logState();
+  if (!pushRecord(state.ringForThread(), level, text, len)) {
+    state.dropped.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void MqttLog::flush() {
+  LogState &state = logState();
+  QMutexLocker locker(&state.drain_mutex);
+  state.drain();
+}
+
+quint64 MqttLog::droppedCount() { return logState().dropped.load(std::memory_order_relaxed); }
+
+bool MqttLog::decode(const QString &path, const std::function<bool(const Entry &)> &visitor, QString *error) {
+  QFile file(path);
+  if (!file.open(QIODevice::ReadOnly)) {
+    if (error) {
+      *error = file.errorString();
+    }
+    return false;
+  }
+  const qint64 file_size = file.size();
+  const uchar *data = file_size > 0 ? file.map(0, file_size) : nullptr;
+  BinaryHeader header;
+  if (!data || file_size < static_cast<qint64>(sizeof(header))) {
+    if (error) {
+      *error = QStringLiteral("file too short");
+    }
+    return false;
+  }
+  std::memcpy(&header, data, sizeof(header));
+  if (std::memcmp(header.magic, kBinaryMagic, sizeof(header.magic)) != 0 || header.version != kBinaryVersion) {
+    if (error) {
+      *error = QStringLiteral("not a binary log file");
+    }
+    return false;
+  }
+
+  // 程序异常退出时最后一条记录可能不完整，读到该处即停止
+  qint64 offset = sizeof(header);
+  while (offset + static_cast<qint64>(sizeof(BinaryRecord)) <= file_size) {
+    BinaryRecord record;
+    std::memcpy(&record, data + offset, sizeof(record));
+    offset += sizeof(record);
+    if (offset + record.length > file_size) {
+      break;
+    }
+    Entry entry;
+    entry.timestamp_us = header.start_wall_us + (record.timestamp_ns - header.start_mono_ns) / 1000;
+    entry.level = static_cast<Level>(qMin<int>(record.level, Error));
+    entry.thread = static_cast<int>(record.thread);
+    entry.text = QByteArray(reinterpret_cast<const char *>(data + offset), record.length);
+    offset += record.length;
+    if (!visitor(entry)) {
+      break;
+    }
+  }
+  return true;
+}
+
+MqttLogLine::~MqttLogLine() {
+  // QDebug在每一项之后追加空格，与qDebug()一样去掉末尾的空格
+  if (text_.endsWith(QLatin1Char(' '))) {
+    text_.chop(1);
+  }
+  const QByteArray text = text_.toUtf8();
+  MqttLog::write(level_, text.constData(), text.size());
+}
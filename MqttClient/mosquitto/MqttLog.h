@@ -0,0 +1,132 @@
+#ifndef MQTTLOG_H
+#define MQTTLOG_H
+
+#include <QByteArray>
+#include <QDebug>
+#include <QString>
+#include <atomic>
+#include <functional>
+
+/*!
+ * \brief 异步日志
+ * 级别低于阈值的日志在格式化之前即被丢弃。每个写日志的线程拥有一个无锁单生产者环形缓冲区，
+ * 日志记录只复制进缓冲区，由后台写出线程按时间顺序合并后输出，网络线程不会阻塞在控制台I/O上。
+ * 缓冲区已满时丢弃日志并计数，不会阻塞调用者。
+ * 默认通过Qt消息处理器输出文本，也可改为写入紧凑的二进制文件，由mqtt_logdecode工具解码。
+ * 初始级别取自环境变量MQTTCLIENT_LOG_LEVEL（debug、info、warning、error、off），默认为info。
+ */
+class MqttLog {
+ public:
+  /*!
+   * \brief 日志级别
+   */
+  enum Level {
+    Debug = 0,  // 调试信息，含libmosquitto的逐包日志
+    Info,       // 一般信息
+    Warning,    // 警告
+    Error,      // 错误
+    Off         // 关闭日志（仅用作阈值）
+  };
+
+  /*!
+   * \brief 从二进制日志解码出的一条记录
+   */
+  struct Entry {
+    qint64 timestamp_us = 0;  // 记录时间（自纪元起的微秒数）
+    Level level = Info;       // 日志级别
+    int thread = 0;           // 写日志的线程序号（按首次写日志的先后编号）
+    QByteArray text;          // 日志内容（UTF-8）
+  };
+
+  /*!
+   * \brief 该级别的日志是否会被记录，在格式化之前调用
+   */
+  static bool isEnabled(Level level) { return level >= level_.load(std::memory_order_relaxed); }
+
+  /*!
+   * \brief 设置级别阈值，低于该级别的日志被丢弃
+   * 已连接的MqttClient在下次连接时按新级别决定是否安装libmosquitto日志回调。
+   */
+  static void setLevel(Level level);
+
+  /*!
+   * \brief 当前级别阈值
+   */
+  static Level level() { return static_cast<Level>(level_.load(std::memory_order_relaxed)); }
+
+  /*!
+   * \brief 解析级别名称（debug、info、warning、error、off，不区分大小写）
+   * \param ok 输出参数，名称是否有效
+   */
+  static Level levelFromName(const QString &name, bool *ok = nullptr);
+
+  /*!
+   * \brief 级别名称
+   */
+  static const char *levelName(Level level);
+
+  /*!
+   * \brief 改为写入二进制日志文件（覆盖已有文件）
+   * \param path 文件路径，为空表示恢复为文本输出
+   * \return 文件是否打开成功，失败时仍为文本输出
+   */
+  static bool setBinaryOutput(const QString &path);
+
+  /*!
+   * \brief 记录一条日志，文本超过kMaxTextBytes时截断
+   * 调用前应先用isEnabled()检查级别。
+   */
+  static void write(Level level, const char *text, int len);
+
+  /*!
+   * \brief 在调用线程中立即写出所有线程已记录的日志，程序退出或崩溃处理前调用
+   */
+  static void flush();
+
+  /*!
+   * \brief 因缓冲区已满而丢弃的日志数
+   */
+  static quint64 droppedCount();
+
+  /*!
+   * \brief 逐条读取二进制日志文件
+   * \param path 文件路径
+   * \param visitor 每条记录调用一次，返回false时停止读取
+   * \param error 输出参数，失败原因
+   * \return 文件格式是否有效
+   */
+  static bool decode(const QString &path, const std::function<bool(const Entry &)> &visitor, QString *error = nullptr);
+
+  static const int kMaxTextBytes = 4096;  // 单条日志的最大字节数
+
+ private:
+  static std::atomic<int> level_;  // 级别阈值
+};
+
+/*!
+ * \brief 一条日志的格式化缓冲区，析构时交给MqttLog
+ * 通过mqttDebug()等宏使用，输出格式与qDebug()相同。
+ */
+class MqttLogLine {
+ public:
+  explicit MqttLogLine(MqttLog::Level level) : level_(level), debug_(&text_) {}
+  ~MqttLogLine();
+
+  MqttLogLine(const MqttLogLine &) = delete;
+  MqttLogLine &operator=(const MqttLogLine &) = delete;
+
+  QDebug &stream() { return debug_; }
+
+ private:
+  MqttLog::Level level_;  // 日志级别
+  QString text_;          // 格式化结果
+  QDebug debug_;          // 写入text_的格式化流
+};
+
+// 与qDebug()等用法相同，级别未启用时不求值任何参数
+#define mqttDebug() if (!MqttLog::isEnabled(MqttLog::Debug)) {} else MqttLogLine(MqttLog::Debug).stream()
+#define mqttInfo() if (!MqttLog::isEnabled(MqttLog::Info)) {} else MqttLogLine(MqttLog::Info).stream()
+#define mqttWarning() if (!MqttLog::isEnabled(MqttLog::Warning)) {} else MqttLogLine(MqttLog::Warning).stream()
+#define mqttError() if (!MqttLog::isEnabled(MqttLog::Error)) {} else MqttLogLine(MqttLog::Error).stream()
+
+#endif  // MQTTLOG_H
@@ -0,0 +1,51 @@
+#ifndef MQTTMESSAGE_H
+#define MQTTMESSAGE_H
+
+#include <QByteArray>
+#include <QMetaType>
+#include <QString>
+#include <QVector>
+#include <memory>
+
+#include "MqttCodec.h"
+#include "PayloadArena.h"
+
+/*!
+ * \brief 批量投递模式下的单条MQTT消息
+ * topic为驻留后的共享字符串，payload为指向内存池的只读视图。
+ * 消息对象持有所在内存块的引用，只要消息（或其拷贝）存活，payload就有效；
+ * 若需要脱离消息单独保存负载，请使用payloadCopy()。
+ * payload为线路上的原始字节，经MqttCodec编码的负载只在调用body()时才解码。
+ */
+struct MqttMessage {
+  QString topic;                            // 消息主题（驻留字符串）
+  int topic_id = -1;                        // 经MqttClient::topic()注册的主题序号，未注册为-1
+  QByteArray payload;                       // 消息内容（内存池视图）
+  int qos = 0;                              // 消息质量等级
+  bool retain = false;                      // 是否为保留消息
+  qint64 timestamp = 0;                     // 接收时间（自纪元起的毫秒数）
+  qint64 received_ns = 0;                   // 接收时刻（单调时钟纳秒，用于统计投递延迟）
+  bool unchanged = false;                   // 与最新值缓存中的值相同（如重连后代理重复推送的保留消息）
+  std::shared_ptr<const PayloadSlab> slab;  // 负载所在的内存块
+
+  /*!
+   * \brief 深拷贝负载，返回的QByteArray不再依赖内存池
+   */
+  QByteArray payloadCopy() const { return QByteArray(payload.constData(), payload.size()); }
+
+  /*!
+   * \brief 消息正文，负载经MqttCodec编码时返回解码结果，否则返回负载的深拷贝
+   * 返回值总是独立于内存池，可以在消息释放后继续保存。每次调用都重新解码（或拷贝），
+   * 需要多次读取时应保存返回值；只在处理函数内读取未编码的负载时直接使用payload更省。
+   */
+  QByteArray body() const { return MqttCodec::isEncoded(payload) ? MqttCodec::decode(payload) : payloadCopy(); }
+};
+
+Q_DECLARE_METATYPE(MqttMessage)
+
+/*!
+ * \brief 一次投递的消息批次（QVector<T>在T注册后自动成为元类型）
+ */
+typedef QVector<MqttMessage> MqttMessageBatch;
+
+#endif  // MQTTMESSAGE_H
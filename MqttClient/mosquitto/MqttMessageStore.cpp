@@ -0,0 +1,347 @@
+#include "MqttMessageStore.h"
+
+#include <QDir>
+#include <QFile>
+#include <algorithm>
+#include <functional>
+
+#include "MqttCodec.h"
+#include "MqttLog.h"
+#include "TopicTrie.h"
+
+namespace {
+
+const quint32 kSpillMagic = 0x534d514d;  // "MQMS"
+const quint32 kSpillVersion = 1;
+
+// 溢出文件头，其后依次为时间戳、主题编号、负载偏移（count + 1项）、标志和负载各列
+struct SpillHeader {
+  quint32 magic;
+  quint32 version;
+  quint32 count;
+  quint32 reserved;
+};
+
+// 每条消息的列数据（时间戳、主题编号、负载偏移、标志）及倒排列表占用的字节数
+const qint64 kColumnBytesPerRow = sizeof(qint64) + sizeof(quint32) + sizeof(quint32) + sizeof(quint8);
+const qint64 kPostingBytesPerRow = sizeof(int);
+
+}  // namespace
+
+const int MqttMessageStore::kSegmentRows;
+const int MqttMessageStore::kSegmentPayloadBytes;
+
+/*!
+ * \brief 存储分段
+ * 追加期间各列保存在容器中；溢出到磁盘后容器被释放，列数据改由文件映射提供。
+ */
+struct MqttMessageStore::Segment {
+  /*!
+   * \brief 列数据的只读视图
+   */
+  struct Columns {
+    const qint64 *timestamps;
+    const quint32 *topic_ids;
+    const quint32 *offsets;
+    const quint8 *flags;
+    const char *payloads;
+  };
+
+  int count = 0;                          // 消息数
+  qint64 min_ts = 0;                      // 第一条消息的时间
+  qint64 max_ts = 0;                      // 最后一条消息的时间
+  QVector<qint64> timestamps;             // 时间戳列
+  QVector<quint32> topic_ids;             // 主题编号列
+  QVector<quint32> offsets{0};            // 负载起始位置列，末尾多一项为负载总长
+  QVector<quint8> flags;                  // 标志列，低2位为QoS，第3位为保留标志
+  QByteArray payloads;                    // 负载
+  QHash<quint32, QVector<int>> postings;  // 各主题在本分段中的行号（升序）
+  QFile file;                             // 溢出文件
+  uchar *map = nullptr;                   // 溢出文件的映射，为空表示仍在内存中
+  Columns mapped;                         // 映射区中的列
+
+  Columns columns() const {
+    if (map) {
+      return mapped;
+    }
+    Columns columns;
+    columns.timestamps = timestamps.constData();
+    columns.topic_ids = topic_ids.constData();
+    columns.offsets = offsets.constData();
+    columns.flags = flags.constData();
+    columns.payloads = payloads.constData();
+    return columns;
+  }
+
+  qint64 payloadBytes() const { return count > 0 ? columns().offsets[count] : 0; }
+  qint64 columnBytes() const { return count * kColumnBytesPerRow + payloadBytes(); }
+};
+
+MqttMessageStore::MqttMessageStore(const QString &spill_dir, qint64 memory_limit, qint64 disk_limit)
+    : spill_dir_(spill_dir), memory_limit_(memory_limit), disk_limit_(disk_limit) {
+  if (spill_dir_.isEmpty()) {
+    return;
+  }
+  if (!QDir().mkpath(spill_dir_)) {
+    mqttWarning() << "无法创建消息存储溢出目录:" << spill_dir_;
+    spill_dir_.clear();
+    return;
+  }
+  // 上次运行遗留的溢出文件已经没有对应的倒排列表，直接删除
+  QDir dir(spill_dir_);
+  for (const QString &name : dir.entryList(QStringList() << "*.seg", QDir::Files)) {
+    dir.remove(name);
+  }
+}
+
+MqttMessageStore::~MqttMessageStore() { clear(); }
+
+void MqttMessageStore::append(qint64 timestamp, const QString &topic, const QByteArray &payload, int qos,
+                              bool retain) {
+  timestamp = qMax(timestamp, last_timestamp_);
+  last_timestamp_ = timestamp;
+
+  QHash<QString, quint32>::const_iterator it = topic_ids_.constFind(topic);
+  quint32 topic_id;
+  if (it != topic_ids_.constEnd()) {
+    topic_id = it.value();
+  } else {
+    topic_id = static_cast<quint32>(topics_.size());
+    topics_.append(topic);
+    encoded_topics_.append(topic.toUtf8());
+    topic_ids_.insert(topic, topic_id);
+  }
+
+  Segment *segment = activeSegment(payload.size());
+  if (segment->count == 0) {
+    segment->min_ts = timestamp;
+  }
+  segment->max_ts = timestamp;
+  segment->timestamps.append(timestamp);
+  segment->topic_ids.append(topic_id);
+  segment->flags.append(static_cast<quint8>((qos & 0x3) | (retain ? 0x4 : 0)));
+  segment->payloads.append(payload);
+  segment->offsets.append(static_cast<quint32>(segment->payloads.size()));
+  segment->postings[topic_id].append(segment->count);
+  ++segment->count;
+
+  memory_bytes_ += payload.size() + kColumnBytesPerRow + kPostingBytesPerRow;
+  enforceLimits();
+}
+
+QVector<MqttMessageStore::Record> MqttMessageStore::query(const Query &query, bool *truncated) {
+  QVector<Record> results;
+  if (truncated) {
+    *truncated = false;
+  }
+  if (query.limit <= 0) {
+    return results;
+  }
+  const QVector<quint32> *topics = query.filter.isEmpty() ? nullptr : &matchingTopics(query.filter);
+  if (topics && topics->isEmpty()) {
+    return results;
+  }
+
+  // 从最新的分段向前查找，凑满limit条即停止
+  bool full = false;
+  QVector<int> rows;
+  for (int s = segments_.size() - 1; s >= 0 && !full; --s) {
+    const Segment *segment = segments_.at(s);
+    if (segment->count == 0 || segment->min_ts > query.to_ms) {
+      continue;
+    }
+    if (segment->max_ts < query.from_ms) {
+      break;
+    }
+
+    const Segment::Columns columns = segment->columns();
+    const int lo = static_cast<int>(
+        std::lower_bound(columns.timestamps, columns.timestamps + segment->count, query.from_ms) - columns.timestamps);
+    const int hi = static_cast<int>(
+        std::upper_bound(columns.timestamps, columns.timestamps + segment->count, query.to_ms) - columns.timestamps);
+    if (lo >= hi) {
+      continue;
+    }
+
+    // 候选行，按时间从新到旧
+    rows.clear();
+    if (topics) {
+      for (quint32 topic_id : *topics) {
+        QHash<quint32, QVector<int>>::const_iterator it = segment->postings.constFind(topic_id);
+        if (it == segment->postings.constEnd()) {
+          continue;
+        }
+        const QVector<int> &posting = it.value();
+        QVector<int>::const_iterator first = std::lower_bound(posting.constBegin(), posting.constEnd(), lo);
+        QVector<int>::const_iterator last = std::lower_bound(first, posting.constEnd(), hi);
+        for (; first != last; ++first) {
+          rows.append(*first);
+        }
+      }
+      std::sort(rows.begin(), rows.end(), std::greater<int>());
+    } else {
+      rows.reserve(hi - lo);
+      for (int row = hi - 1; row >= lo; --row) {
+        rows.append(row);
+      }
+    }
+
+    for (int row : rows) {
+      const char *payload = columns.payloads + columns.offsets[row];
+      const int payload_len = static_cast<int>(columns.offsets[row + 1] - columns.offsets[row]);
+      if (!query.contains.isEmpty()) {
+        // 编码的负载解码后再查找，与显示的内容一致
+        const QByteArray raw = QByteArray::fromRawData(payload, payload_len);
+        const QByteArray body = MqttCodec::isEncoded(raw) ? MqttCodec::decode(raw) : raw;
+        if (body.indexOf(query.contains) < 0) {
+          continue;
+        }
+      }
+      if (results.size() == query.limit) {
+        full = true;
+        break;
+      }
+      Record record;
+      record.timestamp = columns.timestamps[row];
+      record.topic = topics_.at(static_cast<int>(columns.topic_ids[row]));
+      record.payload = QByteArray(payload, payload_len);
+      record.qos = columns.flags[row] & 0x3;
+      record.retain = (columns.flags[row] & 0x4) != 0;
+      results.append(record);
+    }
+  }
+
+  if (truncated) {
+    *truncated = full;
+  }
+  std::reverse(results.begin(), results.end());
+  return results;
+}
+
+void MqttMessageStore::clear() {
+  while (!segments_.isEmpty()) {
+    Segment *segment = segments_.takeFirst();
+    if (segment->map) {
+      segment->file.unmap(segment->map);
+      segment->file.remove();
+    }
+    delete segment;
+  }
+  memory_bytes_ = 0;
+  disk_bytes_ = 0;
+}
+
+qint64 MqttMessageStore::size() const {
+  qint64 count = 0;
+  for (const Segment *segment : segments_) {
+    count += segment->count;
+  }
+  return count;
+}
+
+MqttMessageStore::Segment *MqttMessageStore::activeSegment(int payload_len) {
+  if (!segments_.isEmpty()) {
+    Segment *last = segments_.last();
+    if (!last->map && last->count < kSegmentRows &&
+        (last->count == 0 || last->payloads.size() + qint64(payload_len) <= kSegmentPayloadBytes)) {
+      return last;
+    }
+  }
+  segments_.append(new Segment);
+  return segments_.last();
+}
+
+void MqttMessageStore::enforceLimits() {
+  while (memory_bytes_ > memory_limit_ && segments_.size() > 1) {
+    // 最旧的仍在内存中的已封闭分段
+    Segment *victim = nullptr;
+    for (int i = 0; i < segments_.size() - 1; ++i) {
+      if (!segments_.at(i)->map) {
+        victim = segments_.at(i);
+        break;
+      }
+    }
+    // 全部已溢出时只剩倒排列表占用内存，只能丢弃
+    if (!victim || spill_dir_.isEmpty() || !spill(victim)) {
+      dropOldest();
+    }
+  }
+  while (disk_bytes_ > disk_limit_ && segments_.size() > 1) {
+    dropOldest();
+  }
+}
+
+bool MqttMessageStore::spill(Segment *segment) {
+  segment->file.setFileName(QDir(spill_dir_).filePath(QString("%1.seg").arg(next_file_++, 8, 10, QChar('0'))));
+  if (!segment->file.open(QIODevice::ReadWrite | QIODevice::Truncate)) {
+    mqttWarning() << "无法创建消息存储溢出文件:" << segment->file.errorString();
+    return false;
+  }
+
+  SpillHeader header;
+  header.magic = kSpillMagic;
+  header.version = kSpillVersion;
+  header.count = static_cast<quint32>(segment->count);
+  header.reserved = 0;
+  const qint64 n = segment->count;
+  bool ok = segment->file.write(reinterpret_cast<const char *>(&header), sizeof(header)) == sizeof(header) &&
+            segment->file.write(reinterpret_cast<const char *>(segment->timestamps.constData()), n * 8) == n * 8 &&
+            segment->file.write(reinterpret_cast<const char *>(segment->topic_ids.constData()), n * 4) == n * 4 &&
+            segment->file.write(reinterpret_cast<const char *>(segment->offsets.constData()), (n + 1) * 4) ==
+                (n + 1) * 4 &&
+            segment->file.write(reinterpret_cast<const char *>(segment->flags.constData()), n) == n &&
+            segment->file.write(segment->payloads) == segment->payloads.size();
+  uchar *map = ok && segment->file.flush() ? segment->file.map(0, segment->file.size()) : nullptr;
+  if (!map) {
+    mqttWarning() << "无法写入消息存储溢出文件:" << segment->file.errorString();
+    segment->file.remove();
+    return false;
+  }
+
+  // 各列按8、4、4、1字节对齐依次排列，起始位置均满足对齐要求
+  const uchar *p = map + sizeof(SpillHeader);
+  segment->mapped.timestamps = reinterpret_cast<const qint64 *>(p);
+  segment->mapped.topic_ids = reinterpret_cast<const quint32 *>(p + n * 8);
+  segment->mapped.offsets = reinterpret_cast<const quint32 *>(p + n * 12);
+  segment->mapped.flags = p + n * 16 + 4;
+  segment->mapped.payloads = reinterpret_cast<const char *>(p + n * 17 + 4);
+
+  memory_bytes_ -= segment->columnBytes();
+  disk_bytes_ += segment->file.size();
+  segment->map = map;
+  segment->timestamps = QVector<qint64>();
+  segment->topic_ids = QVector<quint32>();
+  segment->offsets = QVector<quint32>();
+  segment->flags = QVector<quint8>();
+  segment->payloads = QByteArray();
+  return true;
+}
+
+void MqttMessageStore::dropOldest() {
+  Segment *segment = segments_.takeFirst();
+  memory_bytes_ -= segment->count * kPostingBytesPerRow;
+  if (segment->map) {
+    disk_bytes_ -= segment->file.size();
+    segment->file.unmap(segment->map);
+    segment->file.remove();
+  } else {
+    memory_bytes_ -= segment->columnBytes();
+  }
+  delete segment;
+}
+
+const QVector<quint32> &MqttMessageStore::matchingTopics(const QString &filter) {
+  if (filter != cached_filter_) {
+    cached_filter_ = filter;
+    cached_checked_ = 0;
+    cached_matches_.clear();
+  }
+  // 只需比较上次查询之后新出现的主题
+  const QByteArray encoded_filter = filter.toUtf8();
+  for (; cached_checked_ < encoded_topics_.size(); ++cached_checked_) {
+    if (TopicTrie::matches(encoded_filter, encoded_topics_.at(cached_checked_))) {
+      cached_matches_.append(static_cast<quint32>(cached_checked_));
+    }
+  }
+  return cached_matches_;
+}
@@ -0,0 +1,124 @@
+#ifndef MQTTMESSAGESTORE_H
+#define MQTTMESSAGESTORE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QVector>
+#include <limits>
+
+/*!
+ * \brief 按列存储的消息历史
+ * 消息只追加，按到达顺序分成若干分段，每个分段按列保存时间戳、主题编号、标志和负载偏移，
+ * 负载连续存放在一块内存中；主题字符串只在全局字典中保存一次。
+ * 每个分段为各主题维护一个升序行号列表（倒排索引），时间戳列单调不减，可直接二分查找，
+ * 查询按时间范围定位行区间，再按主题倒排列表取候选行，最后检查负载子串。
+ * 内存超过上限时最旧的分段写入溢出目录并以内存映射方式继续参与查询（倒排列表仍在内存中），
+ * 磁盘占用超过上限时丢弃最旧的分段。溢出文件只在本对象存活期间有效，析构时删除。
+ * 非线程安全，应在同一线程中使用。
+ */
+class MqttMessageStore {
+ public:
+  static const int kSegmentRows = 65536;                    // 每个分段最多的消息数
+  static const int kSegmentPayloadBytes = 8 * 1024 * 1024;  // 每个分段最多的负载字节数
+
+  /*!
+   * \brief 查询结果中的一条消息
+   */
+  struct Record {
+    qint64 timestamp = 0;  // 接收时间（自纪元起的毫秒数）
+    QString topic;         // 消息主题
+    QByteArray payload;    // 消息内容
+    int qos = 0;           // 消息质量等级
+    bool retain = false;   // 是否为保留消息
+  };
+
+  /*!
+   * \brief 查询条件，各条件同时满足
+   */
+  struct Query {
+    QString filter;                                     // 主题过滤器，支持'+'和'#'，为空表示全部主题
+    qint64 from_ms = 0;                                 // 起始时间（含）
+    qint64 to_ms = std::numeric_limits<qint64>::max();  // 结束时间（含）
+    QByteArray contains;                                // 负载（经MqttCodec编码的按解码后）须包含的字节串，为空表示不限
+    int limit = 10000;                                  // 最多返回的条数，超出时只返回最新的
+  };
+
+  /*!
+   * \brief 构造函数，删除溢出目录中上次运行遗留的分段文件
+   * \param spill_dir 溢出目录，为空表示不溢出，超出内存上限时直接丢弃最旧的分段
+   * \param memory_limit 内存上限（字节）
+   * \param disk_limit 溢出文件总大小上限（字节）
+   */
+  explicit MqttMessageStore(const QString &spill_dir, qint64 memory_limit = 256 * 1024 * 1024,
+                            qint64 disk_limit = 4LL * 1024 * 1024 * 1024);
+
+  /*!
+   * \brief 析构函数，删除溢出文件
+   */
+  ~MqttMessageStore();
+
+  MqttMessageStore(const MqttMessageStore &) = delete;
+  MqttMessageStore &operator=(const MqttMessageStore &) = delete;
+
+  /*!
+   * \brief 追加一条消息
+   * 时间戳早于上一条消息时（系统时间被回拨）按上一条的时间保存，保证时间列有序。
+   */
+  void append(qint64 timestamp, const QString &topic, const QByteArray &payload, int qos, bool retain);
+
+  /*!
+   * \brief 查询消息
+   * \param query 查询条件
+   * \param truncated 输出参数，匹配的消息是否多于limit
+   * \return 按时间先后排列的匹配消息
+   */
+  QVector<Record> query(const Query &query, bool *truncated = nullptr);
+
+  /*!
+   * \brief 删除全部消息
+   */
+  void clear();
+
+  /*!
+   * \brief 保存的消息数
+   */
+  qint64 size() const;
+
+  /*!
+   * \brief 内存占用（字节）
+   */
+  qint64 memoryBytes() const { return memory_bytes_; }
+
+  /*!
+   * \brief 溢出文件总大小（字节）
+   */
+  qint64 diskBytes() const { return disk_bytes_; }
+
+ private:
+  struct Segment;
+
+  Segment *activeSegment(int payload_len);
+  void enforceLimits();
+  bool spill(Segment *segment);
+  void dropOldest();
+  const QVector<quint32> &matchingTopics(const QString &filter);
+
+  QString spill_dir_;                   // 溢出目录
+  qint64 memory_limit_;                 // 内存上限
+  qint64 disk_limit_;                   // 溢出文件总大小上限
+  qint64 memory_bytes_ = 0;             // 内存占用
+  qint64 disk_bytes_ = 0;               // 溢出文件总大小
+  qint64 last_timestamp_ = 0;           // 最后一条消息的时间
+  int next_file_ = 0;                   // 下一个溢出文件的编号
+  QList<Segment *> segments_;           // 分段，最旧的在前，最后一个可继续追加
+  QHash<QString, quint32> topic_ids_;   // 主题字典
+  QVector<QString> topics_;             // 按编号排列的主题
+  QVector<QByteArray> encoded_topics_;  // 按编号排列的UTF-8主题，用于匹配过滤器
+  QString cached_filter_;               // 上次查询的过滤器
+  int cached_checked_ = 0;              // 已与该过滤器比较过的主题数
+  QVector<quint32> cached_matches_;     // 与该过滤器匹配的主题编号
+};
+
+#endif  // MQTTMESSAGESTORE_H
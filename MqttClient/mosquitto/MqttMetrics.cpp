@@ -0,0 +1,195 @@
+#include "MqttMetrics.h"
+
+#include <QtAlgorithms>
+#include <chrono>
+#include <cmath>
+
+qint64 mqttMonotonicNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+namespace {
+
+void appendMetric(QByteArray *out, const char *name, const char *type, const char *help, const QByteArray &labels,
+                  double value) {
+  *out += QByteArray("# HELP ") + name + ' ' + help + '\n';
+  *out += QByteArray("# TYPE ") + name + ' ' + type + '\n';
+  *out += QByteArray(name) + '{' + labels + "} " + QByteArray::number(value, 'g', 17) + '\n';
+}
+
+void appendSummary(QByteArray *out, const char *name, const char *help, const QByteArray &labels,
+                   const MqttLatencyStats &stats) {
+  *out += QByteArray("# HELP ") + name + ' ' + help + '\n';
+  *out += QByteArray("# TYPE ") + name + " summary\n";
+  const struct {
+    const char *quantile;
+    double value_us;
+  } quantiles[] = {{"0.5", stats.p50_us}, {"0.9", stats.p90_us}, {"0.99", stats.p99_us}, {"0.999", stats.p999_us}};
+  for (const auto &q : quantiles) {
+    *out += QByteArray(name) + '{' + labels + ",quantile=\"" + q.quantile + "\"} " +
+            QByteArray::number(q.value_us / 1e6, 'g', 9) + '\n';
+  }
+  *out += QByteArray(name) + "_sum{" + labels + "} " + QByteArray::number(stats.sum_us / 1e6, 'g', 17) + '\n';
+  *out += QByteArray(name) + "_count{" + labels + "} " + QByteArray::number(stats.count) + '\n';
+}
+
+}  // namespace
+
+QByteArray MqttStats::toPrometheus() const {
+  QByteArray labels = "client_id=\"" + client_id.toUtf8().replace('\\', "\\\\").replace('"', "\\\"") + '"';
+  QByteArray out;
+  out.reserve(4096);
+  appendMetric(&out, "mqttclient_messages_in_total", "counter", "Messages received.", labels, messages_in);
+  appendMetric(&out, "mqttclient_bytes_in_total", "counter", "Payload bytes received.", labels, bytes_in);
+  appendMetric(&out, "mqttclient_messages_out_total", "counter", "Messages handed to libmosquitto.", labels,
+               messages_out);
+  appendMetric(&out, "mqttclient_bytes_out_total", "counter", "Payload bytes published.", labels, bytes_out);
+  appendMetric(&out, "mqttclient_publish_acked_total", "counter", "Publishes acknowledged.", labels, publish_acked);
+  appendMetric(&out, "mqttclient_publish_failed_total", "counter", "Publishes failed or dropped.", labels,
+               publish_failed);
+  appendMetric(&out, "mqttclient_publish_rejected_total", "counter", "Publishes rejected by the inflight window.",
+               labels, publish_rejected);
+  appendMetric(&out, "mqttclient_publish_spooled_total", "counter", "Publishes written to the offline outbox.", labels,
+               publish_spooled);
+  appendMetric(&out, "mqttclient_echo_filtered_total", "counter", "Own messages filtered on receipt.", labels,
+               echo_filtered);
+  appendMetric(&out, "mqttclient_connects_total", "counter", "Successful connections.", labels, connects);
+  appendMetric(&out, "mqttclient_disconnects_total", "counter", "Disconnections.", labels, disconnects);
+  appendMetric(&out, "mqttclient_reconnect_attempts_total", "counter", "Reconnect attempts.", labels,
+               reconnect_attempts);
+  appendMetric(&out, "mqttclient_tls_handshakes_total", "counter", "Full TLS handshakes.", labels, tls_handshakes);
+  appendMetric(&out, "mqttclient_tls_resumed_total", "counter", "TLS handshakes resumed from a cached session.",
+               labels, tls_resumed);
+  appendMetric(&out, "mqttclient_sessions_resumed_total", "counter", "Connects where the broker kept the session.",
+               labels, sessions_resumed);
+  appendMetric(&out, "mqttclient_topic_alias_publishes_total", "counter", "Publishes sent with a topic alias only.",
+               labels, topic_alias_publishes);
+  appendMetric(&out, "mqttclient_topic_bytes_saved_total", "counter", "Topic bytes not sent thanks to topic aliases.",
+               labels, topic_bytes_saved);
+  appendMetric(&out, "mqttclient_conflated_total", "counter", "Messages superseded in the conflation queue.", labels,
+               conflated);
+  appendMetric(&out, "mqttclient_rate_limited_total", "counter", "Messages delayed by per-topic rate limits.", labels,
+               rate_limited);
+  appendMetric(&out, "mqttclient_delivery_dropped_total", "counter", "Messages dropped by a full conflation queue.",
+               labels, delivery_dropped);
+  appendMetric(&out, "mqttclient_pool_processed_total", "counter", "Messages handled by the worker pool.", labels,
+               pool_processed);
+  appendMetric(&out, "mqttclient_pool_steals_total", "counter", "Shards stolen between worker pool threads.", labels,
+               pool_steals);
+  appendMetric(&out, "mqttclient_captured_total", "counter", "Messages written to the capture file.", labels, captured);
+  appendMetric(&out, "mqttclient_capture_dropped_total", "counter", "Messages not captured because the file was full.",
+               labels, capture_dropped);
+  appendMetric(&out, "mqttclient_fanout_messages_total", "counter", "Messages written to the local fan-out ring.",
+               labels, fanout_messages);
+  appendMetric(&out, "mqttclient_fanout_dropped_total", "counter", "Messages too large for the local fan-out ring.",
+               labels, fanout_dropped);
+  appendMetric(&out, "mqttclient_fanout_relayed_total", "counter", "Publishes relayed from local fan-out readers.",
+               labels, fanout_relayed);
+  appendMetric(&out, "mqttclient_publish_inflight", "gauge", "Publishes queued or awaiting acknowledgement.", labels,
+               publish_inflight);
+  appendMetric(&out, "mqttclient_outbox_pending", "gauge", "Messages waiting in the offline outbox.", labels,
+               outbox_pending);
+  appendMetric(&out, "mqttclient_delivery_pending", "gauge", "Messages delivered but not yet handled by the receiver.",
+               labels, delivery_pending);
+  appendMetric(&out, "mqttclient_pool_queued", "gauge", "Messages waiting in the worker pool.", labels, pool_queued);
+  appendMetric(&out, "mqttclient_fanout_readers", "gauge", "Processes attached to the local fan-out ring.", labels,
+               fanout_readers);
+  appendSummary(&out, "mqttclient_publish_ack_latency_seconds", "Latency from publish() to acknowledgement.", labels,
+                publish_ack_latency);
+  appendSummary(&out, "mqttclient_delivery_latency_seconds", "Latency from network callback to receiver slot.",
+                labels, delivery_latency);
+  appendSummary(&out, "mqttclient_connect_latency_seconds", "Time from connect or disconnect to CONNACK.", labels,
+                connect_latency);
+  appendSummary(&out, "mqttclient_tls_handshake_latency_seconds", "TLS handshake time including round trips.",
+                labels, tls_handshake_latency);
+  return out;
+}
+
+MqttLatencyHistogram::MqttLatencyHistogram() {
+  for (std::atomic<quint64> &bucket : buckets_) {
+    bucket.store(0, std::memory_order_relaxed);
+  }
+}
+
+void MqttLatencyHistogram::record(qint64 value_ns) {
+  quint64 value = value_ns > 0 ? static_cast<quint64>(value_ns) : 0;
+  buckets_[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+  sum_.fetch_add(value, std::memory_order_relaxed);
+}
+
+MqttLatencyStats MqttLatencyHistogram::snapshot() const {
+  quint64 counts[kBucketCount];
+  quint64 total = 0;
+  for (int i = 0; i < kBucketCount; ++i) {
+    counts[i] = buckets_[i].load(std::memory_order_relaxed);
+    total += counts[i];
+  }
+
+  MqttLatencyStats stats;
+  stats.count = total;
+  if (total == 0) {
+    return stats;
+  }
+  stats.sum_us = sum_.load(std::memory_order_relaxed) / 1000.0;
+  stats.mean_us = stats.sum_us / total;
+
+  // 逐桶累加，分位数取所在桶的上界
+  const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+  double *targets[] = {&stats.p50_us, &stats.p90_us, &stats.p99_us, &stats.p999_us};
+  int next = 0;
+  quint64 seen = 0;
+  for (int i = 0; i < kBucketCount; ++i) {
+    if (counts[i] == 0) {
+      continue;
+    }
+    seen += counts[i];
+    while (next < 4 && seen >= qMax<quint64>(1, static_cast<quint64>(std::ceil(quantiles[next] * total)))) {
+      *targets[next++] = bucketUpperBound(i) / 1000.0;
+    }
+    stats.max_us = bucketUpperBound(i) / 1000.0;
+  }
+  return stats;
+}
+
+int MqttLatencyHistogram::bucketIndex(quint64 value) {
+  if (value < static_cast<quint64>(kSubBuckets)) {
+    return static_cast<int>(value);
+  }
+  // 最高位决定区间，其后kSubBucketBits位决定区间内的桶
+  int msb = 63 - qCountLeadingZeroBits(value);
+  int shift = msb - kSubBucketBits;
+  return (msb - kSubBucketBits + 1) * kSubBuckets + static_cast<int>((value >> shift) & (kSubBuckets - 1));
+}
+
+quint64 MqttLatencyHistogram::bucketUpperBound(int index) {
+  if (index < kSubBuckets) {
+    return static_cast<quint64>(index);
+  }
+  int shift = index / kSubBuckets - 1;
+  quint64 sub = static_cast<quint64>(kSubBuckets + index % kSubBuckets);
+  return ((sub + 1) << shift) - 1;
+}
+
+MqttMetrics::MqttMetrics() {
+  for (Stripe &stripe : stripes_) {
+    for (std::atomic<quint64> &counter : stripe.counters) {
+      counter.store(0, std::memory_order_relaxed);
+    }
+  }
+}
+
+quint64 MqttMetrics::value(Counter counter) const {
+  quint64 total = 0;
+  for (const Stripe &stripe : stripes_) {
+    total += stripe.counters[counter].load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+int MqttMetrics::stripeIndex() {
+  // 每个线程首次计数时领取一个行号
+  static std::atomic<int> next_stripe{0};
+  thread_local int stripe = next_stripe.fetch_add(1, std::memory_order_relaxed) % kStripes;
+  return stripe;
+}
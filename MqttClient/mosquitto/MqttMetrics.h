@@ -0,0 +1,188 @@
+#ifndef MQTTMETRICS_H
+#define MQTTMETRICS_H
+
+#include <QByteArray>
+#include <QMetaType>
+#include <QString>
+#include <QtGlobal>
+#include <atomic>
+
+/*!
+ * \brief 单调时钟纳秒数，用于计算各类延迟
+ */
+qint64 mqttMonotonicNs();
+
+/*!
+ * \brief 延迟分布摘要（单位：微秒）
+ */
+struct MqttLatencyStats {
+  quint64 count = 0;   // 样本数
+  double sum_us = 0;   // 样本总和
+  double mean_us = 0;  // 平均值
+  double p50_us = 0;   // 中位数
+  double p90_us = 0;   // 90分位
+  double p99_us = 0;   // 99分位
+  double p999_us = 0;  // 99.9分位
+  double max_us = 0;   // 最大值（所在桶的上界）
+};
+
+/*!
+ * \brief MqttClient运行指标快照
+ * 计数器自客户端创建起单调递增，瞬时值为取快照时的状态。
+ */
+struct MqttStats {
+  qint64 timestamp = 0;  // 快照时间（自纪元起的毫秒数）
+  QString client_id;     // 客户端ID
+
+  quint64 messages_in = 0;         // 收到的消息数
+  quint64 bytes_in = 0;            // 收到的负载字节数
+  quint64 messages_out = 0;        // 交给libmosquitto发送的消息数
+  quint64 bytes_out = 0;           // 发送的负载字节数
+  quint64 publish_acked = 0;       // 已确认的发布数
+  quint64 publish_failed = 0;      // 发送失败的发布数（含断线时丢弃）
+  quint64 publish_rejected = 0;    // 因发布窗口已满被拒绝的发布数
+  quint64 publish_spooled = 0;     // 写入离线发件箱的发布数
+  quint64 echo_filtered = 0;       // 被过滤的自身消息数
+  quint64 connects = 0;            // 连接成功次数
+  quint64 disconnects = 0;         // 断开次数
+  quint64 reconnect_attempts = 0;  // 重连尝试次数
+  quint64 tls_handshakes = 0;      // 完整TLS握手次数
+  quint64 tls_resumed = 0;         // 复用会话的TLS握手次数
+  quint64 sessions_resumed = 0;    // 代理保留了持久会话的连接次数
+
+  quint64 topic_alias_publishes = 0;  // 只携带主题别名的发布数
+  quint64 topic_bytes_saved = 0;      // 主题别名节省的主题字节数
+
+  quint64 conflated = 0;         // 合并队列中被更新值覆盖的消息数
+  quint64 rate_limited = 0;      // 合并队列中因限速而延后的消息数
+  quint64 delivery_dropped = 0;  // 合并队列已满而丢弃的消息数
+  quint64 pool_processed = 0;    // 工作线程池处理的消息数
+  quint64 pool_steals = 0;       // 工作线程池窃取分片的次数
+  quint64 captured = 0;          // 写入录制文件的消息数
+  quint64 capture_dropped = 0;   // 录制文件已满而未录制的消息数
+
+  quint64 fanout_messages = 0;  // 写入本机分发区的消息数
+  quint64 fanout_dropped = 0;   // 因过大而未写入本机分发区的消息数
+  quint64 fanout_relayed = 0;   // 本机进程经分发区提交并转发的发布数
+
+  qint64 publish_inflight = 0;  // 发布队列及等待确认的消息数
+  qint64 outbox_pending = 0;    // 发件箱中等待重发的消息数
+  qint64 delivery_pending = 0;  // 已投递给接收线程但尚未处理的消息数
+  qint64 pool_queued = 0;       // 工作线程池中等待处理的消息数
+  qint64 fanout_readers = 0;    // 连接到本机分发区的读者进程数
+
+  MqttLatencyStats publish_ack_latency;    // publish()调用到确认的延迟
+  MqttLatencyStats delivery_latency;       // 网络回调到接收方槽函数的延迟
+  MqttLatencyStats connect_latency;        // 发起连接（或断线）到连接成功的耗时
+  MqttLatencyStats tls_handshake_latency;  // TLS握手耗时（含网络往返）
+
+  /*!
+   * \brief 以Prometheus文本格式输出
+   */
+  QByteArray toPrometheus() const;
+};
+
+Q_DECLARE_METATYPE(MqttStats)
+
+/*!
+ * \brief HDR风格的对数线性延迟直方图
+ * 每个2的幂区间再均分为16个桶，相对误差约6%，覆盖纳秒到数百年的范围。
+ * record()只有两次无锁原子加，可在任意线程调用。
+ */
+class MqttLatencyHistogram {
+ public:
+  MqttLatencyHistogram();
+
+  MqttLatencyHistogram(const MqttLatencyHistogram &) = delete;
+  MqttLatencyHistogram &operator=(const MqttLatencyHistogram &) = delete;
+
+  /*!
+   * \brief 记录一个样本
+   * \param value_ns 延迟（纳秒）
+   */
+  void record(qint64 value_ns);
+
+  /*!
+   * \brief 计算分布摘要
+   */
+  MqttLatencyStats snapshot() const;
+
+ private:
+  static const int kSubBucketBits = 4;
+  static const int kSubBuckets = 1 << kSubBucketBits;
+  static const int kBucketCount = 64 * kSubBuckets;
+
+  static int bucketIndex(quint64 value);
+  static quint64 bucketUpperBound(int index);
+
+  std::atomic<quint64> buckets_[kBucketCount];  // 各桶的样本数
+  std::atomic<quint64> sum_{0};                 // 样本总和（纳秒）
+};
+
+/*!
+ * \brief MqttClient内部指标
+ * 计数器按线程分条存放：每个线程固定写入自己的一行，行之间留有缓存行间隔，
+ * 多个生产者线程同时计数不会争用同一缓存行；读取时把各行累加。
+ */
+class MqttMetrics {
+ public:
+  /*!
+   * \brief 计数器
+   */
+  enum Counter {
+    MessagesIn,
+    BytesIn,
+    MessagesOut,
+    BytesOut,
+    PublishAcked,
+    PublishFailed,
+    PublishRejected,
+    PublishSpooled,
+    EchoFiltered,
+    Connects,
+    Disconnects,
+    ReconnectAttempts,
+    TlsHandshakes,
+    TlsResumed,
+    SessionsResumed,
+    TopicAliasPublishes,
+    TopicBytesSaved,
+    CounterCount
+  };
+
+  MqttMetrics();
+
+  MqttMetrics(const MqttMetrics &) = delete;
+  MqttMetrics &operator=(const MqttMetrics &) = delete;
+
+  /*!
+   * \brief 累加计数器（线程安全，无锁）
+   */
+  void add(Counter counter, quint64 n = 1) {
+    stripes_[stripeIndex()].counters[counter].fetch_add(n, std::memory_order_relaxed);
+  }
+
+  /*!
+   * \brief 读取计数器在各线程中的总和
+   */
+  quint64 value(Counter counter) const;
+
+  MqttLatencyHistogram publish_ack_latency;    // publish()调用到确认的延迟
+  MqttLatencyHistogram delivery_latency;       // 网络回调到接收方槽函数的延迟
+  MqttLatencyHistogram connect_latency;        // 发起连接（或断线）到连接成功的耗时
+  MqttLatencyHistogram tls_handshake_latency;  // TLS握手耗时（含网络往返）
+
+ private:
+  static const int kStripes = 8;
+
+  struct Stripe {
+    std::atomic<quint64> counters[CounterCount];
+    char padding[64];  // 与下一行隔开，避免伪共享
+  };
+
+  static int stripeIndex();
+
+  Stripe stripes_[kStripes];  // 各线程的计数行
+};
+
+#endif  // MQTTMETRICS_H
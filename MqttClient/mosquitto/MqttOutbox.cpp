@@ -0,0 +1,374 @@
+#include "MqttOutbox.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <cstring>
+
+#include "MqttFileSpace.h"
+#include "MqttLog.h"
+
+namespace {
+
+const quint32 kSegmentMagic = 0x424f514d;  // "MQOB"
+const quint32 kSegmentVersion = 1;
+
+// 分段文件头
+struct SegmentHeader {
+  quint32 magic;
+  quint32 version;
+  qint64 seq;
+};
+
+// 消息记录头，其后依次为主题和消息内容
+struct RecordHeader {
+  quint32 size;  // 记录总字节数（含头部并按8字节对齐），0表示分段结束
+  quint32 payload_len;
+  qint64 timestamp;
+  quint16 topic_len;
+  quint8 qos;
+  quint8 retain;
+  quint32 reserved;
+};
+
+const qint64 kSegmentHeaderSize = sizeof(SegmentHeader);
+const qint64 kRecordHeaderSize = sizeof(RecordHeader);
+
+inline qint64 alignRecord(qint64 size) { return (size + 7) & ~qint64(7); }
+
+}  // namespace
+
+const qint64 MqttOutbox::kDefaultSegmentSize;
+
+MqttOutbox::MqttOutbox() = default;
+
+MqttOutbox::~MqttOutbox() { close(); }
+
+bool MqttOutbox::open(const QString &dir, qint64 max_bytes, qint64 max_age_ms, qint64 segment_size) {
+  close();
+
+  QMutexLocker locker(&mutex_);
+  if (!QDir().mkpath(dir)) {
+    mqttWarning() << "无法创建发件箱目录:" << dir;
+    return false;
+  }
+  dir_ = dir;
+  max_age_ms_ = max_age_ms;
+  segment_size_ = qMax(segment_size, kSegmentHeaderSize + kRecordHeaderSize);
+  max_bytes_ = qMax(max_bytes, segment_size_);
+
+  // 读取进度
+  cursor_file_.setFileName(QDir(dir_).filePath("cursor"));
+  if (!cursor_file_.open(QIODevice::ReadWrite) || !mqttReserveFileSpace(&cursor_file_, 2 * sizeof(qint64))) {
+    mqttWarning() << "无法打开发件箱进度文件:" << cursor_file_.errorString();
+    cursor_file_.close();
+    return false;
+  }
+  cursor_map_ = reinterpret_cast<qint64 *>(cursor_file_.map(0, 2 * sizeof(qint64)));
+  if (!cursor_map_) {
+    cursor_file_.close();
+    return false;
+  }
+  read_seq_ = cursor_map_[0];
+  read_offset_ = cursor_map_[1];
+
+  // 恢复已有分段，删除已读完或损坏的分段
+  const QStringList names = QDir(dir_).entryList(QStringList() << "*.seg", QDir::Files, QDir::Name);
+  for (const QString &name : names) {
+    bool ok = false;
+    qint64 seq = QFileInfo(name).baseName().toLongLong(&ok);
+    QFile file(QDir(dir_).filePath(name));
+    if (!ok || seq < read_seq_ || !file.open(QIODevice::ReadWrite) || file.size() < kSegmentHeaderSize) {
+      file.remove();
+      continue;
+    }
+    uchar *map = file.map(0, file.size());
+    SegmentHeader header;
+    if (map) {
+      memcpy(&header, map, sizeof(header));
+    }
+    if (!map || header.magic != kSegmentMagic || header.version != kSegmentVersion || header.seq != seq) {
+      file.remove();
+      continue;
+    }
+
+    Segment segment;
+    segment.seq = seq;
+    segment.size = file.size();
+    qint64 end = scanSegment(map, segment.size, kSegmentHeaderSize, &segment.records);
+    file.unmap(map);
+    segments_.append(segment);
+    total_bytes_ += segment.size;
+    next_seq_ = seq + 1;
+    write_offset_ = end;
+  }
+
+  if (segments_.isEmpty()) {
+    next_seq_ = qMax(next_seq_, read_seq_);
+    if (!rollSegment(0)) {
+      return false;
+    }
+  } else if (!mapSegment(segments_.last().seq, segments_.last().size, &write_file_, &write_map_)) {
+    return false;
+  }
+
+  // 进度所在分段已丢失时从最早的分段开始读取
+  if (read_seq_ != segments_.first().seq) {
+    read_seq_ = segments_.first().seq;
+    read_offset_ = kSegmentHeaderSize;
+  }
+  read_offset_ = qMax(read_offset_, kSegmentHeaderSize);
+  if (!mapReadSegment()) {
+    return false;
+  }
+
+  // 统计尚未发送的消息
+  qint64 remaining = 0;
+  read_offset_ = qMin(read_offset_, scanSegment(read_map_, segments_.first().size, read_offset_, &remaining));
+  read_consumed_ = segments_.first().records - remaining;
+  qint64 pending = remaining;
+  for (int i = 1; i < segments_.size(); ++i) {
+    pending += segments_.at(i).records;
+  }
+  pending_.store(pending, std::memory_order_release);
+  saveCursor();
+  return true;
+}
+
+void MqttOutbox::close() {
+  QMutexLocker locker(&mutex_);
+  unmapSegment(&write_file_, &write_map_);
+  unmapSegment(&read_file_, &read_map_);
+  if (cursor_map_) {
+    cursor_file_.unmap(reinterpret_cast<uchar *>(cursor_map_));
+    cursor_map_ = nullptr;
+  }
+  cursor_file_.close();
+  segments_.clear();
+  total_bytes_ = 0;
+  write_offset_ = 0;
+  read_offset_ = 0;
+  read_consumed_ = 0;
+  peek_size_ = 0;
+  pending_.store(0, std::memory_order_release);
+}
+
+bool MqttOutbox::append(const QByteArray &topic, const QByteArray &payload, int qos, bool retain) {
+  const qint64 size = alignRecord(kRecordHeaderSize + topic.size() + payload.size());
+  RecordHeader header;
+  header.size = 0;
+  header.payload_len = static_cast<quint32>(payload.size());
+  header.timestamp = QDateTime::currentMSecsSinceEpoch();
+  header.topic_len = static_cast<quint16>(topic.size());
+  header.qos = static_cast<quint8>(qos);
+  header.retain = retain ? 1 : 0;
+  header.reserved = 0;
+
+  QMutexLocker locker(&mutex_);
+  if (!write_map_) {
+    return false;
+  }
+  if (write_offset_ + size > segments_.last().size && !rollSegment(size)) {
+    return false;
+  }
+
+  // 最后写入记录长度，中途崩溃时读取方只会看到长度为0的分段结尾
+  uchar *dst = write_map_ + write_offset_;
+  memcpy(dst + sizeof(header.size), reinterpret_cast<const char *>(&header) + sizeof(header.size),
+         kRecordHeaderSize - sizeof(header.size));
+  memcpy(dst + kRecordHeaderSize, topic.constData(), topic.size());
+  memcpy(dst + kRecordHeaderSize + topic.size(), payload.constData(), payload.size());
+  header.size = static_cast<quint32>(size);
+  memcpy(dst, &header.size, sizeof(header.size));
+
+  write_offset_ += size;
+  ++segments_.last().records;
+  pending_.fetch_add(1, std::memory_order_release);
+  return true;
+}
+
+bool MqttOutbox::peek(Record *record) {
+  QMutexLocker locker(&mutex_);
+  const qint64 now = max_age_ms_ > 0 ? QDateTime::currentMSecsSinceEpoch() : 0;
+  while (pending_.load(std::memory_order_relaxed) > 0) {
+    if (!read_map_ && !mapReadSegment()) {
+      return false;
+    }
+
+    const bool is_write_segment = read_seq_ == segments_.last().seq;
+    const qint64 end = is_write_segment ? write_offset_ : segments_.first().size;
+    RecordHeader header;
+    header.size = 0;
+    if (read_offset_ + kRecordHeaderSize <= end) {
+      memcpy(&header, read_map_ + read_offset_, sizeof(header));
+    }
+    if (header.size == 0 || read_offset_ + header.size > end) {
+      if (is_write_segment || !advanceReadSegment()) {
+        return false;
+      }
+      continue;
+    }
+
+    if (max_age_ms_ > 0 && now - header.timestamp > max_age_ms_) {
+      read_offset_ += header.size;
+      ++read_consumed_;
+      pending_.fetch_sub(1, std::memory_order_release);
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      saveCursor();
+      continue;
+    }
+
+    const char *data = reinterpret_cast<const char *>(read_map_ + read_offset_ + kRecordHeaderSize);
+    record->topic = QByteArray(data, header.topic_len);
+    record->payload = QByteArray(data + header.topic_len, static_cast<int>(header.payload_len));
+    record->qos = header.qos;
+    record->retain = header.retain != 0;
+    record->timestamp = header.timestamp;
+    peek_size_ = header.size;
+    return true;
+  }
+  return false;
+}
+
+void MqttOutbox::pop() {
+  QMutexLocker locker(&mutex_);
+  // 期间读取分段可能因超出大小限制被丢弃
+  if (peek_size_ == 0) {
+    return;
+  }
+  read_offset_ += peek_size_;
+  ++read_consumed_;
+  peek_size_ = 0;
+  pending_.fetch_sub(1, std::memory_order_release);
+  saveCursor();
+}
+
+QString MqttOutbox::segmentPath(qint64 seq) const {
+  return QDir(dir_).filePath(QString("%1.seg").arg(seq, 12, 10, QChar('0')));
+}
+
+bool MqttOutbox::mapSegment(qint64 seq, qint64 size, QFile *file, uchar **map) {
+  file->setFileName(segmentPath(seq));
+  if (!file->open(QIODevice::ReadWrite)) {
+    mqttWarning() << "无法打开发件箱分段:" << file->fileName() << file->errorString();
+    return false;
+  }
+  // 离线时磁盘可能恰好写满，映射前实际分配空间，分配失败时发布按失败报告而不是在写入时触发SIGBUS
+  if (!mqttReserveFileSpace(file, size)) {
+    file->close();
+    return false;
+  }
+  *map = file->map(0, size);
+  if (!*map) {
+    file->close();
+    return false;
+  }
+  return true;
+}
+
+void MqttOutbox::unmapSegment(QFile *file, uchar **map) {
+  if (*map) {
+    file->unmap(*map);
+    *map = nullptr;
+  }
+  file->close();
+}
+
+qint64 MqttOutbox::scanSegment(const uchar *map, qint64 size, qint64 offset, qint64 *records) {
+  *records = 0;
+  while (offset + kRecordHeaderSize <= size) {
+    quint32 record_size;
+    memcpy(&record_size, map + offset, sizeof(record_size));
+    if (record_size == 0 || offset + record_size > size) {
+      break;
+    }
+    ++*records;
+    offset += record_size;
+  }
+  return offset;
+}
+
+bool MqttOutbox::rollSegment(qint64 min_size) {
+  const qint64 size = qMax(segment_size_, kSegmentHeaderSize + min_size);
+  unmapSegment(&write_file_, &write_map_);
+
+  // 超出总大小限制时丢弃最早的分段
+  while (!segments_.isEmpty() && total_bytes_ + size > max_bytes_) {
+    dropOldestSegment();
+  }
+
+  Segment segment;
+  segment.seq = next_seq_++;
+  segment.size = size;
+  if (!mapSegment(segment.seq, size, &write_file_, &write_map_)) {
+    // 新分段中还没有消息，不留下分配了一半的文件
+    QFile::remove(segmentPath(segment.seq));
+    return false;
+  }
+  SegmentHeader header;
+  header.magic = kSegmentMagic;
+  header.version = kSegmentVersion;
+  header.seq = segment.seq;
+  memcpy(write_map_, &header, sizeof(header));
+  write_offset_ = kSegmentHeaderSize;
+
+  segments_.append(segment);
+  total_bytes_ += size;
+  if (segments_.size() == 1) {
+    read_seq_ = segment.seq;
+    read_offset_ = kSegmentHeaderSize;
+    read_consumed_ = 0;
+    saveCursor();
+  }
+  return true;
+}
+
+void MqttOutbox::dropOldestSegment() {
+  Segment oldest = segments_.takeFirst();
+  qint64 lost = oldest.records;
+  if (oldest.seq == read_seq_) {
+    lost -= read_consumed_;
+    unmapSegment(&read_file_, &read_map_);
+    read_seq_ = segments_.isEmpty() ? next_seq_ : segments_.first().seq;
+    read_offset_ = kSegmentHeaderSize;
+    read_consumed_ = 0;
+    peek_size_ = 0;
+    saveCursor();
+  }
+  QFile::remove(segmentPath(oldest.seq));
+  total_bytes_ -= oldest.size;
+  pending_.fetch_sub(lost, std::memory_order_release);
+  dropped_.fetch_add(lost, std::memory_order_relaxed);
+  mqttWarning() << "发件箱超出大小限制，丢弃" << lost << "条消息";
+}
+
+bool MqttOutbox::mapReadSegment() {
+  if (segments_.isEmpty() || segments_.first().seq != read_seq_) {
+    return false;
+  }
+  return mapSegment(read_seq_, segments_.first().size, &read_file_, &read_map_);
+}
+
+bool MqttOutbox::advanceReadSegment() {
+  if (segments_.size() < 2) {
+    return false;
+  }
+  // 已读完的分段直接删除
+  unmapSegment(&read_file_, &read_map_);
+  Segment finished = segments_.takeFirst();
+  QFile::remove(segmentPath(finished.seq));
+  total_bytes_ -= finished.size;
+
+  read_seq_ = segments_.first().seq;
+  read_offset_ = kSegmentHeaderSize;
+  read_consumed_ = 0;
+  saveCursor();
+  return mapReadSegment();
+}
+
+void MqttOutbox::saveCursor() {
+  if (cursor_map_) {
+    cursor_map_[0] = read_seq_;
+    cursor_map_[1] = read_offset_;
+  }
+}
@@ -0,0 +1,140 @@
+#ifndef MQTTOUTBOX_H
+#define MQTTOUTBOX_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <atomic>
+
+/*!
+ * \brief 离线发件箱
+ * 基于内存映射文件的只追加分段日志，用于保存断线期间或超出发布窗口的消息，
+ * 重连后按写入顺序取出重发。每个分段是一个预分配大小的文件，追加一条消息只需
+ * 在映射区内拷贝一次，不产生系统调用；只有切换分段时才创建文件并实际分配磁盘空间，
+ * 磁盘写满时追加失败而不会在写入映射区时崩溃。
+ * 读取进度保存在同目录的cursor文件中，进程重启后从上次位置继续。
+ * 数据依赖操作系统回写，进程崩溃不丢数据，但掉电可能丢失最近写入的部分。
+ * 文件格式使用本机字节序，不能在不同架构之间迁移。
+ * append()可在任意线程调用，其余方法应由同一线程调用。
+ */
+class MqttOutbox {
+ public:
+  /*!
+   * \brief 发件箱中的一条消息
+   */
+  struct Record {
+    QByteArray topic;      // UTF-8编码的主题
+    QByteArray payload;    // 消息内容
+    int qos = 0;           // 消息质量等级
+    bool retain = false;   // 是否为保留消息
+    qint64 timestamp = 0;  // 写入时间（毫秒级Unix时间戳）
+  };
+
+  MqttOutbox();
+
+  /*!
+   * \brief 析构函数，解除映射并关闭文件
+   */
+  ~MqttOutbox();
+
+  MqttOutbox(const MqttOutbox &) = delete;
+  MqttOutbox &operator=(const MqttOutbox &) = delete;
+
+  /*!
+   * \brief 打开发件箱目录，恢复已有的分段及读取进度
+   * \param dir 发件箱目录，不存在时自动创建
+   * \param max_bytes 全部分段的总大小上限，超出时丢弃最早的分段
+   * \param max_age_ms 消息最长保留时间（毫秒），过期消息在取出时丢弃，0表示不限制
+   * \param segment_size 单个分段文件的大小
+   * \return 是否成功打开
+   */
+  bool open(const QString &dir, qint64 max_bytes, qint64 max_age_ms, qint64 segment_size = kDefaultSegmentSize);
+
+  /*!
+   * \brief 关闭发件箱
+   */
+  void close();
+
+  /*!
+   * \brief 是否已打开
+   */
+  bool isOpen() const { return write_map_ != nullptr; }
+
+  /*!
+   * \brief 追加一条消息（线程安全）
+   * \return 写入失败（未打开或无法创建分段，包括磁盘空间不足）时返回false
+   */
+  bool append(const QByteArray &topic, const QByteArray &payload, int qos, bool retain);
+
+  /*!
+   * \brief 读取下一条未发送的消息，跳过已过期的消息
+   * \param record 输出参数
+   * \return 发件箱为空时返回false
+   */
+  bool peek(Record *record);
+
+  /*!
+   * \brief 确认peek()返回的消息已发送，推进读取进度
+   */
+  void pop();
+
+  /*!
+   * \brief 是否没有待发送的消息（线程安全）
+   */
+  bool isEmpty() const { return pending_.load(std::memory_order_acquire) == 0; }
+
+  /*!
+   * \brief 待发送的消息数量（线程安全）
+   */
+  qint64 pendingCount() const { return pending_.load(std::memory_order_relaxed); }
+
+  /*!
+   * \brief 因超出大小或时间限制而丢弃的消息数量（线程安全）
+   */
+  qint64 droppedCount() const { return dropped_.load(std::memory_order_relaxed); }
+
+  static const qint64 kDefaultSegmentSize = 4 * 1024 * 1024;  // 默认分段大小（4MB）
+
+ private:
+  struct Segment {
+    qint64 seq = 0;      // 分段序号，决定文件名
+    qint64 size = 0;     // 文件大小
+    qint64 records = 0;  // 已写入的消息数量
+  };
+
+  QString segmentPath(qint64 seq) const;
+  bool mapSegment(qint64 seq, qint64 size, QFile *file, uchar **map);
+  static void unmapSegment(QFile *file, uchar **map);
+  static qint64 scanSegment(const uchar *map, qint64 size, qint64 offset, qint64 *records);
+  bool rollSegment(qint64 min_size);
+  void dropOldestSegment();
+  bool mapReadSegment();
+  bool advanceReadSegment();
+  void saveCursor();
+
+  QString dir_;                     // 发件箱目录
+  qint64 max_bytes_ = 0;            // 总大小上限
+  qint64 max_age_ms_ = 0;           // 消息最长保留时间
+  qint64 segment_size_ = 0;         // 分段大小
+  QMutex mutex_;                    // 保护分段列表及写入位置
+  QList<Segment> segments_;         // 全部分段，按序号递增排列
+  qint64 next_seq_ = 0;             // 下一个分段的序号
+  qint64 total_bytes_ = 0;          // 全部分段的大小之和
+  QFile write_file_;                // 当前写入分段
+  uchar *write_map_ = nullptr;      // 写入分段映射地址
+  qint64 write_offset_ = 0;         // 写入位置
+  QFile read_file_;                 // 当前读取分段
+  uchar *read_map_ = nullptr;       // 读取分段映射地址
+  qint64 read_seq_ = 0;             // 读取分段序号
+  qint64 read_offset_ = 0;          // 读取位置
+  qint64 read_consumed_ = 0;        // 读取分段中已取出的消息数量
+  qint64 peek_size_ = 0;            // peek()返回的消息所占字节数
+  QFile cursor_file_;               // 读取进度文件
+  qint64 *cursor_map_ = nullptr;    // 读取进度映射地址（分段序号、偏移）
+  std::atomic<qint64> pending_{0};  // 待发送的消息数量
+  std::atomic<qint64> dropped_{0};  // 丢弃的消息数量
+};
+
+#endif  // MQTTOUTBOX_H
@@ -0,0 +1,59 @@
+#include "MqttPublishToken.h"
+
+#include "MqttMetrics.h"
+
+MqttPublishToken::MqttPublishToken() = default;
+
+bool MqttPublishToken::isValid() const { return state_ != nullptr; }
+
+MqttPublishToken::Status MqttPublishToken::status() const {
+  return state_ ? static_cast<Status>(state_->status.load(std::memory_order_acquire)) : Failed;
+}
+
+bool MqttPublishToken::isFinished() const { return status() != Pending; }
+
+int MqttPublishToken::messageId() const { return state_ ? state_->mid.load(std::memory_order_relaxed) : 0; }
+
+int MqttPublishToken::qos() const { return state_ ? state_->qos : 0; }
+
+int MqttPublishToken::errorCode() const { return isFinished() && state_ ? state_->rc : 0; }
+
+qint64 MqttPublishToken::latencyUs() const { return isFinished() && state_ ? state_->latency_us : -1; }
+
+bool MqttPublishToken::waitForFinished(int msecs) const {
+  if (!state_) {
+    return false;
+  }
+
+  std::unique_lock<std::mutex> lock(state_->mutex);
+  state_->waiting = true;
+  auto done = [this]() { return state_->status.load(std::memory_order_acquire) != Pending; };
+  if (msecs < 0) {
+    state_->cond.wait(lock, done);
+    return true;
+  }
+  return state_->cond.wait_for(lock, std::chrono::milliseconds(msecs), done);
+}
+
+MqttPublishToken MqttPublishToken::create(int qos) {
+  MqttPublishToken token;
+  token.state_ = std::make_shared<State>();
+  token.state_->qos = qos;
+  token.state_->created_ns = mqttMonotonicNs();
+  return token;
+}
+
+void MqttPublishToken::finish(Status status, int rc) const {
+  if (!state_ || isFinished()) {
+    return;
+  }
+
+  state_->rc = rc;
+  state_->latency_us = (mqttMonotonicNs() - state_->created_ns) / 1000;
+  // 在锁内更新状态，保证等待线程不会错过通知
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  state_->status.store(status, std::memory_order_release);
+  if (state_->waiting) {
+    state_->cond.notify_all();
+  }
+}
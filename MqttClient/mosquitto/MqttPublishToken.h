@@ -0,0 +1,108 @@
+#ifndef MQTTPUBLISHTOKEN_H
+#define MQTTPUBLISHTOKEN_H
+
+#include <QMetaType>
+#include <QtGlobal>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+/*!
+ * \brief 发布凭据
+ * MqttClient::publish()的返回值，可在任意线程查询或等待消息的确认结果：
+ * QoS0在报文写出后完成，QoS1在收到PUBACK后完成，QoS2在收到PUBCOMP后完成。
+ * 凭据是共享的值类型，拷贝代价很小。
+ */
+class MqttPublishToken {
+ public:
+  /*!
+   * \brief 发布状态
+   */
+  enum Status {
+    Pending,    // 等待确认
+    Completed,  // 已确认
+    Failed,     // 发送失败（见errorCode()）
+    Rejected,   // 发布窗口已满，消息被拒绝
+    Spooled     // 已写入离线发件箱，将在重连后发送
+  };
+
+  /*!
+   * \brief 构造一个无效凭据
+   */
+  MqttPublishToken();
+
+  /*!
+   * \brief 凭据是否有效
+   */
+  bool isValid() const;
+
+  /*!
+   * \brief 当前状态
+   */
+  Status status() const;
+
+  /*!
+   * \brief 是否已有结果（确认、失败、被拒绝或已写入发件箱）
+   */
+  bool isFinished() const;
+
+  /*!
+   * \brief 消息ID，消息尚未交给libmosquitto时为0
+   */
+  int messageId() const;
+
+  /*!
+   * \brief 消息质量等级
+   */
+  int qos() const;
+
+  /*!
+   * \brief 失败时的Mosquitto错误码
+   */
+  int errorCode() const;
+
+  /*!
+   * \brief 从调用publish()到收到确认的耗时（微秒），未完成时为-1
+   */
+  qint64 latencyUs() const;
+
+  /*!
+   * \brief 阻塞等待结果
+   * 不要在客户端线程中调用，否则确认永远无法被处理。
+   * \param msecs 最长等待时间（毫秒），负数表示一直等待
+   * \return 是否在超时前得到结果
+   */
+  bool waitForFinished(int msecs = -1) const;
+
+ private:
+  friend class MqttClient;
+
+  struct State {
+    std::atomic<int> status{Pending};  // 发布状态
+    int qos = 0;                       // 消息质量等级
+    std::atomic<int> mid{0};           // 消息ID
+    int rc = 0;                        // Mosquitto错误码
+    qint64 created_ns = 0;             // 调用publish()的时间（单调时钟纳秒）
+    qint64 latency_us = -1;            // 确认耗时
+    std::mutex mutex;                  // 等待互斥锁
+    std::condition_variable cond;      // 等待条件变量
+    bool waiting = false;              // 是否有线程在等待
+  };
+
+  /*!
+   * \brief 创建一个待确认的凭据
+   */
+  static MqttPublishToken create(int qos);
+
+  /*!
+   * \brief 设置最终结果并唤醒等待的线程
+   */
+  void finish(Status status, int rc) const;
+
+  std::shared_ptr<State> state_;  // 共享状态
+};
+
+Q_DECLARE_METATYPE(MqttPublishToken)
+
+#endif  // MQTTPUBLISHTOKEN_H
@@ -0,0 +1,17 @@
+#include "MqttSubscription.h"
+
+MqttSubscription::MqttSubscription(int id, const QString &filter, int qos, const Handler &handler)
+    : QObject(nullptr), id_(id), filter_(filter), qos_(qos), handler_(handler) {}
+
+int MqttSubscription::id() const { return id_; }
+
+QString MqttSubscription::filter() const { return filter_; }
+
+int MqttSubscription::qos() const { return qos_; }
+
+void MqttSubscription::deliver(const MqttMessage &message) {
+  if (handler_) {
+    handler_(message);
+  }
+  emit messageReceived(message);
+}
@@ -0,0 +1,62 @@
+#ifndef MQTTSUBSCRIPTION_H
+#define MQTTSUBSCRIPTION_H
+
+#include <QObject>
+#include <QString>
+#include <functional>
+
+#include "MqttMessage.h"
+
+/*!
+ * \brief 订阅句柄
+ * 由MqttClient::subscribe(filter, qos, handler)创建，只接收与其过滤器匹配的消息。
+ * 匹配到的消息先在客户端线程中调用处理函数（若有），再发出messageReceived信号；
+ * 句柄由MqttClient管理，通过MqttClient::unsubscribe()释放，不要直接delete。
+ */
+class MqttSubscription : public QObject {
+  Q_OBJECT
+ public:
+  /*!
+   * \brief 消息处理函数，在客户端线程中同步调用
+   */
+  typedef std::function<void(const MqttMessage &)> Handler;
+
+  /*!
+   * \brief 订阅标识，在同一客户端内唯一
+   */
+  int id() const;
+
+  /*!
+   * \brief 订阅的主题过滤器
+   */
+  QString filter() const;
+
+  /*!
+   * \brief 订阅的消息质量等级
+   */
+  int qos() const;
+
+ signals:
+  /*!
+   * \brief 匹配消息接收信号
+   * \param message 与过滤器匹配的消息
+   */
+  void messageReceived(const MqttMessage &message);
+
+ private:
+  friend class MqttClient;
+
+  MqttSubscription(int id, const QString &filter, int qos, const Handler &handler);
+
+  /*!
+   * \brief 投递一条匹配的消息
+   */
+  void deliver(const MqttMessage &message);
+
+  int id_;           // 订阅标识
+  QString filter_;   // 主题过滤器
+  int qos_;          // 消息质量等级
+  Handler handler_;  // 消息处理函数
+};
+
+#endif  // MQTTSUBSCRIPTION_H
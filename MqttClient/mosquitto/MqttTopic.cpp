@@ -0,0 +1,28 @@
+#include "MqttTopic.h"
+
+MqttTopicTable::~MqttTopicTable() { qDeleteAll(entries_); }
+
+MqttTopic MqttTopicTable::intern(const QString &name) {
+  if (name.isEmpty()) {
+    return MqttTopic();
+  }
+  const QByteArray utf8 = name.toUtf8();
+  QMutexLocker locker(&mutex_);
+  MqttTopicEntry *entry = by_name_.value(utf8, nullptr);
+  if (!entry) {
+    entry = new MqttTopicEntry;
+    entry->table = this;
+    entry->id = entries_.size();
+    entry->name = name;
+    entry->utf8 = utf8;
+    entries_.append(entry);
+    by_name_.insert(utf8, entry);
+    size_.store(entries_.size(), std::memory_order_release);
+  }
+  return MqttTopic(entry);
+}
+
+MqttTopic MqttTopicTable::find(const QByteArray &utf8) const {
+  QMutexLocker locker(&mutex_);
+  return MqttTopic(by_name_.value(utf8, nullptr));
+}
@@ -0,0 +1,108 @@
+#ifndef MQTTTOPIC_H
+#define MQTTTOPIC_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+#include <atomic>
+
+class MqttTopicTable;
+
+/*!
+ * \brief 主题表中的一个条目
+ * 名称和编码在创建后不再改变；别名相关字段只由所属MqttClient在客户端线程中维护。
+ */
+struct MqttTopicEntry {
+  const MqttTopicTable *table = nullptr;  // 所属主题表，用于拒绝其他客户端的句柄
+  int id = -1;                            // 在主题表中的序号
+  QString name;                           // 主题字符串
+  QByteArray utf8;                        // 预先编码的UTF-8主题
+  quint32 publishes = 0;                  // 分配别名前发布的QoS0消息数，用于挑选热点主题（仅客户端线程访问）
+  int alias = 0;                          // 分配到的v5主题别名，0表示没有（仅客户端线程访问）
+  quint64 alias_epoch = 0;                // 别名所属的连接序号，与当前连接不同时别名无效（仅客户端线程访问）
+  bool alias_sent = false;                // 别名映射是否已随完整主题告知代理（仅客户端线程访问）
+};
+
+/*!
+ * \brief 主题句柄
+ * 由MqttClient::topic()创建，保存主题字符串和预先编码的UTF-8字节，复制只是复制一个指针。
+ * 句柄指向的条目在所属客户端的生命周期内不会释放，可在任意线程使用，但只能用于创建它的客户端。
+ */
+class MqttTopic {
+ public:
+  MqttTopic() = default;
+
+  /*!
+   * \brief 是否为有效句柄
+   */
+  bool isValid() const { return entry_ != nullptr; }
+
+  /*!
+   * \brief 在所属主题表中的序号，与MqttMessage::topic_id对应；无效句柄为-1
+   */
+  int id() const { return entry_ ? entry_->id : -1; }
+
+  /*!
+   * \brief 主题字符串（共享数据，不复制）
+   */
+  QString name() const { return entry_ ? entry_->name : QString(); }
+
+  /*!
+   * \brief UTF-8编码的主题（共享数据，不复制）
+   */
+  QByteArray utf8() const { return entry_ ? entry_->utf8 : QByteArray(); }
+
+  bool operator==(const MqttTopic &other) const { return entry_ == other.entry_; }
+  bool operator!=(const MqttTopic &other) const { return entry_ != other.entry_; }
+
+ private:
+  friend class MqttTopicTable;
+  friend class MqttClient;
+
+  explicit MqttTopic(MqttTopicEntry *entry) : entry_(entry) {}
+
+  MqttTopicEntry *entry_ = nullptr;  // 主题表中的条目
+};
+
+/*!
+ * \brief 主题表
+ * 为注册的主题分配从0开始的连续序号并保存编码结果，条目只增不减，随主题表一起释放。
+ * 所有函数线程安全。
+ */
+class MqttTopicTable {
+ public:
+  MqttTopicTable() = default;
+  ~MqttTopicTable();
+
+  MqttTopicTable(const MqttTopicTable &) = delete;
+  MqttTopicTable &operator=(const MqttTopicTable &) = delete;
+
+  /*!
+   * \brief 注册主题，已注册时返回原有句柄
+   * \param name 主题字符串，不能为空
+   * \return 主题句柄，主题为空时返回无效句柄
+   */
+  MqttTopic intern(const QString &name);
+
+  /*!
+   * \brief 查找已注册的主题
+   * \param utf8 UTF-8编码的主题
+   * \return 主题句柄，未注册时返回无效句柄
+   */
+  MqttTopic find(const QByteArray &utf8) const;
+
+  /*!
+   * \brief 已注册的主题数量，只增不减，可用于判断是否有新主题注册（无锁）
+   */
+  int size() const { return size_.load(std::memory_order_acquire); }
+
+ private:
+  mutable QMutex mutex_;                         // 保护以下两个容器
+  QHash<QByteArray, MqttTopicEntry *> by_name_;  // 按UTF-8主题索引
+  QVector<MqttTopicEntry *> entries_;            // 按序号排列的条目
+  std::atomic<int> size_{0};                     // 条目数量
+};
+
+#endif  // MQTTTOPIC_H
@@ -0,0 +1,188 @@
+#include "MqttWorkerPool.h"
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QThread>
+
+// 空闲工作线程的最长等待时间（毫秒），超时后重新尝试窃取
+static const int kIdleWaitMs = 10;
+
+class MqttWorkerPool::Worker : public QThread {
+ public:
+  Worker(MqttWorkerPool *pool, int index) : pool_(pool), index_(index) {}
+
+ protected:
+  void run() override { pool_->runWorker(index_); }
+
+ private:
+  MqttWorkerPool *pool_;  // 所属线程池
+  int index_;             // 工作线程序号
+};
+
+MqttWorkerPool::MqttWorkerPool(int threads, const Handler &handler, int shards_per_thread) : handler_(handler) {
+  if (threads <= 0) {
+    threads = qMax(1, QThread::idealThreadCount());
+  }
+  const int shard_count = threads * qMax(1, shards_per_thread);
+  shards_.reserve(shard_count);
+  for (int i = 0; i < shard_count; ++i) {
+    shards_.append(new Shard);
+  }
+  run_queues_.reserve(threads);
+  workers_.reserve(threads);
+  for (int i = 0; i < threads; ++i) {
+    run_queues_.append(new RunQueue);
+  }
+  for (int i = 0; i < threads; ++i) {
+    Worker *worker = new Worker(this, i);
+    workers_.append(worker);
+    worker->start();
+  }
+}
+
+MqttWorkerPool::~MqttWorkerPool() {
+  stopping_.store(true, std::memory_order_release);
+  {
+    QMutexLocker locker(&idle_mutex_);
+    idle_cond_.wakeAll();
+  }
+  for (Worker *worker : workers_) {
+    worker->wait();
+  }
+  qDeleteAll(workers_);
+  qDeleteAll(run_queues_);
+  qDeleteAll(shards_);
+}
+
+void MqttWorkerPool::submit(const MqttMessage &message) {
+  const int index = static_cast<int>(qHash(message.topic) % static_cast<uint>(shards_.size()));
+  Shard *shard = shards_.at(index);
+  queued_.fetch_add(1, std::memory_order_relaxed);
+
+  bool idle;
+  {
+    QMutexLocker locker(&shard->mutex);
+    shard->queue.append(message);
+    idle = !shard->scheduled;
+    shard->scheduled = true;
+  }
+  // 分片由空闲转为就绪时才进入就绪队列，之后的消息只追加到分片
+  if (idle) {
+    schedule(index % workers_.size(), index);
+  }
+}
+
+bool MqttWorkerPool::waitForIdle(int msecs) {
+  QElapsedTimer timer;
+  timer.start();
+  while (queued_.load(std::memory_order_acquire) > 0) {
+    if (timer.elapsed() >= msecs) {
+      return false;
+    }
+    QThread::msleep(1);
+  }
+  return true;
+}
+
+MqttWorkerPool::Stats MqttWorkerPool::stats() const {
+  Stats stats;
+  stats.processed = processed_.load(std::memory_order_relaxed);
+  stats.steals = steals_.load(std::memory_order_relaxed);
+  stats.queued = queued_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void MqttWorkerPool::runWorker(int index) {
+  while (!stopping_.load(std::memory_order_acquire)) {
+    int shard;
+    if (popLocal(index, &shard) || steal(index, &shard)) {
+      process(index, shard);
+      continue;
+    }
+
+    // 在锁内确认没有就绪分片后再等待，与schedule()的唤醒配合不会丢失通知
+    QMutexLocker locker(&idle_mutex_);
+    if (ready_shards_.load(std::memory_order_acquire) > 0 || stopping_.load(std::memory_order_acquire)) {
+      continue;
+    }
+    ++idle_workers_;
+    idle_cond_.wait(&idle_mutex_, kIdleWaitMs);
+    --idle_workers_;
+  }
+}
+
+void MqttWorkerPool::schedule(int worker, int shard) {
+  RunQueue *queue = run_queues_.at(worker);
+  {
+    QMutexLocker locker(&queue->mutex);
+    queue->shards.push_back(shard);
+  }
+  ready_shards_.fetch_add(1, std::memory_order_release);
+
+  QMutexLocker locker(&idle_mutex_);
+  if (idle_workers_ > 0) {
+    idle_cond_.wakeOne();
+  }
+}
+
+bool MqttWorkerPool::popLocal(int worker, int *shard) {
+  RunQueue *queue = run_queues_.at(worker);
+  QMutexLocker locker(&queue->mutex);
+  if (queue->shards.empty()) {
+    return false;
+  }
+  *shard = queue->shards.front();
+  queue->shards.pop_front();
+  ready_shards_.fetch_sub(1, std::memory_order_acq_rel);
+  return true;
+}
+
+bool MqttWorkerPool::steal(int worker, int *shard) {
+  const int count = run_queues_.size();
+  for (int i = 1; i < count; ++i) {
+    RunQueue *queue = run_queues_.at((worker + i) % count);
+    // 对方正忙于操作自己的队列时跳过，不在窃取上阻塞
+    if (!queue->mutex.tryLock()) {
+      continue;
+    }
+    bool found = !queue->shards.empty();
+    if (found) {
+      // 从队尾窃取，队首留给所属线程
+      *shard = queue->shards.back();
+      queue->shards.pop_back();
+      ready_shards_.fetch_sub(1, std::memory_order_acq_rel);
+    }
+    queue->mutex.unlock();
+    if (found) {
+      steals_.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+  }
+  return false;
+}
+
+void MqttWorkerPool::process(int worker, int index) {
+  Shard *shard = shards_.at(index);
+  QVector<MqttMessage> batch;
+  {
+    QMutexLocker locker(&shard->mutex);
+    batch.swap(shard->queue);
+  }
+
+  for (const MqttMessage &message : batch) {
+    handler_(message);
+  }
+  processed_.fetch_add(batch.size(), std::memory_order_relaxed);
+  queued_.fetch_sub(batch.size(), std::memory_order_release);
+
+  bool more;
+  {
+    QMutexLocker locker(&shard->mutex);
+    more = !shard->queue.isEmpty();
+    shard->scheduled = more;
+  }
+  // 处理期间又有新消息，放回本线程队尾，让其他分片也有机会执行
+  if (more) {
+    schedule(worker, index);
+  }
+}
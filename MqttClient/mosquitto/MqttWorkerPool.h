@@ -0,0 +1,109 @@
+#ifndef MQTTWORKERPOOL_H
+#define MQTTWORKERPOOL_H
+
+#include <QMutex>
+#include <QVector>
+#include <QWaitCondition>
+#include <atomic>
+#include <deque>
+#include <functional>
+
+#include "MqttMessage.h"
+
+/*!
+ * \brief 按主题分片的并行消息处理线程池
+ * 消息按主题哈希分配到固定的分片，每个分片同一时刻只由一个工作线程处理，
+ * 因此同一主题的消息按到达顺序处理，不同主题的消息在多个线程上并行处理。
+ * 有消息的分片进入其所属工作线程的就绪队列；空闲的工作线程从其他线程的就绪队列中
+ * 窃取整个分片，窃取不会打乱分片内的顺序。
+ * submit()可在任意线程调用，处理函数在工作线程中调用，必须是线程安全的。
+ */
+class MqttWorkerPool {
+ public:
+  /*!
+   * \brief 消息处理函数，在工作线程中调用
+   */
+  typedef std::function<void(const MqttMessage &)> Handler;
+
+  /*!
+   * \brief 运行统计
+   */
+  struct Stats {
+    quint64 processed = 0;  // 已处理的消息数
+    quint64 steals = 0;     // 窃取分片的次数
+    qint64 queued = 0;      // 等待处理的消息数
+  };
+
+  /*!
+   * \brief 构造函数，立即启动工作线程
+   * \param threads 工作线程数，不大于0时使用CPU核数
+   * \param handler 消息处理函数
+   * \param shards_per_thread 每个工作线程对应的分片数，分片越多负载越均衡
+   */
+  MqttWorkerPool(int threads, const Handler &handler, int shards_per_thread = 16);
+
+  /*!
+   * \brief 析构函数，停止并等待全部工作线程，未处理的消息被丢弃
+   */
+  ~MqttWorkerPool();
+
+  MqttWorkerPool(const MqttWorkerPool &) = delete;
+  MqttWorkerPool &operator=(const MqttWorkerPool &) = delete;
+
+  /*!
+   * \brief 提交一条消息
+   */
+  void submit(const MqttMessage &message);
+
+  /*!
+   * \brief 等待已提交的消息全部处理完
+   * \param msecs 超时（毫秒）
+   * \return 是否在超时前处理完
+   */
+  bool waitForIdle(int msecs);
+
+  /*!
+   * \brief 工作线程数
+   */
+  int threadCount() const { return workers_.size(); }
+
+  /*!
+   * \brief 获取运行统计
+   */
+  Stats stats() const;
+
+ private:
+  class Worker;
+
+  struct Shard {
+    QMutex mutex;                // 保护以下成员
+    QVector<MqttMessage> queue;  // 等待处理的消息
+    bool scheduled = false;      // 是否在就绪队列中或正在处理
+  };
+
+  struct RunQueue {
+    QMutex mutex;            // 保护shards
+    std::deque<int> shards;  // 就绪的分片
+  };
+
+  void runWorker(int index);
+  void schedule(int worker, int shard);
+  bool popLocal(int worker, int *shard);
+  bool steal(int worker, int *shard);
+  void process(int worker, int shard);
+
+  Handler handler_;                    // 消息处理函数
+  QVector<Shard *> shards_;            // 全部分片
+  QVector<RunQueue *> run_queues_;     // 各工作线程的就绪队列
+  QVector<Worker *> workers_;          // 工作线程
+  QMutex idle_mutex_;                  // 空闲等待互斥锁
+  QWaitCondition idle_cond_;           // 空闲等待条件
+  int idle_workers_ = 0;               // 正在等待的工作线程数（受idle_mutex_保护）
+  std::atomic<int> ready_shards_{0};   // 全部就绪队列中的分片数
+  std::atomic<qint64> queued_{0};      // 等待处理的消息数
+  std::atomic<quint64> processed_{0};  // 已处理的消息数
+  std::atomic<quint64> steals_{0};     // 窃取分片的次数
+  std::atomic<bool> stopping_{false};  // 是否正在停止
+};
+
+#endif  // MQTTWORKERPOOL_H
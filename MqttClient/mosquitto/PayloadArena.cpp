@@ -0,0 +1,74 @@
+#include "PayloadArena.h"
+
+#include <cstring>
+
+PayloadArena::PayloadArena(int slab_size, int max_pooled_slabs)
+    : slab_size_(slab_size), free_list_(std::make_shared<FreeList>()) {
+  free_list_->max_slabs = max_pooled_slabs;
+}
+
+PayloadArena::~PayloadArena() {
+  current_.reset();
+  QMutexLocker locker(&free_list_->mutex);
+  free_list_->closed = true;
+  for (PayloadSlab *slab : free_list_->slabs) {
+    delete slab;
+  }
+  free_list_->slabs.clear();
+}
+
+int PayloadArena::pooledSlabCount() const {
+  QMutexLocker locker(&free_list_->mutex);
+  return static_cast<int>(free_list_->slabs.size());
+}
+
+QByteArray PayloadArena::allocate(const char *data, int size, std::shared_ptr<const PayloadSlab> *slab) {
+  // 大负载单独分配，避免一条消息独占整块内存导致内存块迟迟不能回收
+  if (size > slab_size_ / 4) {
+    slab->reset();
+    return QByteArray(data, size);
+  }
+
+  if (!current_ || current_->available() < size) {
+    current_ = acquireSlab();
+  }
+
+  char *dst = current_->data() + current_->used_;
+  if (size > 0) {
+    memcpy(dst, data, size);
+  }
+  current_->used_ += size;
+  *slab = current_;
+  return QByteArray::fromRawData(dst, size);
+}
+
+std::shared_ptr<PayloadSlab> PayloadArena::acquireSlab() {
+  PayloadSlab *slab = nullptr;
+  {
+    // 加锁取出保证消费者对内存块的最后一次读取先于这里的覆盖写入
+    QMutexLocker locker(&free_list_->mutex);
+    if (!free_list_->slabs.empty()) {
+      slab = free_list_->slabs.back();
+      free_list_->slabs.pop_back();
+    }
+  }
+  if (slab) {
+    slab->used_ = 0;
+  } else {
+    slab = new PayloadSlab(slab_size_);
+  }
+  Recycle recycle;
+  recycle.free_list = free_list_;
+  return std::shared_ptr<PayloadSlab>(slab, recycle);
+}
+
+void PayloadArena::Recycle::operator()(PayloadSlab *slab) const {
+  {
+    QMutexLocker locker(&free_list->mutex);
+    if (!free_list->closed && static_cast<int>(free_list->slabs.size()) < free_list->max_slabs) {
+      free_list->slabs.push_back(slab);
+      return;
+    }
+  }
+  delete slab;
+}
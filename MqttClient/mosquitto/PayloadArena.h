@@ -0,0 +1,100 @@
+#ifndef PAYLOADARENA_H
+#define PAYLOADARENA_H
+
+#include <QByteArray>
+#include <QMutex>
+#include <memory>
+#include <vector>
+
+/*!
+ * \brief 消息负载内存块
+ * 一块连续的内存，多条消息的负载依次写入其中；由引用计数管理生命周期，
+ * 当所有引用该内存块的消息都被释放后，内存块归还内存池复用。
+ */
+class PayloadSlab {
+ public:
+  explicit PayloadSlab(int capacity) : data_(new char[capacity]), capacity_(capacity) {}
+
+  PayloadSlab(const PayloadSlab &) = delete;
+  PayloadSlab &operator=(const PayloadSlab &) = delete;
+
+  char *data() { return data_.get(); }
+  int capacity() const { return capacity_; }
+  int used() const { return used_; }
+  int available() const { return capacity_ - used_; }
+
+ private:
+  friend class PayloadArena;
+
+  std::unique_ptr<char[]> data_;  // 内存块数据
+  int capacity_ = 0;              // 内存块容量
+  int used_ = 0;                  // 已使用字节数
+};
+
+/*!
+ * \brief 消息负载内存池
+ * 以内存块（slab）为单位分配负载内存，避免每条消息单独申请堆内存。
+ * 返回的QByteArray是指向内存块的只读视图（QByteArray::fromRawData），
+ * 调用方需同时持有对应的内存块引用以保证视图有效。
+ * 最后一个引用释放时（可能在消费者线程），内存块经加锁的空闲列表归还内存池，
+ * 网络线程从空闲列表取出后才会覆盖其内容，两者之间有明确的先后关系。
+ * 除内存块的归还外非线程安全，只能在网络线程中使用。
+ */
+class PayloadArena {
+ public:
+  /*!
+   * \brief 构造函数
+   * \param slab_size 单个内存块大小，默认为64KB
+   * \param max_pooled_slabs 内存池最多缓存的内存块数量，超出部分在释放后直接归还系统
+   */
+  explicit PayloadArena(int slab_size = 64 * 1024, int max_pooled_slabs = 64);
+
+  /*!
+   * \brief 析构函数
+   * 释放空闲的内存块；仍被消息引用的内存块在最后一个引用释放时直接归还系统。
+   */
+  ~PayloadArena();
+
+  PayloadArena(const PayloadArena &) = delete;
+  PayloadArena &operator=(const PayloadArena &) = delete;
+
+  /*!
+   * \brief 拷贝一段负载到内存池中
+   * \param data 负载数据
+   * \param size 负载长度
+   * \param slab 输出参数，返回负载所在的内存块；大负载单独分配时为空
+   * \return 负载视图；大于内存块四分之一的负载直接深拷贝为独立的QByteArray
+   */
+  QByteArray allocate(const char *data, int size, std::shared_ptr<const PayloadSlab> *slab);
+
+  /*!
+   * \brief 当前内存池中缓存的内存块数量
+   */
+  int pooledSlabCount() const;
+
+ private:
+  // 空闲内存块列表，由内存池和各内存块的删除器共同持有，内存池析构后删除器不再归还
+  struct FreeList {
+    QMutex mutex;                      // 保护以下成员
+    std::vector<PayloadSlab *> slabs;  // 已被全部消费者释放的内存块
+    int max_slabs = 0;                 // 最多缓存的内存块数量
+    bool closed = false;               // 内存池已析构
+  };
+
+  // shared_ptr的删除器：最后一个引用释放时把内存块放回空闲列表
+  struct Recycle {
+    std::shared_ptr<FreeList> free_list;
+    void operator()(PayloadSlab *slab) const;
+  };
+
+  /*!
+   * \brief 获取一个可写入的内存块，优先复用已被消费者释放的内存块
+   */
+  std::shared_ptr<PayloadSlab> acquireSlab();
+
+  int slab_size_;                         // 内存块大小
+  std::shared_ptr<FreeList> free_list_;   // 空闲内存块
+  std::shared_ptr<PayloadSlab> current_;  // 当前写入的内存块
+};
+
+#endif  // PAYLOADARENA_H
@@ -0,0 +1,50 @@
+#include "PublishQueue.h"
+
+PublishQueue::PublishQueue() : head_(&stub_), tail_(&stub_) {}
+
+PublishQueue::~PublishQueue() {
+  while (PublishRequest *request = pop()) {
+    delete request;
+  }
+}
+
+void PublishQueue::push(PublishRequest *request) {
+  request->next.store(nullptr, std::memory_order_relaxed);
+  // 交换头指针后再链接前驱节点，两步之间消费者会看到一个暂时断开的链表
+  PublishRequest *prev = head_.exchange(request, std::memory_order_acq_rel);
+  prev->next.store(request, std::memory_order_release);
+}
+
+PublishRequest *PublishQueue::pop() {
+  PublishRequest *tail = tail_;
+  PublishRequest *next = tail->next.load(std::memory_order_acquire);
+
+  // 跳过哨兵节点
+  if (tail == &stub_) {
+    if (!next) {
+      return nullptr;
+    }
+    tail_ = next;
+    tail = next;
+    next = next->next.load(std::memory_order_acquire);
+  }
+
+  if (next) {
+    tail_ = next;
+    return tail;
+  }
+
+  // tail不是最后入队的节点，说明有生产者尚未完成链接，稍后再取
+  if (tail != head_.load(std::memory_order_acquire)) {
+    return nullptr;
+  }
+
+  // 队列中只剩最后一个节点，重新放入哨兵节点后才能安全取出
+  push(&stub_);
+  next = tail->next.load(std::memory_order_acquire);
+  if (next) {
+    tail_ = next;
+    return tail;
+  }
+  return nullptr;
+}
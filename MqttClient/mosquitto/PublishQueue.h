@@ -0,0 +1,60 @@
+#ifndef PUBLISHQUEUE_H
+#define PUBLISHQUEUE_H
+
+#include <QByteArray>
+#include <atomic>
+
+#include "MqttPublishToken.h"
+#include "MqttTopic.h"
+
+/*!
+ * \brief 待发布的消息
+ */
+struct PublishRequest {
+  QByteArray topic;                             // UTF-8编码后的主题
+  MqttTopicEntry *topic_entry = nullptr;        // 使用主题句柄发布时的主题表条目
+  QByteArray payload;                           // 编码后的消息内容，v3.1.1的前缀在客户端线程发送时添加
+  bool encoded = false;                         // 负载已按v5的编码规则编码
+  int qos = 0;                                  // 消息质量等级
+  bool retain = false;                          // 是否为保留消息
+  MqttPublishToken token;                       // 发布凭据
+  std::atomic<PublishRequest *> next{nullptr};  // 队列链接指针（队列内部使用）
+};
+
+/*!
+ * \brief 多生产者单消费者无锁发布队列
+ * 基于Vyukov的侵入式MPSC队列：生产者入队只需一次原子交换，任意线程均可调用push()；
+ * pop()只能由消费者（MqttClient所在线程）调用。队列节点的所有权随push()转移给队列，
+ * 随pop()转移给调用方。
+ */
+class PublishQueue {
+ public:
+  PublishQueue();
+
+  /*!
+   * \brief 析构函数，释放队列中尚未取出的消息
+   */
+  ~PublishQueue();
+
+  PublishQueue(const PublishQueue &) = delete;
+  PublishQueue &operator=(const PublishQueue &) = delete;
+
+  /*!
+   * \brief 入队（线程安全，无锁）
+   * \param request 待发布的消息，所有权转移给队列
+   */
+  void push(PublishRequest *request);
+
+  /*!
+   * \brief 出队（仅消费者线程调用）
+   * \return 队首消息；队列为空或生产者尚未完成入队时返回nullptr
+   */
+  PublishRequest *pop();
+
+ private:
+  std::atomic<PublishRequest *> head_;  // 最新入队的节点（生产者端）
+  PublishRequest *tail_;                // 最早入队的节点（消费者端）
+  PublishRequest stub_;                 // 哨兵节点
+};
+
+#endif  // PUBLISHQUEUE_H
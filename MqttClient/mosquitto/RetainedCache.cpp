@@ -0,0 +1,342 @@
+#include "RetainedCache.h"
+
+#include <QSaveFile>
+#include <cstring>
+
+#include "MqttLog.h"
+#include "TopicTrie.h"
+
+namespace {
+
+const quint32 kSnapshotMagic = 0x4352514d;  // "MQRC"
+const quint32 kSnapshotVersion = 1;
+
+// 快照文件头
+struct SnapshotHeader {
+  quint32 magic;
+  quint32 version;
+  quint32 count;
+  quint32 reserved;
+};
+
+// 条目头，其后依次为UTF-8主题和负载
+struct SnapshotEntry {
+  quint32 topic_len;
+  quint32 payload_len;
+  qint64 timestamp;
+  quint8 qos;
+  quint8 retain;
+  quint16 reserved;
+};
+
+// QCache中每个条目的固定开销估算
+const int kEntryOverhead = 64;
+
+}  // namespace
+
+RetainedCache::RetainedCache(qint64 max_bytes) : max_cost_(qMax<qint64>(1, max_bytes)) {}
+
+RetainedCache::~RetainedCache() {
+  // 先清空条目，避免映射释放后仍有条目引用映射区
+  qDeleteAll(entries_);
+  entries_.clear();
+  if (snapshot_map_) {
+    snapshot_file_.unmap(snapshot_map_);
+  }
+}
+
+bool RetainedCache::loadSnapshot(const QString &path) {
+  QMutexLocker locker(&mutex_);
+  releaseMapping();
+
+  snapshot_file_.setFileName(path);
+  if (!snapshot_file_.open(QIODevice::ReadOnly)) {
+    return false;
+  }
+  const qint64 size = snapshot_file_.size();
+  if (size < qint64(sizeof(SnapshotHeader))) {
+    snapshot_file_.close();
+    return false;
+  }
+  snapshot_map_ = snapshot_file_.map(0, size);
+  if (!snapshot_map_) {
+    snapshot_file_.close();
+    return false;
+  }
+
+  SnapshotHeader header;
+  memcpy(&header, snapshot_map_, sizeof(header));
+  if (header.magic != kSnapshotMagic || header.version != kSnapshotVersion) {
+    mqttWarning() << "Ignoring retained snapshot with unknown format:" << path;
+    releaseMapping();
+    return false;
+  }
+
+  qint64 offset = sizeof(header);
+  quint32 loaded = 0;
+  for (; loaded < header.count; ++loaded) {
+    SnapshotEntry record;
+    if (offset + qint64(sizeof(record)) > size) {
+      break;
+    }
+    memcpy(&record, snapshot_map_ + offset, sizeof(record));
+    offset += sizeof(record);
+    if (offset + qint64(record.topic_len) + qint64(record.payload_len) > size) {
+      break;
+    }
+
+    const char *data = reinterpret_cast<const char *>(snapshot_map_ + offset);
+    offset += record.topic_len + record.payload_len;
+    // 已收到实时消息的主题不被快照覆盖
+    QString topic = QString::fromUtf8(data, static_cast<int>(record.topic_len));
+    if (entries_.contains(topic)) {
+      continue;
+    }
+    Entry *entry = new Entry;
+    entry->topic = topic;
+    entry->payload = QByteArray::fromRawData(data + record.topic_len, static_cast<int>(record.payload_len));
+    entry->qos = record.qos;
+    entry->retain = record.retain != 0;
+    entry->stale = true;
+    entry->mapped = true;
+    entry->timestamp = record.timestamp;
+    entry->cost = entryCost(topic, entry->payload.size());
+    insertEntry(entry);
+  }
+  if (loaded != header.count) {
+    mqttWarning() << "Retained snapshot truncated:" << path << loaded << "of" << header.count << "entries loaded";
+  }
+  return true;
+}
+
+bool RetainedCache::saveSnapshot(const QString &path) {
+  QMutexLocker locker(&mutex_);
+  // 快照文件将被替换，先让条目脱离旧映射
+  releaseMapping();
+
+  QSaveFile file(path);
+  if (!file.open(QIODevice::WriteOnly)) {
+    mqttWarning() << "Cannot write retained snapshot:" << path << file.errorString();
+    return false;
+  }
+
+  SnapshotHeader header;
+  header.magic = kSnapshotMagic;
+  header.version = kSnapshotVersion;
+  header.count = static_cast<quint32>(entries_.size());
+  header.reserved = 0;
+  file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+  for (const Entry *entry : entries_) {
+    const QByteArray encoded_topic = entry->topic.toUtf8();
+    SnapshotEntry record;
+    record.topic_len = static_cast<quint32>(encoded_topic.size());
+    record.payload_len = static_cast<quint32>(entry->payload.size());
+    record.timestamp = entry->timestamp;
+    record.qos = static_cast<quint8>(entry->qos);
+    record.retain = entry->retain ? 1 : 0;
+    record.reserved = 0;
+    file.write(reinterpret_cast<const char *>(&record), sizeof(record));
+    file.write(encoded_topic);
+    file.write(entry->payload);
+  }
+
+  if (!file.commit()) {
+    mqttWarning() << "Cannot write retained snapshot:" << path << file.errorString();
+    return false;
+  }
+  return true;
+}
+
+bool RetainedCache::update(const QString &topic, const QByteArray &payload, int qos, bool retain, qint64 timestamp) {
+  return update(topic, payload.constData(), payload.size(), qos, retain, timestamp);
+}
+
+bool RetainedCache::update(const QString &topic, const char *data, int size, int qos, bool retain,
+                           qint64 timestamp) {
+  QMutexLocker locker(&mutex_);
+  Entry *entry = entries_.value(topic);
+  // 空负载的保留消息表示代理已删除该主题的保留值
+  if (retain && size == 0) {
+    if (!entry) {
+      return false;
+    }
+    removeEntry(entry);
+    return true;
+  }
+
+  if (!entry) {
+    entry = new Entry;
+    entry->topic = topic;
+    entry->payload = QByteArray(data, size);
+    entry->qos = qos;
+    entry->retain = retain;
+    entry->timestamp = timestamp;
+    entry->cost = entryCost(topic, size);
+    insertEntry(entry);
+    return true;
+  }
+
+  // 值未变化时只更新字段和使用顺序，不拷贝负载
+  const bool changed =
+      entry->payload.size() != size || (size > 0 && memcmp(entry->payload.constData(), data, size) != 0);
+  unlink(entry);
+  linkFront(entry);
+  entry->qos = qos;
+  entry->retain = retain;
+  entry->stale = false;
+  entry->timestamp = timestamp;
+  if (changed) {
+    total_cost_ -= entry->cost;
+    entry->payload = QByteArray(data, size);
+    entry->mapped = false;
+    entry->cost = entryCost(topic, size);
+    total_cost_ += entry->cost;
+    if (entry->cost > max_cost_) {
+      removeEntry(entry);
+      return true;
+    }
+    evict(entry);
+  }
+  return changed;
+}
+
+bool RetainedCache::lookup(const QString &topic, Record *record) {
+  QMutexLocker locker(&mutex_);
+  const Entry *entry = entries_.value(topic);
+  if (!entry) {
+    return false;
+  }
+  *record = toRecord(*entry);
+  return true;
+}
+
+QList<RetainedCache::Record> RetainedCache::query(const QString &filter) {
+  const QByteArray encoded_filter = filter.toUtf8();
+  QList<Record> records;
+  QMutexLocker locker(&mutex_);
+  for (const Entry *entry : entries_) {
+    if (TopicTrie::matches(encoded_filter, entry->topic.toUtf8())) {
+      records.append(toRecord(*entry));
+    }
+  }
+  return records;
+}
+
+int RetainedCache::removeStale(const QString &filter) {
+  const QByteArray encoded_filter = filter.toUtf8();
+  int removed = 0;
+  QMutexLocker locker(&mutex_);
+  const QList<Entry *> entries = entries_.values();
+  for (Entry *entry : entries) {
+    if (entry->stale && TopicTrie::matches(encoded_filter, entry->topic.toUtf8())) {
+      removeEntry(entry);
+      ++removed;
+    }
+  }
+  return removed;
+}
+
+int RetainedCache::size() const {
+  QMutexLocker locker(&mutex_);
+  return entries_.size();
+}
+
+qint64 RetainedCache::memoryUsage() const {
+  QMutexLocker locker(&mutex_);
+  return total_cost_;
+}
+
+void RetainedCache::clear() {
+  QMutexLocker locker(&mutex_);
+  qDeleteAll(entries_);
+  entries_.clear();
+  newest_ = nullptr;
+  oldest_ = nullptr;
+  total_cost_ = 0;
+  releaseMapping();
+}
+
+qint64 RetainedCache::entryCost(const QString &topic, int payload_size) {
+  return kEntryOverhead + topic.size() * static_cast<qint64>(sizeof(QChar)) + payload_size;
+}
+
+RetainedCache::Record RetainedCache::toRecord(const Entry &entry) {
+  Record record;
+  record.topic = entry.topic;
+  // 映射区可能在调用方使用期间被释放，返回深拷贝
+  record.payload = entry.mapped ? QByteArray(entry.payload.constData(), entry.payload.size()) : entry.payload;
+  record.qos = entry.qos;
+  record.retain = entry.retain;
+  record.timestamp = entry.timestamp;
+  record.stale = entry.stale;
+  return record;
+}
+
+void RetainedCache::insertEntry(Entry *entry) {
+  // 与QCache相同：单个条目超出整个预算时不缓存
+  if (entry->cost > max_cost_) {
+    delete entry;
+    return;
+  }
+  entries_.insert(entry->topic, entry);
+  linkFront(entry);
+  total_cost_ += entry->cost;
+  evict(entry);
+}
+
+void RetainedCache::evict(const Entry *keep) {
+  while (total_cost_ > max_cost_ && oldest_ && oldest_ != keep) {
+    removeEntry(oldest_);
+  }
+}
+
+void RetainedCache::removeEntry(Entry *entry) {
+  unlink(entry);
+  total_cost_ -= entry->cost;
+  entries_.remove(entry->topic);
+  delete entry;
+}
+
+void RetainedCache::unlink(Entry *entry) {
+  if (entry->prev) {
+    entry->prev->next = entry->next;
+  } else {
+    newest_ = entry->next;
+  }
+  if (entry->next) {
+    entry->next->prev = entry->prev;
+  } else {
+    oldest_ = entry->prev;
+  }
+  entry->prev = nullptr;
+  entry->next = nullptr;
+}
+
+void RetainedCache::linkFront(Entry *entry) {
+  entry->next = newest_;
+  if (newest_) {
+    newest_->prev = entry;
+  }
+  newest_ = entry;
+  if (!oldest_) {
+    oldest_ = entry;
+  }
+}
+
+void RetainedCache::releaseMapping() {
+  if (!snapshot_map_) {
+    snapshot_file_.close();
+    return;
+  }
+
+  for (Entry *entry : entries_) {
+    if (entry->mapped) {
+      entry->payload = QByteArray(entry->payload.constData(), entry->payload.size());
+      entry->mapped = false;
+    }
+  }
+  snapshot_file_.unmap(snapshot_map_);
+  snapshot_map_ = nullptr;
+  snapshot_file_.close();
+}
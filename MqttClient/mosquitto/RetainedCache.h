@@ -0,0 +1,152 @@
+#ifndef RETAINEDCACHE_H
+#define RETAINEDCACHE_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QString>
+
+/*!
+ * \brief 主题最新值缓存
+ * 保存每个主题最近一条保留消息的内容、QoS和时间，按内存预算以LRU方式淘汰，
+ * 可在本地完成单主题查询和通配符查询，无需等待代理重新推送保留消息；只有update()改变淘汰顺序，查询不会。
+ * 退出时写出紧凑的二进制快照；启动时以内存映射方式加载快照，缓存立即可用，
+ * 快照中的条目标记为stale，收到代理推送的实时消息后被替换，订阅生效后仍未被
+ * 替换的条目可由removeStale()清除（对应代理上已被删除的保留消息）。
+ * 所有方法均线程安全。
+ */
+class RetainedCache {
+ public:
+  /*!
+   * \brief 缓存条目
+   */
+  struct Record {
+    QString topic;         // 消息主题
+    QByteArray payload;    // 消息内容
+    int qos = 0;           // 消息质量等级
+    bool retain = false;   // 是否为保留消息
+    qint64 timestamp = 0;  // 接收时间（自纪元起的毫秒数）
+    bool stale = false;    // 是否来自快照且尚未被实时消息确认
+  };
+
+  /*!
+   * \brief 构造函数
+   * \param max_bytes 内存预算（主题与负载字节数之和）
+   */
+  explicit RetainedCache(qint64 max_bytes = 64 * 1024 * 1024);
+
+  /*!
+   * \brief 析构函数，释放快照映射
+   */
+  ~RetainedCache();
+
+  RetainedCache(const RetainedCache &) = delete;
+  RetainedCache &operator=(const RetainedCache &) = delete;
+
+  /*!
+   * \brief 加载快照
+   * 快照文件被映射到内存，条目负载直接引用映射区，不逐条拷贝。
+   * \param path 快照文件路径
+   * \return 文件不存在或格式错误时返回false
+   */
+  bool loadSnapshot(const QString &path);
+
+  /*!
+   * \brief 写出快照
+   * 先写临时文件再替换，写出前会释放已加载的快照映射。
+   * \param path 快照文件路径
+   * \return 是否写出成功
+   */
+  bool saveSnapshot(const QString &path);
+
+  /*!
+   * \brief 更新主题的最新值，保留消息的空负载表示删除
+   * \return 主题的值是否发生变化（新主题、负载不同或被删除）
+   */
+  bool update(const QString &topic, const QByteArray &payload, int qos, bool retain, qint64 timestamp);
+
+  /*!
+   * \brief 同上，负载为调用方的缓冲区
+   * 先与缓存的值比较，只有值发生变化时才拷贝负载；值未变化时原地更新QoS和时间，不分配内存。
+   */
+  bool update(const QString &topic, const char *data, int size, int qos, bool retain, qint64 timestamp);
+
+  /*!
+   * \brief 查询单个主题
+   * \param topic 消息主题
+   * \param record 输出参数
+   * \return 主题不在缓存中时返回false
+   */
+  bool lookup(const QString &topic, Record *record);
+
+  /*!
+   * \brief 查询与过滤器匹配的全部主题
+   * \param filter 主题过滤器，支持'+'和'#'通配符
+   */
+  QList<Record> query(const QString &filter);
+
+  /*!
+   * \brief 清除与过滤器匹配且尚未被实时消息确认的快照条目
+   * \return 清除的条目数
+   */
+  int removeStale(const QString &filter);
+
+  /*!
+   * \brief 缓存的主题数量
+   */
+  int size() const;
+
+  /*!
+   * \brief 当前占用的内存预算
+   */
+  qint64 memoryUsage() const;
+
+  /*!
+   * \brief 清空缓存
+   */
+  void clear();
+
+ private:
+  struct Entry {
+    QString topic;          // 消息主题
+    QByteArray payload;     // 消息内容，mapped为true时引用快照映射区
+    int qos = 0;            // 消息质量等级
+    bool retain = false;    // 是否为保留消息
+    bool stale = false;     // 是否来自快照
+    bool mapped = false;    // 负载是否引用快照映射区
+    qint64 timestamp = 0;   // 接收时间
+    qint64 cost = 0;        // 占用的内存预算
+    Entry *prev = nullptr;  // LRU链表中较新的条目
+    Entry *next = nullptr;  // LRU链表中较旧的条目
+  };
+
+  static qint64 entryCost(const QString &topic, int payload_size);
+  static Record toRecord(const Entry &entry);
+
+  /*!
+   * \brief 把新条目加入缓存并按预算淘汰最旧的条目，单个条目超出预算时不加入
+   */
+  void insertEntry(Entry *entry);
+
+  /*!
+   * \brief 从最旧的条目开始淘汰，直到不超出预算（keep及更新的条目不淘汰）
+   */
+  void evict(const Entry *keep);
+  void removeEntry(Entry *entry);
+  void unlink(Entry *entry);
+  void linkFront(Entry *entry);
+  void releaseMapping();
+
+  mutable QMutex mutex_;             // 保护以下全部成员
+  QHash<QString, Entry *> entries_;  // 主题到最新值
+  Entry *newest_ = nullptr;          // LRU链表头（最近更新）
+  Entry *oldest_ = nullptr;          // LRU链表尾（最先淘汰）
+  qint64 total_cost_ = 0;            // 已占用的内存预算
+  qint64 max_cost_;                  // 内存预算
+  QFile snapshot_file_;              // 已加载的快照文件
+  uchar *snapshot_map_ = nullptr;    // 快照映射地址
+};
+
+#endif  // RETAINEDCACHE_H
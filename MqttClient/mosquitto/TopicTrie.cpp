@@ -0,0 +1,173 @@
+#include "TopicTrie.h"
+
+#include <QList>
+#include <QPair>
+#include <cstring>
+
+TopicTrie::Node::~Node() {
+  qDeleteAll(children);
+  delete plus;
+}
+
+TopicTrie::TopicTrie() = default;
+
+TopicTrie::~TopicTrie() = default;
+
+bool TopicTrie::insert(const QByteArray &filter, int id) {
+  if (!isValidFilter(filter)) {
+    return false;
+  }
+
+  Node *node = &root_;
+  const QList<QByteArray> levels = filter.split('/');
+  for (const QByteArray &level : levels) {
+    if (level == "#") {
+      node->hash_ids.append(id);
+      ++size_;
+      return true;
+    }
+    if (level == "+") {
+      if (!node->plus) {
+        node->plus = new Node;
+      }
+      node = node->plus;
+      continue;
+    }
+    Node *&child = node->children[level];
+    if (!child) {
+      child = new Node;
+    }
+    node = child;
+  }
+
+  node->ids.append(id);
+  ++size_;
+  return true;
+}
+
+bool TopicTrie::remove(const QByteArray &filter, int id) {
+  if (!isValidFilter(filter)) {
+    return false;
+  }
+
+  // 记录经过的节点，移除后自底向上回收空节点
+  QVector<QPair<Node *, QByteArray>> path;
+  Node *node = &root_;
+  bool removed = false;
+  const QList<QByteArray> levels = filter.split('/');
+  for (const QByteArray &level : levels) {
+    if (level == "#") {
+      removed = node->hash_ids.removeOne(id);
+      break;
+    }
+    Node *child = nullptr;
+    if (level == "+") {
+      child = node->plus;
+    } else {
+      child = node->children.value(level, nullptr);
+    }
+    if (!child) {
+      return false;
+    }
+    path.append(qMakePair(node, level));
+    node = child;
+  }
+  if (!removed && levels.last() != "#") {
+    removed = node->ids.removeOne(id);
+  }
+  if (!removed) {
+    return false;
+  }
+  --size_;
+
+  for (int i = path.size() - 1; i >= 0; --i) {
+    Node *parent = path.at(i).first;
+    const QByteArray &level = path.at(i).second;
+    Node *child = level == "+" ? parent->plus : parent->children.value(level, nullptr);
+    if (!child->ids.isEmpty() || !child->hash_ids.isEmpty() || !child->children.isEmpty() || child->plus) {
+      break;
+    }
+    if (level == "+") {
+      parent->plus = nullptr;
+    } else {
+      parent->children.remove(level);
+    }
+    delete child;
+  }
+  return true;
+}
+
+bool TopicTrie::isValidFilter(const QByteArray &filter) {
+  if (filter.isEmpty()) {
+    return false;
+  }
+
+  const QList<QByteArray> levels = filter.split('/');
+  for (int i = 0; i < levels.size(); ++i) {
+    const QByteArray &level = levels.at(i);
+    if (level.contains('#') && (level.size() != 1 || i != levels.size() - 1)) {
+      return false;
+    }
+    if (level.contains('+') && level.size() != 1) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool TopicTrie::isSharedFilter(const QByteArray &filter) {
+  return filter.startsWith("$share/") && filter.indexOf('/', 7) > 7;
+}
+
+QByteArray TopicTrie::topicFilter(const QByteArray &filter) {
+  if (!isSharedFilter(filter)) {
+    return filter;
+  }
+  return filter.mid(filter.indexOf('/', 7) + 1);
+}
+
+bool TopicTrie::matches(const QByteArray &filter, const QByteArray &topic) {
+  if (filter.isEmpty() || topic.isEmpty()) {
+    return false;
+  }
+  // '$'开头的主题不匹配首层通配符
+  if (topic.at(0) == '$' && (filter.at(0) == '+' || filter.at(0) == '#')) {
+    return false;
+  }
+
+  const char *f = filter.constData();
+  const char *f_end = f + filter.size();
+  const char *t = topic.constData();
+  const char *t_end = t + topic.size();
+  while (true) {
+    const char *f_level_end = static_cast<const char *>(memchr(f, '/', f_end - f));
+    if (!f_level_end) {
+      f_level_end = f_end;
+    }
+    bool is_hash = f_level_end - f == 1 && *f == '#';
+    bool is_plus = f_level_end - f == 1 && *f == '+';
+    if (is_hash) {
+      return true;
+    }
+    // 主题层级已用完，过滤器还有非'#'层级
+    if (!t) {
+      return false;
+    }
+
+    const char *t_level_end = static_cast<const char *>(memchr(t, '/', t_end - t));
+    if (!t_level_end) {
+      t_level_end = t_end;
+    }
+    if (!is_plus && (f_level_end - f != t_level_end - t || memcmp(f, t, f_level_end - f) != 0)) {
+      return false;
+    }
+
+    bool f_more = f_level_end != f_end;
+    bool t_more = t_level_end != t_end;
+    if (!f_more) {
+      return !t_more;
+    }
+    f = f_level_end + 1;
+    t = t_more ? t_level_end + 1 : nullptr;
+  }
+}
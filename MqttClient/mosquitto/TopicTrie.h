@@ -0,0 +1,142 @@
+#ifndef TOPICTRIE_H
+#define TOPICTRIE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QVector>
+
+/*!
+ * \brief 主题过滤器前缀树
+ * 按主题层级（'/'分隔）组织订阅过滤器，支持'+'单层通配符和'#'多层通配符，
+ * 并遵循MQTT规范：以'$'开头的主题不会被以通配符开头的过滤器匹配。
+ * 匹配一个主题的代价与主题层级数成正比，与已注册的过滤器数量无关。
+ * 非线程安全，由调用方保证串行访问。
+ */
+class TopicTrie {
+ public:
+  TopicTrie();
+  ~TopicTrie();
+
+  TopicTrie(const TopicTrie &) = delete;
+  TopicTrie &operator=(const TopicTrie &) = delete;
+
+  /*!
+   * \brief 注册过滤器
+   * \param filter UTF-8编码的主题过滤器
+   * \param id 订阅标识，匹配时回传给调用方
+   * \return 过滤器是否合法
+   */
+  bool insert(const QByteArray &filter, int id);
+
+  /*!
+   * \brief 移除过滤器
+   * \param filter 注册时使用的主题过滤器
+   * \param id 注册时使用的订阅标识
+   * \return 是否找到并移除
+   */
+  bool remove(const QByteArray &filter, int id);
+
+  /*!
+   * \brief 查找与主题匹配的全部订阅
+   * \param topic 以'\0'结尾的UTF-8主题
+   * \param visit 对每个匹配的订阅标识调用一次，签名为void(int id)
+   */
+  template <typename Visitor>
+  void match(const char *topic, Visitor visit) const;
+
+  /*!
+   * \brief 已注册的过滤器数量
+   */
+  int size() const { return size_; }
+
+  /*!
+   * \brief 检查过滤器是否合法（'#'只能位于末尾，通配符必须独占一个层级）
+   */
+  static bool isValidFilter(const QByteArray &filter);
+
+  /*!
+   * \brief 判断单个过滤器是否与主题匹配，不需要构建前缀树
+   */
+  static bool matches(const QByteArray &filter, const QByteArray &topic);
+
+  /*!
+   * \brief 是否为共享订阅过滤器（$share/<group>/<filter>）
+   */
+  static bool isSharedFilter(const QByteArray &filter);
+
+  /*!
+   * \brief 去掉共享订阅前缀，返回用于匹配主题的过滤器；非共享订阅原样返回
+   */
+  static QByteArray topicFilter(const QByteArray &filter);
+
+ private:
+  struct Node {
+    ~Node();
+
+    QHash<QByteArray, Node *> children;  // 普通层级子节点
+    Node *plus = nullptr;                // '+'子节点
+    QVector<int> ids;                    // 在本层级结束的过滤器
+    QVector<int> hash_ids;               // 本层级之后为'#'的过滤器
+  };
+
+  template <typename Visitor>
+  static void matchLevel(const Node *node, const char *level, bool first, Visitor &visit);
+
+  Node root_;     // 根节点
+  int size_ = 0;  // 已注册的过滤器数量
+};
+
+template <typename Visitor>
+void TopicTrie::match(const char *topic, Visitor visit) const {
+  matchLevel(&root_, topic, true, visit);
+}
+
+template <typename Visitor>
+void TopicTrie::matchLevel(const Node *node, const char *level, bool first, Visitor &visit) {
+  // '$'开头的主题不匹配首层通配符
+  bool wildcard_allowed = !(first && level[0] == '$');
+
+  // "a/#"同时匹配"a"本身及其全部子层级
+  if (wildcard_allowed) {
+    for (int id : node->hash_ids) {
+      visit(id);
+    }
+  }
+
+  const char *end = level;
+  while (*end != '\0' && *end != '/') {
+    ++end;
+  }
+  const char *next = *end == '/' ? end + 1 : nullptr;
+
+  // 使用fromRawData查找子节点，不产生内存分配
+  QHash<QByteArray, Node *>::const_iterator it =
+      node->children.constFind(QByteArray::fromRawData(level, static_cast<int>(end - level)));
+  if (it != node->children.constEnd()) {
+    if (next) {
+      matchLevel(it.value(), next, false, visit);
+    } else {
+      for (int id : it.value()->ids) {
+        visit(id);
+      }
+      for (int id : it.value()->hash_ids) {
+        visit(id);
+      }
+    }
+  }
+
+  if (node->plus && wildcard_allowed) {
+    if (next) {
+      matchLevel(node->plus, next, false, visit);
+    } else {
+      for (int id : node->plus->ids) {
+        visit(id);
+      }
+      for (int id : node->plus->hash_ids) {
+        visit(id);
+      }
+    }
+  }
+}
+
+#endif  // TOPICTRIE_H
@@ -0,0 +1,604 @@
+#include "fake_mosquitto.h"
+
+#include <mosquitto.h>
+#include <mqtt_protocol.h>
+
+#include <QHash>
+#include <QMutex>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "TopicTrie.h"
+
+// libmosquitto的属性列表是不透明类型，这里只保存MqttClient用到的几种属性
+struct mqtt5__property {
+  int identifier = 0;
+  uint16_t int16 = 0;
+  uint32_t int32 = 0;
+  QByteArray name;
+  QByteArray value;
+  mqtt5__property *next = nullptr;
+};
+
+namespace {
+
+// 一批待投递给某个实例的消息，主题在topics中循环
+struct Delivery {
+  QVector<QByteArray> topics;  // 主题
+  QByteArray payload;          // 消息内容
+  int qos = 0;                 // 消息质量等级
+  bool retain = false;         // 是否为保留消息
+  qint64 remaining = 0;        // 剩余条数
+  int next_topic = 0;          // 下一条消息的主题
+};
+
+// 需要在下一次读取时回调的确认
+struct Ack {
+  bool suback = false;  // SUBACK或PUBACK
+  int mid = 0;          // 报文ID
+  int count = 0;        // SUBACK中的订阅数
+  int qos = 0;          // SUBACK中授予的QoS
+};
+
+struct Subscription {
+  QByteArray filter;      // 订阅过滤器
+  bool no_local = false;  // v5的No Local选项
+};
+
+}  // namespace
+
+struct mosquitto {
+  void *obj = nullptr;                  // 回调的用户数据（MqttClient）
+  int protocol = MQTT_PROTOCOL_V311;    // 协议版本
+  int fds[2] = {-1, -1};                // 本地套接字对，fds[0]交给客户端的读通知器
+  bool wake_pending = false;            // fds[1]是否已写入唤醒字节
+  bool connect_pending = false;         // 下一次读取时回调CONNACK
+  bool connected = false;               // 是否已连接
+  int last_mid = 0;                     // 最近分配的报文ID
+  QVector<Subscription> subscriptions;  // 订阅
+  QHash<int, QByteArray> aliases;       // 客户端使用的主题别名
+  std::deque<Delivery> inbound;         // 待投递的消息
+  std::deque<Ack> acks;                 // 待回调的确认
+  QByteArray topic;                     // 正在回调的消息主题（保证以0结尾）
+  QByteArray payload;                   // 正在回调的消息内容
+  QVector<QByteArray> route_topics;     // 最近一次转发的发布主题
+  QByteArray route_payload;             // 最近一次转发的发布内容
+  void (*on_connect)(mosquitto *, void *, int, int, const mosquitto_property *) = nullptr;
+  void (*on_disconnect)(mosquitto *, void *, int) = nullptr;
+  void (*on_publish)(mosquitto *, void *, int) = nullptr;
+  void (*on_message)(mosquitto *, void *, const mosquitto_message *) = nullptr;
+  void (*on_subscribe)(mosquitto *, void *, int, int, const int *) = nullptr;
+};
+
+namespace {
+
+QMutex g_mutex;                          // 保护所有实例的订阅和队列
+QVector<mosquitto *> g_instances;        // 已连接的实例
+std::atomic<qint64> g_published{0};      // 客户端发布的消息数
+std::atomic<int> g_topic_alias_max{64};  // CONNACK中的Topic Alias Maximum
+
+int nextMid(mosquitto *mosq) {
+  mosq->last_mid = mosq->last_mid % 65535 + 1;
+  return mosq->last_mid;
+}
+
+// 调用方持有g_mutex
+void wake(mosquitto *mosq) {
+  if (!mosq->wake_pending && mosq->fds[1] >= 0) {
+    const char byte = 0;
+    if (::write(mosq->fds[1], &byte, 1) == 1) {
+      mosq->wake_pending = true;
+    }
+  }
+}
+
+// 调用方持有g_mutex
+bool matches(const mosquitto *mosq, const QByteArray &topic, const mosquitto *publisher) {
+  for (const Subscription &subscription : mosq->subscriptions) {
+    if ((!subscription.no_local || mosq != publisher) && TopicTrie::matches(subscription.filter, topic)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// 调用方持有g_mutex；与队尾相同的单主题消息只增加计数，回环发布不分配内存
+void enqueue(mosquitto *mosq, const QVector<QByteArray> &topics, const QByteArray &payload, int qos, bool retain,
+             qint64 count) {
+  if (!mosq->inbound.empty()) {
+    Delivery &last = mosq->inbound.back();
+    if (topics.size() == 1 && last.topics.size() == 1 && last.topics.at(0) == topics.at(0) &&
+        last.payload == payload && last.qos == qos && last.retain == retain) {
+      last.remaining += count;
+      return;
+    }
+  }
+  Delivery delivery;
+  delivery.topics = topics;
+  delivery.payload = payload;
+  delivery.qos = qos;
+  delivery.retain = retain;
+  delivery.remaining = count;
+  mosq->inbound.push_back(delivery);
+  wake(mosq);
+}
+
+void freeProperties(mosquitto_property **properties) {
+  while (*properties) {
+    mosquitto_property *next = (*properties)->next;
+    delete *properties;
+    *properties = next;
+  }
+}
+
+void appendProperty(mosquitto_property **proplist, mosquitto_property *property) {
+  while (*proplist) {
+    proplist = &(*proplist)->next;
+  }
+  *proplist = property;
+}
+
+int routePublish(mosquitto *mosq, int *mid, const char *topic, int payloadlen, const void *payload, int qos,
+                 bool retain, int alias) {
+  QMutexLocker locker(&g_mutex);
+  if (!mosq->connected) {
+    return MOSQ_ERR_NO_CONN;
+  }
+  const char *name = topic;
+  if (!topic) {
+    QHash<int, QByteArray>::const_iterator it = mosq->aliases.constFind(alias);
+    if (it == mosq->aliases.constEnd()) {
+      return MOSQ_ERR_INVAL;
+    }
+    name = it.value().constData();
+  } else if (alias > 0 && mosq->aliases.value(alias) != topic) {
+    mosq->aliases.insert(alias, QByteArray(topic));
+  }
+  const int message_mid = nextMid(mosq);
+  if (mid) {
+    *mid = message_mid;
+  }
+  g_published.fetch_add(1, std::memory_order_relaxed);
+
+  bool subscribed = false;
+  for (mosquitto *subscriber : g_instances) {
+    subscribed = subscribed || !subscriber->subscriptions.isEmpty();
+  }
+  if (subscribed) {
+    // 与上一条发布的主题和内容相同时复用，回环发布同一条消息不分配内存
+    if (mosq->route_topics.isEmpty() || mosq->route_topics.at(0) != name) {
+      mosq->route_topics = QVector<QByteArray>() << QByteArray(name);
+    }
+    if (mosq->route_payload.size() != payloadlen || memcmp(mosq->route_payload.constData(), payload, payloadlen) != 0) {
+      mosq->route_payload = QByteArray(static_cast<const char *>(payload), payloadlen);
+    }
+    for (mosquitto *subscriber : g_instances) {
+      if (matches(subscriber, mosq->route_topics.at(0), mosq)) {
+        enqueue(subscriber, mosq->route_topics, mosq->route_payload, qos, retain, 1);
+      }
+    }
+  }
+
+  if (qos > 0) {
+    Ack ack;
+    ack.mid = message_mid;
+    mosq->acks.push_back(ack);
+    wake(mosq);
+    return MOSQ_ERR_SUCCESS;
+  }
+  // libmosquitto在QoS0报文写出后立即回调，可能发生在mosquitto_publish返回之前
+  locker.unlock();
+  if (mosq->on_publish) {
+    mosq->on_publish(mosq, mosq->obj, message_mid);
+  }
+  return MOSQ_ERR_SUCCESS;
+}
+
+}  // namespace
+
+namespace FakeMosquitto {
+
+void publish(const QVector<QByteArray> &topics, const QByteArray &payload, int qos, bool retain, qint64 count) {
+  QMutexLocker locker(&g_mutex);
+  for (mosquitto *mosq : g_instances) {
+    // 先按订阅筛出主题，读取时不再匹配
+    QVector<QByteArray> matched;
+    for (const QByteArray &topic : topics) {
+      if (matches(mosq, topic, nullptr)) {
+        matched.append(topic);
+      }
+    }
+    if (!matched.isEmpty()) {
+      enqueue(mosq, matched, payload, qos, retain, count);
+    }
+  }
+}
+
+qint64 publishedCount() { return g_published.load(std::memory_order_relaxed); }
+
+void setTopicAliasMaximum(int maximum) { g_topic_alias_max.store(maximum, std::memory_order_relaxed); }
+
+}  // namespace FakeMosquitto
+
+extern "C" {
+
+int mosquitto_lib_init(void) { return MOSQ_ERR_SUCCESS; }
+
+int mosquitto_lib_cleanup(void) { return MOSQ_ERR_SUCCESS; }
+
+struct mosquitto *mosquitto_new(const char *id, bool clean_session, void *obj) {
+  Q_UNUSED(id)
+  Q_UNUSED(clean_session)
+  mosquitto *mosq = new mosquitto;
+  mosq->obj = obj;
+  return mosq;
+}
+
+int mosquitto_reinitialise(struct mosquitto *mosq, const char *id, bool clean_session, void *obj) {
+  Q_UNUSED(id)
+  Q_UNUSED(clean_session)
+  mosquitto_disconnect(mosq);
+  QMutexLocker locker(&g_mutex);
+  mosq->obj = obj;
+  mosq->protocol = MQTT_PROTOCOL_V311;
+  mosq->subscriptions.clear();
+  return MOSQ_ERR_SUCCESS;
+}
+
+void mosquitto_destroy(struct mosquitto *mosq) {
+  if (mosq) {
+    mosquitto_disconnect(mosq);
+    delete mosq;
+  }
+}
+
+int mosquitto_connect_async(struct mosquitto *mosq, const char *host, int port, int keepalive) {
+  Q_UNUSED(host)
+  Q_UNUSED(port)
+  Q_UNUSED(keepalive)
+  mosquitto_disconnect(mosq);
+  QMutexLocker locker(&g_mutex);
+  if (::socketpair(AF_UNIX, SOCK_STREAM, 0, mosq->fds) != 0) {
+    return MOSQ_ERR_ERRNO;
+  }
+  fcntl(mosq->fds[0], F_SETFL, O_NONBLOCK);
+  mosq->connect_pending = true;
+  mosq->connected = true;
+  mosq->aliases.clear();
+  g_instances.append(mosq);
+  wake(mosq);
+  return MOSQ_ERR_SUCCESS;
+}
+
+int mosquitto_connect_bind_v5(struct mosquitto *mosq, const char *host, int port, int keepalive,
+                              const char *bind_address, const mosquitto_property *properties) {
+  Q_UNUSED(bind_address)
+  Q_UNUSED(properties)
+  return mosquitto_connect_async(mosq, host, port, keepalive);
+}
+
+int mosquitto_reconnect_async(struct mosquitto *mosq) { return mosquitto_connect_async(mosq, nullptr, 0, 0); }
+
+int mosquitto_disconnect(struct mosquitto *mosq) {
+  QMutexLocker locker(&g_mutex);
+  g_instances.removeAll(mosq);
+  for (int &fd : mosq->fds) {
+    if (fd >= 0) {
+      ::close(fd);
+      fd = -1;
+    }
+  }
+  mosq->wake_pending = false;
+  mosq->connect_pending = false;
+  mosq->connected = false;
+  mosq->inbound.clear();
+  mosq->acks.clear();
+  return MOSQ_ERR_SUCCESS;
+}
+
+int mosquitto_publish(struct mosquitto *mosq, int *mid, const char *topic, int payloadlen, const void *payload,
+                      int qos, bool retain) {
+  return routePublish(mosq, mid, topic, payloadlen, payload, qos, retain, 0);
+}
+
+int mosquitto_publish_v5(struct mosquitto *mosq, int *mid, const char *topic, int payloadlen, const void *payload,
+                         int qos, bool retain, const mosquitto_property *properties) {
+  uint16_t alias = 0;
+  mosquitto_property_read_int16(properties, MQTT_PROP_TOPIC_ALIAS, &alias, false);
+  return routePublish(mosq, mid, topic, payloadlen, payload, qos, retain, alias);
+}
+
+int mosquitto_subscribe_multiple(struct mosquitto *mosq, int *mid, int sub_count, char *const *const sub, int qos,
+                                 int options, const mosquitto_property *properties) {
+  Q_UNUSED(properties)
+  QMutexLocker locker(&g_mutex);
+  if (!mosq->connected) {
+    return MOSQ_ERR_NO_CONN;
+  }
+  for (int i = 0; i < sub_count; ++i) {
+    Subscription subscription;
+    subscription.filter = QByteArray(sub[i]);
+    subscription.no_local = mosq->protocol == MQTT_PROTOCOL_V5 && (options & MQTT_SUB_OPT_NO_LOCAL);
+    mosq->subscriptions.append(subscription);
+  }
+  Ack ack;
+  ack.suback = true;
+  ack.mid = nextMid(mosq);
+  ack.count = sub_count;
+  ack.qos = qos;
+  if (mid) {
+    *mid = ack.mid;
+  }
+  mosq->acks.push_back(ack);
+  wake(mosq);
+  return MOSQ_ERR_SUCCESS;
+}
+
+int mosquitto_unsubscribe_multiple(struct mosquitto *mosq, int *mid, int sub_count, char *const *const sub,
+                                   const mosquitto_property *properties) {
+  Q_UNUSED(properties)
+  QMutexLocker locker(&g_mutex);
+  for (int i = 0; i < sub_count; ++i) {
+    for (int j = mosq->subscriptions.size() - 1; j >= 0; --j) {
+      if (mosq->subscriptions.at(j).filter == sub[i]) {
+        mosq->subscriptions.remove(j);
+      }
+    }
+  }
+  if (mid) {
+    *mid = nextMid(mosq);
+  }
+  return mosq->connected ? MOSQ_ERR_SUCCESS : MOSQ_ERR_NO_CONN;
+}
+
+int mosquitto_unsubscribe(struct mosquitto *mosq, int *mid, const char *sub) {
+  char *const subs[] = {const_cast<char *>(sub)};
+  return mosquitto_unsubscribe_multiple(mosq, mid, 1, subs, nullptr);
+}
+
+// 每次回调一个“报文”，没有待处理的报文时读走唤醒字节并置errno为EAGAIN，与非阻塞套接字的行为一致
+int mosquitto_loop_read(struct mosquitto *mosq, int max_packets) {
+  Q_UNUSED(max_packets)
+  QMutexLocker locker(&g_mutex);
+  if (!mosq->connected) {
+    return MOSQ_ERR_NO_CONN;
+  }
+  if (mosq->connect_pending) {
+    mosq->connect_pending = false;
+    locker.unlock();
+    mosquitto_property *props = nullptr;
+    const int alias_max = g_topic_alias_max.load(std::memory_order_relaxed);
+    if (mosq->protocol == MQTT_PROTOCOL_V5 && alias_max > 0) {
+      mosquitto_property_add_int16(&props, MQTT_PROP_TOPIC_ALIAS_MAXIMUM, static_cast<uint16_t>(alias_max));
+    }
+    if (mosq->on_connect) {
+      mosq->on_connect(mosq, mosq->obj, MOSQ_ERR_SUCCESS, 0, props);
+    }
+    freeProperties(&props);
+    return MOSQ_ERR_SUCCESS;
+  }
+
+  if (!mosq->acks.empty()) {
+    const Ack ack = mosq->acks.front();
+    mosq->acks.pop_front();
+    locker.unlock();
+    if (ack.suback && mosq->on_subscribe) {
+      QVector<int> granted(ack.count, ack.qos);
+      mosq->on_subscribe(mosq, mosq->obj, ack.mid, ack.count, granted.constData());
+    } else if (!ack.suback && mosq->on_publish) {
+      mosq->on_publish(mosq, mosq->obj, ack.mid);
+    }
+    return MOSQ_ERR_SUCCESS;
+  }
+
+  if (!mosq->inbound.empty()) {
+    Delivery &delivery = mosq->inbound.front();
+    // 共享数据的浅拷贝，回调期间队列可被其他线程修改
+    mosq->topic = delivery.topics.at(delivery.next_topic);
+    mosq->payload = delivery.payload;
+    mosquitto_message message;
+    message.mid = 0;
+    message.topic = const_cast<char *>(mosq->topic.constData());
+    message.payload = const_cast<char *>(mosq->payload.constData());
+    message.payloadlen = mosq->payload.size();
+    message.qos = delivery.qos;
+    message.retain = delivery.retain;
+    delivery.next_topic = (delivery.next_topic + 1) % delivery.topics.size();
+    if (--delivery.remaining == 0) {
+      mosq->inbound.pop_front();
+    }
+    locker.unlock();
+    if (mosq->on_message) {
+      mosq->on_message(mosq, mosq->obj, &message);
+    }
+    return MOSQ_ERR_SUCCESS;
+  }
+
+  char buffer[64];
+  while (::read(mosq->fds[0], buffer, sizeof(buffer)) > 0) {
+  }
+  mosq->wake_pending = false;
+  errno = EAGAIN;
+  return MOSQ_ERR_SUCCESS;
+}
+
+int mosquitto_loop_write(struct mosquitto *mosq, int max_packets) {
+  Q_UNUSED(max_packets)
+  return mosq->connected ? MOSQ_ERR_SUCCESS : MOSQ_ERR_NO_CONN;
+}
+
+int mosquitto_loop_misc(struct mosquitto *mosq) { return mosq->connected ? MOSQ_ERR_SUCCESS : MOSQ_ERR_NO_CONN; }
+
+int mosquitto_socket(struct mosquitto *mosq) {
+  QMutexLocker locker(&g_mutex);
+  return mosq->fds[0];
+}
+
+bool mosquitto_want_write(struct mosquitto *mosq) {
+  Q_UNUSED(mosq)
+  return false;
+}
+
+int mosquitto_int_option(struct mosquitto *mosq, enum mosq_opt_t option, int value) {
+  if (option == MOSQ_OPT_PROTOCOL_VERSION) {
+    QMutexLocker locker(&g_mutex);
+    mosq->protocol = value;
+  }
+  return MOSQ_ERR_SUCCESS;
+}
+
+int mosquitto_void_option(struct mosquitto *mosq, enum mosq_opt_t option, void *value) {
+  Q_UNUSED(mosq)
+  Q_UNUSED(option)
+  Q_UNUSED(value)
+  return MOSQ_ERR_SUCCESS;
+}
+
+int mosquitto_max_inflight_messages_set(struct mosquitto *mosq, unsigned int max_inflight_messages) {
+  Q_UNUSED(mosq)
+  Q_UNUSED(max_inflight_messages)
+  return MOSQ_ERR_SUCCESS;
+}
+
+int mosquitto_username_pw_set(struct mosquitto *mosq, const char *username, const char *password) {
+  Q_UNUSED(mosq)
+  Q_UNUSED(username)
+  Q_UNUSED(password)
+  return MOSQ_ERR_SUCCESS;
+}
+
+int mosquitto_tls_set(struct mosquitto *mosq, const char *cafile, const char *capath, const char *certfile,
+                      const char *keyfile, int (*pw_callback)(char *buf, int size, int rwflag, void *userdata)) {
+  Q_UNUSED(mosq)
+  Q_UNUSED(cafile)
+  Q_UNUSED(capath)
+  Q_UNUSED(certfile)
+  Q_UNUSED(keyfile)
+  Q_UNUSED(pw_callback)
+  return MOSQ_ERR_NOT_SUPPORTED;
+}
+
+int mosquitto_tls_opts_set(struct mosquitto *mosq, int cert_reqs, const char *tls_version, const char *ciphers) {
+  Q_UNUSED(mosq)
+  Q_UNUSED(cert_reqs)
+  Q_UNUSED(tls_version)
+  Q_UNUSED(ciphers)
+  return MOSQ_ERR_NOT_SUPPORTED;
+}
+
+int mosquitto_tls_insecure_set(struct mosquitto *mosq, bool value) {
+  Q_UNUSED(mosq)
+  Q_UNUSED(value)
+  return MOSQ_ERR_NOT_SUPPORTED;
+}
+
+int mosquitto_tls_psk_set(struct mosquitto *mosq, const char *psk, const char *identity, const char *ciphers) {
+  Q_UNUSED(mosq)
+  Q_UNUSED(psk)
+  Q_UNUSED(identity)
+  Q_UNUSED(ciphers)
+  return MOSQ_ERR_NOT_SUPPORTED;
+}
+
+void mosquitto_connect_v5_callback_set(struct mosquitto *mosq,
+                                       void (*on_connect)(struct mosquitto *, void *, int, int,
+                                                          const mosquitto_property *props)) {
+  mosq->on_connect = on_connect;
+}
+
+void mosquitto_disconnect_callback_set(struct mosquitto *mosq, void (*on_disconnect)(struct mosquitto *, void *, int)) {
+  mosq->on_disconnect = on_disconnect;
+}
+
+void mosquitto_publish_callback_set(struct mosquitto *mosq, void (*on_publish)(struct mosquitto *, void *, int)) {
+  mosq->on_publish = on_publish;
+}
+
+void mosquitto_message_callback_set(struct mosquitto *mosq,
+                                    void (*on_message)(struct mosquitto *, void *, const struct mosquitto_message *)) {
+  mosq->on_message = on_message;
+}
+
+void mosquitto_subscribe_callback_set(struct mosquitto *mosq,
+                                      void (*on_subscribe)(struct mosquitto *, void *, int, int, const int *)) {
+  mosq->on_subscribe = on_subscribe;
+}
+
+void mosquitto_log_callback_set(struct mosquitto *mosq, void (*on_log)(struct mosquitto *, void *, int, const char *)) {
+  Q_UNUSED(mosq)
+  Q_UNUSED(on_log)
+}
+
+const char *mosquitto_strerror(int mosq_errno) {
+  switch (mosq_errno) {
+    case MOSQ_ERR_SUCCESS:
+      return "No error.";
+    case MOSQ_ERR_NO_CONN:
+      return "The client is not currently connected.";
+    case MOSQ_ERR_INVAL:
+      return "Invalid function arguments provided.";
+    case MOSQ_ERR_NOT_SUPPORTED:
+      return "This feature is not supported.";
+    default:
+      return "Unknown error.";
+  }
+}
+
+int mosquitto_property_add_int16(mosquitto_property **proplist, int identifier, uint16_t value) {
+  mosquitto_property *property = new mosquitto_property;
+  property->identifier = identifier;
+  property->int16 = value;
+  appendProperty(proplist, property);
+  return MOSQ_ERR_SUCCESS;
+}
+
+int mosquitto_property_add_int32(mosquitto_property **proplist, int identifier, uint32_t value) {
+  mosquitto_property *property = new mosquitto_property;
+  property->identifier = identifier;
+  property->int32 = value;
+  appendProperty(proplist, property);
+  return MOSQ_ERR_SUCCESS;
+}
+
+int mosquitto_property_add_string_pair(mosquitto_property **proplist, int identifier, const char *name,
+                                       const char *value) {
+  mosquitto_property *property = new mosquitto_property;
+  property->identifier = identifier;
+  property->name = name;
+  property->value = value;
+  appendProperty(proplist, property);
+  return MOSQ_ERR_SUCCESS;
+}
+
+int mosquitto_property_copy_all(mosquitto_property **dest, const mosquitto_property *src) {
+  *dest = nullptr;
+  for (; src; src = src->next) {
+    mosquitto_property *property = new mosquitto_property(*src);
+    property->next = nullptr;
+    appendProperty(dest, property);
+  }
+  return MOSQ_ERR_SUCCESS;
+}
+
+void mosquitto_property_free_all(mosquitto_property **properties) { freeProperties(properties); }
+
+const mosquitto_property *mosquitto_property_read_int16(const mosquitto_property *proplist, int identifier,
+                                                        uint16_t *value, bool skip_first) {
+  for (const mosquitto_property *property = skip_first && proplist ? proplist->next : proplist; property;
+       property = property->next) {
+    if (property->identifier == identifier) {
+      if (value) {
+        *value = property->int16;
+      }
+      return property;
+    }
+  }
+  return nullptr;
+}
+
+}  // extern "C"
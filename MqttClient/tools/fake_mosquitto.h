@@ -0,0 +1,37 @@
+#ifndef FAKE_MOSQUITTO_H
+#define FAKE_MOSQUITTO_H
+
+#include <QByteArray>
+#include <QVector>
+
+/*!
+ * \brief 进程内的假mosquitto代理
+ * fake_mosquitto.cpp实现了MqttClient用到的libmosquitto函数，链接它代替libmosquitto后，
+ * 所有客户端实例都连接到这个内存中的代理：
+ *   - 连接、订阅立即成功，CONNACK和SUBACK在下一次mosquitto_loop_read()时回调；
+ *   - 客户端发布的消息按订阅转发给各实例（遵守v5的No Local选项），QoS0在发布时即确认，
+ *     QoS1/2的确认在下一次读取时回调；
+ *   - 每个实例用一对本地套接字唤醒客户端的读通知器，不经过网络。
+ * 代理本身处理一条消息不分配内存，微基准统计到的分配全部来自客户端代码。
+ * 所有函数线程安全。
+ */
+namespace FakeMosquitto {
+
+/*!
+ * \brief 从外部发布count条消息，主题在topics中循环，投递给订阅了对应主题的所有实例
+ */
+void publish(const QVector<QByteArray> &topics, const QByteArray &payload, int qos, bool retain, qint64 count);
+
+/*!
+ * \brief 客户端发布到代理的消息总数
+ */
+qint64 publishedCount();
+
+/*!
+ * \brief 设置CONNACK中的Topic Alias Maximum，0表示不允许主题别名（默认64）
+ */
+void setTopicAliasMaximum(int maximum);
+
+}  // namespace FakeMosquitto
+
+#endif  // FAKE_MOSQUITTO_H
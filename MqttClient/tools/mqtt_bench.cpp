@@ -0,0 +1,551 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QThread>
+#include <QVector>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "MqttClient.h"
+#include "MqttClientPool.h"
+
+/*!
+ * \brief 发布吞吐量与端到端延迟基准测试
+ * 在两个线程中各运行一个MqttClient（发布端、订阅端），连接本地mosquitto代理，
+ * 对每种QoS和消息大小的组合发布固定数量的消息，统计：
+ *   - 发布吞吐量：从第一条发布到全部确认的消息数/秒、MB/秒；
+ *   - 确认延迟：publish()调用到libmosquitto确认的耗时；
+ *   - 往返延迟：publish()调用到订阅端收到消息的耗时。
+ * 消息末尾16字节为序号和发送时刻（单调时钟），发布端与订阅端在同一进程内，时钟一致。
+ * 指定--pool-threads时另外测量并行处理线程池的扩展性：消息分布在多个主题上，每条消息在
+ * 处理函数中占用固定的CPU时间，对每个线程数统计处理吞吐量，并检查同一主题内的顺序。
+ * 指定--connections时另外测量多连接客户端池的扩展性：发布端与订阅端各使用N个连接，
+ * 订阅端使用共享订阅，对每个连接数统计从第一条发布到全部收到的总吞吐量。
+ * 结果以JSON输出，便于在版本之间对比。
+ * 用法：mqtt_bench [--host localhost] [--port 1883] [--qos 0,1,2] [--sizes 16,256,4096,65536]
+ *                  [--count 20000] [--rate 0] [--window 1000] [--output result.json]
+ *                  [--pool-threads 1,2,4,8] [--pool-work-us 50] [--pool-topics 64]
+ *                  [--connections 1,2,4,8]
+ */
+
+namespace {
+
+const int kTrailerSize = 16;                 // 序号 + 发送时刻
+const quint64 kProbeSeq = ~quint64(0);       // 探测消息的序号
+const int kConnectTimeoutMs = 10000;         // 连接超时
+const int kSubscribeTimeoutMs = 5000;        // 等待订阅生效的超时
+const int kDrainTimeoutMs = 30000;           // 等待全部消息到达的超时
+
+qint64 monotonicNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// 订阅端统计，由订阅端客户端线程写入
+struct RunState {
+  explicit RunState(int count) : latencies_ns(count, 0) {}
+
+  std::vector<qint64> latencies_ns;  // 往返延迟
+  std::atomic<int> received{0};      // 收到的消息数
+  std::atomic<bool> probe_seen{false};
+};
+
+// 线程池扩展性测试的统计，由工作线程写入
+struct PoolState {
+  explicit PoolState(int topics) : last_seq(topics, -1) {}
+
+  std::vector<qint64> last_seq;      // 各主题最近处理的序号（同一主题串行处理，无需同步）
+  std::atomic<int> processed{0};     // 处理的消息数
+  std::atomic<int> out_of_order{0};  // 同一主题内乱序的消息数
+  std::atomic<bool> probe_seen{false};
+};
+
+// 运行在独立线程中的客户端
+struct BenchClient {
+  MqttClient *client = nullptr;
+  QThread *thread = nullptr;
+  std::atomic<bool> connected{false};
+  std::atomic<bool> failed{false};
+};
+
+bool waitUntil(const std::atomic<bool> &flag, int timeout_ms) {
+  qint64 deadline = monotonicNs() + qint64(timeout_ms) * 1000000;
+  while (!flag.load(std::memory_order_acquire)) {
+    if (monotonicNs() > deadline) {
+      return false;
+    }
+    QThread::msleep(1);
+  }
+  return true;
+}
+
+bool startClient(BenchClient *bench, const QString &host, int port, int window,
+                 const std::function<void(MqttClient *)> &setup = std::function<void(MqttClient *)>()) {
+  bench->client = new MqttClient();
+  bench->client->setDeliveryMode(MqttClient::Batched);
+  bench->client->setProtocolVersion(MqttClient::MQTTv5);
+  bench->client->setMaxInflightMessages(window);
+  if (setup) {
+    setup(bench->client);
+  }
+  bench->thread = new QThread();
+  bench->client->moveToThread(bench->thread);
+  QObject::connect(bench->thread, &QThread::finished, bench->client, &QObject::deleteLater);
+  // 无上下文对象的连接在发出信号的线程中直接执行
+  std::atomic<bool> *connected = &bench->connected;
+  std::atomic<bool> *failed = &bench->failed;
+  QObject::connect(bench->client, &MqttClient::connected, [connected]() { connected->store(true); });
+  QObject::connect(bench->client, &MqttClient::connectionFailed, [failed](const QString &) { failed->store(true); });
+  bench->thread->start();
+
+  bench->client->connectToBroker(host, port, 60, 1);
+  return waitUntil(bench->connected, kConnectTimeoutMs) && !bench->failed.load();
+}
+
+void stopClient(BenchClient *bench) {
+  if (!bench->thread) {
+    return;
+  }
+  MqttClient *client = bench->client;
+  QMetaObject::invokeMethod(client, [client]() { client->disconnectFromBroker(); }, Qt::BlockingQueuedConnection);
+  bench->thread->quit();
+  bench->thread->wait();
+  delete bench->thread;
+  bench->thread = nullptr;
+  bench->client = nullptr;
+}
+
+QByteArray makePayload(int size, quint64 seq) {
+  QByteArray payload(qMax(size, kTrailerSize), 'x');
+  qint64 sent_ns = monotonicNs();
+  char *tail = payload.data() + payload.size() - kTrailerSize;
+  memcpy(tail, &seq, sizeof(seq));
+  memcpy(tail + sizeof(seq), &sent_ns, sizeof(sent_ns));
+  return payload;
+}
+
+// 取排序后样本的分位数
+qint64 percentile(const std::vector<qint64> &sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  size_t index = std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()));
+  return sorted[index];
+}
+
+QJsonObject summarize(std::vector<qint64> samples_ns) {
+  std::sort(samples_ns.begin(), samples_ns.end());
+  double sum = 0;
+  for (qint64 sample : samples_ns) {
+    sum += sample;
+  }
+  QJsonObject object;
+  object["samples"] = static_cast<qint64>(samples_ns.size());
+  object["mean"] = samples_ns.empty() ? 0.0 : sum / samples_ns.size() / 1000.0;
+  object["p50"] = percentile(samples_ns, 0.50) / 1000.0;
+  object["p99"] = percentile(samples_ns, 0.99) / 1000.0;
+  object["p999"] = percentile(samples_ns, 0.999) / 1000.0;
+  object["max"] = samples_ns.empty() ? 0.0 : samples_ns.back() / 1000.0;
+  return object;
+}
+
+QJsonObject runOnce(BenchClient *publisher, BenchClient *subscriber, int qos, int size, int count, int rate) {
+  const QString topic =
+      QString("mqtt_bench/%1/q%2/s%3").arg(QCoreApplication::applicationPid()).arg(qos).arg(size);
+  // 主题句柄免去每次发布的编码，v5模式下QoS0消息还会使用主题别名
+  const MqttTopic topic_handle = publisher->client->topic(topic);
+  std::shared_ptr<RunState> state = std::make_shared<RunState>(count);
+
+  MqttSubscription *subscription =
+      subscriber->client->subscribe(topic, qos, [state](const MqttMessage &message) {
+        if (message.payload.size() < kTrailerSize) {
+          return;
+        }
+        const char *tail = message.payload.constData() + message.payload.size() - kTrailerSize;
+        quint64 seq;
+        qint64 sent_ns;
+        memcpy(&seq, tail, sizeof(seq));
+        memcpy(&sent_ns, tail + sizeof(seq), sizeof(sent_ns));
+        if (seq == kProbeSeq) {
+          state->probe_seen.store(true, std::memory_order_release);
+          return;
+        }
+        int index = state->received.load(std::memory_order_relaxed);
+        if (index < static_cast<int>(state->latencies_ns.size())) {
+          state->latencies_ns[index] = monotonicNs() - sent_ns;
+          state->received.store(index + 1, std::memory_order_release);
+        }
+      });
+
+  // 没有SUBACK通知，持续发送探测消息直到订阅端收到
+  qint64 probe_deadline = monotonicNs() + qint64(kSubscribeTimeoutMs) * 1000000;
+  while (!state->probe_seen.load(std::memory_order_acquire) && monotonicNs() < probe_deadline) {
+    publisher->client->publishTopic(topic_handle, makePayload(size, kProbeSeq), qos);
+    QThread::msleep(20);
+  }
+
+  QVector<MqttPublishToken> tokens;
+  tokens.reserve(count);
+  qint64 rejected = 0;
+  const qint64 interval_ns = rate > 0 ? 1000000000LL / rate : 0;
+  const qint64 start_ns = monotonicNs();
+  for (int i = 0; i < count; ++i) {
+    if (interval_ns > 0) {
+      while (monotonicNs() < start_ns + i * interval_ns) {
+      }
+    }
+    MqttPublishToken token;
+    while (true) {
+      token = publisher->client->publishTopic(topic_handle, makePayload(size, i), qos);
+      if (token.status() != MqttPublishToken::Rejected) {
+        break;
+      }
+      // 发布窗口已满，稍后重试
+      ++rejected;
+      QThread::usleep(20);
+    }
+    tokens.append(token);
+  }
+
+  std::vector<qint64> ack_ns;
+  ack_ns.reserve(count);
+  int acked = 0, failed = 0;
+  for (const MqttPublishToken &token : tokens) {
+    token.waitForFinished(kDrainTimeoutMs);
+    if (token.status() == MqttPublishToken::Completed) {
+      ++acked;
+      ack_ns.push_back(token.latencyUs() * 1000);
+    } else {
+      ++failed;
+    }
+  }
+  const qint64 publish_ns = monotonicNs() - start_ns;
+
+  qint64 drain_deadline = monotonicNs() + qint64(kDrainTimeoutMs) * 1000000;
+  while (state->received.load(std::memory_order_acquire) < count && monotonicNs() < drain_deadline) {
+    QThread::msleep(1);
+  }
+  subscriber->client->unsubscribe(subscription);
+
+  int received = state->received.load(std::memory_order_acquire);
+  std::vector<qint64> rtt_ns(state->latencies_ns.begin(), state->latencies_ns.begin() + received);
+  double seconds = publish_ns / 1e9;
+
+  QJsonObject result;
+  result["qos"] = qos;
+  result["payload_bytes"] = size;
+  result["messages"] = count;
+  result["acked"] = acked;
+  result["failed"] = failed;
+  result["rejected_retries"] = rejected;
+  result["received"] = received;
+  result["publish_seconds"] = seconds;
+  result["publish_msgs_per_sec"] = acked / seconds;
+  result["publish_mb_per_sec"] = static_cast<double>(acked) * qMax(size, kTrailerSize) / seconds / (1024 * 1024);
+  result["ack_latency_us"] = summarize(ack_ns);
+  result["rtt_latency_us"] = summarize(rtt_ns);
+  return result;
+}
+
+// 占用CPU约work_us微秒，模拟解析、计算等处理开销
+void burnCpu(int work_us) {
+  const qint64 until = monotonicNs() + qint64(work_us) * 1000;
+  while (monotonicNs() < until) {
+  }
+}
+
+QJsonObject runPool(BenchClient *publisher, const QString &host, int port, int window, int threads, int work_us,
+                    int topics, int count) {
+  const QString prefix = QString("mqtt_bench/%1/pool/").arg(QCoreApplication::applicationPid());
+  std::shared_ptr<PoolState> state = std::make_shared<PoolState>(topics);
+
+  BenchClient subscriber;
+  bool started = startClient(&subscriber, host, port, window, [state, threads, work_us, topics](MqttClient *client) {
+    client->enableWorkerPool(threads, [state, work_us, topics](const MqttMessage &message) {
+      if (message.payload.size() < kTrailerSize) {
+        return;
+      }
+      quint64 seq;
+      memcpy(&seq, message.payload.constData() + message.payload.size() - kTrailerSize, sizeof(seq));
+      if (seq == kProbeSeq) {
+        state->probe_seen.store(true, std::memory_order_release);
+        return;
+      }
+      qint64 &last = state->last_seq[seq % topics];
+      if (static_cast<qint64>(seq) < last) {
+        state->out_of_order.fetch_add(1, std::memory_order_relaxed);
+      }
+      last = static_cast<qint64>(seq);
+      burnCpu(work_us);
+      state->processed.fetch_add(1, std::memory_order_release);
+    });
+  });
+  QJsonObject result;
+  result["threads"] = threads;
+  if (!started) {
+    stopClient(&subscriber);
+    result["error"] = "cannot connect";
+    return result;
+  }
+
+  MqttClient *client = subscriber.client;
+  const QString filter = prefix + "#";
+  QMetaObject::invokeMethod(client, [client, filter]() { client->subscribe(filter, 1); }, Qt::QueuedConnection);
+
+  QVector<QByteArray> encoded_topics;
+  for (int i = 0; i < topics; ++i) {
+    encoded_topics.append((prefix + QString::number(i)).toUtf8());
+  }
+  qint64 probe_deadline = monotonicNs() + qint64(kSubscribeTimeoutMs) * 1000000;
+  while (!state->probe_seen.load(std::memory_order_acquire) && monotonicNs() < probe_deadline) {
+    publisher->client->publishEncoded(encoded_topics.at(0), makePayload(kTrailerSize, kProbeSeq), 1);
+    QThread::msleep(20);
+  }
+
+  const qint64 start_ns = monotonicNs();
+  for (int i = 0; i < count; ++i) {
+    while (publisher->client->publishEncoded(encoded_topics.at(i % topics), makePayload(kTrailerSize, i), 1).status() ==
+           MqttPublishToken::Rejected) {
+      QThread::usleep(20);
+    }
+  }
+  qint64 drain_deadline = monotonicNs() + qint64(kDrainTimeoutMs) * 1000000;
+  while (state->processed.load(std::memory_order_acquire) < count && monotonicNs() < drain_deadline) {
+    QThread::msleep(1);
+  }
+  const double seconds = (monotonicNs() - start_ns) / 1e9;
+  const MqttWorkerPool::Stats pool = client->workerPool()->stats();
+  stopClient(&subscriber);
+
+  const int processed = state->processed.load(std::memory_order_acquire);
+  result["work_us"] = work_us;
+  result["topics"] = topics;
+  result["messages"] = count;
+  result["processed"] = processed;
+  result["out_of_order"] = state->out_of_order.load();
+  result["steals"] = static_cast<qint64>(pool.steals);
+  result["seconds"] = seconds;
+  result["msgs_per_sec"] = processed / seconds;
+  return result;
+}
+
+bool waitForPool(const MqttClientPool &pool, int timeout_ms) {
+  qint64 deadline = monotonicNs() + qint64(timeout_ms) * 1000000;
+  while (pool.connectedCount() < pool.size()) {
+    if (monotonicNs() > deadline) {
+      return false;
+    }
+    QThread::msleep(1);
+  }
+  return true;
+}
+
+QJsonObject runConnections(const QString &host, int port, int window, int connections, int qos, int size, int count) {
+  MqttClientPool::Setup setup = [window](MqttClient *client, int) {
+    client->setDeliveryMode(MqttClient::Batched);
+    client->setProtocolVersion(MqttClient::MQTTv5);
+    client->setMaxInflightMessages(window);
+  };
+  MqttClientPool publishers(connections, setup);
+  MqttClientPool subscribers(connections, setup);
+  publishers.connectToBroker(host, port, 60, 1);
+  subscribers.connectToBroker(host, port, 60, 1);
+
+  QJsonObject result;
+  result["connections"] = connections;
+  if (!waitForPool(publishers, kConnectTimeoutMs) || !waitForPool(subscribers, kConnectTimeoutMs)) {
+    result["error"] = "cannot connect";
+    return result;
+  }
+
+  const QString prefix = QString("mqtt_bench/%1/conn%2/").arg(QCoreApplication::applicationPid()).arg(connections);
+  std::shared_ptr<std::atomic<int>> received = std::make_shared<std::atomic<int>>(0);
+  std::shared_ptr<std::atomic<bool>> probe_seen = std::make_shared<std::atomic<bool>>(false);
+  QList<MqttSubscription *> subscriptions =
+      subscribers.subscribe(prefix + "#", qos, [received, probe_seen](const MqttMessage &message) {
+        quint64 seq = 0;
+        if (message.payload.size() >= kTrailerSize) {
+          memcpy(&seq, message.payload.constData() + message.payload.size() - kTrailerSize, sizeof(seq));
+        }
+        if (seq == kProbeSeq) {
+          probe_seen->store(true, std::memory_order_release);
+        } else {
+          received->fetch_add(1, std::memory_order_release);
+        }
+      });
+
+  // 主题数取连接数的倍数，使各连接分到的主题数大致相同
+  QVector<QByteArray> topics;
+  for (int i = 0; i < connections * 16; ++i) {
+    topics.append((prefix + QString::number(i)).toUtf8());
+  }
+  qint64 probe_deadline = monotonicNs() + qint64(kSubscribeTimeoutMs) * 1000000;
+  while (!probe_seen->load(std::memory_order_acquire) && monotonicNs() < probe_deadline) {
+    publishers.publishEncoded(topics.at(0), makePayload(size, kProbeSeq), qos);
+    QThread::msleep(20);
+  }
+  // 等待其余连接的共享订阅也生效
+  QThread::msleep(100);
+
+  const qint64 start_ns = monotonicNs();
+  for (int i = 0; i < count; ++i) {
+    const QByteArray &topic = topics.at(i % topics.size());
+    while (publishers.publishEncoded(topic, makePayload(size, i), qos).status() == MqttPublishToken::Rejected) {
+      QThread::usleep(20);
+    }
+  }
+  qint64 drain_deadline = monotonicNs() + qint64(kDrainTimeoutMs) * 1000000;
+  while (received->load(std::memory_order_acquire) < count && monotonicNs() < drain_deadline) {
+    QThread::msleep(1);
+  }
+  const double seconds = (monotonicNs() - start_ns) / 1e9;
+  subscribers.unsubscribe(subscriptions);
+
+  const int total = received->load(std::memory_order_acquire);
+  result["qos"] = qos;
+  result["payload_bytes"] = size;
+  result["messages"] = count;
+  result["received"] = total;
+  result["seconds"] = seconds;
+  result["msgs_per_sec"] = total / seconds;
+  result["mb_per_sec"] = static_cast<double>(total) * qMax(size, kTrailerSize) / seconds / (1024 * 1024);
+  return result;
+}
+
+QList<int> parseIntList(const QString &text) {
+  QList<int> values;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+  const QStringList parts = text.split(',', Qt::SkipEmptyParts);
+#else
+  const QStringList parts = text.split(',', QString::SkipEmptyParts);
+#endif
+  for (const QString &part : parts) {
+    values.append(part.trimmed().toInt());
+  }
+  return values;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  QCoreApplication app(argc, argv);
+  QCoreApplication::setApplicationName("mqtt_bench");
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription("MQTT publish throughput and latency benchmark");
+  parser.addHelpOption();
+  parser.addOption(QCommandLineOption("host", "Broker host.", "host", "localhost"));
+  parser.addOption(QCommandLineOption("port", "Broker port.", "port", "1883"));
+  parser.addOption(QCommandLineOption("qos", "Comma separated QoS levels.", "list", "0,1,2"));
+  parser.addOption(QCommandLineOption("sizes", "Comma separated payload sizes in bytes.", "list", "16,256,4096,65536"));
+  parser.addOption(QCommandLineOption("count", "Messages per run.", "n", "20000"));
+  parser.addOption(QCommandLineOption("rate", "Publish rate limit in msgs/s, 0 for unlimited.", "n", "0"));
+  parser.addOption(QCommandLineOption("window", "Publish inflight window.", "n", "1000"));
+  parser.addOption(QCommandLineOption("output", "Write JSON to file instead of stdout.", "file"));
+  parser.addOption(QCommandLineOption("pool-threads", "Comma separated worker pool sizes to measure.", "list"));
+  parser.addOption(QCommandLineOption("pool-work-us", "CPU time spent per message in the worker pool.", "us", "50"));
+  parser.addOption(QCommandLineOption("pool-topics", "Topics the worker pool messages are spread over.", "n", "64"));
+  parser.addOption(QCommandLineOption("connections", "Comma separated client pool sizes to measure.", "list"));
+  parser.process(app);
+
+  const QString host = parser.value("host");
+  const int port = parser.value("port").toInt();
+  const int count = qMax(1, parser.value("count").toInt());
+  const int rate = parser.value("rate").toInt();
+  const int window = parser.value("window").toInt();
+
+  BenchClient publisher, subscriber;
+  if (!startClient(&subscriber, host, port, window) || !startClient(&publisher, host, port, window)) {
+    fprintf(stderr, "cannot connect to %s:%d\n", qPrintable(host), port);
+    stopClient(&publisher);
+    stopClient(&subscriber);
+    return 1;
+  }
+
+  QJsonArray results;
+  for (int qos : parseIntList(parser.value("qos"))) {
+    for (int size : parseIntList(parser.value("sizes"))) {
+      QJsonObject result = runOnce(&publisher, &subscriber, qos, size, count, rate);
+      fprintf(stderr, "qos=%d size=%-6d %10.0f msg/s %8.2f MB/s  rtt p50=%.0fus p99=%.0fus\n", qos, size,
+              result["publish_msgs_per_sec"].toDouble(), result["publish_mb_per_sec"].toDouble(),
+              result["rtt_latency_us"].toObject()["p50"].toDouble(),
+              result["rtt_latency_us"].toObject()["p99"].toDouble());
+      results.append(result);
+    }
+  }
+
+  stopClient(&subscriber);
+
+  QJsonArray pool_results;
+  double baseline = 0;
+  for (int threads : parseIntList(parser.value("pool-threads"))) {
+    QJsonObject result = runPool(&publisher, host, port, window, threads, parser.value("pool-work-us").toInt(),
+                                 qMax(1, parser.value("pool-topics").toInt()), count);
+    const double throughput = result["msgs_per_sec"].toDouble();
+    if (baseline == 0) {
+      baseline = throughput;
+    }
+    result["speedup"] = baseline > 0 ? throughput / baseline : 0.0;
+    fprintf(stderr, "pool threads=%-3d %10.0f msg/s  speedup=%.2f  out_of_order=%d\n", threads, throughput,
+            result["speedup"].toDouble(), result["out_of_order"].toInt());
+    pool_results.append(result);
+  }
+  stopClient(&publisher);
+
+  // 连接池测试使用第一个QoS和消息大小
+  QJsonArray connection_results;
+  const QList<int> qos_levels = parseIntList(parser.value("qos"));
+  const QList<int> sizes = parseIntList(parser.value("sizes"));
+  baseline = 0;
+  for (int connections : parseIntList(parser.value("connections"))) {
+    QJsonObject result = runConnections(host, port, window, qMax(1, connections), qos_levels.value(0, 0),
+                                        sizes.value(0, 256), count);
+    const double throughput = result["msgs_per_sec"].toDouble();
+    if (baseline == 0) {
+      baseline = throughput;
+    }
+    result["speedup"] = baseline > 0 ? throughput / baseline : 0.0;
+    fprintf(stderr, "connections=%-3d %10.0f msg/s  speedup=%.2f\n", connections, throughput,
+            result["speedup"].toDouble());
+    connection_results.append(result);
+  }
+
+  QJsonObject report;
+  report["tool"] = "mqtt_bench";
+  report["format_version"] = 1;
+  report["broker"] = QString("%1:%2").arg(host).arg(port);
+  report["timestamp"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+  report["qt_version"] = qVersion();
+  report["messages_per_run"] = count;
+  report["rate_limit"] = rate;
+  report["window"] = window;
+  report["results"] = results;
+  if (!pool_results.isEmpty()) {
+    report["pool_results"] = pool_results;
+  }
+  if (!connection_results.isEmpty()) {
+    report["connection_results"] = connection_results;
+  }
+
+  QByteArray json = QJsonDocument(report).toJson(QJsonDocument::Indented);
+  if (parser.isSet("output")) {
+    QFile file(parser.value("output"));
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(json) != json.size()) {
+      fprintf(stderr, "cannot write %s\n", qPrintable(parser.value("output")));
+      return 1;
+    }
+  } else {
+    fwrite(json.constData(), 1, json.size(), stdout);
+  }
+  return 0;
+}
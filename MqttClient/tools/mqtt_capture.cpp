@@ -0,0 +1,337 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QHash>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QThread>
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+#include <vector>
+
+#include "MqttCapture.h"
+#include "MqttClient.h"
+
+/*!
+ * \brief 流量录制与重放工具
+ *   - record：订阅主题并把收到的消息录制到文件，到达--duration或收到SIGINT/SIGTERM后结束；
+ *   - replay：把录制文件中的消息重新发布到代理，--speed为1时按原始时间间隔，为N时加速N倍，
+ *             为0时不等待、尽快发布；--map把主题前缀from替换为to，可指定多次；
+ *   - info：输出录制文件的概况。
+ * 重放时统计每条消息实际发布时刻相对计划时刻的滞后，用于判断本机能否跟上原始流量。
+ * 结果以JSON输出。
+ * 用法：mqtt_capture record --output traffic.mqcap [--topic '#'] [--duration 60] [--max-mb 1024]
+ *       mqtt_capture replay --input traffic.mqcap [--speed 1] [--map from=to] [--qos -1] [--from 0]
+ *       mqtt_capture info --input traffic.mqcap
+ */
+
+namespace {
+
+const int kConnectTimeoutMs = 10000;  // 连接超时
+const int kDrainTimeoutMs = 30000;    // 等待最后的发布确认的超时
+const qint64 kSpinNs = 200000;        // 距计划时刻不足该值时忙等而不休眠
+
+std::atomic<bool> g_stop{false};
+
+void onSignal(int) { g_stop.store(true); }
+
+// 运行在独立线程中的客户端
+struct ToolClient {
+  MqttClient *client = nullptr;
+  QThread *thread = nullptr;
+  std::atomic<bool> connected{false};
+  std::atomic<bool> failed{false};
+};
+
+bool waitUntil(const std::atomic<bool> &flag, int timeout_ms) {
+  qint64 deadline = mqttMonotonicNs() + qint64(timeout_ms) * 1000000;
+  while (!flag.load(std::memory_order_acquire)) {
+    if (mqttMonotonicNs() > deadline) {
+      return false;
+    }
+    QThread::msleep(1);
+  }
+  return true;
+}
+
+bool startClient(ToolClient *tool, const QString &host, int port, int window) {
+  tool->client = new MqttClient();
+  tool->client->setDeliveryMode(MqttClient::Batched);
+  tool->client->setProtocolVersion(MqttClient::MQTTv5);
+  tool->client->setMaxInflightMessages(window);
+  tool->thread = new QThread();
+  tool->client->moveToThread(tool->thread);
+  QObject::connect(tool->thread, &QThread::finished, tool->client, &QObject::deleteLater);
+  std::atomic<bool> *connected = &tool->connected;
+  std::atomic<bool> *failed = &tool->failed;
+  QObject::connect(tool->client, &MqttClient::connected, [connected]() { connected->store(true); });
+  QObject::connect(tool->client, &MqttClient::connectionFailed, [failed](const QString &) { failed->store(true); });
+  tool->thread->start();
+
+  // 常驻进程：启动后断线时无限重连，不因代理短暂不可用而停止
+  tool->client->connectToBroker(host, port, 60, 0);
+  return waitUntil(tool->connected, kConnectTimeoutMs) && !tool->failed.load();
+}
+
+void stopClient(ToolClient *tool) {
+  if (!tool->thread) {
+    return;
+  }
+  MqttClient *client = tool->client;
+  QMetaObject::invokeMethod(client, [client]() { client->disconnectFromBroker(); }, Qt::BlockingQueuedConnection);
+  tool->thread->quit();
+  tool->thread->wait();
+  delete tool->thread;
+  tool->thread = nullptr;
+  tool->client = nullptr;
+}
+
+qint64 percentile(const std::vector<qint64> &sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  size_t index = std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()));
+  return sorted[index];
+}
+
+int runRecord(const QCommandLineParser &parser, QJsonObject *report) {
+  const QString path = parser.value("output");
+  if (path.isEmpty()) {
+    fprintf(stderr, "record requires --output\n");
+    return 1;
+  }
+
+  ToolClient subscriber;
+  if (!startClient(&subscriber, parser.value("host"), parser.value("port").toInt(), 0)) {
+    fprintf(stderr, "cannot connect to %s:%s\n", qPrintable(parser.value("host")), qPrintable(parser.value("port")));
+    stopClient(&subscriber);
+    return 1;
+  }
+  MqttClient *client = subscriber.client;
+  if (!client->enableCapture(path, parser.value("max-mb").toLongLong() * 1024 * 1024)) {
+    fprintf(stderr, "cannot create %s\n", qPrintable(path));
+    stopClient(&subscriber);
+    return 1;
+  }
+  for (const QString &topic : parser.values("topic")) {
+    client->subscribe(topic, parser.value("sub-qos").toInt());
+  }
+
+  const qint64 duration_ns = parser.value("duration").toLongLong() * 1000000000LL;
+  const qint64 start_ns = mqttMonotonicNs();
+  while (!g_stop.load() && (duration_ns <= 0 || mqttMonotonicNs() - start_ns < duration_ns)) {
+    QThread::msleep(100);
+  }
+  client->stopCapture();
+  const MqttStats stats = client->stats();
+  stopClient(&subscriber);
+
+  (*report)["mode"] = "record";
+  (*report)["file"] = path;
+  (*report)["seconds"] = (mqttMonotonicNs() - start_ns) / 1e9;
+  (*report)["messages"] = static_cast<qint64>(stats.captured);
+  (*report)["dropped"] = static_cast<qint64>(stats.capture_dropped);
+  return 0;
+}
+
+int runReplay(const QCommandLineParser &parser, QJsonObject *report) {
+  MqttCaptureReader reader;
+  if (!reader.open(parser.value("input"))) {
+    return 1;
+  }
+
+  // 主题前缀映射，按命令行顺序取第一个匹配的规则
+  QList<QPair<QByteArray, QByteArray>> maps;
+  for (const QString &rule : parser.values("map")) {
+    const int eq = rule.indexOf('=');
+    if (eq <= 0) {
+      fprintf(stderr, "invalid --map %s, expected from=to\n", qPrintable(rule));
+      return 1;
+    }
+    maps.append(qMakePair(rule.left(eq).toUtf8(), rule.mid(eq + 1).toUtf8()));
+  }
+  QHash<QByteArray, QByteArray> mapped_topics;
+
+  const double speed = parser.value("speed").toDouble();
+  const int qos_override = parser.value("qos").toInt();
+  const qint64 from_ns = static_cast<qint64>(parser.value("from").toDouble() * 1e9);
+  if (from_ns > 0) {
+    reader.seek(from_ns);
+  }
+
+  ToolClient publisher;
+  if (!startClient(&publisher, parser.value("host"), parser.value("port").toInt(), parser.value("window").toInt())) {
+    fprintf(stderr, "cannot connect to %s:%s\n", qPrintable(parser.value("host")), qPrintable(parser.value("port")));
+    stopClient(&publisher);
+    return 1;
+  }
+
+  std::vector<qint64> lag_ns;
+  lag_ns.reserve(static_cast<size_t>(qMin<qint64>(reader.recordCount(), 10000000)));
+  qint64 published = 0, rejected = 0, bytes = 0;
+  qint64 first_offset_ns = -1;
+  MqttPublishToken last_token;
+  MqttCaptureReader::Record record;
+  const qint64 start_ns = mqttMonotonicNs();
+  while (!g_stop.load() && reader.next(&record)) {
+    if (first_offset_ns < 0) {
+      first_offset_ns = record.offset_ns;
+    }
+    qint64 due_ns = start_ns;
+    if (speed > 0) {
+      due_ns += static_cast<qint64>((record.offset_ns - first_offset_ns) / speed);
+      qint64 wait_ns = due_ns - mqttMonotonicNs();
+      if (wait_ns > kSpinNs) {
+        QThread::usleep(static_cast<unsigned long>((wait_ns - kSpinNs) / 1000));
+      }
+      while (mqttMonotonicNs() < due_ns) {
+      }
+    }
+
+    QHash<QByteArray, QByteArray>::const_iterator it = mapped_topics.constFind(record.topic);
+    if (it == mapped_topics.constEnd()) {
+      QByteArray topic = record.topic;
+      for (const QPair<QByteArray, QByteArray> &map : maps) {
+        if (topic.startsWith(map.first)) {
+          topic = map.second + topic.mid(map.first.size());
+          break;
+        }
+      }
+      it = mapped_topics.insert(record.topic, topic);
+    }
+
+    const int qos = qos_override >= 0 ? qos_override : record.qos;
+    while (true) {
+      last_token = publisher.client->publishEncoded(it.value(), record.payload, qos, record.retain);
+      if (last_token.status() != MqttPublishToken::Rejected) {
+        break;
+      }
+      // 发布窗口已满，稍后重试
+      ++rejected;
+      QThread::usleep(20);
+    }
+    if (speed > 0) {
+      lag_ns.push_back(mqttMonotonicNs() - due_ns);
+    }
+    ++published;
+    bytes += record.payload.size();
+  }
+  // 同一连接上的确认按顺序到达，等最后一条即可
+  last_token.waitForFinished(kDrainTimeoutMs);
+  const qint64 elapsed_ns = mqttMonotonicNs() - start_ns;
+  const MqttStats stats = publisher.client->stats();
+  stopClient(&publisher);
+
+  std::sort(lag_ns.begin(), lag_ns.end());
+  QJsonObject lag;
+  lag["p50"] = percentile(lag_ns, 0.50) / 1000.0;
+  lag["p99"] = percentile(lag_ns, 0.99) / 1000.0;
+  lag["max"] = lag_ns.empty() ? 0.0 : lag_ns.back() / 1000.0;
+
+  (*report)["mode"] = "replay";
+  (*report)["file"] = parser.value("input");
+  (*report)["speed"] = speed;
+  (*report)["messages"] = published;
+  (*report)["bytes"] = bytes;
+  (*report)["seconds"] = elapsed_ns / 1e9;
+  (*report)["msgs_per_sec"] = elapsed_ns > 0 ? published * 1e9 / elapsed_ns : 0.0;
+  (*report)["capture_seconds"] = reader.durationNs() / 1e9;
+  (*report)["rejected_retries"] = rejected;
+  (*report)["publish_failed"] = static_cast<qint64>(stats.publish_failed);
+  if (speed > 0) {
+    (*report)["lag_us"] = lag;
+  }
+  return 0;
+}
+
+int runInfo(const QCommandLineParser &parser, QJsonObject *report) {
+  MqttCaptureReader reader;
+  if (!reader.open(parser.value("input"))) {
+    return 1;
+  }
+
+  // 统计各主题的消息数
+  QVector<qint64> counts(reader.topics().size(), 0);
+  QHash<QByteArray, int> topic_index;
+  for (int i = 0; i < reader.topics().size(); ++i) {
+    topic_index.insert(reader.topics().at(i), i);
+  }
+  qint64 bytes = 0;
+  MqttCaptureReader::Record record;
+  while (reader.next(&record)) {
+    ++counts[topic_index.value(record.topic)];
+    bytes += record.payload.size();
+  }
+  QJsonObject topics;
+  for (int i = 0; i < counts.size(); ++i) {
+    topics[QString::fromUtf8(reader.topics().at(i))] = counts.at(i);
+  }
+
+  (*report)["mode"] = "info";
+  (*report)["file"] = parser.value("input");
+  (*report)["start"] = QDateTime::fromMSecsSinceEpoch(reader.startTimeMs()).toUTC().toString(Qt::ISODateWithMs);
+  (*report)["capture_seconds"] = reader.durationNs() / 1e9;
+  (*report)["messages"] = reader.recordCount();
+  (*report)["bytes"] = bytes;
+  (*report)["indexed"] = reader.hasIndex();
+  (*report)["topics"] = topics;
+  return 0;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  QCoreApplication app(argc, argv);
+  QCoreApplication::setApplicationName("mqtt_capture");
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription("Record MQTT traffic to a capture file and replay it");
+  parser.addHelpOption();
+  parser.addPositionalArgument("mode", "record, replay or info.");
+  parser.addOption(QCommandLineOption("host", "Broker host.", "host", "localhost"));
+  parser.addOption(QCommandLineOption("port", "Broker port.", "port", "1883"));
+  parser.addOption(QCommandLineOption("topic", "Topic filter to record, may be repeated.", "filter"));
+  parser.addOption(QCommandLineOption("sub-qos", "Subscription QoS when recording.", "n", "0"));
+  parser.addOption(QCommandLineOption("duration", "Recording time in seconds, 0 until interrupted.", "secs", "0"));
+  parser.addOption(QCommandLineOption("max-mb", "Capture file size limit in MB.", "n", "1024"));
+  parser.addOption(QCommandLineOption("output", "Capture file to record to.", "file"));
+  parser.addOption(QCommandLineOption("input", "Capture file to replay or inspect.", "file"));
+  parser.addOption(QCommandLineOption("speed", "Replay speed factor, 0 for as fast as possible.", "x", "1"));
+  parser.addOption(QCommandLineOption("map", "Replace topic prefix on replay, may be repeated.", "from=to"));
+  parser.addOption(QCommandLineOption("qos", "Replay QoS, -1 keeps the recorded QoS.", "n", "-1"));
+  parser.addOption(QCommandLineOption("from", "Start replay at this many seconds into the capture.", "secs", "0"));
+  parser.addOption(QCommandLineOption("window", "Publish inflight window.", "n", "1000"));
+  parser.process(app);
+
+  std::signal(SIGINT, onSignal);
+  std::signal(SIGTERM, onSignal);
+
+  const QString mode = parser.positionalArguments().value(0);
+  if (mode == "record" && parser.values("topic").isEmpty()) {
+    fprintf(stderr, "record requires at least one --topic\n");
+    return 1;
+  }
+
+  QJsonObject report;
+  report["tool"] = "mqtt_capture";
+  report["format_version"] = 1;
+  int rc = 1;
+  if (mode == "record") {
+    rc = runRecord(parser, &report);
+  } else if (mode == "replay") {
+    rc = runReplay(parser, &report);
+  } else if (mode == "info") {
+    rc = runInfo(parser, &report);
+  } else {
+    parser.showHelp(1);
+  }
+  if (rc != 0) {
+    return rc;
+  }
+
+  QByteArray json = QJsonDocument(report).toJson(QJsonDocument::Indented);
+  fwrite(json.constData(), 1, json.size(), stdout);
+  return 0;
+}
@@ -0,0 +1,137 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QList>
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+
+#include "MqttFanout.h"
+#include "MqttMetrics.h"
+#include "TopicTrie.h"
+
+/*!
+ * \brief 本机消息分发区的读取工具
+ * 连接mqtt_fanoutd创建的共享内存分发区，读取其中的消息并按--topic过滤，--print时逐条输出到标准输出。
+ * 指定--publish时按--rate经分发区请求守护进程发布消息，用于验证上行方向。
+ * 统计守护进程收到消息到本进程读出的延迟（同一台机器的单调时钟）以及因落后被覆盖的消息数。
+ * 运行到--duration、收到SIGINT/SIGTERM或守护进程退出为止，结果以JSON输出到标准错误（--print时）或标准输出。
+ * 用法：mqtt_fanout_cat [--shm /dev/shm/mqtt_fanout] [--topic '#'] [--print] [--duration 0]
+ *                       [--publish topic] [--rate 10] [--size 64]
+ */
+
+namespace {
+
+const int kWaitMs = 100;  // 等待新消息的超时，也是检查退出条件的周期
+
+std::atomic<bool> g_stop{false};
+
+void onSignal(int) { g_stop.store(true); }
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  QCoreApplication app(argc, argv);
+  QCoreApplication::setApplicationName("mqtt_fanout_cat");
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription("Read messages from a local fan-out daemon");
+  parser.addHelpOption();
+  parser.addOption(QCommandLineOption("shm", "Shared memory file.", "file", "/dev/shm/mqtt_fanout"));
+  parser.addOption(QCommandLineOption("topic", "Topic filter, may be repeated.", "filter", "#"));
+  parser.addOption(QCommandLineOption("print", "Print each message as topic and payload."));
+  parser.addOption(QCommandLineOption("duration", "Run time in seconds, 0 until interrupted.", "secs", "0"));
+  parser.addOption(QCommandLineOption("publish", "Publish to this topic through the daemon.", "topic"));
+  parser.addOption(QCommandLineOption("rate", "Publishes per second.", "n", "10"));
+  parser.addOption(QCommandLineOption("size", "Publish payload size in bytes.", "bytes", "64"));
+  parser.process(app);
+
+  std::signal(SIGINT, onSignal);
+  std::signal(SIGTERM, onSignal);
+
+  MqttFanoutReader reader;
+  if (!reader.attach(parser.value("shm"))) {
+    fprintf(stderr, "cannot attach to %s\n", qPrintable(parser.value("shm")));
+    return 1;
+  }
+
+  QList<QByteArray> filters;
+  for (const QString &filter : parser.values("topic")) {
+    filters.append(filter.toUtf8());
+  }
+  const bool print = parser.isSet("print");
+  qint64 messages = 0;
+  qint64 matched = 0;
+  MqttLatencyHistogram latency;
+  MqttFanoutReader::Handler handler = [&](const MqttFanoutReader::Message &message) {
+    ++messages;
+    latency.record(mqttMonotonicNs() - message.received_ns);
+    for (const QByteArray &filter : filters) {
+      if (TopicTrie::matches(filter, message.topic)) {
+        ++matched;
+        if (print) {
+          fwrite(message.topic.constData(), 1, message.topic.size(), stdout);
+          fputc(' ', stdout);
+          fwrite(message.payload.constData(), 1, message.payload.size(), stdout);
+          fputc('\n', stdout);
+        }
+        break;
+      }
+    }
+  };
+
+  const QByteArray publish_topic = parser.value("publish").toUtf8();
+  const qint64 publish_interval_ns = 1000000000LL / qMax(1, parser.value("rate").toInt());
+  const QByteArray payload(qMax(0, parser.value("size").toInt()), 'x');
+  qint64 published = 0;
+  qint64 publish_rejected = 0;
+
+  const qint64 duration_ns = parser.value("duration").toLongLong() * 1000000000LL;
+  const qint64 start_ns = mqttMonotonicNs();
+  qint64 next_publish_ns = start_ns;
+  bool writer_exited = false;
+  while (!g_stop.load() && (duration_ns <= 0 || mqttMonotonicNs() - start_ns < duration_ns)) {
+    if (!publish_topic.isEmpty() && mqttMonotonicNs() >= next_publish_ns) {
+      next_publish_ns += publish_interval_ns;
+      if (reader.publish(publish_topic, payload)) {
+        ++published;
+      } else {
+        ++publish_rejected;
+      }
+    }
+    const int wait_ms = publish_topic.isEmpty() ? kWaitMs : qMin<qint64>(kWaitMs, publish_interval_ns / 1000000);
+    if (reader.wait(wait_ms)) {
+      reader.read(handler);
+    } else if (!reader.writerAlive()) {
+      writer_exited = true;
+      break;
+    }
+  }
+  const double seconds = (mqttMonotonicNs() - start_ns) / 1e9;
+  const MqttLatencyStats stats = latency.snapshot();
+
+  QJsonObject report;
+  report["tool"] = "mqtt_fanout_cat";
+  report["format_version"] = 1;
+  report["file"] = parser.value("shm");
+  report["seconds"] = seconds;
+  report["messages"] = messages;
+  report["matched"] = matched;
+  report["dropped"] = static_cast<qint64>(reader.droppedCount());
+  report["messages_per_sec"] = seconds > 0 ? messages / seconds : 0.0;
+  report["published"] = published;
+  report["publish_rejected"] = publish_rejected;
+  report["writer_exited"] = writer_exited;
+  QJsonObject latency_us;
+  latency_us["mean"] = stats.mean_us;
+  latency_us["p50"] = stats.p50_us;
+  latency_us["p99"] = stats.p99_us;
+  latency_us["max"] = stats.max_us;
+  report["fanout_latency_us"] = latency_us;
+  reader.detach();
+
+  QByteArray json = QJsonDocument(report).toJson(QJsonDocument::Indented);
+  fwrite(json.constData(), 1, json.size(), print ? stderr : stdout);
+  return 0;
+}
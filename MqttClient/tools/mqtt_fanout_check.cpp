@@ -0,0 +1,156 @@
+#include <QCoreApplication>
+#include <QSet>
+#include <QTemporaryDir>
+#include <QThread>
+#include <atomic>
+#include <cstdio>
+#include <functional>
+
+#include "MqttClient.h"
+#include "MqttFanout.h"
+#include "MqttMetrics.h"
+#include "fake_mosquitto.h"
+
+/*!
+ * \brief 本机消息分发的自检
+ * 链接fake_mosquitto.cpp代替libmosquitto，不需要代理。客户端启用分发区后连接并订阅，两个读者分别经分发区
+ * 发布一条消息，再由假代理从外部发布一条，检查每个读者都收到对方的发布和外部消息、没有收到自己的发布
+ * （与直连代理时的no_local一致），且运行指标中的读者数为2。MQTT v5和v3.1.1各检查一次，任一项失败时进程返回1。
+ * 用法：mqtt_fanout_check
+ */
+
+namespace {
+
+const int kTimeoutMs = 5000;  // 每一步的等待超时
+const int kWaitMs = 10;       // 读取和转发时单次等待的超时
+
+// 轮询等待，条件由客户端线程推进
+bool waitUntil(const std::function<bool()> &done, int timeout_ms) {
+  qint64 deadline = mqttMonotonicNs() + qint64(timeout_ms) * 1000000;
+  while (!done()) {
+    if (mqttMonotonicNs() > deadline) {
+      return false;
+    }
+    QThread::msleep(1);
+  }
+  return true;
+}
+
+// 读取到收齐期望的主题为止并读完已到达的消息，返回缺少的主题；收到own主题时置位*got_own
+QSet<QByteArray> readTopics(MqttFanoutReader *reader, MqttClient *client, const QSet<QByteArray> &expected,
+                            const QByteArray &own, bool *got_own) {
+  QSet<QByteArray> missing = expected;
+  auto handler = [&](const MqttFanoutReader::Message &message) {
+    missing.remove(message.topic);
+    *got_own = *got_own || message.topic == own;
+  };
+  qint64 deadline = mqttMonotonicNs() + qint64(kTimeoutMs) * 1000000;
+  while (!missing.isEmpty() && mqttMonotonicNs() < deadline) {
+    // 本进程同时充当守护进程，读取期间继续转发上行消息
+    client->relayFanoutPublishes(0);
+    if (reader->wait(kWaitMs)) {
+      reader->read(handler);
+    }
+  }
+  if (reader->wait(kWaitMs)) {
+    reader->read(handler);
+  }
+  return missing;
+}
+
+// 客户端已启用分发区并连接，两个读者已连接
+bool run(const char *name, MqttClient *client, MqttFanoutReader *reader_a, MqttFanoutReader *reader_b) {
+  // 订阅在客户端线程中发给假代理，屏障返回后订阅已生效
+  client->subscribe("check/#", 0);
+  QMetaObject::invokeMethod(client, []() {}, Qt::BlockingQueuedConnection);
+
+  reader_a->publish("check/a", "from reader a");
+  reader_b->publish("check/b", "from reader b");
+  int relayed = 0;
+  waitUntil([&]() { return (relayed += client->relayFanoutPublishes(kWaitMs)) >= 2; }, kTimeoutMs);
+  if (relayed != 2) {
+    printf("%-8s FAILED: %d of 2 reader publishes relayed\n", name, relayed);
+    return false;
+  }
+  FakeMosquitto::publish(QVector<QByteArray>() << "check/external", "from broker", 0, false, 1);
+
+  bool own_a = false;
+  bool own_b = false;
+  const QSet<QByteArray> missing_a = readTopics(reader_a, client, {"check/b", "check/external"}, "check/a", &own_a);
+  const QSet<QByteArray> missing_b = readTopics(reader_b, client, {"check/a", "check/external"}, "check/b", &own_b);
+  if (own_a || own_b) {
+    printf("%-8s FAILED: a reader received its own publish\n", name);
+    return false;
+  }
+  if (!missing_a.isEmpty() || !missing_b.isEmpty()) {
+    printf("%-8s FAILED: readers missed messages\n", name);
+    for (const QByteArray &topic : missing_a) {
+      printf("  reader a missed %s\n", topic.constData());
+    }
+    for (const QByteArray &topic : missing_b) {
+      printf("  reader b missed %s\n", topic.constData());
+    }
+    return false;
+  }
+  const int readers = client->stats().fanout_readers;
+  if (readers != 2) {
+    printf("%-8s FAILED: stats report %d readers instead of 2\n", name, readers);
+    return false;
+  }
+  printf("%-8s ok\n", name);
+  return true;
+}
+
+bool check(MqttClient::ProtocolVersion version, const QString &path) {
+  const char *name = version == MqttClient::MQTTv5 ? "v5" : "v3.1.1";
+  MqttClient *client = new MqttClient();
+  client->setProtocolVersion(version);
+  QThread thread;
+  client->moveToThread(&thread);
+  QObject::connect(&thread, &QThread::finished, client, &QObject::deleteLater);
+  std::atomic<bool> connected{false};
+  QObject::connect(client, &MqttClient::connected, [&connected]() { connected.store(true); });
+  thread.start();
+
+  // 与mqtt_fanoutd相同，先启用分发区再连接
+  bool ok = false;
+  MqttFanoutReader reader_a;
+  MqttFanoutReader reader_b;
+  if (!client->enableFanout(path)) {
+    printf("%-8s FAILED: cannot create %s\n", name, qPrintable(path));
+  } else {
+    client->connectToBroker("127.0.0.1", 1883, 60, 1);
+    if (!waitUntil([&connected]() { return connected.load(); }, kTimeoutMs)) {
+      printf("%-8s FAILED: not connected\n", name);
+    } else if (!reader_a.attach(path) || !reader_b.attach(path)) {
+      printf("%-8s FAILED: cannot attach two readers\n", name);
+    } else {
+      ok = run(name, client, &reader_a, &reader_b);
+    }
+  }
+
+  reader_a.detach();
+  reader_b.detach();
+  client->stopFanout();
+  QMetaObject::invokeMethod(client, [client]() { client->disconnectFromBroker(); }, Qt::BlockingQueuedConnection);
+  thread.quit();
+  thread.wait();
+  return ok;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  QCoreApplication app(argc, argv);
+  QCoreApplication::setApplicationName("mqtt_fanout_check");
+
+  QTemporaryDir dir;
+  if (!dir.isValid()) {
+    fprintf(stderr, "cannot create temporary directory\n");
+    return 1;
+  }
+  const QString path = dir.filePath("mqtt_fanout");
+  bool ok = check(MqttClient::MQTTv5, path);
+  ok = check(MqttClient::MQTTv311, path) && ok;
+  return ok ? 0 : 1;
+}
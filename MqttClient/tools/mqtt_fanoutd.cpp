@@ -0,0 +1,170 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QThread>
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+
+#include "MqttClient.h"
+
+/*!
+ * \brief 本机消息分发守护进程
+ * 以一个连接订阅代理上的主题，把收到的消息写入共享内存分发区，同一台机器上的其他进程用
+ * MqttFanoutReader（或mqtt_fanout_cat工具）读取，不必各自连接代理；这些进程提交的发布也经本连接转发。
+ * 指定--client-id时使用持久会话，守护进程重启期间的QoS1/2消息由代理保留。
+ * 运行到收到SIGINT/SIGTERM为止，期间按--stats周期向标准错误输出一行状态，退出时以JSON输出统计。
+ * 用法：mqtt_fanoutd [--host localhost] [--port 1883] [--topic '#'] [--sub-qos 0] [--shm /dev/shm/mqtt_fanout]
+ *                    [--capacity-mb 64] [--readers 32] [--client-id id] [--stats 10]
+ */
+
+namespace {
+
+const int kConnectTimeoutMs = 10000;  // 连接超时
+const int kRelayWaitMs = 100;         // 等待本机发布的超时，也是检查退出信号的周期
+
+std::atomic<bool> g_stop{false};
+
+void onSignal(int) { g_stop.store(true); }
+
+// 运行在独立线程中的客户端
+struct ToolClient {
+  MqttClient *client = nullptr;
+  QThread *thread = nullptr;
+  std::atomic<bool> connected{false};
+  std::atomic<bool> failed{false};
+};
+
+bool waitUntil(const std::atomic<bool> &flag, int timeout_ms) {
+  qint64 deadline = mqttMonotonicNs() + qint64(timeout_ms) * 1000000;
+  while (!flag.load(std::memory_order_acquire)) {
+    if (mqttMonotonicNs() > deadline) {
+      return false;
+    }
+    QThread::msleep(1);
+  }
+  return true;
+}
+
+// 创建分发区后再连接，持久会话中代理保留的消息在连接后立即到达，不会漏写
+bool startClient(ToolClient *tool, const QCommandLineParser &parser) {
+  tool->client = new MqttClient();
+  tool->client->setDeliveryMode(MqttClient::Batched);
+  tool->client->setProtocolVersion(MqttClient::MQTTv5);
+  if (parser.isSet("client-id") && !tool->client->setPersistentSession(parser.value("client-id"))) {
+    fprintf(stderr, "cannot use persistent session %s\n", qPrintable(parser.value("client-id")));
+    delete tool->client;
+    tool->client = nullptr;
+    return false;
+  }
+  tool->thread = new QThread();
+  tool->client->moveToThread(tool->thread);
+  QObject::connect(tool->thread, &QThread::finished, tool->client, &QObject::deleteLater);
+  std::atomic<bool> *connected = &tool->connected;
+  std::atomic<bool> *failed = &tool->failed;
+  QObject::connect(tool->client, &MqttClient::connected, [connected]() { connected->store(true); });
+  QObject::connect(tool->client, &MqttClient::connectionFailed, [failed](const QString &) { failed->store(true); });
+  tool->thread->start();
+
+  const QString path = parser.value("shm");
+  if (!tool->client->enableFanout(path, parser.value("capacity-mb").toLongLong() * 1024 * 1024,
+                                  parser.value("readers").toInt())) {
+    fprintf(stderr, "cannot create %s\n", qPrintable(path));
+    return false;
+  }
+  // 常驻进程：启动后断线时无限重连，不因代理短暂不可用而停止
+  tool->client->connectToBroker(parser.value("host"), parser.value("port").toInt(), 60, 0);
+  if (!waitUntil(tool->connected, kConnectTimeoutMs) || tool->failed.load()) {
+    fprintf(stderr, "cannot connect to %s:%s\n", qPrintable(parser.value("host")), qPrintable(parser.value("port")));
+    return false;
+  }
+  return true;
+}
+
+void stopClient(ToolClient *tool) {
+  if (!tool->thread) {
+    delete tool->client;
+    return;
+  }
+  MqttClient *client = tool->client;
+  client->stopFanout();
+  QMetaObject::invokeMethod(client, [client]() { client->disconnectFromBroker(); }, Qt::BlockingQueuedConnection);
+  tool->thread->quit();
+  tool->thread->wait();
+  delete tool->thread;
+  tool->thread = nullptr;
+  tool->client = nullptr;
+}
+
+void printStatus(const MqttStats &stats) {
+  fprintf(stderr, "fanout: messages=%llu dropped=%llu relayed=%llu readers=%lld connected=%llu\n",
+          static_cast<unsigned long long>(stats.fanout_messages), static_cast<unsigned long long>(stats.fanout_dropped),
+          static_cast<unsigned long long>(stats.fanout_relayed), static_cast<long long>(stats.fanout_readers),
+          static_cast<unsigned long long>(stats.connects));
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  QCoreApplication app(argc, argv);
+  QCoreApplication::setApplicationName("mqtt_fanoutd");
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription("Share one broker connection with local processes through shared memory");
+  parser.addHelpOption();
+  parser.addOption(QCommandLineOption("host", "Broker host.", "host", "localhost"));
+  parser.addOption(QCommandLineOption("port", "Broker port.", "port", "1883"));
+  parser.addOption(QCommandLineOption("topic", "Topic filter to fan out, may be repeated.", "filter", "#"));
+  parser.addOption(QCommandLineOption("sub-qos", "Subscription QoS.", "n", "0"));
+  parser.addOption(QCommandLineOption("shm", "Shared memory file.", "file", "/dev/shm/mqtt_fanout"));
+  parser.addOption(QCommandLineOption("capacity-mb", "Fan-out ring size in MB.", "n", "64"));
+  parser.addOption(QCommandLineOption("readers", "Maximum number of local reader processes.", "n", "32"));
+  parser.addOption(QCommandLineOption("client-id", "Use a persistent session with this client id.", "id"));
+  parser.addOption(QCommandLineOption("stats", "Status line interval in seconds, 0 to disable.", "secs", "10"));
+  parser.process(app);
+
+  std::signal(SIGINT, onSignal);
+  std::signal(SIGTERM, onSignal);
+
+  ToolClient daemon;
+  if (!startClient(&daemon, parser)) {
+    stopClient(&daemon);
+    return 1;
+  }
+  MqttClient *client = daemon.client;
+  for (const QString &topic : parser.values("topic")) {
+    client->subscribe(topic, parser.value("sub-qos").toInt());
+  }
+
+  const qint64 stats_ns = parser.value("stats").toLongLong() * 1000000000LL;
+  const qint64 start_ns = mqttMonotonicNs();
+  qint64 next_stats_ns = start_ns + stats_ns;
+  while (!g_stop.load()) {
+    client->relayFanoutPublishes(kRelayWaitMs);
+    if (stats_ns > 0 && mqttMonotonicNs() >= next_stats_ns) {
+      next_stats_ns += stats_ns;
+      printStatus(client->stats());
+    }
+  }
+  const MqttStats stats = client->stats();
+  stopClient(&daemon);
+
+  QJsonObject report;
+  report["tool"] = "mqtt_fanoutd";
+  report["format_version"] = 1;
+  report["file"] = parser.value("shm");
+  report["topics"] = QJsonArray::fromStringList(parser.values("topic"));
+  report["seconds"] = (mqttMonotonicNs() - start_ns) / 1e9;
+  report["messages_in"] = static_cast<qint64>(stats.messages_in);
+  report["fanout_messages"] = static_cast<qint64>(stats.fanout_messages);
+  report["fanout_dropped"] = static_cast<qint64>(stats.fanout_dropped);
+  report["relayed_publishes"] = static_cast<qint64>(stats.fanout_relayed);
+  report["readers"] = stats.fanout_readers;
+  report["sessions_resumed"] = static_cast<qint64>(stats.sessions_resumed);
+
+  QByteArray json = QJsonDocument(report).toJson(QJsonDocument::Indented);
+  fwrite(json.constData(), 1, json.size(), stdout);
+  return 0;
+}
@@ -0,0 +1,446 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QThread>
+#include <QTimer>
+#include <QVector>
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+#include <deque>
+#include <random>
+#include <vector>
+
+#include "MqttClient.h"
+
+/*!
+ * \brief 多虚拟客户端负载生成器
+ * 在少量工作线程中运行大量MqttClient会话（每个会话一个连接），模拟成千上万个设备：
+ *   - 会话平均分配到--threads个线程，每个线程的事件循环通过QSocketNotifier驱动本线程全部会话的
+ *     非阻塞套接字，不为每个连接创建网络线程；
+ *   - 会话按--connect-rate逐步建立连接，避免瞬间的连接风暴；
+ *   - 每个会话以--rate的速率向--topic模板生成的主题发布，负载大小按--payload指定的分布抽样，
+ *     前--subscribers个会话订阅--subscribe模板生成的过滤器；
+ *   - 每秒输出一行汇总吞吐量，结束时输出连接延迟与确认延迟的分布。
+ * 主题模板支持{session}（会话序号）、{thread}（线程序号）和{pid}占位符。
+ * 负载分布：N为固定大小，MIN-MAX为均匀分布，exp:MEAN为指数分布（截断到8倍均值）。
+ * 会话较多时需要调高进程的文件描述符上限以及代理的max_connections。
+ * 主机默认使用127.0.0.1：localhost可能同时解析出IPv4和IPv6地址，每次连接都会先做一轮竞速探测。
+ * 用法：mqtt_loadgen [--host 127.0.0.1] [--port 1883] [--sessions 1000] [--threads 4] [--connect-rate 500]
+ *                    [--rate 1] [--topic 'loadgen/{session}/data'] [--payload 64-1024] [--qos 0]
+ *                    [--subscribe 'loadgen/{session}/cmd'] [--subscribers 0] [--duration 60] [--output result.json]
+ */
+
+namespace {
+
+const int kTickMs = 5;                   // 发布节拍
+const int kDrainMs = 1000;               // 停止发布后等待确认的时间
+const int kMaxPayloadSize = 256 * 1024;  // 负载大小上限
+
+std::atomic<bool> g_stop{false};
+
+void onSignal(int) { g_stop.store(true); }
+
+// 负载大小分布
+struct PayloadSpec {
+  enum Kind { Fixed, Uniform, Exponential };
+
+  Kind kind = Fixed;
+  int min = 256;  // 固定大小或均匀分布下限，指数分布时为均值
+  int max = 256;  // 均匀分布上限，指数分布时为截断值
+
+  bool parse(const QString &text) {
+    bool ok = false, ok2 = false;
+    if (text.startsWith("exp:")) {
+      kind = Exponential;
+      min = text.mid(4).toInt(&ok);
+      max = qMin(min * 8, kMaxPayloadSize);
+      return ok && min > 0;
+    }
+    const int dash = text.indexOf('-');
+    if (dash > 0) {
+      kind = Uniform;
+      min = text.left(dash).toInt(&ok);
+      max = text.mid(dash + 1).toInt(&ok2);
+      return ok && ok2 && min >= 0 && max >= min && max <= kMaxPayloadSize;
+    }
+    kind = Fixed;
+    min = max = text.toInt(&ok);
+    return ok && min >= 0 && min <= kMaxPayloadSize;
+  }
+};
+
+// 负载配置
+struct LoadConfig {
+  QString host;
+  int port = 1883;
+  int sessions = 1000;
+  int threads = 4;
+  double connect_rate = 500;  // 每秒建立的连接数，不大于0表示同时建立
+  double rate = 1;            // 每个会话每秒发布的消息数
+  QString topic;              // 发布主题模板
+  QString subscribe;          // 订阅过滤器模板，为空表示不订阅
+  int subscribers = 0;        // 订阅的会话数
+  int qos = 0;                // 发布及订阅的消息质量等级
+  int window = 100;           // 每个会话的发布窗口
+  PayloadSpec payload;
+};
+
+// 全部线程共享的统计
+struct LoadTotals {
+  std::atomic<qint64> connected{0};
+  std::atomic<qint64> connect_failed{0};
+  std::atomic<qint64> published{0};
+  std::atomic<qint64> published_bytes{0};
+  std::atomic<qint64> acked{0};
+  std::atomic<qint64> failed{0};
+  std::atomic<qint64> rejected{0};
+  std::atomic<qint64> received{0};
+  std::atomic<qint64> received_bytes{0};
+  MqttLatencyHistogram connect_latency;
+  MqttLatencyHistogram ack_latency;
+};
+
+QString expandTemplate(const QString &pattern, int session, int thread) {
+  QString text = pattern;
+  text.replace("{session}", QString::number(session));
+  text.replace("{thread}", QString::number(thread));
+  text.replace("{pid}", QString::number(QCoreApplication::applicationPid()));
+  return text;
+}
+
+// 一个工作线程中的全部会话，start()/stop()都在该线程中执行
+class LoadWorker : public QObject {
+ public:
+  LoadWorker(const LoadConfig &config, LoadTotals *totals, int index, int first_session, int sessions)
+      : config_(config), totals_(totals), index_(index), random_(static_cast<quint32>(index) * 7919 + 1) {
+    sessions_.resize(sessions);
+    for (int i = 0; i < sessions; ++i) {
+      sessions_[i].index = first_session + i;
+    }
+    payload_ = QByteArray(config.payload.max, 'x');
+    connect_rate_ = config.connect_rate / qMax(1, config.threads);
+  }
+
+  void start() {
+    timer_ = new QTimer(this);
+    timer_->setTimerType(Qt::PreciseTimer);
+    connect(timer_, &QTimer::timeout, this, [this]() { tick(); });
+    last_tick_ns_ = mqttMonotonicNs();
+    timer_->start(kTickMs);
+  }
+
+  void setPublishing(bool publishing) { publishing_ = publishing; }
+
+  void stop() {
+    timer_->stop();
+    for (Session &session : sessions_) {
+      delete session.client;
+      session.client = nullptr;
+    }
+  }
+
+ private:
+  struct Session {
+    int index = 0;                         // 全局会话序号
+    MqttClient *client = nullptr;          // 连接，尚未开始连接时为空
+    QByteArray topic;                      // 发布主题
+    double credit = 0;                     // 可发布的消息数（令牌桶）
+    qint64 connect_ns = 0;                 // 发起连接的时刻
+    bool connected = false;                // 是否已连接
+    std::deque<MqttPublishToken> pending;  // 等待确认的发布，按发布顺序
+  };
+
+  void tick() {
+    const qint64 now = mqttMonotonicNs();
+    const double elapsed = (now - last_tick_ns_) / 1e9;
+    last_tick_ns_ = now;
+
+    // 按速率逐步建立连接
+    connect_credit_ += connect_rate_ > 0 ? connect_rate_ * elapsed : sessions_.size();
+    while (next_connect_ < static_cast<int>(sessions_.size()) && connect_credit_ >= 1) {
+      startSession(&sessions_[next_connect_++]);
+      connect_credit_ -= 1;
+    }
+
+    // 令牌最多累积几个节拍，节拍被延迟时不会集中补发
+    const double max_credit = 1 + config_.rate * kTickMs * 4 / 1000.0;
+    for (Session &session : sessions_) {
+      if (!session.connected) {
+        continue;
+      }
+      if (publishing_) {
+        session.credit = qMin(session.credit + config_.rate * elapsed, max_credit);
+        while (session.credit >= 1 && publish(&session)) {
+          session.credit -= 1;
+        }
+      }
+      collectAcks(&session);
+    }
+  }
+
+  void startSession(Session *session) {
+    MqttClient *client = new MqttClient(this);
+    client->setProtocolVersion(MqttClient::MQTTv5);
+    client->setMaxInflightMessages(config_.window);
+    session->client = client;
+    session->topic = expandTemplate(config_.topic, session->index, index_).toUtf8();
+
+    const bool subscribe = !config_.subscribe.isEmpty() && session->index < config_.subscribers;
+    const QString filter = subscribe ? expandTemplate(config_.subscribe, session->index, index_) : QString();
+    connect(client, &MqttClient::connected, this, [this, session, filter]() {
+      if (session->connect_ns > 0) {
+        totals_->connect_latency.record(mqttMonotonicNs() - session->connect_ns);
+        session->connect_ns = 0;
+      }
+      session->connected = true;
+      totals_->connected.fetch_add(1, std::memory_order_relaxed);
+      if (!filter.isEmpty()) {
+        session->client->subscribe(filter, config_.qos);
+      }
+    });
+    connect(client, &MqttClient::connectionFailed, this, [this, session](const QString &) {
+      if (session->connected) {
+        session->connected = false;
+        totals_->connected.fetch_sub(1, std::memory_order_relaxed);
+      } else {
+        totals_->connect_failed.fetch_add(1, std::memory_order_relaxed);
+      }
+    });
+    if (subscribe) {
+      LoadTotals *totals = totals_;
+      connect(client, &MqttClient::messageReceived, this,
+              [totals](const QString &, const QByteArray &payload, int, bool) {
+                totals->received.fetch_add(1, std::memory_order_relaxed);
+                totals->received_bytes.fetch_add(payload.size(), std::memory_order_relaxed);
+              });
+    }
+
+    session->connect_ns = mqttMonotonicNs();
+    client->connectToBroker(config_.host, config_.port, 60, 1);
+  }
+
+  bool publish(Session *session) {
+    const int size = payloadSize();
+    // 负载指向共享的缓冲区，发布时不分配内存
+    MqttPublishToken token = session->client->publishEncoded(
+        session->topic, QByteArray::fromRawData(payload_.constData(), size), config_.qos);
+    if (token.status() == MqttPublishToken::Rejected) {
+      totals_->rejected.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    totals_->published.fetch_add(1, std::memory_order_relaxed);
+    totals_->published_bytes.fetch_add(size, std::memory_order_relaxed);
+    session->pending.push_back(token);
+    return true;
+  }
+
+  void collectAcks(Session *session) {
+    while (!session->pending.empty() && session->pending.front().isFinished()) {
+      const MqttPublishToken &token = session->pending.front();
+      if (token.status() == MqttPublishToken::Completed) {
+        totals_->acked.fetch_add(1, std::memory_order_relaxed);
+        totals_->ack_latency.record(token.latencyUs() * 1000);
+      } else {
+        totals_->failed.fetch_add(1, std::memory_order_relaxed);
+      }
+      session->pending.pop_front();
+    }
+  }
+
+  int payloadSize() {
+    const PayloadSpec &spec = config_.payload;
+    if (spec.kind == PayloadSpec::Uniform) {
+      return std::uniform_int_distribution<int>(spec.min, spec.max)(random_);
+    }
+    if (spec.kind == PayloadSpec::Exponential) {
+      const double size = std::exponential_distribution<double>(1.0 / spec.min)(random_);
+      return qMin(static_cast<int>(size), spec.max);
+    }
+    return spec.min;
+  }
+
+  LoadConfig config_;              // 负载配置
+  LoadTotals *totals_;             // 共享统计
+  int index_;                      // 线程序号
+  std::mt19937 random_;            // 负载大小随机数
+  std::vector<Session> sessions_;  // 本线程的会话（创建后不再改变大小，元素地址稳定）
+  QByteArray payload_;             // 共享的负载缓冲区
+  QTimer *timer_ = nullptr;        // 发布节拍定时器
+  qint64 last_tick_ns_ = 0;        // 上一个节拍的时刻
+  double connect_rate_ = 0;        // 本线程每秒建立的连接数
+  double connect_credit_ = 0;      // 可发起的连接数
+  int next_connect_ = 0;           // 下一个发起连接的会话
+  bool publishing_ = true;         // 是否继续发布
+};
+
+QJsonObject latencyJson(const MqttLatencyStats &stats) {
+  QJsonObject object;
+  object["samples"] = static_cast<qint64>(stats.count);
+  object["mean"] = stats.mean_us;
+  object["p50"] = stats.p50_us;
+  object["p90"] = stats.p90_us;
+  object["p99"] = stats.p99_us;
+  object["p999"] = stats.p999_us;
+  object["max"] = stats.max_us;
+  return object;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  QCoreApplication app(argc, argv);
+  QCoreApplication::setApplicationName("mqtt_loadgen");
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription("Simulate many MQTT clients against a local broker");
+  parser.addHelpOption();
+  parser.addOption(QCommandLineOption("host", "Broker host.", "host", "127.0.0.1"));
+  parser.addOption(QCommandLineOption("port", "Broker port.", "port", "1883"));
+  parser.addOption(QCommandLineOption("sessions", "Number of simulated clients.", "n", "1000"));
+  parser.addOption(
+      QCommandLineOption("threads", "Worker threads.", "n", QString::number(qMax(1, QThread::idealThreadCount()))));
+  parser.addOption(QCommandLineOption("connect-rate", "New connections per second, 0 for all at once.", "n", "500"));
+  parser.addOption(QCommandLineOption("rate", "Messages per second per session.", "x", "1"));
+  parser.addOption(QCommandLineOption("topic", "Publish topic template.", "template", "loadgen/{session}/data"));
+  parser.addOption(QCommandLineOption("payload", "Payload size: N, MIN-MAX or exp:MEAN.", "spec", "256"));
+  parser.addOption(QCommandLineOption("qos", "Publish and subscribe QoS.", "n", "0"));
+  parser.addOption(QCommandLineOption("subscribe", "Subscription filter template.", "template"));
+  parser.addOption(QCommandLineOption("subscribers", "Sessions that subscribe, default all.", "n"));
+  parser.addOption(QCommandLineOption("window", "Publish inflight window per session.", "n", "100"));
+  parser.addOption(QCommandLineOption("duration", "Run time in seconds, 0 until interrupted.", "secs", "60"));
+  parser.addOption(QCommandLineOption("output", "Write JSON to file instead of stdout.", "file"));
+  parser.process(app);
+
+  LoadConfig config;
+  config.host = parser.value("host");
+  config.port = parser.value("port").toInt();
+  config.sessions = qMax(1, parser.value("sessions").toInt());
+  config.threads = qBound(1, parser.value("threads").toInt(), config.sessions);
+  config.connect_rate = parser.value("connect-rate").toDouble();
+  config.rate = qMax(0.0, parser.value("rate").toDouble());
+  config.topic = parser.value("topic");
+  config.subscribe = parser.value("subscribe");
+  config.subscribers = parser.isSet("subscribers") ? parser.value("subscribers").toInt() : config.sessions;
+  config.qos = qBound(0, parser.value("qos").toInt(), 2);
+  config.window = parser.value("window").toInt();
+  if (!config.payload.parse(parser.value("payload"))) {
+    fprintf(stderr, "invalid --payload %s\n", qPrintable(parser.value("payload")));
+    return 1;
+  }
+
+  std::signal(SIGINT, onSignal);
+  std::signal(SIGTERM, onSignal);
+
+  LoadTotals totals;
+  QVector<QThread *> threads;
+  QVector<LoadWorker *> workers;
+  for (int i = 0; i < config.threads; ++i) {
+    const int first = static_cast<int>(qint64(config.sessions) * i / config.threads);
+    const int last = static_cast<int>(qint64(config.sessions) * (i + 1) / config.threads);
+    LoadWorker *worker = new LoadWorker(config, &totals, i, first, last - first);
+    QThread *thread = new QThread();
+    worker->moveToThread(thread);
+    thread->start();
+    QMetaObject::invokeMethod(worker, [worker]() { worker->start(); }, Qt::QueuedConnection);
+    threads.append(thread);
+    workers.append(worker);
+  }
+
+  // 每秒输出一次汇总
+  QJsonArray timeline;
+  const qint64 duration_ns = parser.value("duration").toLongLong() * 1000000000LL;
+  const qint64 start_ns = mqttMonotonicNs();
+  qint64 last_ns = start_ns;
+  qint64 last_published = 0, last_acked = 0, last_received = 0, last_bytes = 0;
+  while (!g_stop.load() && (duration_ns <= 0 || last_ns - start_ns < duration_ns)) {
+    QThread::msleep(1000 - static_cast<unsigned long>((mqttMonotonicNs() - start_ns) / 1000000 % 1000));
+    const qint64 now = mqttMonotonicNs();
+    const double secs = (now - last_ns) / 1e9;
+    last_ns = now;
+
+    const qint64 published = totals.published.load(std::memory_order_relaxed);
+    const qint64 acked = totals.acked.load(std::memory_order_relaxed);
+    const qint64 received = totals.received.load(std::memory_order_relaxed);
+    const qint64 bytes = totals.published_bytes.load(std::memory_order_relaxed);
+    const MqttLatencyStats ack = totals.ack_latency.snapshot();
+
+    QJsonObject sample;
+    sample["t"] = qRound64((now - start_ns) / 1e9);
+    sample["connected"] = totals.connected.load(std::memory_order_relaxed);
+    sample["published_per_sec"] = (published - last_published) / secs;
+    sample["acked_per_sec"] = (acked - last_acked) / secs;
+    sample["received_per_sec"] = (received - last_received) / secs;
+    sample["publish_mb_per_sec"] = (bytes - last_bytes) / secs / (1024.0 * 1024.0);
+    sample["rejected"] = totals.rejected.load(std::memory_order_relaxed);
+    sample["failed"] = totals.failed.load(std::memory_order_relaxed);
+    timeline.append(sample);
+    fprintf(stderr,
+            "t=%-4lld connected=%-6lld pub=%9.0f/s ack=%9.0f/s recv=%9.0f/s %7.2f MB/s  ack p50=%.0fus p99=%.0fus\n",
+            static_cast<long long>(sample["t"].toDouble()), static_cast<long long>(sample["connected"].toDouble()),
+            sample["published_per_sec"].toDouble(), sample["acked_per_sec"].toDouble(),
+            sample["received_per_sec"].toDouble(), sample["publish_mb_per_sec"].toDouble(), ack.p50_us, ack.p99_us);
+
+    last_published = published;
+    last_acked = acked;
+    last_received = received;
+    last_bytes = bytes;
+  }
+
+  // 先停止发布，留出时间收取最后的确认，再断开全部会话
+  for (LoadWorker *worker : workers) {
+    QMetaObject::invokeMethod(worker, [worker]() { worker->setPublishing(false); }, Qt::BlockingQueuedConnection);
+  }
+  QThread::msleep(kDrainMs);
+  const qint64 elapsed_ns = mqttMonotonicNs() - start_ns;
+  for (int i = 0; i < workers.size(); ++i) {
+    LoadWorker *worker = workers.at(i);
+    QMetaObject::invokeMethod(worker, [worker]() { worker->stop(); }, Qt::BlockingQueuedConnection);
+    QObject::connect(threads.at(i), &QThread::finished, worker, &QObject::deleteLater);
+    threads.at(i)->quit();
+  }
+  for (QThread *thread : threads) {
+    thread->wait();
+    delete thread;
+  }
+
+  const qint64 published = totals.published.load();
+  QJsonObject report;
+  report["tool"] = "mqtt_loadgen";
+  report["format_version"] = 1;
+  report["broker"] = QString("%1:%2").arg(config.host).arg(config.port);
+  report["timestamp"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+  report["qt_version"] = qVersion();
+  report["sessions"] = config.sessions;
+  report["threads"] = config.threads;
+  report["rate_per_session"] = config.rate;
+  report["qos"] = config.qos;
+  report["payload"] = parser.value("payload");
+  report["seconds"] = elapsed_ns / 1e9;
+  report["connect_failed"] = totals.connect_failed.load();
+  report["published"] = published;
+  report["acked"] = totals.acked.load();
+  report["failed"] = totals.failed.load();
+  report["rejected"] = totals.rejected.load();
+  report["received"] = totals.received.load();
+  report["msgs_per_sec"] = elapsed_ns > 0 ? published * 1e9 / elapsed_ns : 0.0;
+  report["connect_latency_us"] = latencyJson(totals.connect_latency.snapshot());
+  report["ack_latency_us"] = latencyJson(totals.ack_latency.snapshot());
+  report["timeline"] = timeline;
+
+  QByteArray json = QJsonDocument(report).toJson(QJsonDocument::Indented);
+  if (parser.isSet("output")) {
+    QFile file(parser.value("output"));
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(json) != json.size()) {
+      fprintf(stderr, "cannot write %s\n", qPrintable(parser.value("output")));
+      return 1;
+    }
+  } else {
+    fwrite(json.constData(), 1, json.size(), stdout);
+  }
+  return 0;
+}
@@ -0,0 +1,559 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTemporaryDir>
+#include <QThread>
+#include <QTimer>
+#include <QVector>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+
+#include "MqttClient.h"
+#include "fake_mosquitto.h"
+#include "messagelogmodel.h"
+
+/*!
+ * \brief 客户端热点路径的进程内微基准
+ * 链接fake_mosquitto.cpp代替libmosquitto，客户端连接内存中的假代理，不需要网络和代理，只测量客户端代码本身：
+ *   - 入站：onMessage中主题、负载的拷贝，逐条/批量投递及跨线程信号，v3.1.1的自身消息过滤，
+ *     保留消息去重加上界面的接收逻辑（与MainWindow共用的acceptLogMessage()、makeLogEntry()及日志模型追加）；
+ *   - 出站：publish()中主题的toUtf8、v3.1.1的前缀拼接，跨线程发布队列，主题句柄及主题别名；
+ *   - 日志模型显示文本的格式化，以及跨线程invokeMethod本身的开销。
+ * 每个用例重复--repeat次，取耗时和分配次数的最小值，报告每次操作的纳秒数和堆分配次数
+ * （替换glibc的malloc系列函数计数，包括客户端线程中的分配）。
+ * 指定--baseline时与保存的结果对比，耗时超出--tolerance或分配次数增加即为退化，进程返回1；
+ * 基准文件中没有的用例标为NOT IN BASELINE并在标准错误中提示；
+ * --save-baseline把本次结果写入文件，作为之后对比的基准。
+ * 用法：mqtt_microbench [--messages 200000] [--repeat 3] [--filter name] [--baseline file]
+ *                       [--save-baseline file] [--tolerance 0.15]
+ */
+
+#ifdef __GLIBC__
+namespace {
+std::atomic<quint64> g_allocations{0};  // 进程内的堆分配次数
+}
+
+// 转发给glibc的实现；operator new及Qt容器的分配都经过malloc
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void __libc_free(void *ptr);
+
+void *malloc(size_t size) noexcept {
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) noexcept {
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) noexcept {
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) noexcept { __libc_free(ptr); }
+}  // extern "C"
+#else
+#error "mqtt_microbench counts allocations by interposing glibc malloc"
+#endif
+
+namespace {
+
+const int kConnectTimeoutMs = 10000;  // 连接假代理的超时
+const int kRunTimeoutMs = 60000;      // 单次运行的超时
+const int kHeartbeatMs = 50;          // 主线程等待事件的最长阻塞时间，用于检查超时
+const int kTopicCount = 64;           // 入站消息的主题数
+const int kPayloadSize = 64;          // 消息负载大小
+const int kLogRows = 10000;           // 日志模型的行数
+const double kAllocSlack = 0.05;      // 每次操作的分配次数允许的误差
+
+struct Options {
+  qint64 messages = 0;  // 每次运行的操作数
+  int repeat = 0;       // 重复次数
+};
+
+// 每次操作的开销
+struct Result {
+  bool ok = false;           // 是否运行成功
+  double ns_per_op = 0;      // 每次操作的纳秒数
+  double allocs_per_op = 0;  // 每次操作的堆分配次数
+};
+
+// 运行在独立线程中的客户端
+struct BenchClient {
+  MqttClient *client = nullptr;
+  QThread *thread = nullptr;
+  std::atomic<bool> connected{false};
+};
+
+// 轮询等待，条件由客户端线程推进
+bool waitUntil(const std::function<bool()> &done, int timeout_ms) {
+  qint64 deadline = mqttMonotonicNs() + qint64(timeout_ms) * 1000000;
+  while (!done()) {
+    if (mqttMonotonicNs() > deadline) {
+      return false;
+    }
+    QThread::msleep(1);
+  }
+  return true;
+}
+
+// 处理主线程事件直到条件满足，条件由主线程中的槽函数推进
+bool processEventsUntil(const std::function<bool()> &done, int timeout_ms) {
+  QTimer heartbeat;
+  heartbeat.start(kHeartbeatMs);
+  qint64 deadline = mqttMonotonicNs() + qint64(timeout_ms) * 1000000;
+  while (!done()) {
+    if (mqttMonotonicNs() > deadline) {
+      return false;
+    }
+    QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+  }
+  return true;
+}
+
+// 等待客户端线程处理完此前投递给它的事件
+void barrier(MqttClient *client) { QMetaObject::invokeMethod(client, []() {}, Qt::BlockingQueuedConnection); }
+
+bool startClient(BenchClient *bench, MqttClient::DeliveryMode mode, MqttClient::ProtocolVersion version,
+                 const std::function<void(MqttClient *)> &setup = std::function<void(MqttClient *)>()) {
+  bench->client = new MqttClient();
+  bench->client->setDeliveryMode(mode);
+  bench->client->setProtocolVersion(version);
+  bench->client->setMaxInflightMessages(0);
+  if (setup) {
+    setup(bench->client);
+  }
+  bench->thread = new QThread();
+  bench->client->moveToThread(bench->thread);
+  QObject::connect(bench->thread, &QThread::finished, bench->client, &QObject::deleteLater);
+  std::atomic<bool> *connected = &bench->connected;
+  QObject::connect(bench->client, &MqttClient::connected, [connected]() { connected->store(true); });
+  bench->thread->start();
+
+  // 字面IP不经过DNS解析和探测竞速，直接调用假代理的连接函数
+  bench->client->connectToBroker("127.0.0.1", 1883, 60, 1);
+  return waitUntil([bench]() { return bench->connected.load(); }, kConnectTimeoutMs);
+}
+
+void stopClient(BenchClient *bench) {
+  if (!bench->thread) {
+    return;
+  }
+  MqttClient *client = bench->client;
+  QMetaObject::invokeMethod(client, [client]() { client->disconnectFromBroker(); }, Qt::BlockingQueuedConnection);
+  bench->thread->quit();
+  bench->thread->wait();
+  delete bench->thread;
+  bench->thread = nullptr;
+  bench->client = nullptr;
+}
+
+// 订阅在客户端线程中发给假代理，屏障返回后订阅已生效
+void subscribe(BenchClient *bench, const QString &filter) {
+  bench->client->subscribe(filter, 0);
+  barrier(bench->client);
+}
+
+QVector<QByteArray> makeTopics() {
+  QVector<QByteArray> topics;
+  for (int i = 0; i < kTopicCount; ++i) {
+    topics.append("bench/device/" + QByteArray::number(i) + "/telemetry");
+  }
+  return topics;
+}
+
+QByteArray makePayload() { return QByteArray(kPayloadSize, 'x'); }
+
+// 运行options.repeat次，分别取每次操作耗时和分配次数的最小值（第一次运行兼作预热）
+Result measure(const Options &options, const std::function<bool()> &run) {
+  Result best;
+  for (int i = 0; i < options.repeat; ++i) {
+    const quint64 allocations = g_allocations.load(std::memory_order_relaxed);
+    const qint64 start_ns = mqttMonotonicNs();
+    if (!run()) {
+      best.ok = false;
+      return best;
+    }
+    const double ns_per_op = static_cast<double>(mqttMonotonicNs() - start_ns) / options.messages;
+    const double allocs_per_op =
+        static_cast<double>(g_allocations.load(std::memory_order_relaxed) - allocations) / options.messages;
+    best.ns_per_op = best.ok ? qMin(best.ns_per_op, ns_per_op) : ns_per_op;
+    best.allocs_per_op = best.ok ? qMin(best.allocs_per_op, allocs_per_op) : allocs_per_op;
+    best.ok = true;
+  }
+  return best;
+}
+
+// 逐条投递：每条消息构造QString主题、拷贝负载，经队列连接发到主线程
+Result benchInboundPerMessage(const Options &options) {
+  BenchClient bench;
+  Result result;
+  if (startClient(&bench, MqttClient::PerMessage, MqttClient::MQTTv5)) {
+    subscribe(&bench, "bench/#");
+    qint64 received = 0;
+    QObject receiver;
+    QObject::connect(bench.client, &MqttClient::messageReceived, &receiver,
+                     [&received](const QString &, const QByteArray &, int, bool) { ++received; });
+    const QVector<QByteArray> topics = makeTopics();
+    const QByteArray payload = makePayload();
+    result = measure(options, [&]() {
+      received = 0;
+      FakeMosquitto::publish(topics, payload, 0, false, options.messages);
+      return processEventsUntil([&]() { return received >= options.messages; }, kRunTimeoutMs);
+    });
+  }
+  stopClient(&bench);
+  return result;
+}
+
+// 批量投递：负载写入内存池、主题驻留，按批次跨线程投递
+Result benchInboundBatched(const Options &options) {
+  BenchClient bench;
+  Result result;
+  if (startClient(&bench, MqttClient::Batched, MqttClient::MQTTv5)) {
+    subscribe(&bench, "bench/#");
+    qint64 received = 0;
+    QObject receiver;
+    MqttClient *client = bench.client;
+    QObject::connect(client, &MqttClient::messagesReceived, &receiver,
+                     [&received, client](const MqttMessageBatch &batch) {
+                       client->acknowledgeDelivery(batch);
+                       received += batch.size();
+                     });
+    const QVector<QByteArray> topics = makeTopics();
+    const QByteArray payload = makePayload();
+    result = measure(options, [&]() {
+      received = 0;
+      FakeMosquitto::publish(topics, payload, 0, false, options.messages);
+      return processEventsUntil([&]() { return received >= options.messages; }, kRunTimeoutMs);
+    });
+  }
+  stopClient(&bench);
+  return result;
+}
+
+// 按默认处理函数的格式把调试输出写到无缓冲的/dev/null，与写标准错误一样每条一次系统调用，
+// 计入acceptLogMessage()中调试输出的开销而不刷屏
+FILE *g_debug_sink = nullptr;
+
+void discardDebugOutput(QtMsgType type, const QMessageLogContext &context, const QString &text) {
+  fprintf(g_debug_sink, "%s\n", qPrintable(qFormatLogMessage(type, context, text)));
+}
+
+// 重复推送的保留消息：最新值缓存标记未变化的消息，接收方调用与MainWindow::onMessages()相同的
+// acceptLogMessage()（含其调试输出）跳过，其余消息由makeLogEntry()追加到日志模型（不含消息库写入）
+Result benchInboundRetainedDedup(const Options &options) {
+  QTemporaryDir dir;
+  BenchClient bench;
+  Result result;
+  if (dir.isValid() && startClient(&bench, MqttClient::Batched, MqttClient::MQTTv5, [&dir](MqttClient *client) {
+        client->enableRetainedCache(dir.filePath("retained.snapshot"));
+      })) {
+    subscribe(&bench, "bench/#");
+    qint64 received = 0;
+    qint64 accepted = 0;
+    MessageLogModel log_model(kLogRows);
+    MqttClient *client = bench.client;
+    QObject::connect(client, &MqttClient::messagesReceived, &log_model,
+                     [&received, &accepted, &log_model, client](const MqttMessageBatch &batch) {
+                       client->acknowledgeDelivery(batch);
+                       received += batch.size();
+                       for (const MqttMessage &msg : batch) {
+                         if (!acceptLogMessage(msg)) {
+                           continue;
+                         }
+                         log_model.append(makeLogEntry(msg));
+                         ++accepted;
+                       }
+                     });
+    const QVector<QByteArray> topics = makeTopics();
+    const QByteArray payload = makePayload();
+    g_debug_sink = fopen("/dev/null", "w");
+    if (g_debug_sink) {
+      setvbuf(g_debug_sink, nullptr, _IONBF, 0);
+      const QtMessageHandler previous = qInstallMessageHandler(discardDebugOutput);
+      result = measure(options, [&]() {
+        received = 0;
+        FakeMosquitto::publish(topics, payload, 0, true, options.messages);
+        return processEventsUntil([&]() { return received >= options.messages; }, kRunTimeoutMs);
+      });
+      qInstallMessageHandler(previous);
+      fclose(g_debug_sink);
+      g_debug_sink = nullptr;
+    }
+    // 只有每个主题的第一条消息会被接受
+    result.ok = result.ok && accepted == kTopicCount;
+  }
+  stopClient(&bench);
+  return result;
+}
+
+// v3.1.1自身消息过滤：负载以本客户端的前缀开头，在客户端线程中丢弃，不投递
+Result benchInboundEchoFilter(const Options &options) {
+  BenchClient bench;
+  Result result;
+  if (startClient(&bench, MqttClient::Batched, MqttClient::MQTTv311)) {
+    subscribe(&bench, "bench/#");
+    MqttClient *client = bench.client;
+    const QVector<QByteArray> topics = makeTopics();
+    const QByteArray payload = "[ClientID:" + client->clientId().toUtf8() + "]" + makePayload();
+    result = measure(options, [&]() {
+      const quint64 target = client->stats().echo_filtered + options.messages;
+      FakeMosquitto::publish(topics, payload, 0, false, options.messages);
+      return waitUntil([client, target]() { return client->stats().echo_filtered >= target; }, kRunTimeoutMs);
+    });
+  }
+  stopClient(&bench);
+  return result;
+}
+
+// 日志模型生成显示文本：时间戳格式化、解码负载及QString拼接
+Result benchLogModelFormat(const Options &options) {
+  MessageLogModel log_model(kLogRows);
+  const QVector<QByteArray> topics = makeTopics();
+  const QByteArray payload = makePayload();
+  for (int i = 0; i < kLogRows; ++i) {
+    MessageLogModel::Entry entry;
+    entry.timestamp = 1700000000000LL + i;
+    entry.topic = QString::fromUtf8(topics.at(i % topics.size()));
+    entry.payload = payload;
+    entry.retain = i % 2 == 0;
+    log_model.append(entry);
+  }
+  Result result;
+  if (!processEventsUntil([&log_model]() { return log_model.rowCount() == kLogRows; }, kRunTimeoutMs)) {
+    return result;
+  }
+  qint64 checksum = 0;
+  result = measure(options, [&]() {
+    for (qint64 i = 0; i < options.messages; ++i) {
+      checksum += log_model.data(log_model.index(static_cast<int>(i % kLogRows)), Qt::DisplayRole).toString().size();
+    }
+    return true;
+  });
+  result.ok = result.ok && checksum > 0;
+  return result;
+}
+
+// 在客户端线程中逐条发布：主题toUtf8、发布凭据及提交给libmosquitto
+Result benchPublish(const Options &options, MqttClient::ProtocolVersion version) {
+  BenchClient bench;
+  Result result;
+  if (startClient(&bench, MqttClient::Batched, version)) {
+    MqttClient *client = bench.client;
+    const QString topic = "bench/device/0/command";
+    const QByteArray payload = makePayload();
+    result = measure(options, [&]() {
+      bool ok = true;
+      QMetaObject::invokeMethod(client, [&]() {
+        for (qint64 i = 0; i < options.messages; ++i) {
+          ok = client->publish(topic, payload).status() != MqttPublishToken::Failed && ok;
+        }
+      }, Qt::BlockingQueuedConnection);
+      return ok;
+    });
+  }
+  stopClient(&bench);
+  return result;
+}
+
+Result benchPublishClientThread(const Options &options) { return benchPublish(options, MqttClient::MQTTv5); }
+
+Result benchPublishV311Prefix(const Options &options) { return benchPublish(options, MqttClient::MQTTv311); }
+
+// 在主线程发布：经无锁发布队列交给客户端线程批量发送
+Result benchPublishCrossThread(const Options &options) {
+  BenchClient bench;
+  Result result;
+  if (startClient(&bench, MqttClient::Batched, MqttClient::MQTTv5)) {
+    MqttClient *client = bench.client;
+    const QString topic = "bench/device/0/command";
+    const QByteArray payload = makePayload();
+    result = measure(options, [&]() {
+      const quint64 target = client->stats().messages_out + options.messages;
+      for (qint64 i = 0; i < options.messages; ++i) {
+        client->publish(topic, payload);
+      }
+      return waitUntil([client, target]() { return client->stats().messages_out >= target; }, kRunTimeoutMs);
+    });
+  }
+  stopClient(&bench);
+  return result;
+}
+
+// 使用主题句柄发布：不转换主题，达到阈值后只发送主题别名
+Result benchPublishTopicHandle(const Options &options) {
+  BenchClient bench;
+  Result result;
+  if (startClient(&bench, MqttClient::Batched, MqttClient::MQTTv5)) {
+    MqttClient *client = bench.client;
+    const MqttTopic topic = client->topic("bench/device/0/command");
+    const QByteArray payload = makePayload();
+    result = measure(options, [&]() {
+      bool ok = true;
+      QMetaObject::invokeMethod(client, [&]() {
+        for (qint64 i = 0; i < options.messages; ++i) {
+          ok = client->publishTopic(topic, payload).status() != MqttPublishToken::Failed && ok;
+        }
+      }, Qt::BlockingQueuedConnection);
+      return ok;
+    });
+  }
+  stopClient(&bench);
+  return result;
+}
+
+// 主线程到客户端线程的队列调用，即跨线程转发连接、订阅等请求的开销
+Result benchInvokeMethodHop(const Options &options) {
+  BenchClient bench;
+  Result result;
+  if (startClient(&bench, MqttClient::Batched, MqttClient::MQTTv5)) {
+    MqttClient *client = bench.client;
+    std::atomic<qint64> handled{0};
+    result = measure(options, [&]() {
+      handled.store(0);
+      for (qint64 i = 0; i < options.messages; ++i) {
+        QMetaObject::invokeMethod(client, [&handled]() { handled.fetch_add(1, std::memory_order_relaxed); },
+                                  Qt::QueuedConnection);
+      }
+      return waitUntil([&handled, &options]() { return handled.load() >= options.messages; }, kRunTimeoutMs);
+    });
+  }
+  stopClient(&bench);
+  return result;
+}
+
+struct BenchCase {
+  const char *name;
+  Result (*run)(const Options &options);
+};
+
+const BenchCase kCases[] = {
+    {"inbound_per_message", benchInboundPerMessage},
+    {"inbound_batched", benchInboundBatched},
+    {"inbound_retained_dedup", benchInboundRetainedDedup},
+    {"inbound_echo_filter_v311", benchInboundEchoFilter},
+    {"log_model_format", benchLogModelFormat},
+    {"publish_client_thread", benchPublishClientThread},
+    {"publish_v311_prefix", benchPublishV311Prefix},
+    {"publish_cross_thread", benchPublishCrossThread},
+    {"publish_topic_handle", benchPublishTopicHandle},
+    {"invoke_method_hop", benchInvokeMethodHop},
+};
+
+QJsonObject loadBaseline(const QString &path, bool *ok) {
+  QFile file(path);
+  if (!file.open(QIODevice::ReadOnly)) {
+    *ok = false;
+    return QJsonObject();
+  }
+  const QJsonObject root = QJsonDocument::fromJson(file.readAll()).object();
+  *ok = root.value("tool").toString() == "mqtt_microbench";
+  return root.value("cases").toObject();
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  QCoreApplication app(argc, argv);
+  QCoreApplication::setApplicationName("mqtt_microbench");
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription("Per-operation cost of the client's hot paths against an in-memory broker");
+  parser.addHelpOption();
+  parser.addOption(QCommandLineOption("messages", "Operations per run.", "n", "200000"));
+  parser.addOption(QCommandLineOption("repeat", "Runs per case, the best run is reported.", "n", "3"));
+  parser.addOption(QCommandLineOption("filter", "Only run cases whose name contains this text.", "text"));
+  parser.addOption(QCommandLineOption("baseline", "Compare with results saved by --save-baseline.", "file"));
+  parser.addOption(QCommandLineOption("save-baseline", "Save results as a baseline.", "file"));
+  parser.addOption(QCommandLineOption("tolerance", "Allowed ns/op increase over the baseline.", "ratio", "0.15"));
+  parser.process(app);
+
+  Options options;
+  options.messages = qMax<qint64>(1, parser.value("messages").toLongLong());
+  options.repeat = qMax(1, parser.value("repeat").toInt());
+  const double tolerance = qMax(0.0, parser.value("tolerance").toDouble());
+
+  QJsonObject baseline;
+  if (parser.isSet("baseline")) {
+    bool ok = false;
+    baseline = loadBaseline(parser.value("baseline"), &ok);
+    if (!ok) {
+      fprintf(stderr, "cannot read baseline %s\n", qPrintable(parser.value("baseline")));
+      return 1;
+    }
+  }
+
+  printf("%-26s %12s %12s %10s %10s\n", "case", "ns/op", "allocs/op", "ns delta", "allocs +/-");
+  QJsonObject cases;
+  int regressions = 0;
+  int failures = 0;
+  int missing_cases = 0;
+  for (const BenchCase &bench_case : kCases) {
+    const QString name = bench_case.name;
+    if (parser.isSet("filter") && !name.contains(parser.value("filter"))) {
+      continue;
+    }
+    const Result result = bench_case.run(options);
+    if (!result.ok) {
+      printf("%-26s %12s\n", bench_case.name, "FAILED");
+      ++failures;
+      continue;
+    }
+    QJsonObject entry;
+    entry["ns_per_op"] = result.ns_per_op;
+    entry["allocs_per_op"] = result.allocs_per_op;
+    cases[name] = entry;
+
+    if (!baseline.contains(name)) {
+      // 基准文件中没有的用例无从对比，明确标出，避免被当作通过
+      const bool missing = parser.isSet("baseline");
+      missing_cases += missing ? 1 : 0;
+      printf("%-26s %12.1f %12.2f%s\n", bench_case.name, result.ns_per_op, result.allocs_per_op,
+             missing ? "  NOT IN BASELINE" : "");
+      fflush(stdout);
+      continue;
+    }
+    const QJsonObject base = baseline.value(name).toObject();
+    const double base_ns = base.value("ns_per_op").toDouble();
+    const double base_allocs = base.value("allocs_per_op").toDouble();
+    const bool regressed =
+        result.ns_per_op > base_ns * (1 + tolerance) || result.allocs_per_op > base_allocs + kAllocSlack;
+    regressions += regressed ? 1 : 0;
+    printf("%-26s %12.1f %12.2f %+9.1f%% %+10.2f%s\n", bench_case.name, result.ns_per_op, result.allocs_per_op,
+           base_ns > 0 ? (result.ns_per_op / base_ns - 1) * 100 : 0.0, result.allocs_per_op - base_allocs,
+           regressed ? "  REGRESSION" : "");
+    fflush(stdout);
+  }
+
+  if (parser.isSet("save-baseline")) {
+    QJsonObject report;
+    report["tool"] = "mqtt_microbench";
+    report["format_version"] = 1;
+    report["messages"] = options.messages;
+    report["cases"] = cases;
+    QFile file(parser.value("save-baseline"));
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) ||
+        file.write(QJsonDocument(report).toJson(QJsonDocument::Indented)) < 0) {
+      fprintf(stderr, "cannot write %s\n", qPrintable(parser.value("save-baseline")));
+      return 1;
+    }
+  }
+  if (regressions > 0) {
+    fprintf(stderr, "%d case(s) regressed against %s\n", regressions, qPrintable(parser.value("baseline")));
+  }
+  if (missing_cases > 0) {
+    fprintf(stderr, "%d case(s) not in %s were not compared, save a new baseline to cover them\n", missing_cases,
+            qPrintable(parser.value("baseline")));
+  }
+  return regressions > 0 || failures > 0 ? 1 : 0;
+}
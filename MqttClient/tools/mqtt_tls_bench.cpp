@@ -0,0 +1,181 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QThread>
+#include <atomic>
+#include <cstdio>
+
+#include "MqttClient.h"
+
+/*!
+ * \brief TLS握手基准测试
+ * 对同一个MqttClient反复连接、断开本地代理的TLS端口，分别在关闭和开启会话复用时统计：
+ *   - TLS握手耗时：握手开始到完成（含网络往返），取自客户端的tls_handshake_latency；
+ *   - 连接耗时：调用connectToBroker()到收到CONNACK；
+ *   - 完整握手与复用握手的次数。
+ * 代理需开启TLS监听，例如mosquitto.conf中：
+ *   listener 8883
+ *   cafile ca.crt
+ *   certfile server.crt
+ *   keyfile server.key
+ * PSK模式需在代理上配置psk_hint和psk_file。
+ * 结果以JSON输出。
+ * 用法：mqtt_tls_bench --cafile ca.crt [--host localhost] [--port 8883] [--count 200]
+ *                      [--tls-version tlsv1.3] [--ciphers list] [--insecure]
+ *       mqtt_tls_bench --psk-identity id --psk hexkey [--port 8884] [--count 200]
+ */
+
+namespace {
+
+const int kConnectTimeoutMs = 10000;  // 单次连接超时
+
+// 运行在独立线程中的客户端
+struct BenchClient {
+  MqttClient *client = nullptr;
+  QThread *thread = nullptr;
+  std::atomic<bool> connected{false};
+  std::atomic<bool> failed{false};
+};
+
+bool waitUntil(const std::atomic<bool> &flag, const std::atomic<bool> &failed, int timeout_ms) {
+  qint64 deadline = mqttMonotonicNs() + qint64(timeout_ms) * 1000000;
+  while (!flag.load(std::memory_order_acquire)) {
+    if (failed.load(std::memory_order_acquire) || mqttMonotonicNs() > deadline) {
+      return false;
+    }
+    QThread::usleep(100);
+  }
+  return true;
+}
+
+QJsonObject latencyJson(const MqttLatencyStats &stats) {
+  QJsonObject object;
+  object["samples"] = static_cast<qint64>(stats.count);
+  object["mean"] = stats.mean_us;
+  object["p50"] = stats.p50_us;
+  object["p90"] = stats.p90_us;
+  object["p99"] = stats.p99_us;
+  object["max"] = stats.max_us;
+  return object;
+}
+
+bool configureTls(MqttClient *client, const QCommandLineParser &parser) {
+  if (parser.isSet("psk")) {
+    if (!client->enableTlsPsk(parser.value("psk-identity"), parser.value("psk"), parser.value("ciphers"))) {
+      return false;
+    }
+  } else {
+    client->enableSSL(parser.value("cafile"), parser.value("cert"), parser.value("key"));
+  }
+  return client->setTlsOptions(!parser.isSet("insecure"), parser.value("tls-version"),
+                               parser.isSet("psk") ? QString() : parser.value("ciphers"));
+}
+
+// 反复连接并断开，返回该模式的统计结果，失败时返回空对象
+QJsonObject runMode(const QCommandLineParser &parser, bool resumption, int count) {
+  BenchClient bench;
+  bench.client = new MqttClient();
+  bench.client->setTlsSessionResumption(resumption);
+  if (!configureTls(bench.client, parser)) {
+    delete bench.client;
+    return QJsonObject();
+  }
+  bench.thread = new QThread();
+  bench.client->moveToThread(bench.thread);
+  QObject::connect(bench.thread, &QThread::finished, bench.client, &QObject::deleteLater);
+  std::atomic<bool> *connected = &bench.connected;
+  std::atomic<bool> *failed = &bench.failed;
+  QObject::connect(bench.client, &MqttClient::connected, [connected]() { connected->store(true); });
+  QObject::connect(bench.client, &MqttClient::connectionFailed, [failed](const QString &) { failed->store(true); });
+  bench.thread->start();
+
+  const QString host = parser.value("host");
+  const int port = parser.value("port").toInt();
+  MqttClient *client = bench.client;
+  MqttLatencyHistogram connect_latency;
+  bool ok = true;
+  for (int i = 0; i < count && ok; ++i) {
+    bench.connected.store(false);
+    bench.failed.store(false);
+    const qint64 start_ns = mqttMonotonicNs();
+    client->connectToBroker(host, port, 60, 1);
+    ok = waitUntil(bench.connected, bench.failed, kConnectTimeoutMs);
+    if (ok) {
+      connect_latency.record(mqttMonotonicNs() - start_ns);
+    }
+    QMetaObject::invokeMethod(client, [client]() { client->disconnectFromBroker(); }, Qt::BlockingQueuedConnection);
+  }
+
+  const MqttStats stats = client->stats();
+  bench.thread->quit();
+  bench.thread->wait();
+  delete bench.thread;
+  if (!ok) {
+    return QJsonObject();
+  }
+
+  QJsonObject result;
+  result["session_resumption"] = resumption;
+  result["connects"] = count;
+  result["full_handshakes"] = static_cast<qint64>(stats.tls_handshakes);
+  result["resumed_handshakes"] = static_cast<qint64>(stats.tls_resumed);
+  result["handshake_us"] = latencyJson(stats.tls_handshake_latency);
+  result["connect_us"] = latencyJson(connect_latency.snapshot());
+  return result;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  QCoreApplication app(argc, argv);
+  QCoreApplication::setApplicationName("mqtt_tls_bench");
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription("Compare full and resumed TLS handshakes against a local broker");
+  parser.addHelpOption();
+  parser.addOption(QCommandLineOption("host", "Broker host.", "host", "localhost"));
+  parser.addOption(QCommandLineOption("port", "Broker TLS port.", "port", "8883"));
+  parser.addOption(QCommandLineOption("count", "Connections per mode.", "n", "200"));
+  parser.addOption(QCommandLineOption("cafile", "CA certificate.", "file"));
+  parser.addOption(QCommandLineOption("cert", "Client certificate.", "file"));
+  parser.addOption(QCommandLineOption("key", "Client private key.", "file"));
+  parser.addOption(QCommandLineOption("psk-identity", "PSK identity, use PSK instead of certificates.", "id"));
+  parser.addOption(QCommandLineOption("psk", "PSK key in hex.", "hex"));
+  parser.addOption(QCommandLineOption("tls-version", "Pinned TLS version, tlsv1.2 or tlsv1.3.", "version"));
+  parser.addOption(QCommandLineOption("ciphers", "Pinned cipher list.", "list"));
+  parser.addOption(QCommandLineOption("insecure", "Do not verify the broker certificate."));
+  parser.process(app);
+
+  if (!parser.isSet("cafile") && !parser.isSet("psk")) {
+    fprintf(stderr, "either --cafile or --psk-identity and --psk is required\n");
+    return 1;
+  }
+  const int count = qMax(1, parser.value("count").toInt());
+
+  QJsonObject report;
+  report["tool"] = "mqtt_tls_bench";
+  report["format_version"] = 1;
+  report["mode"] = parser.isSet("psk") ? "psk" : "certificate";
+  QJsonArray runs;
+  for (bool resumption : {false, true}) {
+    QJsonObject result = runMode(parser, resumption, count);
+    if (result.isEmpty()) {
+      fprintf(stderr, "cannot connect to %s:%s over TLS\n", qPrintable(parser.value("host")),
+              qPrintable(parser.value("port")));
+      return 1;
+    }
+    runs.append(result);
+  }
+  report["runs"] = runs;
+  const double full_us = runs.at(0).toObject()["handshake_us"].toObject()["p50"].toDouble();
+  const double resumed_us = runs.at(1).toObject()["handshake_us"].toObject()["p50"].toDouble();
+  if (resumed_us > 0) {
+    report["handshake_p50_speedup"] = full_us / resumed_us;
+  }
+
+  QByteArray json = QJsonDocument(report).toJson(QJsonDocument::Indented);
+  fwrite(json.constData(), 1, json.size(), stdout);
+  return 0;
+}
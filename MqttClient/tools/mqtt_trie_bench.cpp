@@ -0,0 +1,101 @@
+#include <QByteArray>
+#include <QByteArrayList>
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+#include <QVector>
+#include <cstdio>
+#include <cstdlib>
+
+#include "TopicTrie.h"
+
+/*!
+ * \brief 主题前缀树基准测试
+ * 注册大量订阅过滤器（默认10万条，含'+'和'#'通配符），分别用前缀树和逐条匹配
+ * 统计每个主题的匹配耗时。
+ * 用法：mqtt_trie_bench [过滤器数量] [主题数量]
+ */
+
+namespace {
+
+// 生成形如 plant/3/line/12/cell/7/sensor/temperature 的层级
+QByteArray makeTopic(QRandomGenerator &rng, int plants, int lines, int cells) {
+  static const char *kSensors[] = {"temperature", "pressure", "humidity", "vibration", "current"};
+  return QByteArray("plant/") + QByteArray::number(rng.bounded(plants)) + "/line/" +
+         QByteArray::number(rng.bounded(lines)) + "/cell/" + QByteArray::number(rng.bounded(cells)) + "/sensor/" +
+         kSensors[rng.bounded(5)];
+}
+
+QByteArray makeFilter(QRandomGenerator &rng, int plants, int lines, int cells) {
+  QList<QByteArray> levels = makeTopic(rng, plants, lines, cells).split('/');
+  // 约三成过滤器带通配符
+  int kind = rng.bounded(10);
+  if (kind == 0) {
+    levels[3] = "+";
+  } else if (kind == 1) {
+    levels[7] = "+";
+  } else if (kind == 2) {
+    levels = levels.mid(0, 6);
+    levels.append("#");
+  }
+  return levels.join('/');
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  int filter_count = argc > 1 ? atoi(argv[1]) : 100000;
+  int topic_count = argc > 2 ? atoi(argv[2]) : 1000000;
+  const int plants = 10, lines = 50, cells = 200;
+
+  QRandomGenerator rng(42);
+  QVector<QByteArray> filters;
+  filters.reserve(filter_count);
+  for (int i = 0; i < filter_count; ++i) {
+    filters.append(makeFilter(rng, plants, lines, cells));
+  }
+  QVector<QByteArray> topics;
+  topics.reserve(4096);
+  for (int i = 0; i < 4096; ++i) {
+    topics.append(makeTopic(rng, plants, lines, cells));
+  }
+
+  QElapsedTimer timer;
+  timer.start();
+  TopicTrie trie;
+  for (int i = 0; i < filters.size(); ++i) {
+    trie.insert(filters.at(i), i);
+  }
+  qint64 build_ns = timer.nsecsElapsed();
+
+  qint64 matched = 0;
+  timer.restart();
+  for (int i = 0; i < topic_count; ++i) {
+    trie.match(topics.at(i & 4095).constData(), [&matched](int) { ++matched; });
+  }
+  qint64 trie_ns = timer.nsecsElapsed();
+
+  // 逐条匹配作为对照，只取少量主题
+  const int linear_topics = qMin(topic_count, 200);
+  qint64 linear_matched = 0;
+  timer.restart();
+  for (int i = 0; i < linear_topics; ++i) {
+    const QByteArray &topic = topics.at(i & 4095);
+    for (const QByteArray &filter : filters) {
+      if (TopicTrie::matches(filter, topic)) {
+        ++linear_matched;
+      }
+    }
+  }
+  qint64 linear_ns = timer.nsecsElapsed();
+
+  double trie_per_topic = static_cast<double>(trie_ns) / topic_count;
+  double linear_per_topic = static_cast<double>(linear_ns) / linear_topics;
+  printf("filters:            %d\n", trie.size());
+  printf("build:              %.1f ms\n", build_ns / 1e6);
+  printf("trie match:         %.1f ns/topic (%.2f matches/topic)\n", trie_per_topic,
+         static_cast<double>(matched) / topic_count);
+  printf("linear match:       %.1f ns/topic (%.2f matches/topic)\n", linear_per_topic,
+         static_cast<double>(linear_matched) / linear_topics);
+  printf("speedup:            %.0fx\n", linear_per_topic / trie_per_topic);
+  return 0;
+}
@@ -1,15 +1,61 @@
 #include "mainwindow.h"
 
 #include <QDateTime>
-#include <QMessageBox>
+#include <QStandardPaths>
 #include <QTimer>
 
 #include "ui_mainwindow.h"
 
-MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), ui(new Ui::MainWindow), received_retained_messages_() {
+// 日志视图最多保留的消息条数
+static const int kMaxLogRows = 10000;
+// 查询最多显示的消息条数
+static const int kMaxQueryRows = 10000;
+// 消息存储的内存上限，超出部分溢出到磁盘
+static const qint64 kStoreMemoryBytes = 256 * 1024 * 1024;
+
+MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), ui(new Ui::MainWindow) {
   ui->setupUi(this);
+  log_model_ = new MessageLogModel(kMaxLogRows, this);
+  result_model_ = new MessageLogModel(kMaxQueryRows, this);
+  showModel(log_model_);
+
+  // 查询栏：主题过滤器、时间范围和内容子串
+  ui->comboBox_range->addItem(tr("全部时间"), 0);
+  ui->comboBox_range->addItem(tr("最近1分钟"), 60);
+  ui->comboBox_range->addItem(tr("最近10分钟"), 600);
+  ui->comboBox_range->addItem(tr("最近1小时"), 3600);
+  ui->comboBox_range->addItem(tr("最近24小时"), 86400);
+  connect(ui->pushButton_query, &QPushButton::clicked, this, &MainWindow::onQueryClicked);
+  connect(ui->lineEdit_filter, &QLineEdit::returnPressed, this, &MainWindow::onQueryClicked);
+  connect(ui->lineEdit_contains, &QLineEdit::returnPressed, this, &MainWindow::onQueryClicked);
+  connect(ui->pushButton_live, &QPushButton::clicked, this, &MainWindow::onLiveClicked);
+
   mqtt_thread_ = new QThread(this);
   mqtt_client_ = new MqttClient();
+  // 入站消息写入合并队列，由onMessagesAvailable()取走
+  mqtt_client_->setDeliveryMode(MqttClient::Conflated);
+  // 使用MQTT v5的no_local订阅过滤自身消息，代理不支持时自动回退到v3.1.1
+  mqtt_client_->setProtocolVersion(MqttClient::MQTTv5);
+  const QString data_dir = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation);
+  // 消息存储在独立线程中追加和查询，查询大量历史时界面不会卡顿
+  store_thread_ = new QThread(this);
+  store_worker_ = new MessageStoreWorker(data_dir + "/store", kStoreMemoryBytes);
+  store_worker_->moveToThread(store_thread_);
+  connect(store_thread_, &QThread::finished, store_worker_, &MessageStoreWorker::deleteLater);
+  connect(this, &MainWindow::requestStoreAppend, store_worker_, &MessageStoreWorker::append);
+  connect(this, &MainWindow::requestQuery, store_worker_, &MessageStoreWorker::query);
+  connect(store_worker_, &MessageStoreWorker::queryFinished, this, &MainWindow::onQueryFinished);
+  store_thread_->start();
+  // 断线期间的发布写入磁盘，重连后重发
+  mqtt_client_->enableOutbox(data_dir + "/outbox");
+  // 启动时先显示上次退出前缓存的各主题最新值
+  mqtt_client_->enableRetainedCache(data_dir + "/retained.snapshot");
+  showCachedMessages();
+  // 界面处理不过来时每个主题只显示最新值，积压不超过日志的最大行数
+  MqttConflator *conflator = mqtt_client_->enableConflation(kMaxLogRows);
+  conflator->addRule("#", true);
+  // 订阅由客户端记录，连接成功及重连后自动恢复
+  mqtt_client_->subscribe("mqttweb/demo", 1);
   mqtt_client_->moveToThread(mqtt_thread_);
 
   // 连接信号
@@ -17,7 +63,7 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), ui(new Ui::MainWi
   connect(this, &MainWindow::requestConnect, mqtt_client_, &MqttClient::connectToBroker);
   connect(this, &MainWindow::requestPublish, mqtt_client_, &MqttClient::publish);
   connect(mqtt_client_, &MqttClient::connected, this, &MainWindow::onConnected);
-  connect(mqtt_client_, &MqttClient::messageReceived, this, &MainWindow::onMessage);
+  connect(mqtt_client_->conflator(), &MqttConflator::messagesAvailable, this, &MainWindow::onMessagesAvailable);
   connect(mqtt_client_, &MqttClient::connectionFailed, this, &MainWindow::onConnectionFailed);
   connect(ui->pushButton, &QPushButton::clicked, this, &MainWindow::onButtonClicked);
   connect(ui->pushButton_2, &QPushButton::clicked, this, &MainWindow::onButton1Clicked);
@@ -39,6 +85,11 @@ MainWindow::~MainWindow() {
     mqtt_thread_->wait();
     delete mqtt_thread_;
   }
+  if (store_thread_) {
+    store_thread_->quit();
+    store_thread_->wait();
+    delete store_thread_;
+  }
   delete ui;
 }
 
@@ -50,60 +101,54 @@ void MainWindow::publishMessage() {
 
 void MainWindow::onConnected() {
   qDebug() << "成功连接到代理";
-  // 订阅示例主题
-  mqtt_client_->subscribe("mqttweb/demo", 1);
+  ui->statusbar->showMessage(tr("已连接"));
 
   // 发布初始消息
   mqtt_client_->publish("mqttclient/demo", QByteArray("Client connected"), 1, true);
 }
 
-void MainWindow::onMessage(const QString &topic, const QByteArray &payload, int qos, bool retain) {
-  // 情况1:过滤己方消息
-  QString message = QString::fromUtf8(payload).trimmed();
-  QString selfPrefix = "[ClientID:" + mqtt_client_->clientId() + "]";
-  if (payload.startsWith(selfPrefix.toUtf8())) {
-    qDebug() << "完整过滤自身消息:" << message;
-    return;
-  }
+void MainWindow::onMessagesAvailable() { onMessages(mqtt_client_->conflator()->take()); }
 
-  // 情况2: 处理未标识来源的消息
-  // 处理保留消息去重
-  if (retain) {
-    // 如果已记录过该主题的保留消息
-    if (received_retained_messages_.contains(topic)) {
-      qDebug() << "Ignored duplicate retained message on topic:" << topic;
-      return;
+void MainWindow::onMessages(const MqttMessageBatch &batch) {
+  mqtt_client_->acknowledgeDelivery(batch);
+  QVector<MqttMessageStore::Record> records;
+  records.reserve(batch.size());
+  for (const MqttMessage &msg : batch) {
+    if (!acceptLogMessage(msg)) {
+      continue;
     }
-    // 记录新主题的保留消息
-    received_retained_messages_.insert(topic);
-  }
 
-  // 处理QoS0消息的特殊情况
-  if (qos == 0 && message.contains(mqtt_client_->clientId())) {
-    qDebug() << "过滤QoS0自身消息：" << message;
-    return;
+    const MessageLogModel::Entry entry = makeLogEntry(msg);
+    log_model_->append(entry);
+
+    MqttMessageStore::Record record;
+    record.timestamp = entry.timestamp;
+    record.topic = entry.topic;
+    record.payload = entry.payload;
+    record.qos = entry.qos;
+    record.retain = entry.retain;
+    records.append(record);
   }
+  if (!records.isEmpty()) {
+    emit requestStoreAppend(records);
+  }
+}
 
-  // 使用明确的占位符顺序
-  // QString display_msg = QString("[QoS%1][%2] Topic: %3 | Message: %4")
-  //                           .arg(qos)                          // %1 → QoS等级
-  //                           .arg(retain ? "R" : " ")           // %2 → 保留标志（R/空格）
-  //                           .arg(topic)                        // %3 → 主题
-  //                           .arg(QString::fromUtf8(payload));  // %4 → 消息内容
-
-  QString display_msg = QString("[%1][QoS%2][%3] Topic: %4 | Message: %5")
-                            .arg(QDateTime::currentDateTime().toString("hh:mm:ss.zzz"))
-                            .arg(qos)
-                            .arg(retain ? "R" : " ")
-                            .arg(topic)
-                            .arg(message);
-  ui->textEdit_2->setText(ui->textEdit_2->toPlainText() + "\n" + display_msg);
-  qDebug() << display_msg;
+void MainWindow::showCachedMessages() {
+  for (const RetainedCache::Record &record : mqtt_client_->retainedCache()->query("#")) {
+    MessageLogModel::Entry entry;
+    entry.timestamp = record.timestamp;
+    entry.topic = record.topic;
+    entry.payload = record.payload;
+    entry.qos = record.qos;
+    entry.retain = record.retain;
+    log_model_->append(entry);
+  }
 }
 
 void MainWindow::onConnectionFailed(const QString &reason) {
-  // 显示错误对话框
-  QMessageBox::critical(this, tr("连接错误"), tr("无法连接到MQTT服务器：\n%1").arg(reason));
+  // 客户端会按退避时间自动重连，失败可能连续出现，显示在状态栏而不是弹出对话框
+  ui->statusbar->showMessage(tr("无法连接到MQTT服务器：%1").arg(reason));
 }
 
 void MainWindow::onButtonClicked() {
@@ -112,4 +157,63 @@ void MainWindow::onButtonClicked() {
   emit requestPublish("mqttclient/demo", text.toUtf8(), 1, true);
 }
 
-void MainWindow::onButton1Clicked() { ui->textEdit_2->clear(); }
+void MainWindow::onButton1Clicked() {
+  // 只清除视图，消息存储中的历史仍可查询
+  log_model_->clear();
+  result_model_->clear();
+}
+
+void MainWindow::onQueryClicked() {
+  MqttMessageStore::Query query;
+  query.filter = ui->lineEdit_filter->text().trimmed();
+  if (!query.filter.isEmpty() && !TopicTrie::isValidFilter(query.filter.toUtf8())) {
+    ui->statusbar->showMessage(tr("无效的主题过滤器：%1").arg(query.filter));
+    return;
+  }
+  const int range_secs = ui->comboBox_range->currentData().toInt();
+  if (range_secs > 0) {
+    query.from_ms = QDateTime::currentMSecsSinceEpoch() - range_secs * 1000LL;
+  }
+  query.contains = ui->lineEdit_contains->text().toUtf8();
+  query.limit = kMaxQueryRows;
+
+  // 结果由onQueryFinished()显示，再次查询或返回实时视图时丢弃尚未返回的结果
+  emit requestQuery(++query_id_, query);
+  ui->statusbar->showMessage(tr("正在查询…"));
+}
+
+void MainWindow::onQueryFinished(int id, const QVector<MqttMessageStore::Record> &records, bool truncated,
+                                 qint64 stored, qint64 elapsed_ms) {
+  if (id != query_id_) {
+    return;
+  }
+
+  result_model_->clear();
+  for (const MqttMessageStore::Record &record : records) {
+    MessageLogModel::Entry entry;
+    entry.timestamp = record.timestamp;
+    entry.topic = record.topic;
+    entry.payload = record.payload;
+    entry.qos = record.qos;
+    entry.retain = record.retain;
+    result_model_->append(entry);
+  }
+  showModel(result_model_);
+  const QString found = truncated ? tr("显示最新的%1条匹配消息") : tr("找到%1条消息");
+  ui->statusbar->showMessage(
+      tr("%1（共存储%2条，耗时%3毫秒）").arg(found.arg(records.size())).arg(stored).arg(elapsed_ms));
+}
+
+void MainWindow::onLiveClicked() {
+  ++query_id_;
+  showModel(log_model_);
+  ui->listView_log->scrollToBottom();
+  ui->statusbar->clearMessage();
+}
+
+void MainWindow::showModel(MessageLogModel *model) {
+  disconnect(scroll_connection_);
+  ui->listView_log->setModel(model);
+  // 每帧提交后滚动到底部；后台模型（如查询期间的实时日志）插入行时不滚动当前视图
+  scroll_connection_ = connect(model, &QAbstractItemModel::rowsInserted, ui->listView_log, &QListView::scrollToBottom);
+}
@@ -2,10 +2,11 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
-#include <QSet>
 #include <QThread>
 
 #include "MqttClient.h"
+#include "messagelogmodel.h"
+#include "messagestoreworker.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui {
@@ -20,6 +21,8 @@ class MainWindow : public QMainWindow {
   void requestConnect(const QString& host, int port, int keepalive, int max_retry, const QString& username,
                       const QString& password);
   void requestPublish(const QString& topic, const QByteArray& payload, int qos, bool retain);
+  void requestStoreAppend(const QVector<MqttMessageStore::Record>& records);
+  void requestQuery(int id, const MqttMessageStore::Query& query);
 
  public:
   MainWindow(QWidget* parent = nullptr);
@@ -28,16 +31,35 @@ class MainWindow : public QMainWindow {
 
  private slots:
   void onConnected();
-  void onMessage(const QString& topic, const QByteArray& payload, int qos, bool retain);
+  void onMessagesAvailable();
+  void onMessages(const MqttMessageBatch& batch);
   void onConnectionFailed(const QString& reason);
   void onButtonClicked();
   void onButton1Clicked();
+  void onQueryClicked();
+  void onLiveClicked();
+  void onQueryFinished(int id, const QVector<MqttMessageStore::Record>& records, bool truncated, qint64 stored,
+                       qint64 elapsed_ms);
 
  private:
+  /*!
+   * \brief 显示最新值缓存中的消息（来自上次退出时的快照）
+   */
+  void showCachedMessages();
+
+  /*!
+   * \brief 切换列表显示的模型，只有显示中的模型插入新行时才滚动到底部
+   */
+  void showModel(MessageLogModel* model);
+
   Ui::MainWindow* ui;
   MqttClient* mqtt_client_;
   QThread* mqtt_thread_;
-
-  QSet<QString> received_retained_messages_;
+  MessageLogModel* log_model_;
+  MessageLogModel* result_model_;
+  QMetaObject::Connection scroll_connection_;
+  QThread* store_thread_;
+  MessageStoreWorker* store_worker_;
+  int query_id_ = 0;
 };
 #endif  // MAINWINDOW_H
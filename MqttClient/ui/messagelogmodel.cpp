@@ -0,0 +1,149 @@
+#include "messagelogmodel.h"
+
+#include <QDateTime>
+#include <QDebug>
+
+#include "MqttCodec.h"
+
+// 提交间隔约为一帧（60Hz）
+static const int kCommitIntervalMs = 16;
+
+MessageLogModel::MessageLogModel(int max_rows, QObject *parent)
+    : QAbstractListModel(parent), max_rows_(qMax(1, max_rows)), commit_timer_(new QTimer(this)) {
+  ring_.resize(max_rows_);
+  commit_timer_->setInterval(kCommitIntervalMs);
+  commit_timer_->setSingleShot(true);
+  connect(commit_timer_, &QTimer::timeout, this, &MessageLogModel::commitPending);
+}
+
+void MessageLogModel::setMaxRows(int max_rows) {
+  max_rows = qMax(1, max_rows);
+  if (max_rows == max_rows_) {
+    return;
+  }
+
+  beginResetModel();
+  int keep = qMin(count_, max_rows);
+  QVector<Entry> ring(max_rows);
+  for (int i = 0; i < keep; ++i) {
+    ring[i] = entryAt(count_ - keep + i);
+  }
+  ring_.swap(ring);
+  head_ = 0;
+  count_ = keep;
+  max_rows_ = max_rows;
+  endResetModel();
+}
+
+int MessageLogModel::maxRows() const { return max_rows_; }
+
+void MessageLogModel::append(const Entry &entry) {
+  pending_.append(entry);
+  // 待提交消息超过上限时，最旧的消息提交后也会被立即丢弃，提前裁剪
+  if (pending_.size() >= max_rows_ * 2) {
+    pending_.remove(0, pending_.size() - max_rows_);
+  }
+  if (!commit_timer_->isActive()) {
+    commit_timer_->start();
+  }
+}
+
+void MessageLogModel::clear() {
+  commit_timer_->stop();
+  pending_.clear();
+  beginResetModel();
+  ring_ = QVector<Entry>(max_rows_);
+  head_ = 0;
+  count_ = 0;
+  endResetModel();
+}
+
+int MessageLogModel::rowCount(const QModelIndex &parent) const { return parent.isValid() ? 0 : count_; }
+
+QVariant MessageLogModel::data(const QModelIndex &index, int role) const {
+  if (!index.isValid() || index.row() >= count_) {
+    return QVariant();
+  }
+
+  const Entry &entry = entryAt(index.row());
+  switch (role) {
+    case Qt::DisplayRole:
+      // 滚动和重绘时同一行会被反复取值，解码和格式化只做一次
+      if (entry.text.isEmpty()) {
+        entry.text = QString("[%1][QoS%2][%3] Topic: %4 | Message: %5")
+                         .arg(QDateTime::fromMSecsSinceEpoch(entry.timestamp).toString("hh:mm:ss.zzz"))
+                         .arg(entry.qos)
+                         .arg(entry.retain ? "R" : " ")
+                         .arg(entry.topic)
+                         .arg(QString::fromUtf8(MqttCodec::decode(entry.payload)).trimmed());
+      }
+      return entry.text;
+    case Qt::ToolTipRole:
+      return entry.topic;
+    default:
+      return QVariant();
+  }
+}
+
+void MessageLogModel::commitPending() {
+  if (pending_.isEmpty()) {
+    return;
+  }
+
+  // 本帧到达的消息已超过上限，直接整体替换
+  if (pending_.size() >= max_rows_) {
+    beginResetModel();
+    int first = pending_.size() - max_rows_;
+    for (int i = 0; i < max_rows_; ++i) {
+      ring_[i] = pending_.at(first + i);
+    }
+    head_ = 0;
+    count_ = max_rows_;
+    pending_.clear();
+    endResetModel();
+    return;
+  }
+
+  int incoming = pending_.size();
+  int overflow = count_ + incoming - max_rows_;
+  if (overflow > 0) {
+    beginRemoveRows(QModelIndex(), 0, overflow - 1);
+    for (int i = 0; i < overflow; ++i) {
+      ring_[(head_ + i) % max_rows_] = Entry();
+    }
+    head_ = (head_ + overflow) % max_rows_;
+    count_ -= overflow;
+    endRemoveRows();
+  }
+
+  beginInsertRows(QModelIndex(), count_, count_ + incoming - 1);
+  for (int i = 0; i < incoming; ++i) {
+    ring_[(head_ + count_ + i) % max_rows_] = pending_.at(i);
+  }
+  count_ += incoming;
+  pending_.clear();
+  endInsertRows();
+}
+
+const MessageLogModel::Entry &MessageLogModel::entryAt(int row) const { return ring_.at((head_ + row) % max_rows_); }
+
+bool acceptLogMessage(const MqttMessage &msg) {
+  // 值未变化的保留消息（重连或启动时代理重复推送）已经显示过
+  if (msg.retain && msg.unchanged) {
+    qDebug() << "Ignored unchanged retained message on topic:" << msg.topic;
+    return false;
+  }
+
+  return true;
+}
+
+MessageLogModel::Entry makeLogEntry(const MqttMessage &msg) {
+  // 只保存原始字段，显示文本在视图绘制时生成
+  MessageLogModel::Entry entry;
+  entry.timestamp = msg.timestamp;
+  entry.topic = msg.topic;
+  entry.payload = msg.payloadCopy();
+  entry.qos = msg.qos;
+  entry.retain = msg.retain;
+  return entry;
+}
@@ -0,0 +1,90 @@
+#ifndef MESSAGELOGMODEL_H
+#define MESSAGELOGMODEL_H
+
+#include <QAbstractListModel>
+#include <QByteArray>
+#include <QString>
+#include <QTimer>
+#include <QVector>
+
+#include "MqttMessage.h"
+
+/*!
+ * \brief 消息日志模型
+ * 以环形缓冲区保存最近的消息，行数达到上限后丢弃最旧的消息。
+ * 新消息先进入待提交缓冲，每帧统一提交一次，视图只需重绘一次；
+ * 时间戳、QoS及保留标志的格式化和编码负载的解码推迟到视图绘制时进行，只处理可见行，结果缓存在条目中。
+ */
+class MessageLogModel : public QAbstractListModel {
+  Q_OBJECT
+ public:
+  /*!
+   * \brief 日志条目，保存原始字段，显示文本在data()中首次需要时生成
+   */
+  struct Entry {
+    qint64 timestamp = 0;  // 接收时间（自纪元起的毫秒数）
+    QString topic;         // 消息主题
+    QByteArray payload;    // 消息内容（线路上的原始字节）
+    int qos = 0;           // 消息质量等级
+    bool retain = false;   // 是否为保留消息
+    mutable QString text;  // 显示文本缓存，为空表示尚未生成
+  };
+
+  /*!
+   * \brief 构造函数
+   * \param max_rows 最多保留的行数
+   * \param parent 父对象
+   */
+  explicit MessageLogModel(int max_rows = 10000, QObject *parent = nullptr);
+
+  /*!
+   * \brief 设置最多保留的行数，超出部分从最旧的消息开始丢弃
+   */
+  void setMaxRows(int max_rows);
+  int maxRows() const;
+
+  /*!
+   * \brief 追加一条消息，在下一帧统一提交到视图
+   */
+  void append(const Entry &entry);
+
+  /*!
+   * \brief 清空全部消息（包括尚未提交的消息）
+   */
+  void clear();
+
+  int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+  QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+ private slots:
+  /*!
+   * \brief 将待提交缓冲中的消息一次性写入环形缓冲区
+   */
+  void commitPending();
+
+ private:
+  /*!
+   * \brief 第row行在环形缓冲区中的位置
+   */
+  const Entry &entryAt(int row) const;
+
+  QVector<Entry> ring_;     // 环形缓冲区
+  int head_ = 0;            // 最旧消息在环形缓冲区中的位置
+  int count_ = 0;           // 当前行数
+  int max_rows_;            // 最大行数
+  QVector<Entry> pending_;  // 待提交的消息
+  QTimer *commit_timer_;    // 帧提交定时器
+};
+
+/*!
+ * \brief 界面是否显示收到的消息，过滤值未变化的保留消息（自身消息已由MqttClient过滤）
+ * 不依赖窗口，供MainWindow和微基准共用。
+ */
+bool acceptLogMessage(const MqttMessage &msg);
+
+/*!
+ * \brief 由收到的消息生成日志条目
+ */
+MessageLogModel::Entry makeLogEntry(const MqttMessage &msg);
+
+#endif  // MESSAGELOGMODEL_H
@@ -0,0 +1,24 @@
+#include "messagestoreworker.h"
+
+#include <QElapsedTimer>
+
+MessageStoreWorker::MessageStoreWorker(const QString &spill_dir, qint64 memory_limit)
+    : store_(spill_dir, memory_limit) {
+  qRegisterMetaType<MqttMessageStore::Record>("MqttMessageStore::Record");
+  qRegisterMetaType<MqttMessageStore::Query>("MqttMessageStore::Query");
+  qRegisterMetaType<QVector<MqttMessageStore::Record>>("QVector<MqttMessageStore::Record>");
+}
+
+void MessageStoreWorker::append(const QVector<MqttMessageStore::Record> &records) {
+  for (const MqttMessageStore::Record &record : records) {
+    store_.append(record.timestamp, record.topic, record.payload, record.qos, record.retain);
+  }
+}
+
+void MessageStoreWorker::query(int id, const MqttMessageStore::Query &query) {
+  QElapsedTimer timer;
+  timer.start();
+  bool truncated = false;
+  const QVector<MqttMessageStore::Record> records = store_.query(query, &truncated);
+  emit queryFinished(id, records, truncated, store_.size(), timer.elapsed());
+}
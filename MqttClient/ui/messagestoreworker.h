@@ -0,0 +1,55 @@
+#ifndef MESSAGESTOREWORKER_H
+#define MESSAGESTOREWORKER_H
+
+#include <QMetaType>
+#include <QObject>
+#include <QVector>
+
+#include "MqttMessageStore.h"
+
+/*!
+ * \brief 在工作线程中访问消息存储
+ * MqttMessageStore非线程安全，本对象移动到工作线程后只通过排队连接的槽函数访问存储：
+ * 界面线程按批追加消息，查询在工作线程中执行并以queryFinished信号返回结果，扫描大量历史时界面不会卡顿。
+ */
+class MessageStoreWorker : public QObject {
+  Q_OBJECT
+ public:
+  /*!
+   * \brief 构造函数，参数含义同MqttMessageStore
+   */
+  MessageStoreWorker(const QString &spill_dir, qint64 memory_limit);
+
+ public slots:
+  /*!
+   * \brief 追加一批消息
+   */
+  void append(const QVector<MqttMessageStore::Record> &records);
+
+  /*!
+   * \brief 执行查询，完成后发出queryFinished信号
+   * \param id 查询编号，随结果原样返回，调用方据此丢弃过时的结果
+   * \param query 查询条件
+   */
+  void query(int id, const MqttMessageStore::Query &query);
+
+ signals:
+  /*!
+   * \brief 查询完成
+   * \param id 查询编号
+   * \param records 按时间先后排列的匹配消息
+   * \param truncated 匹配的消息是否多于limit
+   * \param stored 存储中的消息总数
+   * \param elapsed_ms 查询耗时（毫秒）
+   */
+  void queryFinished(int id, const QVector<MqttMessageStore::Record> &records, bool truncated, qint64 stored,
+                     qint64 elapsed_ms);
+
+ private:
+  MqttMessageStore store_;  // 消息存储，只在工作线程中访问
+};
+
+Q_DECLARE_METATYPE(MqttMessageStore::Record)
+Q_DECLARE_METATYPE(MqttMessageStore::Query)
+
+#endif  // MESSAGESTOREWORKER_H